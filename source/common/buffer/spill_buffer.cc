@@ -0,0 +1,126 @@
+#include "source/common/buffer/spill_buffer.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace Envoy {
+namespace Buffer {
+
+// The buffered body is the content of the memory file, if any, followed by
+// memory_.
+
+SpillBuffer::~SpillBuffer() { reset(); }
+
+void SpillBuffer::move(Instance &data) {
+  length_ += data.length();
+  if (!spilled() && !spill_failed_ && threshold_ != 0 && length_ > threshold_) {
+    spill_failed_ = !spill();
+  }
+  if (spilled() && !spill_failed_ && !write(data)) {
+    // the rest of the body stays on the heap.
+    spill_failed_ = true;
+  }
+  memory_.move(data);
+}
+
+void SpillBuffer::drainTo(Instance &output) {
+  if (spilled()) {
+    const uint64_t file_length = length_ - memory_.length();
+    if (file_length > 0) {
+      addFile(file_length, output);
+    }
+    close(fd_);
+    fd_ = -1;
+  }
+  output.move(memory_);
+  length_ = 0;
+  spill_failed_ = false;
+}
+
+void SpillBuffer::reset() {
+  memory_.drain(memory_.length());
+  length_ = 0;
+  spill_failed_ = false;
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+// Moves the heap part of the body to a new memory file.
+bool SpillBuffer::spill() {
+#if defined(__linux__)
+  fd_ = memfd_create("envoy-body", MFD_CLOEXEC);
+  if (fd_ < 0) {
+    ENVOY_LOG(error, "failed to create a file to spill the body to: {}",
+              strerror(errno));
+    return false;
+  }
+  ENVOY_LOG(debug, "spilling body larger than {} bytes", threshold_);
+  return write(memory_);
+#else
+  return false;
+#endif
+}
+
+bool SpillBuffer::write(Instance &data) {
+  uint64_t written = 0;
+  bool ok = true;
+  for (const RawSlice &slice : data.getRawSlices()) {
+    const char *mem = static_cast<const char *>(slice.mem_);
+    size_t remaining = slice.len_;
+    while (ok && remaining > 0) {
+      const ssize_t result = ::write(fd_, mem, remaining);
+      if (result < 0) {
+        if (errno != EINTR) {
+          ENVOY_LOG(error, "failed to spill the body: {}", strerror(errno));
+          ok = false;
+        }
+        continue;
+      }
+      mem += result;
+      remaining -= result;
+      written += result;
+    }
+    if (!ok) {
+      break;
+    }
+  }
+  data.drain(written);
+  return ok;
+}
+
+void SpillBuffer::addFile(uint64_t file_length, Instance &output) {
+  void *mapped = mmap(nullptr, file_length, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (mapped != MAP_FAILED) {
+    output.addBufferFragment(*new BufferFragmentImpl(
+        mapped, file_length,
+        [](const void *data, size_t size, const BufferFragmentImpl *fragment) {
+          munmap(const_cast<void *>(data), size);
+          delete fragment;
+        }));
+    return;
+  }
+  ENVOY_LOG(error, "failed to map the spilled body, reading it instead: {}",
+            strerror(errno));
+  char chunk[16384];
+  uint64_t offset = 0;
+  while (offset < file_length) {
+    const ssize_t result = pread(fd_, chunk, sizeof(chunk), offset);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      ENVOY_LOG(error, "failed to read the spilled body: {}", strerror(errno));
+      return;
+    }
+    output.add(chunk, result);
+    offset += result;
+  }
+}
+
+} // namespace Buffer
+} // namespace Envoy
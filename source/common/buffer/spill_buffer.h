@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+#include "envoy/buffer/buffer.h"
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/logger.h"
+
+namespace Envoy {
+namespace Buffer {
+
+/**
+ * Accumulates a body on the heap until it grows past a threshold, and from then
+ * on in an anonymous memory file (memfd). When the body is drained, spilled
+ * content is handed out as a single fragment that maps the file, so readers
+ * see one contiguous slice backed by the page cache instead of the heap.
+ *
+ * If the memory file can't be created or written, the buffer logs the error and
+ * keeps the rest of the body on the heap. Spilling is only supported on Linux.
+ */
+class SpillBuffer : Logger::Loggable<Logger::Id::filter> {
+public:
+  /**
+   * @param threshold supplies the number of bytes kept on the heap before the
+   * body is spilled. 0 disables spilling.
+   */
+  explicit SpillBuffer(uint64_t threshold) : threshold_(threshold) {}
+  ~SpillBuffer();
+
+  SpillBuffer(const SpillBuffer &) = delete;
+  SpillBuffer &operator=(const SpillBuffer &) = delete;
+
+  /**
+   * Charges the part of the body kept on the heap to an account. Must be
+   * called while the buffer is empty.
+   */
+  void bindAccount(BufferMemoryAccountSharedPtr account) {
+    memory_.bindAccount(std::move(account));
+  }
+
+  /**
+   * Moves all of data into the buffer.
+   */
+  void move(Instance &data);
+
+  /**
+   * Moves the buffered body to the end of output and resets the buffer.
+   */
+  void drainTo(Instance &output);
+
+  /**
+   * Discards the buffered body.
+   */
+  void reset();
+
+  uint64_t length() const { return length_; }
+  bool spilled() const { return fd_ >= 0; }
+
+private:
+  bool spill();
+  // writes data to the memory file and drains what was written.
+  bool write(Instance &data);
+  void addFile(uint64_t file_length, Instance &output);
+
+  const uint64_t threshold_;
+  OwnedImpl memory_;
+  uint64_t length_{};
+  int fd_{-1};
+  // set if spilling failed, so it isn't retried for every chunk.
+  bool spill_failed_{};
+};
+
+} // namespace Buffer
+} // namespace Envoy
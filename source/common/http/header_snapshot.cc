@@ -0,0 +1,39 @@
+#include "source/common/http/header_snapshot.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace Envoy {
+namespace Http {
+
+HeaderSnapshot::HeaderSnapshot(const HeaderMap &headers) {
+  entries_.reserve(headers.size());
+  headers.iterate([this](const HeaderEntry &header) -> HeaderMap::Iterate {
+    entries_.push_back(
+        {header.key().getStringView(), {header.value().getStringView()}});
+    return HeaderMap::Iterate::Continue;
+  });
+
+  // a stable sort keeps the values of a key in the order they appeared.
+  std::stable_sort(entries_.begin(), entries_.end(),
+                   [](const Entry &lhs, const Entry &rhs) {
+                     return lhs.key < rhs.key;
+                   });
+
+  if (entries_.empty()) {
+    return;
+  }
+  // merge the values of each run of equal keys into its first entry.
+  auto last = entries_.begin();
+  for (auto it = std::next(last); it != entries_.end(); ++it) {
+    if (it->key == last->key) {
+      last->values.push_back(it->values.front());
+    } else if (++last != it) {
+      *last = std::move(*it);
+    }
+  }
+  entries_.erase(std::next(last), entries_.end());
+}
+
+} // namespace Http
+} // namespace Envoy
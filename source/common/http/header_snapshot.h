@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "envoy/http/header_map.h"
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Http {
+
+/**
+ * A view of a header map with the values of repeated headers grouped by key,
+ * built in a single walk of the map. Keys and values are views into the
+ * header map, which must outlive the snapshot and not be modified while it is
+ * in use.
+ */
+class HeaderSnapshot {
+public:
+  // Most headers have a single value, which is kept inline.
+  using Values = absl::InlinedVector<absl::string_view, 1>;
+
+  struct Entry {
+    absl::string_view key;
+    // in the order they appear in the header map.
+    Values values;
+  };
+
+  explicit HeaderSnapshot(const HeaderMap &headers);
+
+  /**
+   * @return the headers in key order, one entry for each key.
+   */
+  const std::vector<Entry> &entries() const { return entries_; }
+
+private:
+  std::vector<Entry> entries_;
+};
+
+} // namespace Http
+} // namespace Envoy
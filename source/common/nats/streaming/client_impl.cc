@@ -45,11 +45,7 @@ PublishRequestPtr ClientImpl::makeRequest(const std::string &subject,
   switch (state_) {
   case State::NotConnected:
     enqueuePendingRequest(subject, payload, callbacks, pub_ack_inbox);
-    cluster_id_.emplace(cluster_id);
-    discover_prefix_.emplace(discover_prefix);
-    conn_pool_->setPoolCallbacks(*this);
-    sendNatsMessage(MessageBuilder::createConnectMessage());
-    state_ = State::Connecting;
+    startConnecting(cluster_id, discover_prefix);
     break;
   case State::Connecting:
     enqueuePendingRequest(subject, payload, callbacks, pub_ack_inbox);
@@ -64,6 +60,23 @@ PublishRequestPtr ClientImpl::makeRequest(const std::string &subject,
   return request_ptr;
 }
 
+void ClientImpl::connect(const std::string &cluster_id,
+                         const std::string &discover_prefix,
+                         std::function<void()> on_connected) {
+  switch (state_) {
+  case State::NotConnected:
+    connected_callbacks_.push_back(std::move(on_connected));
+    startConnecting(cluster_id, discover_prefix);
+    break;
+  case State::Connecting:
+    connected_callbacks_.push_back(std::move(on_connected));
+    break;
+  case State::Connected:
+    on_connected();
+    break;
+  }
+}
+
 void ClientImpl::onResponse(Nats::MessagePtr &&value) {
   ENVOY_LOG(trace, "on response: value is\n[{}]", value->asString());
 
@@ -105,6 +118,12 @@ void ClientImpl::onConnected(const std::string &pub_prefix) {
               *pending_request.callbacks, pub_ack_inbox);
   }
   pending_request_per_inbox_.clear();
+
+  std::vector<std::function<void()>> connected_callbacks;
+  connected_callbacks.swap(connected_callbacks_);
+  for (auto &callback : connected_callbacks) {
+    callback();
+  }
 }
 
 void ClientImpl::send(const Message &message) { sendNatsMessage(message); }
@@ -126,6 +145,15 @@ void ClientImpl::PublishRequestCanceler::cancel() {
   parent_.cancel(pub_ack_inbox_);
 }
 
+void ClientImpl::startConnecting(const std::string &cluster_id,
+                                 const std::string &discover_prefix) {
+  cluster_id_.emplace(cluster_id);
+  discover_prefix_.emplace(discover_prefix);
+  conn_pool_->setPoolCallbacks(*this);
+  sendNatsMessage(MessageBuilder::createConnectMessage());
+  state_ = State::Connecting;
+}
+
 void ClientImpl::onOperation(Nats::MessagePtr &&value) {
   // TODO(talnordan): For better performance, a future decoder implementation
   // might use zero allocation byte parsing. In such case, this function would
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <functional>
 #include <map>
+#include <vector>
 
 #include "envoy/event/timer.h"
 #include "include/envoy/nats/codec.h"
@@ -60,6 +62,18 @@ public:
 
   void cancel(const std::string &pub_ack_inbox);
 
+  /**
+   * Connects to NATS Streaming ahead of the first request, unless the client
+   * is connected or connecting already.
+   * @param cluster_id supplies the cluster-id to connect with.
+   * @param discover_prefix supplies the prefix subject used to connect.
+   * @param on_connected is called once the client is connected, right away if
+   * it is connected already.
+   */
+  void connect(const std::string &cluster_id,
+               const std::string &discover_prefix,
+               std::function<void()> on_connected);
+
 private:
   enum class State { NotConnected, Connecting, Connected };
 
@@ -81,6 +95,9 @@ private:
     const std::string pub_ack_inbox_;
   };
 
+  inline void startConnecting(const std::string &cluster_id,
+                              const std::string &discover_prefix);
+
   inline void onOperation(Nats::MessagePtr &&value);
 
   inline void onPayload(Nats::MessagePtr &&value);
@@ -165,6 +182,7 @@ private:
   absl::optional<std::pair<std::string, absl::optional<std::string>>>
       subect_and_reply_to_waiting_for_payload_{};
   absl::optional<std::string> pub_prefix_{};
+  std::vector<std::function<void()>> connected_callbacks_;
 
   static const std::string INBOX_PREFIX;
   static const std::string PUB_ACK_PREFIX;
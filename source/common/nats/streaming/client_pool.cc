@@ -1,5 +1,7 @@
 #include "source/common/nats/streaming/client_pool.h"
 
+#include <atomic>
+
 #include "source/common/nats/codec_impl.h"
 #include "source/common/nats/streaming/client_impl.h"
 #include "source/common/tcp/conn_pool_impl.h"
@@ -34,13 +36,36 @@ PublishRequestPtr ClientPool::makeRequest(const std::string &subject,
       subject, cluster_id, discover_prefix, std::move(payload), callbacks);
 }
 
+void ClientPool::preconnect(const std::string &cluster_id,
+                            const std::string &discover_prefix,
+                            Event::Dispatcher &main_dispatcher,
+                            std::function<void()> on_connected,
+                            std::function<void(uint32_t)> on_started) {
+  auto workers = std::make_shared<std::atomic<uint32_t>>(0);
+  slot_->runOnAllThreads(
+      [cluster_id, discover_prefix, &main_dispatcher, on_connected,
+       workers](OptRef<ThreadLocal::ThreadLocalObject> object) {
+        if (!object.has_value()) {
+          return;
+        }
+        auto &pool = object->asType<ThreadLocalPool>();
+        if (&pool.dispatcher() == &main_dispatcher) {
+          return;
+        }
+        workers->fetch_add(1);
+        pool.getClient().connect(cluster_id, discover_prefix, on_connected);
+      },
+      [workers, on_started]() { on_started(workers->load()); });
+}
+
 ClientPool::ThreadLocalPool::ThreadLocalPool(
     Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
     Random::RandomGenerator &random, Event::Dispatcher &dispatcher,
     const std::chrono::milliseconds &op_timeout)
-    : client_(std::move(conn_pool), random, dispatcher, op_timeout) {}
+    : client_(std::move(conn_pool), random, dispatcher, op_timeout),
+      dispatcher_(dispatcher) {}
 
-Client &ClientPool::ThreadLocalPool::getClient() { return client_; }
+ClientImpl &ClientPool::ThreadLocalPool::getClient() { return client_; }
 
 } // namespace Streaming
 } // namespace Nats
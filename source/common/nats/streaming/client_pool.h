@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "include/envoy/nats/codec.h"
 #include "include/envoy/nats/streaming/client.h"
 #include "include/envoy/tcp/conn_pool_nats.h"
@@ -26,16 +28,35 @@ public:
                                 std::string &&payload,
                                 PublishCallbacks &callbacks) override;
 
+  /**
+   * Starts connecting the client of every worker, so that the first request
+   * on a worker doesn't wait for the NATS Streaming handshake. The main
+   * thread's client isn't used for requests and isn't connected.
+   * @param cluster_id supplies the cluster-id to connect with.
+   * @param discover_prefix supplies the prefix subject used to connect.
+   * @param main_dispatcher supplies the main thread's dispatcher.
+   * @param on_connected is called on a worker once its client is connected.
+   * @param on_started is called on the main thread once every worker has
+   * started connecting, with the number of workers.
+   */
+  void preconnect(const std::string &cluster_id,
+                  const std::string &discover_prefix,
+                  Event::Dispatcher &main_dispatcher,
+                  std::function<void()> on_connected,
+                  std::function<void(uint32_t)> on_started);
+
 private:
   struct ThreadLocalPool : public ThreadLocal::ThreadLocalObject {
     ThreadLocalPool(Tcp::ConnPoolNats::InstancePtr<Message> &&conn_pool,
                     Random::RandomGenerator &random,
                     Event::Dispatcher &dispatcher,
                     const std::chrono::milliseconds &op_timeout);
-    Client &getClient();
+    ClientImpl &getClient();
+    Event::Dispatcher &dispatcher() { return dispatcher_; }
 
   private:
     ClientImpl client_;
+    Event::Dispatcher &dispatcher_;
   };
 
   Upstream::ClusterManager &cm_;
@@ -0,0 +1,151 @@
+#include "source/common/stats/cpu_accounting.h"
+
+#include <time.h>
+
+#include <chrono>
+
+#include "source/common/stats/utility.h"
+
+namespace Envoy {
+namespace Stats {
+
+namespace {
+
+constexpr absl::string_view SampleRuntimeKey =
+    "io.solo.filters.http.cpu_accounting.sample_percent";
+
+constexpr std::array<absl::string_view, static_cast<size_t>(CpuStep::Count)>
+    StepNames = {
+        "decode_headers",  "decode_data",   "decode_trailers",
+        "encode_headers",  "encode_data",   "encode_trailers",
+        "body_parse",      "template_render", "payload_hash",
+        "request_signing", "payload_serialize",
+};
+
+thread_local CpuSpan *current_span = nullptr;
+
+} // namespace
+
+uint64_t cpuClockNs() {
+  struct timespec ts;
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+#endif
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+FilterCpuStats::FilterCpuStats(Scope &scope, const std::string &prefix,
+                               Runtime::Loader &runtime)
+    : scope_(scope), runtime_(runtime), pool_(scope.symbolTable()),
+      prefix_(pool_.add(prefix)), route_(pool_.add("route")),
+      route_tag_(pool_.add("route_name")),
+      route_overflow_(Utility::counterFromStatNames(
+          scope_, {prefix_, pool_.add("route_overflow")})) {
+  for (size_t i = 0; i < StepCount; i++) {
+    step_names_[i] = pool_.add(StepNames[i]);
+    histograms_[i] = &Utility::histogramFromStatNames(
+        scope_, {prefix_, step_names_[i]}, Histogram::Unit::Microseconds);
+  }
+}
+
+bool FilterCpuStats::sample() const {
+  return runtime_.snapshot().featureEnabled(SampleRuntimeKey, 0);
+}
+
+void FilterCpuStats::record(CpuStep step, absl::string_view route_name,
+                            uint64_t micros) const {
+  const size_t index = static_cast<size_t>(step);
+  histograms_[index]->recordValue(micros);
+  if (route_name.empty()) {
+    return;
+  }
+  const StepHistograms *route_histograms = routeHistograms(route_name);
+  if (route_histograms != nullptr) {
+    (*route_histograms)[index]->recordValue(micros);
+  } else {
+    route_overflow_.inc();
+  }
+}
+
+const FilterCpuStats::StepHistograms *
+FilterCpuStats::routeHistograms(absl::string_view route_name) const {
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    const auto it = route_histograms_.find(route_name);
+    if (it != route_histograms_.end()) {
+      return &it->second;
+    }
+  }
+  absl::MutexLock lock(&mutex_);
+  auto it = route_histograms_.find(route_name);
+  if (it != route_histograms_.end()) {
+    return &it->second;
+  }
+  if (route_histograms_.size() >= MaxRoutes) {
+    return nullptr;
+  }
+  it = route_histograms_.try_emplace(std::string(route_name)).first;
+  const StatNameTagVector tags{
+      {route_tag_, pool_.add(Utility::sanitizeStatsName(route_name))}};
+  for (size_t i = 0; i < StepCount; i++) {
+    it->second[i] = &Utility::histogramFromStatNames(
+        scope_, {prefix_, route_, step_names_[i]},
+        Histogram::Unit::Microseconds, StatNameTagVectorOptConstRef(tags));
+  }
+  return &it->second;
+}
+
+void StreamCpuAccount::flush(const FilterCpuStats &stats,
+                             absl::string_view route_name) {
+  for (size_t i = 0; i < ns_.size(); i++) {
+    if (ns_[i] != 0) {
+      stats.record(static_cast<CpuStep>(i), route_name, ns_[i] / 1000);
+      ns_[i] = 0;
+    }
+  }
+}
+
+StreamCpuAccount *StreamCpuAccount::current() {
+  return current_span != nullptr ? current_span->account_ : nullptr;
+}
+
+CpuSpan::CpuSpan(StreamCpuAccount *account, CpuStep step, bool callback)
+    : account_(account), parent_(current_span), step_(step),
+      callback_(callback),
+      timed_(account != nullptr ||
+             (callback && parent_ != nullptr && parent_->timed_)),
+      start_(timed_ ? cpuClockNs() : 0) {
+  // pushed even if the account is null: a callback can run inside another
+  // filter's callback, e.g. when a local reply is sent, and must not be
+  // accounted to that filter.
+  current_span = this;
+}
+
+CpuSpan::~CpuSpan() {
+  current_span = parent_;
+  if (!timed_) {
+    return;
+  }
+  const uint64_t elapsed = cpuClockNs() - start_;
+  if (account_ != nullptr) {
+    const uint64_t excluded =
+        callback_ ? nested_callback_ns_ : nested_callback_ns_ + nested_step_ns_;
+    account_->add(step_, elapsed > excluded ? elapsed - excluded : 0);
+  }
+  if (parent_ == nullptr || !parent_->timed_) {
+    return;
+  }
+  if (callback_) {
+    parent_->nested_callback_ns_ += elapsed;
+  } else {
+    parent_->nested_callback_ns_ += nested_callback_ns_;
+    parent_->nested_step_ns_ += elapsed - nested_callback_ns_;
+  }
+}
+
+} // namespace Stats
+} // namespace Envoy
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/runtime/runtime.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats.h"
+
+#include "source/common/stats/symbol_table.h"
+
+#include "absl/container/node_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Stats {
+
+/**
+ * The steps of a filter that CPU time is accounted to. Sub-steps run inside a
+ * filter callback, so their time is part of the callback's time as well.
+ */
+enum class CpuStep {
+  DecodeHeaders,
+  DecodeData,
+  DecodeTrailers,
+  EncodeHeaders,
+  EncodeData,
+  EncodeTrailers,
+  BodyParse,
+  TemplateRender,
+  PayloadHash,
+  RequestSigning,
+  PayloadSerialize,
+  Count,
+};
+
+/**
+ * @return the CPU time consumed by the calling thread in nanoseconds, so that
+ * time spent blocked or preempted isn't accounted. Falls back to a monotonic
+ * clock where thread CPU time isn't available. On Linux this is a system call,
+ * as the vDSO only serves the wall clocks, which costs in the order of 100 to
+ * 300ns. Spans read it twice, and only on sampled streams.
+ */
+uint64_t cpuClockNs();
+
+/**
+ * Histograms of the time a filter spends on the worker per stream, for each
+ * step, in microseconds. They are kept for the filter as a whole, as
+ * <prefix>.<step>, and for each named route, as <prefix>.route.<step> tagged
+ * with the route name. Streams are sampled at the percentage set by the
+ * io.solo.filters.http.cpu_accounting.sample_percent runtime key, which
+ * defaults to 0. Each sampled callback costs two reads of cpuClockNs().
+ */
+class FilterCpuStats {
+public:
+  // The number of routes kept per filter config. The time of further routes
+  // is only recorded for the filter as a whole, and counted in
+  // <prefix>.route_overflow.
+  static constexpr size_t MaxRoutes = 1000;
+
+  FilterCpuStats(Scope &scope, const std::string &prefix,
+                 Runtime::Loader &runtime);
+
+  /**
+   * @return whether a new stream should be accounted.
+   */
+  bool sample() const;
+
+  void record(CpuStep step, absl::string_view route_name,
+              uint64_t micros) const;
+
+private:
+  static constexpr size_t StepCount = static_cast<size_t>(CpuStep::Count);
+  using StepHistograms = std::array<Histogram *, StepCount>;
+
+  // the histograms of a route, which are created the first time the route is
+  // recorded and reused after that, or nullptr once MaxRoutes are kept.
+  const StepHistograms *routeHistograms(absl::string_view route_name) const;
+
+  Scope &scope_;
+  Runtime::Loader &runtime_;
+  mutable absl::Mutex mutex_;
+  mutable StatNamePool pool_;
+  const StatName prefix_;
+  const StatName route_;
+  const StatName route_tag_;
+  std::array<StatName, StepCount> step_names_;
+  StepHistograms histograms_;
+  Counter &route_overflow_;
+  // the histograms live as long as the scope, so the map is capped rather
+  // than evicted.
+  mutable absl::node_hash_map<std::string, StepHistograms>
+      route_histograms_ ABSL_GUARDED_BY(mutex_);
+};
+
+using FilterCpuStatsConstSharedPtr = std::shared_ptr<const FilterCpuStats>;
+
+/**
+ * Accumulates the time of one sampled stream for each step.
+ */
+class StreamCpuAccount {
+public:
+  void add(CpuStep step, uint64_t ns) { ns_[static_cast<size_t>(step)] += ns; }
+
+  /**
+   * Records the accumulated time and resets the account.
+   */
+  void flush(const FilterCpuStats &stats, absl::string_view route_name);
+
+  /**
+   * @return the account of the filter callback running on this thread, or
+   * nullptr if there is none or its stream isn't sampled.
+   */
+  static StreamCpuAccount *current();
+
+private:
+  std::array<uint64_t, static_cast<size_t>(CpuStep::Count)> ns_{};
+};
+
+/**
+ * A timed span of a thread's work. Spans nest: the time of a filter callback
+ * that runs inside another span, e.g. when a local reply is sent, is excluded
+ * from every enclosing span, and the time of a sub-step is excluded from an
+ * enclosing sub-step. A sub-step's time stays part of its callback's time.
+ */
+class CpuSpan {
+protected:
+  CpuSpan(StreamCpuAccount *account, CpuStep step, bool callback);
+  ~CpuSpan();
+
+private:
+  friend class StreamCpuAccount;
+
+  StreamCpuAccount *const account_;
+  CpuSpan *const parent_;
+  const CpuStep step_;
+  const bool callback_;
+  // a span is timed when it is accounted, or when it is a callback that runs
+  // inside a timed span and has to be excluded from it.
+  const bool timed_;
+  const uint64_t start_;
+  uint64_t nested_callback_ns_{};
+  uint64_t nested_step_ns_{};
+};
+
+/**
+ * Times a filter callback and makes its account current for the duration of
+ * the callback, so sub-steps are accounted to it. A null account disables
+ * both, including for sub-steps of an enclosing callback.
+ */
+class ScopedCpuAccount : public CpuSpan {
+public:
+  ScopedCpuAccount(StreamCpuAccount *account, CpuStep step)
+      : CpuSpan(account, step, true) {}
+};
+
+/**
+ * Times a sub-step against the current account, if any.
+ */
+class ScopedCpuTimer : public CpuSpan {
+public:
+  explicit ScopedCpuTimer(CpuStep step)
+      : CpuSpan(StreamCpuAccount::current(), step, false) {}
+};
+
+} // namespace Stats
+} // namespace Envoy
@@ -0,0 +1,49 @@
+#include "source/common/tracing/stage_span.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Tracing {
+
+StageSpan::StageSpan(bool enabled, Http::StreamFilterCallbacks &callbacks,
+                     const std::string &name) {
+  if (!enabled) {
+    return;
+  }
+  const OptRef<const Config> config = callbacks.tracingConfig();
+  if (!config.has_value()) {
+    return;
+  }
+  span_ = callbacks.activeSpan().spawnChild(
+      config.ref(), name, callbacks.dispatcher().timeSource().systemTime());
+}
+
+StageSpan &StageSpan::operator=(StageSpan &&other) {
+  if (this != &other) {
+    finish();
+    span_ = std::move(other.span_);
+  }
+  return *this;
+}
+
+void StageSpan::setTag(absl::string_view name, absl::string_view value) {
+  if (span_ != nullptr) {
+    span_->setTag(name, value);
+  }
+}
+
+void StageSpan::setBytes(absl::string_view name, uint64_t bytes) {
+  if (span_ != nullptr) {
+    span_->setTag(name, absl::StrCat(bytes));
+  }
+}
+
+void StageSpan::finish() {
+  if (span_ != nullptr) {
+    span_->finishSpan();
+    span_.reset();
+  }
+}
+
+} // namespace Tracing
+} // namespace Envoy
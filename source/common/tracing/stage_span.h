@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "envoy/http/filter.h"
+#include "envoy/tracing/trace_driver.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Tracing {
+
+/**
+ * A child of a stream's active span that times one stage of a filter. Nothing
+ * is spawned unless stage spans are enabled and tracing is configured for the
+ * stream, so a disabled stage span costs a branch. The span is finished when
+ * the stage span is destroyed, if not earlier.
+ */
+class StageSpan {
+public:
+  StageSpan() = default;
+  StageSpan(bool enabled, Http::StreamFilterCallbacks &callbacks,
+            const std::string &name);
+  StageSpan(StageSpan &&) = default;
+  StageSpan &operator=(StageSpan &&other);
+  ~StageSpan() { finish(); }
+
+  /**
+   * @return whether a span was spawned and hasn't been finished yet.
+   */
+  bool active() const { return span_ != nullptr; }
+
+  void setTag(absl::string_view name, absl::string_view value);
+
+  /**
+   * Tags the span with a byte count, such as the size of a body.
+   */
+  void setBytes(absl::string_view name, uint64_t bytes);
+
+  void finish();
+
+private:
+  SpanPtr span_;
+};
+
+} // namespace Tracing
+} // namespace Envoy
@@ -13,6 +13,7 @@
 #include "source/common/http/headers.h"
 #include "source/common/http/utility.h"
 #include "source/common/singleton/const_singleton.h"
+#include "source/common/stats/cpu_accounting.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -59,7 +60,18 @@ HeaderList AwsAuthenticator::createHeaderToSign(
 }
 
 void AwsAuthenticator::updatePayloadHash(const Buffer::Instance &data) {
+  Stats::ScopedCpuTimer timer(Stats::CpuStep::PayloadHash);
   body_sha_.update(data);
+  payload_hash_updated_ = true;
+}
+
+void AwsAuthenticator::updatePayloadHash(const PayloadHashingBuffer &data) {
+  if (payload_hash_updated_ || !data.hashValid()) {
+    updatePayloadHash(static_cast<const Buffer::Instance &>(data));
+    return;
+  }
+  body_sha_ = Sha256(data.hashContext());
+  payload_hash_updated_ = true;
 }
 
 bool AwsAuthenticator::lowercasecompare(const Http::LowerCaseString &i,
@@ -222,6 +234,7 @@ std::string AwsAuthenticator::computeSignature(
 void AwsAuthenticator::sign(Http::RequestHeaderMap *request_headers,
                             const HeaderList &headers_to_sign,
                             const std::string &region) {
+  Stats::ScopedCpuTimer timer(Stats::CpuStep::RequestSigning);
 
   // we can't use the date provider interface as this is not the date header,
   // plus the date format is different. use slow method now, optimize in the
@@ -276,6 +289,115 @@ std::string AwsAuthenticator::signWithTime(
   return authorizationvalue.str();
 }
 
+PayloadHashingBuffer::PayloadHashingBuffer(
+    Buffer::BufferMemoryAccountSharedPtr account)
+    : Buffer::OwnedImpl(std::move(account)) {
+  SHA256_Init(&context_);
+}
+
+void PayloadHashingBuffer::fill(Buffer::Instance &data) {
+  if (data.length() == 0) {
+    return;
+  }
+  hash_valid_ = false;
+  Buffer::OwnedImpl::move(data, data.length(), false);
+}
+
+void PayloadHashingBuffer::add(const void *data, uint64_t size) {
+  hash(data, size);
+  Buffer::OwnedImpl::add(data, size);
+}
+
+void PayloadHashingBuffer::add(absl::string_view data) {
+  hash(data.data(), data.size());
+  Buffer::OwnedImpl::add(data);
+}
+
+void PayloadHashingBuffer::add(const Buffer::Instance &data) {
+  hash(data, data.length());
+  delegating_ = true;
+  Buffer::OwnedImpl::add(data);
+  delegating_ = false;
+}
+
+void PayloadHashingBuffer::addBufferFragment(
+    Buffer::BufferFragment &fragment) {
+  hash(fragment.data(), fragment.size());
+  Buffer::OwnedImpl::addBufferFragment(fragment);
+}
+
+// transformers usually empty the buffer and then prepend their output, which
+// is the same as appending it.
+void PayloadHashingBuffer::prepend(absl::string_view data) {
+  if (length() == 0) {
+    hash(data.data(), data.size());
+  } else {
+    hash_valid_ = false;
+  }
+  Buffer::OwnedImpl::prepend(data);
+}
+
+void PayloadHashingBuffer::prepend(Buffer::Instance &data) {
+  if (length() == 0) {
+    hash(data, data.length());
+  } else {
+    hash_valid_ = false;
+  }
+  Buffer::OwnedImpl::prepend(data);
+}
+
+void PayloadHashingBuffer::drain(uint64_t size) {
+  const bool emptied = size >= length();
+  Buffer::OwnedImpl::drain(size);
+  if (emptied) {
+    resetHash();
+  } else if (size != 0) {
+    hash_valid_ = false;
+  }
+}
+
+void PayloadHashingBuffer::move(Buffer::Instance &rhs) {
+  move(rhs, rhs.length(), false);
+}
+
+void PayloadHashingBuffer::move(Buffer::Instance &rhs, uint64_t length) {
+  move(rhs, length, false);
+}
+
+void PayloadHashingBuffer::move(Buffer::Instance &rhs, uint64_t length,
+                                bool reset_drain_trackers_and_accounting) {
+  hash(rhs, length);
+  // slices that are only partly moved are copied with add().
+  delegating_ = true;
+  Buffer::OwnedImpl::move(rhs, length, reset_drain_trackers_and_accounting);
+  delegating_ = false;
+}
+
+void PayloadHashingBuffer::hash(const void *data, uint64_t size) {
+  if (!hash_valid_ || delegating_) {
+    return;
+  }
+  SHA256_Update(&context_, data, size);
+  hashed_bytes_ += size;
+}
+
+void PayloadHashingBuffer::hash(const Buffer::Instance &data, uint64_t length) {
+  for (const Buffer::RawSlice &slice : data.getRawSlices()) {
+    if (length == 0) {
+      break;
+    }
+    const uint64_t len = std::min<uint64_t>(length, slice.len_);
+    hash(slice.mem_, len);
+    length -= len;
+  }
+}
+
+void PayloadHashingBuffer::resetHash() {
+  SHA256_Init(&context_);
+  hashed_bytes_ = 0;
+  hash_valid_ = true;
+}
+
 AwsAuthenticator::Sha256::Sha256() { SHA256_Init(&context_); }
 
 void AwsAuthenticator::Sha256::update(const Buffer::Instance &data) {
@@ -6,6 +6,7 @@
 #include "envoy/common/time.h"
 #include "envoy/http/header_map.h"
 
+#include "source/common/buffer/buffer_impl.h"
 #include "source/common/singleton/const_singleton.h"
 
 #include "openssl/digest.h"
@@ -34,6 +35,59 @@ typedef bool (*LowerCaseStringCompareFunc)(const Http::LowerCaseString &,
 
 typedef std::set<Http::LowerCaseString, LowerCaseStringCompareFunc> HeaderList;
 
+/**
+ * A buffer that computes the SHA-256 of the bytes appended to it as they are
+ * written, so a payload serialized into it doesn't have to be read again to
+ * be signed. The hash only covers the content while the buffer has been
+ * written front to back since it was last emptied; otherwise hashValid() is
+ * false and the content has to be hashed again.
+ */
+class PayloadHashingBuffer : public Buffer::OwnedImpl {
+public:
+  PayloadHashingBuffer(Buffer::BufferMemoryAccountSharedPtr account = nullptr);
+
+  /**
+   * Moves data into the buffer without hashing it, for content that is
+   * expected to be replaced.
+   */
+  void fill(Buffer::Instance &data);
+
+  /**
+   * @return whether hashContext() is the hash of the whole content.
+   */
+  bool hashValid() const { return hash_valid_ && hashed_bytes_ == length(); }
+  /**
+   * @return the number of bytes hashed since the buffer was last emptied.
+   */
+  uint64_t hashedBytes() const { return hashed_bytes_; }
+  const SHA256_CTX &hashContext() const { return context_; }
+
+  // Buffer::Instance
+  void add(const void *data, uint64_t size) override;
+  void add(absl::string_view data) override;
+  void add(const Buffer::Instance &data) override;
+  void addBufferFragment(Buffer::BufferFragment &fragment) override;
+  void prepend(absl::string_view data) override;
+  void prepend(Buffer::Instance &data) override;
+  void drain(uint64_t size) override;
+  void move(Buffer::Instance &rhs) override;
+  void move(Buffer::Instance &rhs, uint64_t length) override;
+  void move(Buffer::Instance &rhs, uint64_t length,
+            bool reset_drain_trackers_and_accounting) override;
+
+private:
+  void hash(const void *data, uint64_t size);
+  void hash(const Buffer::Instance &data, uint64_t length);
+  void resetHash();
+
+  SHA256_CTX context_;
+  uint64_t hashed_bytes_{};
+  bool hash_valid_{true};
+  // Set while a base class method that appends through the virtual
+  // add(const void *, uint64_t) runs, as its bytes are already hashed.
+  bool delegating_{};
+};
+
 class AwsAuthenticator {
 public:
   AwsAuthenticator(TimeSource &time_source);
@@ -46,6 +100,12 @@ public:
 
   void updatePayloadHash(const Buffer::Instance &data);
 
+  /**
+   * Like updatePayloadHash, but reuses the hash computed while the buffer was
+   * written when it is the first part of the payload to be hashed.
+   */
+  void updatePayloadHash(const PayloadHashingBuffer &data);
+
   void sign(Http::RequestHeaderMap *request_headers,
             const HeaderList &headers_to_sign, const std::string &region);
 
@@ -92,6 +152,7 @@ private:
   public:
     static const int LENGTH = SHA256_DIGEST_LENGTH;
     Sha256();
+    explicit Sha256(const SHA256_CTX &context) : context_(context) {}
     void update(const Buffer::Instance &data);
     void update(const std::string &data);
     void update(const absl::string_view &data);
@@ -132,6 +193,7 @@ private:
   }
 
   Sha256 body_sha_;
+  bool payload_hash_updated_{};
 
   TimeSource &time_source_;
   const std::string *access_key_{};
@@ -10,12 +10,17 @@
 
 #include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/empty_string.h"
+#include "source/common/common/enum_to_int.h"
 #include "source/common/common/hex.h"
 #include "source/common/common/utility.h"
+#include "source/common/http/codes.h"
+#include "source/common/http/header_map_impl.h"
 #include "source/common/http/headers.h"
+#include "source/common/http/message_impl.h"
 #include "source/common/http/solo_filter_utility.h"
 #include "source/common/http/utility.h"
 #include "source/common/singleton/const_singleton.h"
+#include "source/common/tracing/common_values.h"
 
 #include "source/extensions/filters/http/solo_well_known_names.h"
 
@@ -33,6 +38,12 @@ struct RcDetailsValues {
   const std::string CredentialsNotFound = "aws_lambda_credentials_not_found";
   const std::string CredentialsNotFoundBody =
       "no credentials present for AWS upstream";
+  const std::string PayloadTooLarge = "aws_lambda_payload_too_large";
+  const std::string PayloadTooLargeBody = "payload too large";
+  const std::string HedgedResponse = "aws_lambda_hedged_response";
+  const std::string ConcurrencyLimited = "aws_lambda_concurrency_limited";
+  const std::string ConcurrencyLimitedBody =
+      "lambda concurrency limit exceeded";
 };
 typedef ConstSingleton<RcDetailsValues> RcDetails;
 } // namespace
@@ -46,6 +57,8 @@ public:
   const std::string LogNone{"None"};
   const Http::LowerCaseString HostHead{"x-amz-log-type"};
   const Http::LowerCaseString FunctionError{"x-amz-function-error"};
+  const std::string EventStreamContentType{"application/vnd.amazon.eventstream"};
+  const std::string OctetStreamContentType{"application/octet-stream"};
 };
 
 typedef ConstSingleton<AWSLambdaHeaderValues> AWSLambdaHeaderNames;
@@ -58,19 +71,33 @@ const HeaderList AWSLambdaFilter::HeadersToSign =
 
 AWSLambdaFilter::AWSLambdaFilter(Upstream::ClusterManager &cluster_manager,
                                  Api::Api &api,
-                                 AWSLambdaConfigConstSharedPtr filter_config)
+                                 AWSLambdaConfigConstSharedPtr filter_config,
+                                 Stats::FilterCpuStatsConstSharedPtr cpu_stats,
+                                 RouteResolutionCacheSharedPtr route_cache)
     : aws_authenticator_(api.timeSource()), cluster_manager_(cluster_manager),
-      filter_config_(filter_config){}
+      filter_config_(filter_config),
+      body_spill_(filter_config->spillThreshold()),
+      time_source_(api.timeSource()),
+      route_cache_(std::move(route_cache)),
+      cpu_stats_(std::move(cpu_stats)),
+      cpu_sampled_(cpu_stats_ != nullptr && cpu_stats_->sample()) {}
 
 AWSLambdaFilter::~AWSLambdaFilter() {}
 
 Http::FilterHeadersStatus
 AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
                                bool end_stream) {
-  protocol_options_ = Http::SoloFilterUtility::resolveProtocolOptions<
-      const AWSLambdaProtocolExtensionConfig>(
-      SoloHttpFilterNames::get().AwsLambda, decoder_callbacks_,
-      cluster_manager_);
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeHeaders);
+  RouteResolutionCache::Resolution resolution;
+  if (route_cache_ != nullptr) {
+    resolution = route_cache_->resolve(*decoder_callbacks_);
+    protocol_options_ = std::move(resolution.protocol_options);
+  } else {
+    protocol_options_ = Http::SoloFilterUtility::resolveProtocolOptions<
+        const AWSLambdaProtocolExtensionConfig>(
+        SoloHttpFilterNames::get().AwsLambda, decoder_callbacks_,
+        cluster_manager_);
+  }
 
   if (!protocol_options_) {
     return Http::FilterHeadersStatus::Continue;
@@ -82,8 +109,10 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
   route_ = decoder_callbacks_->route();
   // great! this is an aws cluster. get the function information:
   function_on_route_ =
-      Http::Utility::resolveMostSpecificPerFilterConfig<AWSLambdaRouteConfig>(
-          decoder_callbacks_);
+      route_cache_ != nullptr
+          ? resolution.function_on_route
+          : Http::Utility::resolveMostSpecificPerFilterConfig<
+                AWSLambdaRouteConfig>(decoder_callbacks_);
 
   if (!function_on_route_) {
     state_ = State::Responded;
@@ -96,6 +125,32 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
   // If the state is still the initial, attempt to get credentials
   ASSERT(state_ == State::Init);
   state_ = State::Calling;
+
+  const ConcurrencyLimitPolicy *concurrency_limit =
+      function_on_route_->concurrencyLimit();
+  if (concurrency_limit != nullptr) {
+    limiter_ = &concurrency_limit->limiter();
+    switch (limiter_->acquire(*this)) {
+    case ConcurrencyLimiter::Result::Admitted:
+      admitted_ = true;
+      admitted_at_ = time_source_.monotonicTime();
+      break;
+    case ConcurrencyLimiter::Result::Queued:
+      // credentials are requested once admitted. until then the body is
+      // buffered as if waiting for them.
+      ENVOY_LOG(trace, "{}: waiting for the concurrency limit", __func__);
+      queued_ = true;
+      stopped_ = true;
+      queue_timer_ = decoder_callbacks_->dispatcher().createTimer(
+          [this]() { onQueueTimer(); });
+      queue_timer_->enableTimer(concurrency_limit->maxQueueTime());
+      return Http::FilterHeadersStatus::StopIteration;
+    case ConcurrencyLimiter::Result::Rejected:
+      rejectConcurrencyLimited();
+      return Http::FilterHeadersStatus::StopIteration;
+    }
+  }
+
   context_ = filter_config_->getCredentials(protocol_options_, this);
 
   if (state_ == State::Responded) {
@@ -111,12 +166,17 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
       ENVOY_LOG(trace, "{}: stopping iteration to wait for STS credentials",
                 __func__);
       stopped_ = true;
+      credentials_span_ =
+          Tracing::StageSpan(filter_config_->stageSpans(), *decoder_callbacks_,
+                             "aws_lambda.credentials");
+      credentials_requested_at_ = time_source_.monotonicTime();
       return Http::FilterHeadersStatus::StopIteration;
     }
   }
 
   if (end_stream) {
     finalizeRequest();
+    armHedge(nullptr);
     return Http::FilterHeadersStatus::Continue;
   }
 
@@ -126,12 +186,35 @@ AWSLambdaFilter::decodeHeaders(Http::RequestHeaderMap &headers,
 
 Http::FilterHeadersStatus
 AWSLambdaFilter::encodeHeaders(Http::ResponseHeaderMap &headers, bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::EncodeHeaders);
 
+  if (invoked_at_.has_value()) {
+    recordResponseHeaders(headers);
+    if (end_stream) {
+      recordResponseSize();
+    }
+  }
   if (!headers.get(AWSLambdaHeaderNames::get().FunctionError).empty()){
     // We treat upstream function errors as if it was any other upstream error
     headers.setStatus(504);
   }
   response_headers_ = &headers;
+  // whichever invocation responds first, the other one isn't needed anymore.
+  response_started_ = true;
+  cancelHedge();
+  releaseConcurrency(&headers);
+  if (functionOnRoute() != nullptr && functionOnRoute()->responseStream() &&
+      headers.getContentTypeValue() ==
+          AWSLambdaHeaderNames::get().EventStreamContentType) {
+    // the payload chunks are forwarded without the event stream framing, so
+    // neither the length nor the type of the body is known.
+    headers.removeContentLength();
+    headers.setReferenceContentType(
+        AWSLambdaHeaderNames::get().OctetStreamContentType);
+    event_stream_ =
+        std::make_unique<EventStreamDecoder>(encoder_callbacks_->account());
+    return Http::FilterHeadersStatus::Continue;
+  }
   if (isResponseTransformationNeeded() && !end_stream){
     // Stop iteration so that encodedata can mutate headers from alb json
     return Http::FilterHeadersStatus::StopIteration;
@@ -141,6 +224,7 @@ AWSLambdaFilter::encodeHeaders(Http::ResponseHeaderMap &headers, bool end_stream
 
 Http::FilterDataStatus AWSLambdaFilter::encodeData(
                                       Buffer::Instance &data, bool end_stream ){
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::EncodeData);
 
   if (state_ == State::Destroyed){
     // Safety against use after free if we exceed buffer limit
@@ -149,6 +233,17 @@ Http::FilterDataStatus AWSLambdaFilter::encodeData(
     return Http::FilterDataStatus::StopIterationNoBuffer;
   }
 
+  if (invoked_at_.has_value()) {
+    response_bytes_ += data.length();
+    if (end_stream) {
+      recordResponseSize();
+    }
+  }
+
+  if (event_stream_ != nullptr) {
+    return decodeEventStream(data, end_stream);
+  }
+
   if (!isResponseTransformationNeeded()){
     // return response as is if not configured for alb mode/transformation
     return Http::FilterDataStatus::Continue;
@@ -167,6 +262,10 @@ Http::FilterDataStatus AWSLambdaFilter::encodeData(
 
 Http::FilterTrailersStatus
 AWSLambdaFilter::encodeTrailers(Http::ResponseTrailerMap &) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::EncodeTrailers);
+  if (invoked_at_.has_value()) {
+    recordResponseSize();
+  }
 
   if (!isResponseTransformationNeeded()){
    return Http::FilterTrailersStatus::Continue;
@@ -177,12 +276,38 @@ AWSLambdaFilter::encodeTrailers(Http::ResponseTrailerMap &) {
   return Http::FilterTrailersStatus::Continue;
 }
 
+// Replaces the event stream framing in data with the payload chunks it
+// completes. A failure can no longer change the response status, so the
+// stream is reset instead of letting a truncated body look successful.
+Http::FilterDataStatus AWSLambdaFilter::decodeEventStream(Buffer::Instance &data,
+                                                          bool end_stream) {
+  Buffer::OwnedImpl payload(encoder_callbacks_->account());
+  const EventStreamDecoder::Status status = event_stream_->decode(data, payload);
+  data.move(payload);
+
+  if (status == EventStreamDecoder::Status::Error) {
+    ENVOY_LOG(debug, "{}: lambda response stream failed: {}",
+              functionOnRoute()->path(), event_stream_->error());
+    encoder_callbacks_->resetStream();
+    return Http::FilterDataStatus::StopIterationNoBuffer;
+  }
+  if (end_stream && status != EventStreamDecoder::Status::Complete) {
+    ENVOY_LOG(debug, "{}: lambda response stream ended before InvokeComplete",
+              functionOnRoute()->path());
+    encoder_callbacks_->resetStream();
+    return Http::FilterDataStatus::StopIterationNoBuffer;
+  }
+  return Http::FilterDataStatus::Continue;
+}
+
 void AWSLambdaFilter::finalizeResponse(){
   // Now that the response is finished we know that the following is safe
   // as the following options will only make the resulting buffer smaller.
   const Buffer::Instance&  buff = *encoder_callbacks_->encodingBuffer();
   encoder_callbacks_->modifyEncodingBuffer([this](Buffer::Instance& enc_buf) {
-    Buffer::OwnedImpl body;
+    // the unwrapped body briefly doubles the response, so charge it to the
+    // stream as well.
+    Buffer::OwnedImpl body(encoder_callbacks_->account());
     if (functionOnRoute()->unwrapAsAlb()) {
       if (parseResponseAsALB(*response_headers_, enc_buf, body)){
         response_headers_->setStatus(static_cast<int>(Http::Code::InternalServerError));
@@ -273,6 +398,15 @@ bool AWSLambdaFilter::isRequestTransformationNeeded() {
 void AWSLambdaFilter::onSuccess(
     std::shared_ptr<const Envoy::Extensions::Common::Aws::Credentials>
         credentials) {
+  // credentials usually arrive within decodeHeaders, which is accounted
+  // already. when they arrive later, the signing they unblock is accounted
+  // to header decoding as well.
+  absl::optional<Stats::ScopedCpuAccount> cpu;
+  if (Stats::StreamCpuAccount::current() != cpuAccount()) {
+    cpu.emplace(cpuAccount(), Stats::CpuStep::DecodeHeaders);
+  }
+  credentials_span_.finish();
+  recordCredentialsWait();
   credentials_ = credentials;
   context_ = nullptr;
   state_ = State::Complete;
@@ -306,8 +440,10 @@ void AWSLambdaFilter::onSuccess(
   if (stopped_) {
     if (end_stream_) {
       // edge case where header only request was stopped, but now needs to be
-      // lambdafied.
+      // lambdafied. with spilling, the body may have been buffered meanwhile.
+      addSpilledBody();
       finalizeRequest();
+      armHedge(nullptr);
     }
     stopped_ = false;
     decoder_callbacks_->continueDecoding();
@@ -316,6 +452,10 @@ void AWSLambdaFilter::onSuccess(
 
 // TODO: Use the failure status in the local reply
 void AWSLambdaFilter::onFailure(CredentialsFailureStatus) {
+  credentials_span_.setTag(Tracing::Tags::get().Error,
+                           Tracing::Tags::get().True);
+  credentials_span_.finish();
+  recordCredentialsWait();
   // cancel mustn't be called
   context_ = nullptr;
   state_ = State::Responded;
@@ -326,6 +466,7 @@ void AWSLambdaFilter::onFailure(CredentialsFailureStatus) {
 
 Http::FilterDataStatus AWSLambdaFilter::decodeData(Buffer::Instance &data,
                                                    bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeData);
   if (!function_on_route_) {
     return Http::FilterDataStatus::Continue;
   }
@@ -334,6 +475,7 @@ Http::FilterDataStatus AWSLambdaFilter::decodeData(Buffer::Instance &data,
   if (data.length() != 0) {
     has_body_ = true;
   }
+  request_bytes_ += data.length();
 
   // If we are not transforming the request, then update the payload hash according to the incoming data
   // If we are transforming the request, then we will update the payload hash after the transformation
@@ -341,17 +483,35 @@ Http::FilterDataStatus AWSLambdaFilter::decodeData(Buffer::Instance &data,
     aws_authenticator_.updatePayloadHash(data);
   }
 
-  if (state_ == Calling) {
-    return Http::FilterDataStatus::StopIterationAndBuffer;
-  } else if (state_ == Responded) {
+  if (state_ == Responded) {
     return Http::FilterDataStatus::StopIterationNoBuffer;
   }
 
+  if (filter_config_->spillThreshold() != 0) {
+    body_spill_.move(data);
+    if (body_spill_.length() > filter_config_->spillMaxBytes()) {
+      state_ = State::Responded;
+      body_spill_.reset();
+      decoder_callbacks_->sendLocalReply(
+          Http::Code::PayloadTooLarge, RcDetails::get().PayloadTooLargeBody,
+          nullptr, absl::nullopt, RcDetails::get().PayloadTooLarge);
+      return Http::FilterDataStatus::StopIterationNoBuffer;
+    }
+    if (state_ == Calling || !end_stream) {
+      return Http::FilterDataStatus::StopIterationNoBuffer;
+    }
+    // the whole body continues as this last chunk.
+    body_spill_.drainTo(data);
+  } else if (state_ == Calling) {
+    return Http::FilterDataStatus::StopIterationAndBuffer;
+  }
+
   if (end_stream) {
     if (has_body_ && isRequestTransformationNeeded()) {
       decoder_callbacks_->addDecodedData(data, false);
     }
     finalizeRequest();
+    armHedge(&data);
     return Http::FilterDataStatus::Continue;
   }
 
@@ -360,6 +520,7 @@ Http::FilterDataStatus AWSLambdaFilter::decodeData(Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 AWSLambdaFilter::decodeTrailers(Http::RequestTrailerMap &) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeTrailers);
   end_stream_ = true;
   if (state_ == State::Calling) {
     return Http::FilterTrailersStatus::StopIteration;
@@ -368,21 +529,324 @@ AWSLambdaFilter::decodeTrailers(Http::RequestTrailerMap &) {
   }
 
   if (function_on_route_ != nullptr) {
+    addSpilledBody();
     finalizeRequest();
+    armHedge(nullptr);
   }
 
   return Http::FilterTrailersStatus::Continue;
 }
 
 void AWSLambdaFilter::finalizeRequest() {
+  Tracing::StageSpan span(filter_config_->stageSpans(), *decoder_callbacks_,
+                          "aws_lambda.finalize_request");
+  span.setBytes("aws_lambda.request_bytes", request_bytes_);
+
   handleDefaultBody();
   if (isRequestTransformationNeeded()) {
       transformRequest();
   }
   updateHeaders();
 
+  // a transformed or default payload has been added to the decoding buffer,
+  // otherwise the request body is sent as is.
+  uint64_t payload_bytes = request_bytes_;
+  if (isRequestTransformationNeeded() || !has_body_) {
+    const Buffer::Instance *buffered = decoder_callbacks_->decodingBuffer();
+    payload_bytes = buffered != nullptr ? buffered->length() : 0;
+  }
+  span.setBytes("aws_lambda.payload_bytes", payload_bytes);
+
+  Tracing::StageSpan sign_span(filter_config_->stageSpans(),
+                               *decoder_callbacks_, "aws_lambda.sign");
+  sign_span.setBytes("aws_lambda.payload_bytes", payload_bytes);
+  const FunctionStats &stats = function_on_route_->stats();
+  const MonotonicTime sign_start = time_source_.monotonicTime();
   aws_authenticator_.sign(request_headers_, HeadersToSign,
                           protocol_options_->region());
+  invoked_at_ = time_source_.monotonicTime();
+  stats.signing_time_.recordValue(
+      std::chrono::duration_cast<std::chrono::microseconds>(*invoked_at_ -
+                                                            sign_start)
+          .count());
+  stats.request_payload_size_.recordValue(payload_bytes);
+  stats.invocationStarted(*invoked_at_);
+}
+
+void AWSLambdaFilter::recordCredentialsWait() {
+  if (!credentials_requested_at_.has_value()) {
+    return;
+  }
+  function_on_route_->stats().credentials_wait_time_.recordValue(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          time_source_.monotonicTime() - *credentials_requested_at_)
+          .count());
+  credentials_requested_at_.reset();
+}
+
+// Throttles are counted from the status Lambda responded with, before function
+// errors are turned into a 504.
+void AWSLambdaFilter::recordResponseHeaders(
+    const Http::ResponseHeaderMap &headers) {
+  const FunctionStats &stats = function_on_route_->stats();
+  stats.invocation_time_.recordValue(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          time_source_.monotonicTime() - *invoked_at_)
+          .count());
+  if (!headers.get(AWSLambdaHeaderNames::get().FunctionError).empty()) {
+    stats.function_errors_.inc();
+  }
+  if (Http::Utility::getResponseStatus(headers) ==
+      enumToInt(Http::Code::TooManyRequests)) {
+    stats.throttles_.inc();
+  }
+}
+
+// The size is of the response as Lambda sent it, before it is transformed.
+void AWSLambdaFilter::recordResponseSize() {
+  if (response_size_recorded_) {
+    return;
+  }
+  response_size_recorded_ = true;
+  function_on_route_->stats().response_payload_size_.recordValue(
+      response_bytes_);
+}
+
+// The limiter can't be re-entered from onAdmitted, so the request resumes from
+// the queue timer.
+void AWSLambdaFilter::onAdmitted() {
+  admitted_ = true;
+  admitted_at_ = time_source_.monotonicTime();
+  queue_timer_->enableTimer(std::chrono::milliseconds(0));
+}
+
+void AWSLambdaFilter::onQueueTimer() {
+  queued_ = false;
+  if (!admitted_) {
+    limiter_->cancel(*this);
+    rejectConcurrencyLimited();
+    return;
+  }
+  context_ = filter_config_->getCredentials(protocol_options_, this);
+  if (context_ != nullptr && state_ == State::Calling) {
+    // onSuccess continues decoding once the credentials arrive.
+    credentials_span_ =
+        Tracing::StageSpan(filter_config_->stageSpans(), *decoder_callbacks_,
+                           "aws_lambda.credentials");
+    credentials_requested_at_ = time_source_.monotonicTime();
+  }
+}
+
+void AWSLambdaFilter::rejectConcurrencyLimited() {
+  state_ = State::Responded;
+  function_on_route_->concurrencyLimit()->stats().rejected_.inc();
+  decoder_callbacks_->sendLocalReply(
+      Http::Code::ServiceUnavailable, RcDetails::get().ConcurrencyLimitedBody,
+      nullptr, absl::nullopt, RcDetails::get().ConcurrencyLimited);
+}
+
+// Gives back the request's slot. A response adjusts the limit: throttles and
+// function errors lower it.
+void AWSLambdaFilter::releaseConcurrency(const Http::ResponseHeaderMap *headers) {
+  if (queued_) {
+    queue_timer_->disableTimer();
+    limiter_->cancel(*this);
+    queued_ = false;
+  }
+  if (!admitted_) {
+    return;
+  }
+  admitted_ = false;
+  if (headers == nullptr) {
+    limiter_->release();
+    return;
+  }
+  const bool throttled =
+      Http::Utility::getResponseStatus(*headers) ==
+          enumToInt(Http::Code::TooManyRequests) ||
+      !headers->get(AWSLambdaHeaderNames::get().FunctionError).empty();
+  limiter_->release(std::chrono::duration_cast<std::chrono::milliseconds>(
+                        time_source_.monotonicTime() - admitted_at_),
+                    throttled);
+}
+
+// Retains a copy of the signed request if the route hedges, so it can be sent
+// again when the response is slow. last_chunk is the part of the body that is
+// not in the decoding buffer yet.
+void AWSLambdaFilter::armHedge(const Buffer::Instance *last_chunk) {
+  const HedgePolicy *hedge = function_on_route_->hedge();
+  if (hedge == nullptr || state_ == State::Responded) {
+    return;
+  }
+  hedge_headers_ =
+      Http::createHeaderMap<Http::RequestHeaderMapImpl>(*request_headers_);
+  const Buffer::Instance *buffered = decoder_callbacks_->decodingBuffer();
+  if (buffered != nullptr) {
+    hedge_body_.add(*buffered);
+  }
+  if (last_chunk != nullptr) {
+    hedge_body_.add(*last_chunk);
+  }
+  hedge->requestStarted();
+  hedge_tracked_ = true;
+  hedge_timer_ =
+      decoder_callbacks_->dispatcher().createTimer([this]() { onHedgeTimer(); });
+  hedge_timer_->enableTimer(hedge->delay());
+}
+
+void AWSLambdaFilter::onHedgeTimer() {
+  if (!function_on_route_->hedge()->tryStartHedge()) {
+    ENVOY_LOG(debug, "{}: hedge budget exhausted", function_on_route_->path());
+    hedge_headers_.reset();
+    hedge_body_.drain(hedge_body_.length());
+    return;
+  }
+  hedge_in_flight_ = true;
+  sendHedge();
+}
+
+// Re-signs the retained request for the hedge cluster's region and sends it.
+void AWSLambdaFilter::sendHedge() {
+  const HedgePolicy &hedge = *function_on_route_->hedge();
+  Http::RequestHeaderMapPtr headers = std::move(hedge_headers_);
+  Buffer::OwnedImpl body;
+  body.move(hedge_body_);
+
+  const std::string &cluster_name = hedge.cluster().empty()
+                                        ? route_->routeEntry()->clusterName()
+                                        : hedge.cluster();
+  Upstream::ThreadLocalCluster *cluster =
+      cluster_manager_.getThreadLocalCluster(cluster_name);
+  SharedAWSLambdaProtocolExtensionConfig options;
+  if (cluster != nullptr) {
+    options = cluster->info()
+                  ->extensionProtocolOptionsTyped<
+                      const AWSLambdaProtocolExtensionConfig>(
+                      SoloHttpFilterNames::get().AwsLambda);
+  }
+  if (options == nullptr) {
+    ENVOY_LOG(debug, "{}: hedge cluster {} is not an AWS Lambda cluster",
+              function_on_route_->path(), cluster_name);
+    onHedgeFailure();
+    return;
+  }
+
+  CredentialsConstSharedPtr credentials = credentials_;
+  if (options->accessKey().has_value() && options->secretKey().has_value()) {
+    credentials =
+        options->sessionToken().has_value()
+            ? std::make_shared<const Envoy::Extensions::Common::Aws::Credentials>(
+                  options->accessKey().value(), options->secretKey().value(),
+                  options->sessionToken().value())
+            : std::make_shared<const Envoy::Extensions::Common::Aws::Credentials>(
+                  options->accessKey().value(), options->secretKey().value());
+  }
+
+  headers->remove(Http::CustomHeaders::get().Authorization);
+  headers->remove(AwsAuthenticatorConsts::get().DateHeader);
+  headers->remove(AwsAuthenticatorConsts::get().SecurityTokenHeader);
+  headers->setPath(hedge.path());
+  headers->setHost(options->host());
+
+  AwsAuthenticator signer(time_source_);
+  signer.init(&credentials->accessKeyId().value(),
+              &credentials->secretAccessKey().value(),
+              credentials->sessionToken().has_value()
+                  ? &credentials->sessionToken().value()
+                  : nullptr);
+  signer.updatePayloadHash(body);
+  signer.sign(headers.get(), HeadersToSign, options->region());
+
+  // the hedge gets what is left of the route's timeout, so that a hedge that
+  // doesn't respond gives its budget back no later than the first invocation.
+  Http::AsyncClient::RequestOptions options;
+  const std::chrono::milliseconds route_timeout =
+      route_->routeEntry()->timeout();
+  if (route_timeout.count() > 0) {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time_source_.monotonicTime() -
+        decoder_callbacks_->streamInfo().startTimeMonotonic());
+    if (elapsed >= route_timeout) {
+      onHedgeFailure();
+      return;
+    }
+    options.setTimeout(route_timeout - elapsed);
+  }
+
+  auto message = std::make_unique<Http::RequestMessageImpl>(std::move(headers));
+  message->body().move(body);
+  hedge.stats().sent_.inc();
+  hedge_request_ = cluster->httpAsyncClient().send(std::move(message),
+                                                   hedge_callbacks_, options);
+}
+
+// A successful hedged response is sent downstream, which resets the first
+// invocation. Failures are left to the first invocation, which may still
+// succeed.
+void AWSLambdaFilter::onHedgeSuccess(Http::ResponseMessagePtr &&response) {
+  hedge_request_ = nullptr;
+  const HedgePolicy &hedge = *function_on_route_->hedge();
+  if (hedge_in_flight_) {
+    hedge.hedgeFinished();
+    hedge_in_flight_ = false;
+  }
+  if (!Http::CodeUtility::is2xx(
+          Http::Utility::getResponseStatus(response->headers())) ||
+      !response->headers().get(AWSLambdaHeaderNames::get().FunctionError).empty()) {
+    hedge.stats().failed_.inc();
+    return;
+  }
+  // a hedged response is never sent once the first invocation's response has
+  // started.
+  if (response_started_) {
+    return;
+  }
+
+  hedge.stats().won_.inc();
+  const bool end_stream = response->body().length() == 0;
+  decoder_callbacks_->encodeHeaders(
+      Http::createHeaderMap<Http::ResponseHeaderMapImpl>(response->headers()),
+      end_stream, RcDetails::get().HedgedResponse);
+  if (!end_stream) {
+    decoder_callbacks_->encodeData(response->body(), true);
+  }
+}
+
+void AWSLambdaFilter::onHedgeFailure() {
+  hedge_request_ = nullptr;
+  const HedgePolicy &hedge = *function_on_route_->hedge();
+  if (hedge_in_flight_) {
+    hedge.hedgeFinished();
+    hedge_in_flight_ = false;
+  }
+  hedge.stats().failed_.inc();
+}
+
+void AWSLambdaFilter::cancelHedge() {
+  if (hedge_timer_ != nullptr) {
+    hedge_timer_->disableTimer();
+  }
+  if (hedge_request_ != nullptr) {
+    hedge_request_->cancel();
+    hedge_request_ = nullptr;
+  }
+  if (hedge_in_flight_) {
+    function_on_route_->hedge()->hedgeFinished();
+    hedge_in_flight_ = false;
+  }
+  hedge_headers_.reset();
+  hedge_body_.drain(hedge_body_.length());
+}
+
+// Moves a body held by body_spill_ to the decoding buffer, so it is
+// transformed and sent like a body buffered by the connection manager.
+void AWSLambdaFilter::addSpilledBody() {
+  if (body_spill_.length() == 0) {
+    return;
+  }
+  Buffer::OwnedImpl body;
+  body_spill_.drainTo(body);
+  decoder_callbacks_->addDecodedData(body, false);
 }
 
 void AWSLambdaFilter::handleDefaultBody() {
@@ -424,9 +888,11 @@ void AWSLambdaFilter::transformRequest() {
   auto request_transformer_config = functionOnRoute()->requestTransformerConfig();
   // if we're processing a headers-only request, the decoding buffer does not exist,
   // so we need to transform an empty buffer and then create the decoding buffer from it
+  // the transformer writes its output to a PayloadHashingBuffer, so the
+  // payload is hashed as it is serialized rather than read again afterwards.
   if (!has_body_) {
     ENVOY_LOG(debug, "Performing request transformation on empty buffer");
-    Buffer::OwnedImpl body_buffer("");
+    PayloadHashingBuffer body_buffer(decoder_callbacks_->account());
     request_transformer_config->transform(*request_headers_, request_headers_, body_buffer, *decoder_callbacks_);
     request_headers_->setContentLength(body_buffer.length());
     aws_authenticator_.updatePayloadHash(body_buffer);
@@ -434,12 +900,16 @@ void AWSLambdaFilter::transformRequest() {
     return;
   }
 
-  // if we're processing a request with a body, we modify the decoding buffer directly
+  // if we're processing a request with a body, the decoding buffer's slices
+  // are moved through the hashing buffer and back, without copying them.
   ENVOY_LOG(debug, "Performing request transformation on non-empty buffer");
   decoder_callbacks_->modifyDecodingBuffer([this, &request_transformer_config](Buffer::Instance &buffer) {
-    request_transformer_config->transform(*request_headers_, request_headers_, buffer, *decoder_callbacks_);
-    request_headers_->setContentLength(buffer.length());
-    aws_authenticator_.updatePayloadHash(buffer);
+    PayloadHashingBuffer body_buffer(decoder_callbacks_->account());
+    body_buffer.fill(buffer);
+    request_transformer_config->transform(*request_headers_, request_headers_, body_buffer, *decoder_callbacks_);
+    request_headers_->setContentLength(body_buffer.length());
+    aws_authenticator_.updatePayloadHash(body_buffer);
+    buffer.move(body_buffer);
   });
 }
 
@@ -4,13 +4,19 @@
 #include <string>
 
 #include "envoy/server/filter_config.h"
+#include "envoy/http/async_client.h"
 #include "envoy/http/filter.h"
 #include "envoy/upstream/cluster_manager.h"
 #include "source/common/common/base64.h"
 #include "source/common/buffer/buffer_impl.h"
+#include "source/common/buffer/spill_buffer.h"
+#include "source/common/stats/cpu_accounting.h"
+#include "source/common/tracing/stage_span.h"
 
 #include "source/extensions/filters/http/aws_lambda/aws_authenticator.h"
 #include "source/extensions/filters/http/aws_lambda/config.h"
+#include "source/extensions/filters/http/aws_lambda/event_stream_decoder.h"
+#include "source/extensions/filters/http/aws_lambda/route_resolution_cache.h"
 #include "source/extensions/filters/http/aws_lambda/sts_credentials_provider.h"
 
 #include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.validate.h"
@@ -25,10 +31,13 @@ namespace AwsLambda {
  */
 class AWSLambdaFilter : public Http::StreamFilter,
                         StsConnectionPool::Context::Callbacks,
+                        ConcurrencyLimiter::Waiter,
                         Logger::Loggable<Logger::Id::filter> {
 public:
   AWSLambdaFilter(Upstream::ClusterManager &cluster_manager, Api::Api &api,
-                  AWSLambdaConfigConstSharedPtr filter_config);
+                  AWSLambdaConfigConstSharedPtr filter_config,
+                  Stats::FilterCpuStatsConstSharedPtr cpu_stats = nullptr,
+                  RouteResolutionCacheSharedPtr route_cache = nullptr);
   ~AWSLambdaFilter();
 
   // Http::StreamFilterBase
@@ -38,6 +47,17 @@ public:
     if (context_ != nullptr) {
       context_->cancel();
     }
+    cancelHedge();
+    releaseConcurrency();
+    if (hedge_tracked_) {
+      function_on_route_->hedge()->requestFinished();
+      hedge_tracked_ = false;
+    }
+    credentials_span_.finish();
+    if (cpu_sampled_) {
+      cpu_account_.flush(*cpu_stats_,
+                         decoder_callbacks_->streamInfo().getRouteName());
+    }
   }
 
   // Http::StreamDecoderFilter
@@ -48,6 +68,7 @@ public:
   void setDecoderFilterCallbacks(
       Http::StreamDecoderFilterCallbacks &decoder_callbacks) override {
     decoder_callbacks_ = &decoder_callbacks;
+    body_spill_.bindAccount(decoder_callbacks.account());
   }
 
    // Http::StreamEncoderFilter
@@ -76,6 +97,9 @@ public:
                 credential) override;
   void onFailure(CredentialsFailureStatus status) override;
 
+  // ConcurrencyLimiter::Waiter
+  void onAdmitted() override;
+
   const AWSLambdaRouteConfig  * functionOnRoute() {
     return function_on_route_;
   }
@@ -88,16 +112,55 @@ public:
 private:
   static const HeaderList HeadersToSign;
 
+  // Receives the response to the hedged invocation.
+  class HedgeCallbacks : public Http::AsyncClient::Callbacks {
+  public:
+    HedgeCallbacks(AWSLambdaFilter &parent) : parent_(parent) {}
+
+    // Http::AsyncClient::Callbacks
+    void onSuccess(const Http::AsyncClient::Request &,
+                   Http::ResponseMessagePtr &&response) override {
+      parent_.onHedgeSuccess(std::move(response));
+    }
+    void onFailure(const Http::AsyncClient::Request &,
+                   Http::AsyncClient::FailureReason) override {
+      parent_.onHedgeFailure();
+    }
+    void onBeforeFinalizeUpstreamSpan(Tracing::Span &,
+                                      const Http::ResponseHeaderMap *) override {}
+
+  private:
+    AWSLambdaFilter &parent_;
+  };
+
   void handleDefaultBody();
 
   void finalizeRequest();
+  void armHedge(const Buffer::Instance *last_chunk);
+  void onHedgeTimer();
+  void sendHedge();
+  void onHedgeSuccess(Http::ResponseMessagePtr &&response);
+  void onHedgeFailure();
+  void cancelHedge();
+  void onQueueTimer();
+  void rejectConcurrencyLimited();
+  void releaseConcurrency(const Http::ResponseHeaderMap *headers = nullptr);
+  void recordCredentialsWait();
+  void recordResponseHeaders(const Http::ResponseHeaderMap &headers);
+  void recordResponseSize();
   void finalizeResponse();
+  Http::FilterDataStatus decodeEventStream(Buffer::Instance &data,
+                                           bool end_stream);
   bool parseResponseAsALB(Http::ResponseHeaderMap&,
                           const Buffer::Instance&, Buffer::Instance&);
   bool isResponseTransformationNeeded();
   bool isRequestTransformationNeeded();
   void updateHeaders();
   void transformRequest();
+  void addSpilledBody();
+  Stats::StreamCpuAccount *cpuAccount() {
+    return cpu_sampled_ ? &cpu_account_ : nullptr;
+  }
 
   Http::RequestHeaderMap *request_headers_{};
   Http::ResponseHeaderMap *response_headers_{};
@@ -112,6 +175,7 @@ private:
   Router::RouteConstSharedPtr route_;
   const AWSLambdaRouteConfig *function_on_route_{};
   bool has_body_{};
+  uint64_t request_bytes_{};
 
   AWSLambdaConfigConstSharedPtr filter_config_;
 
@@ -128,6 +192,55 @@ private:
 
   // if end_stream_is true before stopping iteration
   bool end_stream_{};
+
+  // Holds the request body when spilling is enabled, in place of the
+  // connection manager's decoding buffer, until the request is finalized.
+  Buffer::SpillBuffer body_spill_;
+
+  // Times the wait for credentials that weren't available in decodeHeaders.
+  Tracing::StageSpan credentials_span_;
+  absl::optional<MonotonicTime> credentials_requested_at_;
+
+  // Set once the invocation is sent, for the stats of the function.
+  absl::optional<MonotonicTime> invoked_at_;
+  uint64_t response_bytes_{};
+  bool response_size_recorded_{};
+
+  // Set when the response is an InvokeWithResponseStream event stream.
+  std::unique_ptr<EventStreamDecoder> event_stream_;
+
+  // Hedging state. The signed request is retained until the hedge is sent or
+  // the response starts.
+  TimeSource &time_source_;
+  HedgeCallbacks hedge_callbacks_{*this};
+  Http::RequestHeaderMapPtr hedge_headers_;
+  Buffer::OwnedImpl hedge_body_;
+  Event::TimerPtr hedge_timer_;
+  Http::AsyncClient::Request *hedge_request_{};
+  // whether the request counts towards the route's hedge budget.
+  bool hedge_tracked_{};
+  // whether a hedge taken from the budget hasn't finished yet.
+  bool hedge_in_flight_{};
+  // whether the first invocation's response reached the filter, after which
+  // a hedged response is dropped.
+  bool response_started_{};
+
+  // Concurrency limiting state. limiter_ is the worker's limiter of the
+  // function, if it limits concurrency.
+  ConcurrencyLimiter *limiter_{};
+  Event::TimerPtr queue_timer_;
+  MonotonicTime admitted_at_;
+  bool queued_{};
+  // whether the request holds a slot of limiter_.
+  bool admitted_{};
+
+  // Resolves the protocol options and function config, if set. Otherwise they
+  // are looked up for each request.
+  RouteResolutionCacheSharedPtr route_cache_;
+
+  Stats::FilterCpuStatsConstSharedPtr cpu_stats_;
+  bool cpu_sampled_{};
+  Stats::StreamCpuAccount cpu_account_;
 };
 
 } // namespace AwsLambda
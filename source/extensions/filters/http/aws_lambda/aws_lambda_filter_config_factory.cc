@@ -1,6 +1,7 @@
 #include "source/extensions/filters/http/aws_lambda/aws_lambda_filter_config_factory.h"
 
 #include "envoy/registry/registry.h"
+#include "envoy/singleton/manager.h"
 
 #include "source/extensions/common/aws/credentials_provider_impl.h"
 #include "source/extensions/common/aws/utility.h"
@@ -11,6 +12,8 @@ namespace Extensions {
 namespace HttpFilters {
 namespace AwsLambda {
 
+SINGLETON_MANAGER_REGISTRATION(aws_lambda_credentials_refresher);
+
 Http::FilterFactoryCb
 AWSLambdaFilterConfigFactory::createFilterFactoryFromProtoTyped(
     const envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig
@@ -19,6 +22,28 @@ AWSLambdaFilterConfigFactory::createFilterFactoryFromProtoTyped(
     Server::Configuration::FactoryContext &context) {
   auto& server_context = context.serverFactoryContext();
 
+  // the default chain is refreshed on a thread shared by the configs of the
+  // server. It is pinned, so that removing the last of them doesn't wait for
+  // the thread, which is joined when the server shuts down instead.
+  CredentialsRefresherSharedPtr credentials_refresher;
+  Extensions::Common::Aws::MetadataCredentialsProviderBase::CurlMetadataFetcher
+      fetch_metadata = Extensions::Common::Aws::Utility::fetchMetadata;
+  if (proto_config.credentials_fetcher_case() ==
+      envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
+          CredentialsFetcherCase::kUseDefaultCredentials) {
+    credentials_refresher =
+        server_context.singletonManager().getTyped<CredentialsRefresher>(
+            SINGLETON_MANAGER_REGISTERED_NAME(aws_lambda_credentials_refresher),
+            [&server_context] {
+              return std::make_shared<CredentialsRefresher>(
+                  server_context.mainThreadDispatcher(),
+                  server_context.api().threadFactory(),
+                  server_context.lifecycleNotifier());
+            },
+            true);
+    fetch_metadata = credentials_refresher->metadataFetcher();
+  }
+
   // ServerFactoryContext::clusterManager() is not available during server initialization
   // therefore we need to pass absl::nullopt in lieu of the server_context to prevent
   // the upstream code from attempting to access the method. https://github.com/envoyproxy/envoy/issues/26653
@@ -26,18 +51,25 @@ AWSLambdaFilterConfigFactory::createFilterFactoryFromProtoTyped(
           server_context.api(), absl::nullopt /* ServerFactoryContextOptRef context */,
           // We pass an empty string if we don't have a region
           proto_config.has_service_account_credentials() ? proto_config.service_account_credentials().region() : "",
-          Extensions::Common::Aws::Utility::fetchMetadata);
+          fetch_metadata);
   auto sts_factory = StsCredentialsProviderFactory::create(server_context.api(),
                                             server_context.clusterManager());
   auto config = std::make_shared<AWSLambdaConfigImpl>(std::move(chain),
-      std::move(sts_factory),
-      server_context.mainThreadDispatcher(), server_context.api(), server_context.threadLocal(), stats_prefix,
+      std::move(sts_factory), credentials_refresher,
+      server_context.mainThreadDispatcher(), server_context.api(), server_context.threadLocal(),
+      context.initManager(), stats_prefix,
       server_context.scope(), proto_config);
+  auto cpu_stats = std::make_shared<const Stats::FilterCpuStats>(
+      server_context.scope(), stats_prefix + "aws_lambda.cpu",
+      server_context.runtime());
+  auto route_cache = std::make_shared<RouteResolutionCache>(
+      server_context.threadLocal(), server_context.clusterManager());
   return
-      [&server_context, config]
+      [&server_context, config, cpu_stats, route_cache]
       (Http::FilterChainFactoryCallbacks &callbacks) -> void {
         callbacks.addStreamFilter(std::make_shared<AWSLambdaFilter>(
-            server_context.clusterManager(), server_context.api(), config));
+            server_context.clusterManager(), server_context.api(), config,
+            cpu_stats, route_cache));
       };
 }
 
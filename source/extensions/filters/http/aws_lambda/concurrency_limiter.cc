@@ -0,0 +1,149 @@
+#include "source/extensions/filters/http/aws_lambda/concurrency_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "envoy/common/exception.h"
+
+#include "source/common/common/assert.h"
+#include "source/common/protobuf/utility.h"
+
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+ConcurrencyLimiter::ConcurrencyLimiter(
+    ConcurrencyLimitSettingsConstSharedPtr settings)
+    : settings_(std::move(settings)), limit_(settings_->initialLimit()) {
+  reported_limit_ = static_cast<uint64_t>(limit_);
+  settings_->stats().limit_.add(reported_limit_);
+}
+
+ConcurrencyLimiter::~ConcurrencyLimiter() {
+  settings_->stats().limit_.sub(reported_limit_);
+  settings_->stats().in_flight_.sub(in_flight_);
+  settings_->stats().queue_depth_.sub(queue_.size());
+}
+
+ConcurrencyLimiter::Result ConcurrencyLimiter::acquire(Waiter &waiter) {
+  if (queue_.empty() && in_flight_ < static_cast<uint32_t>(limit_)) {
+    in_flight_++;
+    settings_->stats().in_flight_.inc();
+    return Result::Admitted;
+  }
+  if (queue_.size() < settings_->maxQueueSize()) {
+    queue_.push_back(&waiter);
+    settings_->stats().queue_depth_.inc();
+    return Result::Queued;
+  }
+  return Result::Rejected;
+}
+
+void ConcurrencyLimiter::cancel(Waiter &waiter) {
+  auto it = std::find(queue_.begin(), queue_.end(), &waiter);
+  if (it != queue_.end()) {
+    queue_.erase(it);
+    settings_->stats().queue_depth_.dec();
+  }
+}
+
+void ConcurrencyLimiter::release(std::chrono::milliseconds latency,
+                                 bool throttled) {
+  const absl::optional<std::chrono::milliseconds> threshold =
+      settings_->latencyThreshold();
+  if (throttled || (threshold.has_value() && latency > threshold.value())) {
+    settings_->stats().throttled_.inc();
+    setLimit(limit_ * settings_->backoffRatio());
+  } else if (in_flight_ * 2 >= limit_) {
+    // only grow while the limit is in use, so an idle function doesn't
+    // accumulate a limit it has never been tested at.
+    setLimit(limit_ + 1);
+  }
+  release();
+}
+
+void ConcurrencyLimiter::release() {
+  ASSERT(in_flight_ > 0);
+  in_flight_--;
+  settings_->stats().in_flight_.dec();
+  admitWaiters();
+}
+
+void ConcurrencyLimiter::setLimit(double limit) {
+  limit_ = std::clamp<double>(limit, settings_->minLimit(), settings_->maxLimit());
+  const uint64_t reported = static_cast<uint64_t>(limit_);
+  if (reported > reported_limit_) {
+    settings_->stats().limit_.add(reported - reported_limit_);
+  } else {
+    settings_->stats().limit_.sub(reported_limit_ - reported);
+  }
+  reported_limit_ = reported;
+}
+
+void ConcurrencyLimiter::admitWaiters() {
+  while (!queue_.empty() && in_flight_ < static_cast<uint32_t>(limit_)) {
+    Waiter *waiter = queue_.front();
+    queue_.pop_front();
+    settings_->stats().queue_depth_.dec();
+    in_flight_++;
+    settings_->stats().in_flight_.inc();
+    waiter->onAdmitted();
+  }
+}
+
+// create the stats with the function and qualifier as tags.
+#define TAGGED_COUNTER(NAME) names_.counter(scope, #NAME),
+#define TAGGED_GAUGE(NAME, MODE)                                               \
+  names_.gauge(scope, #NAME, Stats::Gauge::ImportMode::MODE),
+
+ConcurrencyLimitSettings::ConcurrencyLimitSettings(
+    const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::
+        ConcurrencyLimit &protoconfig,
+    absl::string_view function, absl::string_view qualifier,
+    Stats::Scope &scope)
+    : names_(scope.symbolTable(), "aws_lambda.concurrency_limit", function,
+             qualifier),
+      initial_limit_(
+          PROTOBUF_GET_WRAPPED_OR_DEFAULT(protoconfig, initial_limit, 20)),
+      min_limit_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(protoconfig, min_limit, 1)),
+      max_limit_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(protoconfig, max_limit, 1000)),
+      backoff_ratio_(
+          PROTOBUF_GET_WRAPPED_OR_DEFAULT(protoconfig, backoff_ratio, 0.9)),
+      max_queue_size_(protoconfig.max_queue_size()),
+      max_queue_time_(
+          PROTOBUF_GET_MS_OR_DEFAULT(protoconfig, max_queue_time, 100)),
+      stats_{ALL_AWS_LAMBDA_CONCURRENCY_LIMIT_STATS(TAGGED_COUNTER,
+                                                    TAGGED_GAUGE)} {
+  if (min_limit_ > initial_limit_ || initial_limit_ > max_limit_) {
+    throw EnvoyException(fmt::format(
+        "concurrency_limit: initial_limit {} must be between min_limit {} and "
+        "max_limit {}",
+        initial_limit_, min_limit_, max_limit_));
+  }
+  if (protoconfig.has_latency_threshold()) {
+    latency_threshold_ = std::chrono::milliseconds(
+        DurationUtil::durationToMilliseconds(protoconfig.latency_threshold()));
+  }
+}
+
+ConcurrencyLimitPolicy::ConcurrencyLimitPolicy(
+    const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::
+        ConcurrencyLimit &protoconfig,
+    absl::string_view function, absl::string_view qualifier,
+    Server::Configuration::ServerFactoryContext &context)
+    : settings_(std::make_shared<const ConcurrencyLimitSettings>(
+          protoconfig, function, qualifier, context.scope())),
+      tls_(context.threadLocal()) {
+  // the limiters are destroyed on the workers after the policy is gone.
+  tls_.set([settings = settings_](Event::Dispatcher &) {
+    return std::make_shared<ConcurrencyLimiter>(settings);
+  });
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "envoy/server/factory_context.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "source/extensions/filters/http/aws_lambda/function_stats.h"
+
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * All stats for the concurrency limit of a function, named by
+ * FunctionStatNames under aws_lambda.concurrency_limit. The gauges are the
+ * sums over the workers. @see stats_macros.h
+ */
+#define ALL_AWS_LAMBDA_CONCURRENCY_LIMIT_STATS(COUNTER, GAUGE)                 \
+  COUNTER(rejected)                                                            \
+  COUNTER(throttled)                                                           \
+  GAUGE(limit, Accumulate)                                                     \
+  GAUGE(in_flight, Accumulate)                                                 \
+  GAUGE(queue_depth, Accumulate)
+
+/**
+ * Wrapper struct for concurrency limit stats. @see stats_macros.h
+ */
+struct AwsLambdaConcurrencyLimitStats {
+  ALL_AWS_LAMBDA_CONCURRENCY_LIMIT_STATS(GENERATE_COUNTER_STRUCT,
+                                         GENERATE_GAUGE_STRUCT)
+};
+
+/**
+ * The settings and stats of a concurrency limit. Shared by the limiters of the
+ * workers, which are torn down on the workers after the route that configured
+ * them is gone.
+ */
+class ConcurrencyLimitSettings {
+public:
+  ConcurrencyLimitSettings(
+      const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::
+          ConcurrencyLimit &protoconfig,
+      absl::string_view function, absl::string_view qualifier,
+      Stats::Scope &scope);
+
+  uint32_t initialLimit() const { return initial_limit_; }
+  uint32_t minLimit() const { return min_limit_; }
+  uint32_t maxLimit() const { return max_limit_; }
+  double backoffRatio() const { return backoff_ratio_; }
+  // responses slower than this are treated as throttled, if set.
+  absl::optional<std::chrono::milliseconds> latencyThreshold() const {
+    return latency_threshold_;
+  }
+  uint32_t maxQueueSize() const { return max_queue_size_; }
+  std::chrono::milliseconds maxQueueTime() const { return max_queue_time_; }
+  AwsLambdaConcurrencyLimitStats &stats() const { return stats_; }
+
+private:
+  FunctionStatNames names_;
+  const uint32_t initial_limit_;
+  const uint32_t min_limit_;
+  const uint32_t max_limit_;
+  const double backoff_ratio_;
+  absl::optional<std::chrono::milliseconds> latency_threshold_;
+  const uint32_t max_queue_size_;
+  const std::chrono::milliseconds max_queue_time_;
+  mutable AwsLambdaConcurrencyLimitStats stats_;
+};
+
+using ConcurrencyLimitSettingsConstSharedPtr =
+    std::shared_ptr<const ConcurrencyLimitSettings>;
+
+/**
+ * Limits the invocations of a function in flight on a worker. The limit is
+ * adjusted with AIMD: it grows by one for each response that arrives while the
+ * limit is being used, and is multiplied by the backoff ratio for each
+ * response that is throttled, failed or slower than the latency threshold.
+ * Requests over the limit wait in a bounded FIFO queue.
+ */
+class ConcurrencyLimiter : public ThreadLocal::ThreadLocalObject {
+public:
+  /**
+   * A request waiting in the queue.
+   */
+  class Waiter {
+  public:
+    virtual ~Waiter() = default;
+
+    /**
+     * Called when a slot has been reserved for the waiter, which has been
+     * removed from the queue. Must not re-enter the limiter.
+     */
+    virtual void onAdmitted() PURE;
+  };
+
+  enum class Result {
+    Admitted,
+    Queued,
+    Rejected,
+  };
+
+  explicit ConcurrencyLimiter(ConcurrencyLimitSettingsConstSharedPtr settings);
+  ~ConcurrencyLimiter() override;
+
+  /**
+   * Takes a slot, or queues the waiter if the queue has room.
+   */
+  Result acquire(Waiter &waiter);
+
+  /**
+   * Removes a waiter that gave up waiting from the queue.
+   */
+  void cancel(Waiter &waiter);
+
+  /**
+   * Releases a slot and adjusts the limit for the response.
+   * @param latency supplies how long the invocation took.
+   * @param throttled supplies whether it was throttled or failed.
+   */
+  void release(std::chrono::milliseconds latency, bool throttled);
+
+  /**
+   * Releases a slot of an invocation that has no response.
+   */
+  void release();
+
+  double limit() const { return limit_; }
+  uint32_t inFlight() const { return in_flight_; }
+  size_t queueDepth() const { return queue_.size(); }
+
+private:
+  void setLimit(double limit);
+  void admitWaiters();
+
+  const ConcurrencyLimitSettingsConstSharedPtr settings_;
+  double limit_;
+  // the part of the limit gauge contributed by this worker.
+  uint64_t reported_limit_{};
+  uint32_t in_flight_{};
+  std::list<Waiter *> queue_;
+};
+
+/**
+ * The concurrency limit configured on a route, with a limiter on each
+ * worker. The limiters co-own the settings, so they don't refer back to the
+ * policy.
+ */
+class ConcurrencyLimitPolicy {
+public:
+  ConcurrencyLimitPolicy(
+      const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::
+          ConcurrencyLimit &protoconfig,
+      absl::string_view function, absl::string_view qualifier,
+      Server::Configuration::ServerFactoryContext &context);
+
+  /**
+   * @return the limiter of the current worker.
+   */
+  ConcurrencyLimiter &limiter() const { return *tls_; }
+
+  std::chrono::milliseconds maxQueueTime() const {
+    return settings_->maxQueueTime();
+  }
+  AwsLambdaConcurrencyLimitStats &stats() const { return settings_->stats(); }
+
+private:
+  const ConcurrencyLimitSettingsConstSharedPtr settings_;
+  mutable ThreadLocal::TypedSlot<ConcurrencyLimiter> tls_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,5 +1,7 @@
 #include "source/extensions/filters/http/aws_lambda/config.h"
 
+#include <algorithm>
+
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 #include "source/extensions/filters/http/transformation/transformation_factory.h"
 
@@ -7,6 +9,7 @@
 
 #include "source/common/common/regex.h"
 #include "source/common/config/utility.h"
+#include "source/common/protobuf/utility.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -34,14 +37,21 @@ namespace {
 // Refreshing every 14 minutes should guarantee us fresh credentials.
 constexpr std::chrono::milliseconds REFRESH_AWS_CREDS =
     std::chrono::minutes(14);
+
+// Failed fetches are retried sooner than the refresh interval.
+constexpr uint64_t RETRY_AWS_CREDS_BASE_MS = 1000;
+constexpr uint64_t RETRY_AWS_CREDS_MAX_MS = 60 * 1000;
+
+constexpr uint64_t DEFAULT_SPILL_MAX_BYTES = 64 * 1024 * 1024;
 } // namespace
 
 AWSLambdaConfigImpl::AWSLambdaConfigImpl(
     std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> &&provider,
     std::unique_ptr<StsCredentialsProviderFactory> &&sts_factory,
+    CredentialsRefresherSharedPtr credentials_refresher,
     Event::Dispatcher &dispatcher, Api::Api &api,
-    Envoy::ThreadLocal::SlotAllocator &tls, const std::string &stats_prefix,
-    Stats::Scope &scope,
+    Envoy::ThreadLocal::SlotAllocator &tls, Init::Manager &init_manager,
+    const std::string &stats_prefix, Stats::Scope &scope,
     const envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig
         &protoconfig)
     : stats_(generateStats(stats_prefix, scope)), api_(api),
@@ -49,7 +59,14 @@ AWSLambdaConfigImpl::AWSLambdaConfigImpl(
       credential_refresh_delay_(std::chrono::milliseconds(
         DurationUtil::durationToMilliseconds(
           protoconfig.credential_refresh_delay()))),
-          propagate_original_routing_(protoconfig.propagate_original_routing()){
+          propagate_original_routing_(protoconfig.propagate_original_routing()),
+          stage_spans_(protoconfig.stage_spans()){
+
+  if (protoconfig.has_body_spill()) {
+    spill_threshold_ = protoconfig.body_spill().threshold_bytes();
+    spill_max_bytes_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+        protoconfig.body_spill(), max_bytes, DEFAULT_SPILL_MAX_BYTES);
+  }
 
 
   // Initialize Credential fetcher, if none exists do nothing. Filter will
@@ -58,17 +75,29 @@ AWSLambdaConfigImpl::AWSLambdaConfigImpl(
   case envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
       CredentialsFetcherCase::kUseDefaultCredentials: {
     ENVOY_LOG(debug, "{}: Using default credentials source", __func__);
-    provider_ = std::move(provider);
 
     auto empty_creds = std::make_shared<const CommonAws::Credentials>();
     tls_.set([empty_creds](Event::Dispatcher &) {
       return std::make_shared<ThreadLocalCredentials>(empty_creds);
     });
 
-    timer_ = dispatcher.createTimer([this] { timerCallback(); });
-    // call the time callback to fetch credentials now.
-    // this will also re-trigger the timer.
-    timerCallback();
+    init_target_ = std::make_unique<Init::TargetImpl>(
+        "aws_lambda default credentials", [this]() {
+          if (fetched_default_credentials_) {
+            init_target_->ready();
+          }
+        });
+    init_manager.add(*init_target_);
+
+    // fetches credentials now, and again on the refresh interval.
+    refresh_subscription_ = credentials_refresher->subscribe(
+        std::move(provider), REFRESH_AWS_CREDS,
+        std::make_unique<JitteredExponentialBackOffStrategy>(
+            RETRY_AWS_CREDS_BASE_MS, RETRY_AWS_CREDS_MAX_MS,
+            api_.randomGenerator()),
+        [this](const CommonAws::Credentials &new_creds) {
+          onDefaultCredentials(new_creds);
+        });
     break;
   }
   case envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig::
@@ -234,7 +263,7 @@ StsConnectionPool::Context *AWSLambdaConfigImpl::getCredentials(
     return nullptr;
   }
 
-  if (provider_) {
+  if (refresh_subscription_) {
     ENVOY_LOG(trace, "{}: Credentials found from default source", __func__);
     callbacks->onSuccess(tls_->credentials_);
     // no context necessary as these credentials are available immediately
@@ -253,33 +282,33 @@ StsConnectionPool::Context *AWSLambdaConfigImpl::getCredentials(
   return nullptr;
 }
 
-void AWSLambdaConfigImpl::timerCallback() {
-  // get new credentials.
-  auto new_creds = provider_->getCredentials();
+void AWSLambdaConfigImpl::onDefaultCredentials(
+    const CommonAws::Credentials &new_creds) {
+  // the listener doesn't need to wait for credentials that failed to fetch,
+  // requests fail either way.
+  fetched_default_credentials_ = true;
+  init_target_->ready();
+
   if (new_creds == CommonAws::Credentials()) {
     stats_.fetch_failed_.inc();
     stats_.current_state_.set(0);
     ENVOY_LOG(warn, "can't get AWS credentials - credentials will not be "
                     "refreshed and request to AWS may fail");
-  } else {
-    stats_.fetch_success_.inc();
-    stats_.current_state_.set(1);
-    auto currentCreds =
-        tls_->credentials_;
-    if (currentCreds == nullptr || !((*currentCreds) == new_creds)) {
-      stats_.creds_rotated_.inc();
-      ENVOY_LOG(debug, "refreshing AWS credentials");
-      auto shared_new_creds =
-          std::make_shared<const CommonAws::Credentials>(new_creds);
-      tls_.set([shared_new_creds](Event::Dispatcher &) {
-        return std::make_shared<ThreadLocalCredentials>(shared_new_creds);
-      });
-    }
+    return;
   }
 
-  if (timer_ != nullptr) {
-    // re-enable refersh timer
-    timer_->enableTimer(REFRESH_AWS_CREDS);
+  stats_.fetch_success_.inc();
+  stats_.current_state_.set(1);
+  auto currentCreds =
+      tls_->credentials_;
+  if (currentCreds == nullptr || !((*currentCreds) == new_creds)) {
+    stats_.creds_rotated_.inc();
+    ENVOY_LOG(debug, "refreshing AWS credentials");
+    auto shared_new_creds =
+        std::make_shared<const CommonAws::Credentials>(new_creds);
+    tls_.set([shared_new_creds](Event::Dispatcher &) {
+      return std::make_shared<ThreadLocalCredentials>(shared_new_creds);
+    });
   }
 }
 
@@ -295,12 +324,39 @@ AWSLambdaRouteConfig::AWSLambdaRouteConfig(
     const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute &protoconfig,
     Server::Configuration::ServerFactoryContext &context
     )
-    : path_(functionUrlPath(protoconfig.name(), protoconfig.qualifier())),
+    : path_(functionUrlPath(protoconfig.name(), protoconfig.qualifier(),
+                            protoconfig.response_stream())),
       async_(protoconfig.async()),
+      response_stream_(protoconfig.response_stream()),
       unwrap_as_alb_(protoconfig.unwrap_as_alb()),
-      has_transformer_config_(protoconfig.has_transformer_config())
+      has_transformer_config_(protoconfig.has_transformer_config()),
+      stats_(FunctionStatsRegistry::get(context)->stats(
+          protoconfig.name(), protoconfig.qualifier()))
     {
 
+  if (response_stream_ && (async_ || unwrap_as_alb_ || has_transformer_config_)) {
+    throw EnvoyException("response_stream cannot be combined with async, "
+                         "unwrap_as_alb or transformer_config");
+  }
+
+  if (protoconfig.has_hedge()) {
+    if (async_ || response_stream_) {
+      throw EnvoyException("hedge cannot be combined with async or response_stream");
+    }
+    const std::string &qualifier = protoconfig.hedge().qualifier().empty()
+                                       ? protoconfig.qualifier()
+                                       : protoconfig.hedge().qualifier();
+    hedge_ = std::make_unique<const HedgePolicy>(
+        protoconfig.hedge(), functionUrlPath(protoconfig.name(), qualifier, false),
+        context.scope());
+  }
+
+  if (protoconfig.has_concurrency_limit()) {
+    concurrency_limit_ = std::make_unique<const ConcurrencyLimitPolicy>(
+        protoconfig.concurrency_limit(), protoconfig.name(),
+        protoconfig.qualifier(), context);
+  }
+
   if (protoconfig.has_empty_body_override()) {
     default_body_ = protoconfig.empty_body_override().value();
   }
@@ -318,12 +374,40 @@ AWSLambdaRouteConfig::AWSLambdaRouteConfig(
   }
 }
 
+HedgePolicy::HedgePolicy(
+    const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::Hedge
+        &protoconfig,
+    std::string path, Stats::Scope &scope)
+    : cluster_(protoconfig.cluster()), path_(std::move(path)),
+      delay_(PROTOBUF_GET_MS_REQUIRED(protoconfig, delay)),
+      budget_percent_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(protoconfig, budget_percent, 10)),
+      min_concurrency_(PROTOBUF_GET_WRAPPED_OR_DEFAULT(protoconfig, min_concurrency, 1)),
+      stats_{ALL_AWS_LAMBDA_HEDGE_STATS(
+          POOL_COUNTER_PREFIX(scope, "aws_lambda.hedge."))} {}
+
+bool HedgePolicy::tryStartHedge() const {
+  const uint64_t allowed = std::max<uint64_t>(
+      min_concurrency_, requests_.load() * budget_percent_ / 100);
+  if (hedges_.fetch_add(1) >= allowed) {
+    hedges_--;
+    stats_.budget_exhausted_.inc();
+    return false;
+  }
+  return true;
+}
+
 std::string
 AWSLambdaRouteConfig::functionUrlPath(const std::string &name,
-                                      const std::string &qualifier) {
+                                      const std::string &qualifier,
+                                      bool response_stream) {
 
   std::stringstream val;
-  val << "/2015-03-31/functions/" << name << "/invocations";
+  // see: https://docs.aws.amazon.com/lambda/latest/dg/API_InvokeWithResponseStream.html
+  if (response_stream) {
+    val << "/2021-11-15/functions/" << name << "/response-streaming-invocations";
+  } else {
+    val << "/2015-03-31/functions/" << name << "/invocations";
+  }
   if (!qualifier.empty()) {
     val << "?Qualifier=" << qualifier;
   }
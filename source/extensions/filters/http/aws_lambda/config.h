@@ -1,14 +1,22 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <string>
 
 #include "envoy/http/filter.h"
+#include "envoy/init/manager.h"
 #include "envoy/stats/scope.h"
 #include "envoy/stats/stats_macros.h"
 #include "envoy/upstream/cluster_manager.h"
 
+#include "source/common/common/backoff_strategy.h"
+#include "source/common/init/target_impl.h"
 #include "source/extensions/common/aws/credentials_provider.h"
+#include "source/extensions/filters/http/aws_lambda/concurrency_limiter.h"
+#include "source/extensions/filters/http/aws_lambda/credentials_refresher.h"
+#include "source/extensions/filters/http/aws_lambda/function_stats.h"
 #include "source/extensions/filters/http/aws_lambda/sts_credentials_provider.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
 
@@ -39,6 +47,22 @@ struct AwsLambdaFilterStats {
   ALL_AWS_LAMBDA_FILTER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
 };
 
+/**
+ * All stats for hedged invocations. @see stats_macros.h
+ */
+#define ALL_AWS_LAMBDA_HEDGE_STATS(COUNTER)                                    \
+  COUNTER(sent)                                                                \
+  COUNTER(won)                                                                 \
+  COUNTER(failed)                                                              \
+  COUNTER(budget_exhausted)
+
+/**
+ * Wrapper struct for hedged invocation stats. @see stats_macros.h
+ */
+struct AwsLambdaHedgeStats {
+  ALL_AWS_LAMBDA_HEDGE_STATS(GENERATE_COUNTER_STRUCT)
+};
+
 using CredentialsSharedPtr =
     std::shared_ptr<Envoy::Extensions::Common::Aws::Credentials>;
 using CredentialsConstSharedPtr =
@@ -80,6 +104,12 @@ public:
   getCredentials(SharedAWSLambdaProtocolExtensionConfig ext_cfg,
                  StsConnectionPool::Context::Callbacks *callbacks) const PURE;
   virtual bool propagateOriginalRouting() const PURE;
+  // The request body size above which the body is spilled out of the heap, or
+  // 0 if the filter leaves buffering to the connection manager.
+  virtual uint64_t spillThreshold() const PURE;
+  virtual uint64_t spillMaxBytes() const PURE;
+  // Whether the stages of a request are recorded as child spans.
+  virtual bool stageSpans() const PURE;
   virtual ~AWSLambdaConfig() = default;
 };
 
@@ -98,8 +128,9 @@ public:
   AWSLambdaConfigImpl(std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
              &&provider,
          std::unique_ptr<StsCredentialsProviderFactory> &&sts_factory,
+         CredentialsRefresherSharedPtr credentials_refresher,
          Event::Dispatcher &dispatcher, Api::Api &api,
-         Envoy::ThreadLocal::SlotAllocator &tls,
+         Envoy::ThreadLocal::SlotAllocator &tls, Init::Manager &init_manager,
          const std::string &stats_prefix, Stats::Scope &scope,
          const envoy::config::filter::http::aws_lambda::v2::AWSLambdaConfig
              &protoconfig);
@@ -112,6 +143,10 @@ public:
       return propagate_original_routing_;
     }
 
+  uint64_t spillThreshold() const override { return spill_threshold_; }
+  uint64_t spillMaxBytes() const override { return spill_max_bytes_; }
+  bool stageSpans() const override { return stage_spans_; }
+
 private:
 
   class AWSLambdaStsRefresher :
@@ -144,7 +179,8 @@ private:
   static AwsLambdaFilterStats generateStats(const std::string &prefix,
                                             Stats::Scope &scope);
 
-  void timerCallback();
+  void onDefaultCredentials(
+      const Envoy::Extensions::Common::Aws::Credentials &new_creds);
 
   void init(Event::Dispatcher &dispatcher);
 
@@ -154,8 +190,12 @@ private:
 
   Api::Api &api_;
 
-  std::unique_ptr<Envoy::Extensions::Common::Aws::CredentialsProvider>
-      provider_;
+  // Refreshes the default credentials chain off the main thread.
+  CredentialsRefresher::SubscriptionPtr refresh_subscription_;
+  // Holds the listener's initialization until the default chain has been
+  // fetched once.
+  std::unique_ptr<Init::TargetImpl> init_target_;
+  bool fetched_default_credentials_{};
 
   ThreadLocal::TypedSlot<ThreadLocalCredentials> tls_;
   std::string token_file_;
@@ -164,16 +204,55 @@ private:
 
   std::shared_ptr<AWSLambdaStsRefresher> sts_refresher_;
 
-  Event::TimerPtr timer_;
-
   std::unique_ptr<StsCredentialsProviderFactory> sts_factory_;
   std::chrono::milliseconds credential_refresh_delay_;
 
   bool propagate_original_routing_;
+  uint64_t spill_threshold_{};
+  uint64_t spill_max_bytes_{};
+  bool stage_spans_{};
 };
 
 typedef std::shared_ptr<const AWSLambdaConfig> AWSLambdaConfigConstSharedPtr;
 
+/**
+ * How a route hedges slow invocations. The budget is shared by the workers,
+ * so it is kept in atomics and may briefly be exceeded by concurrent hedges.
+ */
+class HedgePolicy {
+public:
+  HedgePolicy(
+      const envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::Hedge
+          &protoconfig,
+      std::string path, Stats::Scope &scope);
+
+  // The cluster to send the hedged invocation to, or empty for the route's.
+  const std::string &cluster() const { return cluster_; }
+  const std::string &path() const { return path_; }
+  std::chrono::milliseconds delay() const { return delay_; }
+  AwsLambdaHedgeStats &stats() const { return stats_; }
+
+  // Tracks the requests in flight that may be hedged.
+  void requestStarted() const { requests_++; }
+  void requestFinished() const { requests_--; }
+  /**
+   * Takes a hedge from the budget.
+   * @return false if the budget is exhausted.
+   */
+  bool tryStartHedge() const;
+  void hedgeFinished() const { hedges_--; }
+
+private:
+  const std::string cluster_;
+  const std::string path_;
+  const std::chrono::milliseconds delay_;
+  const uint32_t budget_percent_;
+  const uint32_t min_concurrency_;
+  mutable AwsLambdaHedgeStats stats_;
+  mutable std::atomic<uint64_t> requests_{};
+  mutable std::atomic<uint64_t> hedges_{};
+};
+
 class AWSLambdaRouteConfig : public Router::RouteSpecificFilterConfig {
 public:
   AWSLambdaRouteConfig(
@@ -183,6 +262,7 @@ public:
 
   const std::string &path() const { return path_; }
   bool async() const { return async_; }
+  bool responseStream() const { return response_stream_; }
   const absl::optional<std::string> &defaultBody() const {
     return default_body_;
   }
@@ -191,17 +271,29 @@ public:
   Transformation::TransformerConstSharedPtr requestTransformerConfig() const { return request_transformer_config_; }
   bool hasTransformerConfig() const { return has_transformer_config_; }
   bool hasRequestTransformerConfig() const { return request_transformer_config_ != nullptr; }
+  // The hedging policy of the route, if any.
+  const HedgePolicy *hedge() const { return hedge_.get(); }
+  // The concurrency limit of the function, if any.
+  const ConcurrencyLimitPolicy *concurrencyLimit() const {
+    return concurrency_limit_.get();
+  }
+  const FunctionStats &stats() const { return *stats_; }
 private:
   std::string path_;
   bool async_;
+  bool response_stream_;
   bool unwrap_as_alb_;
   Transformation::TransformerConstSharedPtr transformer_config_;
   bool has_transformer_config_;
   Transformation::TransformerConstSharedPtr request_transformer_config_;
   absl::optional<std::string> default_body_;
+  std::unique_ptr<const HedgePolicy> hedge_;
+  std::unique_ptr<const ConcurrencyLimitPolicy> concurrency_limit_;
+  FunctionStatsConstSharedPtr stats_;
 
   static std::string functionUrlPath(const std::string &name,
-                                     const std::string &qualifier);
+                                     const std::string &qualifier,
+                                     bool response_stream);
 };
 
 } // namespace AwsLambda
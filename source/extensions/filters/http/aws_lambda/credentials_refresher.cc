@@ -0,0 +1,263 @@
+#include "source/extensions/filters/http/aws_lambda/credentials_refresher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#include "envoy/http/message.h"
+
+#include "source/common/http/headers.h"
+
+#include "absl/synchronization/mutex.h"
+#include "curl/curl.h"
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+struct CredentialsRefresher::Fetch {
+  Fetch(std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> &&provider,
+        std::weak_ptr<ResultCallback> callback)
+      : provider_(std::move(provider)), callback_(std::move(callback)) {}
+
+  const std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> provider_;
+  const std::weak_ptr<ResultCallback> callback_;
+  // Whether the fetch is waiting for the thread. Guarded by the queue's mutex.
+  bool queued_{};
+};
+
+struct CredentialsRefresher::Queue {
+  using FetchSharedPtr = std::shared_ptr<Fetch>;
+
+  bool hasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !pending_.empty() || shutdown_;
+  }
+
+  absl::Mutex mutex_;
+  std::deque<FetchSharedPtr> pending_ ABSL_GUARDED_BY(mutex_);
+  bool shutdown_ ABSL_GUARDED_BY(mutex_){};
+  // Set with shutdown_, and polled by metadata calls in flight.
+  std::atomic<bool> aborted_{};
+};
+
+namespace {
+
+size_t appendToString(char *data, size_t size, size_t count, void *buffer) {
+  static_cast<std::string *>(buffer)->append(data, size * count);
+  return size * count;
+}
+
+// curl calls this about once a second, and more often while data arrives.
+int abortIfSet(void *aborted, curl_off_t, curl_off_t, curl_off_t,
+               curl_off_t) {
+  return static_cast<const std::atomic<bool> *>(aborted)->load() ? 1 : 0;
+}
+
+// Fetches the metadata the way Utility::fetchMetadata does, but only once and
+// until the call times out or the flag is set.
+absl::optional<std::string> fetchMetadata(Http::RequestMessage &message,
+                                          const std::atomic<bool> &aborted) {
+  if (aborted) {
+    return absl::nullopt;
+  }
+  CURL *const curl = curl_easy_init();
+  if (curl == nullptr) {
+    return absl::nullopt;
+  }
+
+  const std::string url = fmt::format("{}://{}{}",
+                                      message.headers().getSchemeValue(),
+                                      message.headers().getHostValue(),
+                                      message.headers().getPathValue());
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                   static_cast<long>(
+                       CredentialsRefresher::MetadataTimeout.count()));
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, abortIfSet);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &aborted);
+
+  std::string buffer;
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendToString);
+
+  struct curl_slist *headers = nullptr;
+  message.headers().iterate(
+      [&headers](const Http::HeaderEntry &entry) -> Http::HeaderMap::Iterate {
+        const absl::string_view key = entry.key().getStringView();
+        if (!key.empty() && key[0] != ':') {
+          headers = curl_slist_append(
+              headers, fmt::format("{}: {}", key,
+                                   entry.value().getStringView())
+                           .c_str());
+        }
+        return Http::HeaderMap::Iterate::Continue;
+      });
+  if (message.headers().getMethodValue() ==
+      Http::Headers::get().MethodValues.Put) {
+    // the instance metadata token is requested with an empty PUT, which some
+    // metadata services only answer without an expect header.
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE, 0L);
+    headers = curl_slist_append(headers, "Expect:");
+  }
+  if (headers != nullptr) {
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  }
+
+  const CURLcode result = curl_easy_perform(curl);
+  if (result != CURLE_OK) {
+    ENVOY_LOG_MISC(debug, "could not fetch AWS metadata from {}: {}", url,
+                   curl_easy_strerror(result));
+    buffer.clear();
+  }
+  curl_easy_cleanup(curl);
+  curl_slist_free_all(headers);
+  return buffer.empty() ? absl::nullopt : absl::make_optional(buffer);
+}
+
+} // namespace
+
+// Runs until the refresher shuts down, which joins the thread.
+void CredentialsRefresher::runFetches(std::shared_ptr<Queue> queue,
+                                      Event::Dispatcher &dispatcher) {
+  while (true) {
+    Queue::FetchSharedPtr fetch;
+    {
+      absl::MutexLock lock(&queue->mutex_);
+      queue->mutex_.Await(
+          absl::Condition(queue.get(), &Queue::hasWork));
+      if (queue->shutdown_) {
+        return;
+      }
+      fetch = std::move(queue->pending_.front());
+      queue->pending_.pop_front();
+      fetch->queued_ = false;
+    }
+
+    ENVOY_LOG(debug, "fetching AWS credentials");
+    Extensions::Common::Aws::Credentials credentials =
+        fetch->provider_->getCredentials();
+    std::weak_ptr<ResultCallback> weak_callback = fetch->callback_;
+    // destroys the provider if its subscription is gone.
+    fetch.reset();
+
+    absl::MutexLock lock(&queue->mutex_);
+    if (queue->shutdown_) {
+      return;
+    }
+    // the callback is only destroyed on the dispatcher's thread, so it can be
+    // checked there. Once the server shuts down, it may not run at all.
+    dispatcher.post([weak_callback = std::move(weak_callback),
+                     credentials = std::move(credentials)]() {
+      if (auto callback = weak_callback.lock()) {
+        (*callback)(credentials);
+      }
+    });
+  }
+}
+
+CredentialsRefresher::CredentialsRefresher(
+    Event::Dispatcher &dispatcher, Thread::ThreadFactory &thread_factory,
+    Server::ServerLifecycleNotifier &lifecycle_notifier)
+    : dispatcher_(dispatcher), lifecycle_notifier_(lifecycle_notifier),
+      queue_(std::make_shared<Queue>()) {
+  thread_ = thread_factory.createThread(
+      [queue = queue_, &dispatcher]() { runFetches(queue, dispatcher); },
+      Thread::Options{"AwsCredsRefresh"});
+}
+
+CredentialsRefresher::~CredentialsRefresher() { shutdown(); }
+
+void CredentialsRefresher::shutdown() {
+  if (thread_ == nullptr) {
+    return;
+  }
+  {
+    absl::MutexLock lock(&queue_->mutex_);
+    queue_->shutdown_ = true;
+    queue_->aborted_ = true;
+    queue_->pending_.clear();
+  }
+  thread_->join();
+  thread_.reset();
+}
+
+Extensions::Common::Aws::MetadataCredentialsProviderBase::CurlMetadataFetcher
+CredentialsRefresher::metadataFetcher() const {
+  return [queue = queue_](Http::RequestMessage &message) {
+    return fetchMetadata(message, queue->aborted_);
+  };
+}
+
+CredentialsRefresher::SubscriptionPtr CredentialsRefresher::subscribe(
+    std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> &&provider,
+    std::chrono::milliseconds refresh_interval, BackOffStrategyPtr retry_backoff,
+    ResultCallback callback) {
+  SubscriptionPtr subscription(new Subscription(
+      shared_from_this(), std::move(provider), refresh_interval,
+      std::move(retry_backoff), std::move(callback)));
+  subscription->refresh();
+  return subscription;
+}
+
+CredentialsRefresher::Subscription::Subscription(
+    CredentialsRefresherSharedPtr refresher,
+    std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> &&provider,
+    std::chrono::milliseconds refresh_interval, BackOffStrategyPtr retry_backoff,
+    ResultCallback callback)
+    : refresher_(std::move(refresher)),
+      shutdown_handle_(refresher_->lifecycle_notifier_.registerCallback(
+          Server::ServerLifecycleNotifier::Stage::ShutdownExit,
+          [refresher = refresher_.get()]() { refresher->shutdown(); })),
+      refresh_interval_(refresh_interval),
+      retry_backoff_(std::move(retry_backoff)), callback_(std::move(callback)),
+      timer_(refresher_->dispatcher_.createTimer([this] { refresh(); })),
+      on_result_(std::make_shared<ResultCallback>(
+          [this](const Extensions::Common::Aws::Credentials &credentials) {
+            onResult(credentials);
+          })) {
+  fetch_ = std::make_shared<Fetch>(std::move(provider), on_result_);
+}
+
+CredentialsRefresher::Subscription::~Subscription() {
+  Queue &queue = *refresher_->queue_;
+  absl::MutexLock lock(&queue.mutex_);
+  if (fetch_->queued_) {
+    queue.pending_.erase(
+        std::find(queue.pending_.begin(), queue.pending_.end(), fetch_));
+  }
+}
+
+void CredentialsRefresher::Subscription::refresh() {
+  Queue &queue = *refresher_->queue_;
+  absl::MutexLock lock(&queue.mutex_);
+  if (fetch_->queued_) {
+    return;
+  }
+  fetch_->queued_ = true;
+  queue.pending_.push_back(fetch_);
+}
+
+void CredentialsRefresher::Subscription::onResult(
+    const Extensions::Common::Aws::Credentials &credentials) {
+  if (credentials == Extensions::Common::Aws::Credentials()) {
+    // failed fetches are retried sooner than the refresh interval.
+    timer_->enableTimer(
+        std::chrono::milliseconds(retry_backoff_->nextBackOffMs()));
+  } else {
+    retry_backoff_->reset();
+    timer_->enableTimer(refresh_interval_);
+  }
+  callback_(credentials);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
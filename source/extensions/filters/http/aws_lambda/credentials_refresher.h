@@ -0,0 +1,143 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "envoy/common/backoff_strategy.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/server/lifecycle_notifier.h"
+#include "envoy/singleton/instance.h"
+#include "envoy/thread/thread.h"
+
+#include "source/common/common/logger.h"
+#include "source/extensions/common/aws/credentials_provider.h"
+#include "source/extensions/common/aws/credentials_provider_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class CredentialsRefresher;
+using CredentialsRefresherSharedPtr = std::shared_ptr<CredentialsRefresher>;
+
+/**
+ * Fetches credentials from providers on a background thread, so that providers
+ * that block on HTTP calls, such as the instance and task metadata lookups of
+ * the default chain, don't stall the dispatcher. One refresher is shared by
+ * the filter configs of a server, and results are posted back to its main
+ * dispatcher.
+ *
+ * The refresher lives as long as the server, so tearing down a config never
+ * waits for the thread; a fetch that completes after its subscription is gone
+ * is dropped. The thread is joined when the server shuts down, which aborts a
+ * metadata call in flight made with metadataFetcher().
+ */
+class CredentialsRefresher : public Singleton::Instance,
+                             public std::enable_shared_from_this<CredentialsRefresher>,
+                             public Logger::Loggable<Logger::Id::aws> {
+  // Defined in the .cc, and shared by the subscriptions and the thread.
+  struct Fetch;
+  struct Queue;
+
+public:
+  using ResultCallback =
+      std::function<void(const Extensions::Common::Aws::Credentials &)>;
+
+  /**
+   * Keeps the credentials of one provider fresh. Fetches again after the
+   * refresh interval, or after a backoff if the fetch returned no credentials.
+   * Must be created and destroyed on the dispatcher's thread.
+   */
+  class Subscription : public Logger::Loggable<Logger::Id::aws> {
+  public:
+    ~Subscription();
+
+    /**
+     * Requests a fetch now. A request made while a fetch is waiting for the
+     * thread is coalesced with it.
+     */
+    void refresh();
+
+  private:
+    friend class CredentialsRefresher;
+
+    Subscription(
+        CredentialsRefresherSharedPtr refresher,
+        std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> &&provider,
+        std::chrono::milliseconds refresh_interval,
+        BackOffStrategyPtr retry_backoff, ResultCallback callback);
+
+    void onResult(const Extensions::Common::Aws::Credentials &credentials);
+
+    const CredentialsRefresherSharedPtr refresher_;
+    // Stops the thread when the server shuts down. Held by the subscriptions,
+    // which are gone before the server's lifecycle callbacks are.
+    const Server::ServerLifecycleNotifier::HandlePtr shutdown_handle_;
+    const std::chrono::milliseconds refresh_interval_;
+    BackOffStrategyPtr retry_backoff_;
+    const ResultCallback callback_;
+    Event::TimerPtr timer_;
+    // Shared with the thread while a fetch is in flight, so that the provider
+    // outlives it. The provider may then be destroyed on the thread.
+    std::shared_ptr<Fetch> fetch_;
+    // Shared with posted results, which are dropped once it is gone.
+    std::shared_ptr<ResultCallback> on_result_;
+  };
+  using SubscriptionPtr = std::unique_ptr<Subscription>;
+
+  // The time allowed for each call made by metadataFetcher().
+  static constexpr std::chrono::milliseconds MetadataTimeout =
+      std::chrono::seconds(5);
+
+  CredentialsRefresher(Event::Dispatcher &dispatcher,
+                       Thread::ThreadFactory &thread_factory,
+                       Server::ServerLifecycleNotifier &lifecycle_notifier);
+
+  /**
+   * Stops and joins the thread, if shutdown() didn't.
+   */
+  ~CredentialsRefresher() override;
+
+  /**
+   * Stops the thread and waits for it. A metadata call in flight is aborted
+   * and pending fetches are dropped. Called when the server shuts down.
+   */
+  void shutdown();
+
+  /**
+   * @return a function for providers to fetch instance and task metadata
+   * with. Unlike Utility::fetchMetadata, it makes a single attempt, bounded by
+   * MetadataTimeout, and is aborted by shutdown(). Failed fetches are retried
+   * by the subscriptions instead.
+   */
+  Extensions::Common::Aws::MetadataCredentialsProviderBase::CurlMetadataFetcher
+  metadataFetcher() const;
+
+  /**
+   * Subscribes to the credentials of a provider and requests a first fetch.
+   * @param callback supplies a function that is called on the dispatcher's
+   * thread with the result of each fetch, which is empty on failure.
+   */
+  SubscriptionPtr
+  subscribe(std::unique_ptr<Extensions::Common::Aws::CredentialsProvider> &&provider,
+            std::chrono::milliseconds refresh_interval,
+            BackOffStrategyPtr retry_backoff, ResultCallback callback);
+
+private:
+  static void runFetches(std::shared_ptr<Queue> queue,
+                         Event::Dispatcher &dispatcher);
+
+  Event::Dispatcher &dispatcher_;
+  Server::ServerLifecycleNotifier &lifecycle_notifier_;
+  // Shared with the thread and the metadata fetchers.
+  std::shared_ptr<Queue> queue_;
+  Thread::ThreadPtr thread_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
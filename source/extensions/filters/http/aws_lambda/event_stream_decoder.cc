@@ -0,0 +1,230 @@
+#include "source/extensions/filters/http/aws_lambda/event_stream_decoder.h"
+
+#include <algorithm>
+
+#include "envoy/common/exception.h"
+
+#include "source/common/protobuf/utility.h"
+
+#include "absl/strings/str_cat.h"
+#include "fmt/format.h"
+#include "zlib.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+constexpr uint32_t PreludeBytes = 12;
+constexpr uint32_t CrcBytes = 4;
+
+// header value types, see
+// https://docs.aws.amazon.com/AmazonS3/latest/API/RESTSelectObjectAppendix.html
+enum HeaderValueType : uint8_t {
+  BoolTrue = 0,
+  BoolFalse = 1,
+  Byte = 2,
+  Short = 3,
+  Integer = 4,
+  Long = 5,
+  ByteArray = 6,
+  String = 7,
+  Timestamp = 8,
+  Uuid = 9,
+};
+
+// CRC32 of the first length bytes of a buffer, without linearizing it.
+uint32_t crc32Prefix(const Buffer::Instance &buffer, uint64_t length) {
+  uLong crc = crc32(0L, Z_NULL, 0);
+  for (const Buffer::RawSlice &slice : buffer.getRawSlices()) {
+    if (length == 0) {
+      break;
+    }
+    const uint64_t len = std::min<uint64_t>(length, slice.len_);
+    crc = crc32(crc, static_cast<const Bytef *>(slice.mem_),
+                static_cast<uInt>(len));
+    length -= len;
+  }
+  return static_cast<uint32_t>(crc);
+}
+
+uint16_t readUint16(absl::string_view data) {
+  return static_cast<uint16_t>(static_cast<uint8_t>(data[0]) << 8 |
+                               static_cast<uint8_t>(data[1]));
+}
+} // namespace
+
+EventStreamDecoder::Status EventStreamDecoder::decode(Buffer::Instance &input,
+                                                      Buffer::Instance &output) {
+  if (status_ != Status::Continue) {
+    input.drain(input.length());
+    return status_;
+  }
+  buffered_.move(input);
+  while (status_ == Status::Continue && decodeMessage(output)) {
+  }
+  if (status_ != Status::Continue) {
+    buffered_.drain(buffered_.length());
+  }
+  return status_;
+}
+
+bool EventStreamDecoder::decodeMessage(Buffer::Instance &output) {
+  if (buffered_.length() < PreludeBytes) {
+    return false;
+  }
+  const uint32_t total_length = buffered_.peekBEInt<uint32_t>(0);
+  const uint32_t headers_length = buffered_.peekBEInt<uint32_t>(4);
+  if (!prelude_checked_) {
+    if (crc32Prefix(buffered_, 8) != buffered_.peekBEInt<uint32_t>(8)) {
+      setError("event stream prelude checksum mismatch");
+      return false;
+    }
+    if (total_length > MaxMessageBytes ||
+        static_cast<uint64_t>(headers_length) + PreludeBytes + CrcBytes >
+            total_length) {
+      setError(fmt::format("invalid event stream message length {}",
+                           total_length));
+      return false;
+    }
+    prelude_checked_ = true;
+  }
+  if (buffered_.length() < total_length) {
+    return false;
+  }
+  if (crc32Prefix(buffered_, total_length - CrcBytes) !=
+      buffered_.peekBEInt<uint32_t>(total_length - CrcBytes)) {
+    setError("event stream message checksum mismatch");
+    return false;
+  }
+  prelude_checked_ = false;
+
+  std::string headers(headers_length, '\0');
+  buffered_.copyOut(PreludeBytes, headers_length, headers.data());
+  MessageHeaders message_headers;
+  if (!parseHeaders(headers, message_headers)) {
+    setError("malformed event stream message headers");
+    return false;
+  }
+  buffered_.drain(PreludeBytes + headers_length);
+
+  const uint32_t payload_length =
+      total_length - PreludeBytes - headers_length - CrcBytes;
+  if (message_headers.message_type == "event" &&
+      message_headers.event_type == "PayloadChunk") {
+    output.move(buffered_, payload_length);
+  } else {
+    std::string payload(payload_length, '\0');
+    buffered_.copyOut(0, payload_length, payload.data());
+    buffered_.drain(payload_length);
+    if (message_headers.message_type == "exception" ||
+        message_headers.message_type == "error") {
+      setError(absl::StrCat(message_headers.exception_type, ": ", payload));
+    } else if (message_headers.event_type == "InvokeComplete") {
+      onInvokeComplete(payload);
+    }
+    // other events carry nothing to forward.
+  }
+  buffered_.drain(CrcBytes);
+  return true;
+}
+
+bool EventStreamDecoder::parseHeaders(absl::string_view headers,
+                                      MessageHeaders &out) {
+  while (!headers.empty()) {
+    const uint8_t name_length = static_cast<uint8_t>(headers[0]);
+    if (headers.size() < 2u + name_length) {
+      return false;
+    }
+    const absl::string_view name = headers.substr(1, name_length);
+    const uint8_t type = static_cast<uint8_t>(headers[1 + name_length]);
+    headers.remove_prefix(2 + name_length);
+
+    size_t value_length;
+    switch (type) {
+    case BoolTrue:
+    case BoolFalse:
+      value_length = 0;
+      break;
+    case Byte:
+      value_length = 1;
+      break;
+    case Short:
+      value_length = 2;
+      break;
+    case Integer:
+      value_length = 4;
+      break;
+    case Long:
+    case Timestamp:
+      value_length = 8;
+      break;
+    case Uuid:
+      value_length = 16;
+      break;
+    case ByteArray:
+    case String: {
+      if (headers.size() < 2) {
+        return false;
+      }
+      value_length = readUint16(headers);
+      headers.remove_prefix(2);
+      break;
+    }
+    default:
+      return false;
+    }
+    if (headers.size() < value_length) {
+      return false;
+    }
+
+    if (type == String) {
+      const absl::string_view value = headers.substr(0, value_length);
+      if (name == ":message-type") {
+        out.message_type = std::string(value);
+      } else if (name == ":event-type") {
+        out.event_type = std::string(value);
+      } else if (name == ":exception-type" || name == ":error-code") {
+        out.exception_type = std::string(value);
+      }
+    }
+    headers.remove_prefix(value_length);
+  }
+  return true;
+}
+
+// The InvokeComplete payload reports whether the function failed after
+// streaming began, as a json object with ErrorCode and ErrorDetails.
+void EventStreamDecoder::onInvokeComplete(absl::string_view payload) {
+  status_ = Status::Complete;
+  if (payload.empty()) {
+    return;
+  }
+  ProtobufWkt::Struct result;
+  try {
+    MessageUtil::loadFromJson(std::string(payload), result);
+  } catch (EnvoyException &ex) {
+    setError(absl::StrCat("malformed InvokeComplete event: ", ex.what()));
+    return;
+  }
+  const auto &fields = result.fields();
+  auto error_code = fields.find("ErrorCode");
+  if (error_code != fields.end() && !error_code->second.string_value().empty()) {
+    auto details = fields.find("ErrorDetails");
+    setError(absl::StrCat(error_code->second.string_value(), ": ",
+                          details != fields.end()
+                              ? details->second.string_value()
+                              : ""));
+  }
+}
+
+void EventStreamDecoder::setError(std::string error) {
+  status_ = Status::Error;
+  error_ = std::move(error);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+
+#include "source/common/buffer/buffer_impl.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Incrementally decodes the application/vnd.amazon.eventstream body of a
+ * Lambda InvokeWithResponseStream response. Each message is a prelude (total
+ * length, headers length and their CRC), typed headers, a payload and a CRC of
+ * the whole message. The payloads of PayloadChunk events are moved to the
+ * output without being copied; other events are buffered only until their
+ * message is complete.
+ */
+class EventStreamDecoder {
+public:
+  enum class Status {
+    // more data is needed to complete the stream.
+    Continue,
+    // the InvokeComplete event was decoded and the function succeeded.
+    Complete,
+    // the function or the stream failed. see error().
+    Error,
+  };
+
+  explicit EventStreamDecoder(
+      Buffer::BufferMemoryAccountSharedPtr account = nullptr)
+      : buffered_(std::move(account)) {}
+
+  /**
+   * Drains input, appending the payload of each PayloadChunk event that
+   * becomes complete to output. Once Complete or Error has been returned,
+   * further input is discarded and the same status is returned.
+   */
+  Status decode(Buffer::Instance &input, Buffer::Instance &output);
+
+  /**
+   * @return the reason decode() returned Error.
+   */
+  const std::string &error() const { return error_; }
+
+  /**
+   * @return whether part of a message is buffered, waiting for more input.
+   */
+  bool hasPartialMessage() const { return buffered_.length() != 0; }
+
+  // Messages larger than this are treated as malformed, so a corrupt prelude
+  // can't make the decoder buffer without bound.
+  static constexpr uint32_t MaxMessageBytes = 16 * 1024 * 1024;
+
+private:
+  struct MessageHeaders {
+    std::string message_type;
+    std::string event_type;
+    std::string exception_type;
+  };
+
+  // Decodes the message at the front of buffered_ if it is complete.
+  bool decodeMessage(Buffer::Instance &output);
+  bool parseHeaders(absl::string_view headers, MessageHeaders &out);
+  void onInvokeComplete(absl::string_view payload);
+  void setError(std::string error);
+
+  Buffer::OwnedImpl buffered_;
+  Status status_{Status::Continue};
+  std::string error_;
+  // set once the prelude of the message at the front of buffered_ has been
+  // validated.
+  bool prelude_checked_{};
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
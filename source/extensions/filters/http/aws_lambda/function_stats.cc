@@ -0,0 +1,115 @@
+#include "source/extensions/filters/http/aws_lambda/function_stats.h"
+
+#include "envoy/singleton/manager.h"
+
+#include "source/common/stats/utility.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+SINGLETON_MANAGER_REGISTRATION(aws_lambda_function_stats_registry);
+
+namespace {
+// the qualifier Lambda invokes when none is given.
+constexpr absl::string_view LatestQualifier = "$LATEST";
+} // namespace
+
+FunctionStatNames::FunctionStatNames(Stats::SymbolTable &symbol_table,
+                                     absl::string_view prefix,
+                                     absl::string_view function,
+                                     absl::string_view qualifier)
+    : pool_(symbol_table), prefix_(pool_.add(prefix)),
+      tags_{{pool_.add("aws_lambda_function"),
+             pool_.add(Stats::Utility::sanitizeStatsName(function))},
+            {pool_.add("aws_lambda_qualifier"),
+             pool_.add(Stats::Utility::sanitizeStatsName(
+                 qualifier.empty() ? LatestQualifier : qualifier))}} {}
+
+FunctionStats::FunctionStats(Stats::Scope &scope, absl::string_view function,
+                             absl::string_view qualifier)
+    : names_(scope.symbolTable(), "aws_lambda.function", function, qualifier),
+      invocations_(names_.counter(scope, "invocations")),
+      function_errors_(names_.counter(scope, "function_errors")),
+      throttles_(names_.counter(scope, "throttles")),
+      estimated_cold_starts_(names_.counter(scope, "estimated_cold_starts")),
+      invocation_time_(names_.histogram(scope, "invocation_time",
+                                        Stats::Histogram::Unit::Milliseconds)),
+      credentials_wait_time_(names_.histogram(
+          scope, "credentials_wait_time", Stats::Histogram::Unit::Milliseconds)),
+      signing_time_(names_.histogram(scope, "signing_time",
+                                     Stats::Histogram::Unit::Microseconds)),
+      request_payload_size_(names_.histogram(scope, "request_payload_size",
+                                             Stats::Histogram::Unit::Bytes)),
+      response_payload_size_(names_.histogram(scope, "response_payload_size",
+                                              Stats::Histogram::Unit::Bytes)) {}
+
+void FunctionStats::invocationStarted(MonotonicTime now) const {
+  invocations_.inc();
+  const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             now.time_since_epoch())
+                             .count();
+  const int64_t last_ns = last_invocation_ns_.exchange(now_ns);
+  if (last_ns == 0 ||
+      now_ns - last_ns >=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(ColdStartIdleTime)
+              .count()) {
+    estimated_cold_starts_.inc();
+  }
+}
+
+Stats::Counter &FunctionStatNames::counter(Stats::Scope &scope,
+                                           absl::string_view name) {
+  return Stats::Utility::counterFromStatNames(
+      scope, {prefix_, pool_.add(name)},
+      Stats::StatNameTagVectorOptConstRef(tags_));
+}
+
+Stats::Gauge &FunctionStatNames::gauge(Stats::Scope &scope,
+                                       absl::string_view name,
+                                       Stats::Gauge::ImportMode import_mode) {
+  return Stats::Utility::gaugeFromStatNames(
+      scope, {prefix_, pool_.add(name)}, import_mode,
+      Stats::StatNameTagVectorOptConstRef(tags_));
+}
+
+Stats::Histogram &FunctionStatNames::histogram(Stats::Scope &scope,
+                                               absl::string_view name,
+                                               Stats::Histogram::Unit unit) {
+  return Stats::Utility::histogramFromStatNames(
+      scope, {prefix_, pool_.add(name)}, unit,
+      Stats::StatNameTagVectorOptConstRef(tags_));
+}
+
+std::shared_ptr<FunctionStatsRegistry> FunctionStatsRegistry::get(
+    Server::Configuration::ServerFactoryContext &context) {
+  // pinned, since route configs only hold the stats it hands out.
+  return context.singletonManager().getTyped<FunctionStatsRegistry>(
+      SINGLETON_MANAGER_REGISTERED_NAME(aws_lambda_function_stats_registry),
+      [&context] {
+        return std::make_shared<FunctionStatsRegistry>(context.scope());
+      },
+      true);
+}
+
+FunctionStatsConstSharedPtr
+FunctionStatsRegistry::stats(absl::string_view function,
+                             absl::string_view qualifier) {
+  absl::erase_if(stats_, [](const auto &entry) {
+    return entry.second.expired();
+  });
+  std::weak_ptr<const FunctionStats> &entry =
+      stats_[{std::string(function), std::string(qualifier)}];
+  FunctionStatsConstSharedPtr stats = entry.lock();
+  if (stats == nullptr) {
+    stats = std::make_shared<const FunctionStats>(scope_, function, qualifier);
+    entry = stats;
+  }
+  return stats;
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
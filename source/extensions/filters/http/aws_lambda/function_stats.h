@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "envoy/common/time.h"
+#include "envoy/server/factory_context.h"
+#include "envoy/singleton/instance.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats.h"
+
+#include "source/common/stats/symbol_table.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Creates the stats of one function and qualifier under a prefix. The
+ * function and the qualifier are set as the aws_lambda_function and
+ * aws_lambda_qualifier tags rather than put in the name, so the tag-extracted
+ * names are the same for every function, e.g. aws_lambda.function.invocations.
+ */
+class FunctionStatNames {
+public:
+  FunctionStatNames(Stats::SymbolTable &symbol_table, absl::string_view prefix,
+                    absl::string_view function, absl::string_view qualifier);
+
+  Stats::Counter &counter(Stats::Scope &scope, absl::string_view name);
+  Stats::Gauge &gauge(Stats::Scope &scope, absl::string_view name,
+                      Stats::Gauge::ImportMode import_mode);
+  Stats::Histogram &histogram(Stats::Scope &scope, absl::string_view name,
+                              Stats::Histogram::Unit unit);
+
+private:
+  Stats::StatNamePool pool_;
+  const Stats::StatName prefix_;
+  const Stats::StatNameTagVector tags_;
+};
+
+/**
+ * Stats of the invocations of one function and qualifier, named by
+ * FunctionStatNames under aws_lambda.function. Routes that invoke the same
+ * function and qualifier share them through the FunctionStatsRegistry.
+ */
+class FunctionStats {
+  // Declared first so that it is initialized before the stats.
+  FunctionStatNames names_;
+
+public:
+  // An invocation is estimated to be a cold start when the function had no
+  // invocation through Envoy for this long, which is about
+  // when Lambda reclaims idle execution environments.
+  static constexpr std::chrono::minutes ColdStartIdleTime{10};
+
+  FunctionStats(Stats::Scope &scope, absl::string_view function,
+                absl::string_view qualifier);
+
+  /**
+   * Counts an invocation that is being sent.
+   * @param now supplies the time it is sent at.
+   */
+  void invocationStarted(MonotonicTime now) const;
+
+  Stats::Counter &invocations_;
+  Stats::Counter &function_errors_;
+  Stats::Counter &throttles_;
+  Stats::Counter &estimated_cold_starts_;
+  // from the time the request is sent until the response headers arrive.
+  Stats::Histogram &invocation_time_;
+  Stats::Histogram &credentials_wait_time_;
+  Stats::Histogram &signing_time_;
+  Stats::Histogram &request_payload_size_;
+  Stats::Histogram &response_payload_size_;
+
+private:
+  // the monotonic time of the last invocation in nanoseconds, 0 if none.
+  mutable std::atomic<int64_t> last_invocation_ns_{0};
+};
+
+using FunctionStatsConstSharedPtr = std::shared_ptr<const FunctionStats>;
+
+/**
+ * Hands out the stats of each function and qualifier of a server. The stats
+ * are kept while a route config refers to them, so a config push that keeps a
+ * function keeps the time of its last invocation rather than estimating a
+ * cold start for its next one. Used on the main thread.
+ */
+class FunctionStatsRegistry : public Singleton::Instance {
+public:
+  explicit FunctionStatsRegistry(Stats::Scope &scope) : scope_(scope) {}
+
+  /**
+   * @return the registry of the server, which lives as long as the server.
+   */
+  static std::shared_ptr<FunctionStatsRegistry>
+  get(Server::Configuration::ServerFactoryContext &context);
+
+  FunctionStatsConstSharedPtr stats(absl::string_view function,
+                                    absl::string_view qualifier);
+
+private:
+  Stats::Scope &scope_;
+  absl::flat_hash_map<std::pair<std::string, std::string>,
+                      std::weak_ptr<const FunctionStats>>
+      stats_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,70 @@
+#include "source/extensions/filters/http/aws_lambda/route_resolution_cache.h"
+
+#include "source/common/http/solo_filter_utility.h"
+#include "source/common/http/utility.h"
+
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+// Caches are cleared when they grow past this, so that cluster names taken
+// from request headers don't accumulate.
+constexpr size_t MaxEntries = 4096;
+} // namespace
+
+RouteResolutionCache::RouteResolutionCache(
+    ThreadLocal::SlotAllocator &tls, Upstream::ClusterManager &cluster_manager)
+    : cluster_manager_(cluster_manager), tls_(tls) {
+  tls_.set([](Event::Dispatcher &) {
+    return std::make_shared<ThreadLocalCache>();
+  });
+}
+
+RouteResolutionCache::Resolution RouteResolutionCache::resolve(
+    Http::StreamDecoderFilterCallbacks &callbacks) const {
+  Router::RouteConstSharedPtr route = callbacks.route();
+  if (route == nullptr || route->routeEntry() == nullptr) {
+    return {};
+  }
+  const std::string &cluster_name = route->routeEntry()->clusterName();
+
+  ThreadLocalCache &cache = tls_.get().ref();
+  if (cache.callbacks_handle_ == nullptr) {
+    cache.callbacks_handle_ =
+        cluster_manager_.addThreadLocalClusterUpdateCallbacks(cache);
+  }
+
+  auto it = cache.protocol_options_.find(cluster_name);
+  if (it == cache.protocol_options_.end()) {
+    if (cache.protocol_options_.size() >= MaxEntries) {
+      cache.protocol_options_.clear();
+    }
+    // a cluster that doesn't exist yet is cached as well, as adding it clears
+    // the cache.
+    it = cache.protocol_options_
+             .emplace(cluster_name,
+                      Http::SoloFilterUtility::resolveProtocolOptions<
+                          const AWSLambdaProtocolExtensionConfig>(
+                          SoloHttpFilterNames::get().AwsLambda, &callbacks,
+                          cluster_manager_))
+             .first;
+  }
+
+  Resolution resolution;
+  resolution.protocol_options = it->second;
+  if (resolution.protocol_options != nullptr) {
+    resolution.function_on_route =
+        Http::Utility::resolveMostSpecificPerFilterConfig<AWSLambdaRouteConfig>(
+            &callbacks);
+  }
+  return resolution;
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
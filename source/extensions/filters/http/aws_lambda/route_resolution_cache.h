@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "envoy/http/filter.h"
+#include "envoy/thread_local/thread_local.h"
+#include "envoy/upstream/cluster_manager.h"
+
+#include "source/extensions/filters/http/aws_lambda/config.h"
+
+#include "absl/container/flat_hash_map.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Memoizes, on each worker, the protocol options of the clusters routes
+ * select, so they aren't looked up by name for every request. The options are
+ * keyed by cluster name rather than by route, as routes that select their
+ * cluster from a header build a new route object for every request. A cache is
+ * used by a single filter config, and is cleared whenever a cluster is added,
+ * updated or removed on the worker.
+ */
+class RouteResolutionCache {
+public:
+  struct Resolution {
+    SharedAWSLambdaProtocolExtensionConfig protocol_options;
+    const AWSLambdaRouteConfig *function_on_route{};
+  };
+
+  RouteResolutionCache(ThreadLocal::SlotAllocator &tls,
+                       Upstream::ClusterManager &cluster_manager);
+
+  /**
+   * Resolves the protocol options and function config for the stream's route.
+   * Either is null if the stream has no route, or the route or its cluster
+   * doesn't configure it. The function config is looked up on the route, which
+   * doesn't involve the cluster manager. Must be called on a worker.
+   */
+  Resolution resolve(Http::StreamDecoderFilterCallbacks &callbacks) const;
+
+private:
+  class ThreadLocalCache : public ThreadLocal::ThreadLocalObject,
+                           public Upstream::ClusterUpdateCallbacks {
+  public:
+    // Upstream::ClusterUpdateCallbacks
+    void onClusterAddOrUpdate(absl::string_view,
+                              Upstream::ThreadLocalClusterCommand &) override {
+      protocol_options_.clear();
+    }
+    void onClusterRemoval(const std::string &) override {
+      protocol_options_.clear();
+    }
+
+    // null for clusters that don't exist or don't configure protocol options.
+    absl::flat_hash_map<std::string, SharedAWSLambdaProtocolExtensionConfig>
+        protocol_options_;
+    // Registered on first use, as the cluster manager may not exist yet when
+    // the slot is set.
+    Upstream::ClusterUpdateCallbacksHandlePtr callbacks_handle_;
+  };
+
+  Upstream::ClusterManager &cluster_manager_;
+  ThreadLocal::TypedSlot<ThreadLocalCache> tls_;
+};
+
+using RouteResolutionCacheSharedPtr = std::shared_ptr<RouteResolutionCache>;
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -11,6 +11,7 @@
 #include "source/common/common/macros.h"
 #include "source/common/common/utility.h"
 #include "source/common/grpc/common.h"
+#include "source/common/http/header_snapshot.h"
 #include "source/common/http/solo_filter_utility.h"
 #include "source/common/http/utility.h"
 
@@ -31,8 +32,13 @@ typedef ConstSingleton<RcDetailsValues> RcDetails;
 
 NatsStreamingFilter::NatsStreamingFilter(
     NatsStreamingFilterConfigSharedPtr config,
-    Envoy::Nats::Streaming::ClientPtr nats_streaming_client)
-    : config_(config), nats_streaming_client_(nats_streaming_client) {}
+    Envoy::Nats::Streaming::ClientPtr nats_streaming_client,
+    Stats::FilterCpuStatsConstSharedPtr cpu_stats,
+    NatsStreamingCompressionStatsConstSharedPtr compression_stats)
+    : config_(config), nats_streaming_client_(nats_streaming_client),
+      cpu_stats_(std::move(cpu_stats)),
+      cpu_sampled_(cpu_stats_ != nullptr && cpu_stats_->sample()),
+      compression_stats_(std::move(compression_stats)) {}
 
 NatsStreamingFilter::~NatsStreamingFilter() {}
 
@@ -42,27 +48,30 @@ void NatsStreamingFilter::onDestroy() {
     in_flight_request_->cancel();
     in_flight_request_ = nullptr;
   }
+  if (cpu_sampled_) {
+    cpu_account_.flush(*cpu_stats_,
+                       decoder_callbacks_->streamInfo().getRouteName());
+  }
 }
 
 Http::FilterHeadersStatus
 NatsStreamingFilter::decodeHeaders(Envoy::Http::RequestHeaderMap &headers,
                                    bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeHeaders);
   retrieveRouteSpecificFilterConfig();
 
   if (!isActive()) {
     return Http::FilterHeadersStatus::Continue;
   }
 
-  // Fill in the headers.
-  // TODO(talnordan): Consider extracting a common utility function which
-  // converts a `HeaderMap` to a Protobuf `Map`, to reduce code duplication
-  // with `Filters::Common::ExtAuthz::CheckRequestUtils::setHttpRequest()`.
+  // Fill in the headers. A repeated header keeps its last value, which is
+  // what consumers of the payload have always received.
   auto *mutable_headers = payload_.mutable_headers();
-  headers.iterate([mutable_headers](const Envoy::Http::HeaderEntry &e) {
-    (*mutable_headers)[std::string(e.key().getStringView())] =
-        std::string(e.value().getStringView());
-    return Envoy::Http::HeaderMap::Iterate::Continue;
-  });
+  const Http::HeaderSnapshot snapshot(headers);
+  for (const auto &entry : snapshot.entries()) {
+    (*mutable_headers)[std::string(entry.key)] =
+        std::string(entry.values.back());
+  }
 
   if (end_stream) {
     relayToNatsStreaming();
@@ -74,6 +83,7 @@ NatsStreamingFilter::decodeHeaders(Envoy::Http::RequestHeaderMap &headers,
 Http::FilterDataStatus
 NatsStreamingFilter::decodeData(Envoy::Buffer::Instance &data,
                                 bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeData);
   if (!isActive()) {
     return Http::FilterDataStatus::Continue;
   }
@@ -104,6 +114,7 @@ NatsStreamingFilter::decodeData(Envoy::Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 NatsStreamingFilter::decodeTrailers(Envoy::Http::RequestTrailerMap &) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeTrailers);
   if (!isActive()) {
     return Http::FilterTrailersStatus::Continue;
   }
@@ -154,9 +165,19 @@ void NatsStreamingFilter::relayToNatsStreaming() {
   const std::string &discover_prefix =
       route_specific_filter_config->discoverPrefix();
 
-  // TODO(talnordan): Consider minimizing content copying.
-  payload_.set_body(body_.toString());
-  std::string payload_string = payload_.SerializeAsString();
+  std::string payload_string;
+  {
+    Stats::ScopedCpuTimer timer(Stats::CpuStep::PayloadSerialize);
+    const PayloadCompressor *compressor =
+        route_specific_filter_config->compressor();
+    if (compressor != nullptr) {
+      payload_.set_body_encoding(
+          std::string(compressor->compress(body_, compression_stats_.get())));
+    }
+    // TODO(talnordan): Consider minimizing content copying.
+    payload_.set_body(body_.toString());
+    payload_string = payload_.SerializeAsString();
+  }
   in_flight_request_ = nats_streaming_client_->makeRequest(
       subject, cluster_id, discover_prefix, std::move(payload_string), *this);
 }
@@ -2,6 +2,8 @@
 
 #include "include/envoy/nats/streaming/client.h"
 
+#include "source/common/stats/cpu_accounting.h"
+
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_filter_config.h"
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_route_specific_filter_config.h"
 
@@ -20,7 +22,10 @@ class NatsStreamingFilter : public Http::StreamDecoderFilter,
                             public Envoy::Nats::Streaming::PublishCallbacks {
 public:
   NatsStreamingFilter(NatsStreamingFilterConfigSharedPtr config,
-                      Envoy::Nats::Streaming::ClientPtr nats_streaming_client);
+                      Envoy::Nats::Streaming::ClientPtr nats_streaming_client,
+                      Stats::FilterCpuStatsConstSharedPtr cpu_stats = nullptr,
+                      NatsStreamingCompressionStatsConstSharedPtr
+                          compression_stats = nullptr);
   ~NatsStreamingFilter();
 
   // Http::StreamFilterBase
@@ -55,6 +60,10 @@ private:
 
   void relayToNatsStreaming();
 
+  Stats::StreamCpuAccount *cpuAccount() {
+    return cpu_sampled_ ? &cpu_account_ : nullptr;
+  }
+
   inline void onCompletion(Http::Code response_code,
                            const std::string &body_text);
 
@@ -72,6 +81,10 @@ private:
   pb::Payload payload_;
   Buffer::OwnedImpl body_{};
   Envoy::Nats::Streaming::PublishRequestPtr in_flight_request_{};
+  Stats::FilterCpuStatsConstSharedPtr cpu_stats_;
+  bool cpu_sampled_{};
+  Stats::StreamCpuAccount cpu_account_;
+  const NatsStreamingCompressionStatsConstSharedPtr compression_stats_;
 };
 
 } // namespace Streaming
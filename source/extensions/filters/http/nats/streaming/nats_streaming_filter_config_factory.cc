@@ -1,5 +1,6 @@
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_filter_config_factory.h"
 
+#include "envoy/init/manager.h"
 #include "envoy/registry/registry.h"
 
 #include "source/common/nats/codec_impl.h"
@@ -8,6 +9,7 @@
 
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_filter.h"
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_filter_config.h"
+#include "source/extensions/filters/http/nats/streaming/nats_streaming_preconnector.h"
 #include "source/extensions/filters/http/nats/streaming/nats_streaming_route_specific_filter_config.h"
 
 namespace Envoy {
@@ -20,7 +22,8 @@ Http::FilterFactoryCb
 NatsStreamingFilterConfigFactory::createFilterFactoryFromProtoTyped(
     const envoy::config::filter::http::nats::streaming::v2::NatsStreaming
         &proto_config,
-    const std::string &, Server::Configuration::FactoryContext &context) {
+    const std::string &stats_prefix,
+    Server::Configuration::FactoryContext &context) {
 
   NatsStreamingFilterConfigSharedPtr config =
       std::make_shared<NatsStreamingFilterConfig>(
@@ -31,14 +34,49 @@ NatsStreamingFilterConfigFactory::createFilterFactoryFromProtoTyped(
                                            Envoy::Nats::EncoderImpl,
                                            Envoy::Nats::DecoderImpl>::instance_;
 
-  Envoy::Nats::Streaming::ClientPtr nats_streaming_client =
-      std::make_shared<Envoy::Nats::Streaming::ClientPool>(
-          config->cluster(), context.serverFactoryContext().clusterManager(), client_factory,
-          context.serverFactoryContext().threadLocal(), context.serverFactoryContext().api().randomGenerator(), config->opTimeout());
+  auto client_pool = std::make_shared<Envoy::Nats::Streaming::ClientPool>(
+      config->cluster(), context.serverFactoryContext().clusterManager(),
+      client_factory, context.serverFactoryContext().threadLocal(),
+      context.serverFactoryContext().api().randomGenerator(),
+      config->opTimeout());
+  Envoy::Nats::Streaming::ClientPtr nats_streaming_client = client_pool;
 
-  return [config, nats_streaming_client](
+  NatsStreamingPreconnectorSharedPtr preconnector;
+  if (proto_config.has_preconnect()) {
+    Event::Dispatcher &main_dispatcher =
+        context.serverFactoryContext().mainThreadDispatcher();
+    // the workers start once the server's init manager is initialized, and
+    // the listener of this config can only wait for them after that.
+    const bool workers_started =
+        context.serverFactoryContext().initManager().state() ==
+        Init::Manager::State::Initialized;
+    preconnector = std::make_shared<NatsStreamingPreconnector>(
+        proto_config.preconnect(),
+        [client_pool, &main_dispatcher,
+         cluster_id = proto_config.preconnect().cluster_id(),
+         discover_prefix = proto_config.preconnect().discover_prefix()](
+            NatsStreamingPreconnector::ConnectedCb on_connected,
+            NatsStreamingPreconnector::StartedCb on_started) {
+          client_pool->preconnect(cluster_id, discover_prefix,
+                                  main_dispatcher, std::move(on_connected),
+                                  std::move(on_started));
+        },
+        main_dispatcher, context.initManager(), workers_started,
+        context.scope(), stats_prefix + "nats_streaming.preconnect.");
+  }
+
+  auto cpu_stats = std::make_shared<const Stats::FilterCpuStats>(
+      context.scope(), stats_prefix + "nats_streaming.cpu",
+      context.serverFactoryContext().runtime());
+  auto compression_stats = generateCompressionStats(
+      context.scope(), stats_prefix + "nats_streaming.compression.");
+
+  // the preconnector lives as long as the filter factory.
+  return [config, nats_streaming_client, cpu_stats, compression_stats,
+          preconnector](
              Envoy::Http::FilterChainFactoryCallbacks &callbacks) -> void {
-    auto filter = new NatsStreamingFilter(config, nats_streaming_client);
+    auto filter = new NatsStreamingFilter(config, nats_streaming_client,
+                                          cpu_stats, compression_stats);
     callbacks.addStreamDecoderFilter(
         Http::StreamDecoderFilterSharedPtr{filter});
   };
@@ -0,0 +1,102 @@
+#include "source/extensions/filters/http/nats/streaming/nats_streaming_preconnector.h"
+
+#include "source/common/protobuf/utility.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+NatsStreamingPreconnector::NatsStreamingPreconnector(
+    const PreconnectProto &config, PreconnectFn preconnect,
+    Event::Dispatcher &main_dispatcher, Init::Manager &init_manager,
+    bool workers_started, Stats::Scope &scope, const std::string &stats_prefix)
+    : preconnect_(std::move(preconnect)), main_dispatcher_(main_dispatcher),
+      stats_{ALL_NATS_STREAMING_PRECONNECT_STATS(
+          POOL_COUNTER_PREFIX(scope, stats_prefix),
+          POOL_GAUGE_PREFIX(scope, stats_prefix),
+          POOL_HISTOGRAM_PREFIX(scope, stats_prefix))},
+      gate_readiness_(config.has_readiness_timeout() && workers_started),
+      readiness_timeout_(
+          PROTOBUF_GET_MS_OR_DEFAULT(config, readiness_timeout, 0)),
+      init_target_("nats_streaming preconnect", [this]() { start(); }) {
+  if (config.has_readiness_timeout() && !workers_started) {
+    ENVOY_LOG(debug, "nats-streaming filter: not waiting for workers to "
+                     "connect, since they start once the server is ready");
+  }
+  init_manager.add(init_target_);
+}
+
+void NatsStreamingPreconnector::start() {
+  started_at_ = main_dispatcher_.timeSource().monotonicTime();
+  if (gate_readiness_) {
+    readiness_timer_ =
+        main_dispatcher_.createTimer([this]() { onReadinessTimeout(); });
+    readiness_timer_->enableTimer(readiness_timeout_);
+  } else {
+    init_target_.ready();
+  }
+
+  // workers report back through the main dispatcher, where the preconnector
+  // may have been destroyed meanwhile.
+  std::weak_ptr<NatsStreamingPreconnector> weak_this = weak_from_this();
+  Event::Dispatcher &main_dispatcher = main_dispatcher_;
+  preconnect_(
+      [weak_this, &main_dispatcher]() {
+        main_dispatcher.post([weak_this]() {
+          if (auto self = weak_this.lock()) {
+            self->onWorkerConnected();
+          }
+        });
+      },
+      [weak_this](uint32_t workers) {
+        if (auto self = weak_this.lock()) {
+          self->onStarted(workers);
+        }
+      });
+}
+
+void NatsStreamingPreconnector::onStarted(uint32_t workers) {
+  all_started_ = true;
+  workers_ = workers;
+  maybeReady();
+}
+
+void NatsStreamingPreconnector::onWorkerConnected() {
+  connected_workers_++;
+  stats_.workers_connected_.inc();
+  stats_.connect_time_.recordValue(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          main_dispatcher_.timeSource().monotonicTime() - started_at_)
+          .count());
+  maybeReady();
+}
+
+void NatsStreamingPreconnector::onReadinessTimeout() {
+  stats_.readiness_timeout_.inc();
+  ENVOY_LOG(warn,
+            "nats-streaming filter: becoming ready with {} of {} workers "
+            "connected",
+            connected_workers_, all_started_ ? std::to_string(workers_) : "?");
+  init_target_.ready();
+}
+
+void NatsStreamingPreconnector::maybeReady() {
+  if (ready_ || !all_started_ || connected_workers_ < workers_) {
+    return;
+  }
+  ready_ = true;
+  stats_.ready_.set(1);
+  ENVOY_LOG(debug, "nats-streaming filter: {} workers connected", workers_);
+  if (readiness_timer_ != nullptr) {
+    readiness_timer_->disableTimer();
+  }
+  init_target_.ready();
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/init/manager.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "source/common/common/logger.h"
+#include "source/common/init/target_impl.h"
+
+#include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+/**
+ * All NATS Streaming preconnect stats. @see stats_macros.h
+ */
+#define ALL_NATS_STREAMING_PRECONNECT_STATS(COUNTER, GAUGE, HISTOGRAM)         \
+  COUNTER(workers_connected)                                                   \
+  COUNTER(readiness_timeout)                                                   \
+  GAUGE(ready, NeverImport)                                                    \
+  HISTOGRAM(connect_time, Milliseconds)
+
+/**
+ * Struct definition for all NATS Streaming preconnect stats. @see
+ * stats_macros.h
+ */
+struct NatsStreamingPreconnectStats {
+  ALL_NATS_STREAMING_PRECONNECT_STATS(GENERATE_COUNTER_STRUCT,
+                                      GENERATE_GAUGE_STRUCT,
+                                      GENERATE_HISTOGRAM_STRUCT)
+};
+
+/**
+ * Connects the NATS Streaming clients of all workers once the filter config is
+ * initialized. The ready gauge is set once all of them are connected. If a
+ * readiness timeout is configured and the workers are already running, the
+ * init target only becomes ready then, or when the timeout passes. At startup
+ * the workers only run once the server is initialized, which waits for the
+ * init target, so it is never held then. Must be owned by a shared_ptr, since
+ * workers report back to it through the main dispatcher.
+ */
+class NatsStreamingPreconnector
+    : public std::enable_shared_from_this<NatsStreamingPreconnector>,
+      public Logger::Loggable<Logger::Id::filter> {
+public:
+  using PreconnectProto = envoy::config::filter::http::nats::streaming::v2::
+      NatsStreaming::Preconnect;
+  // Called on a worker once its client is connected.
+  using ConnectedCb = std::function<void()>;
+  // Called on the main thread once every worker started connecting.
+  using StartedCb = std::function<void(uint32_t workers)>;
+  // Starts connecting the clients, @see ClientPool::preconnect.
+  using PreconnectFn = std::function<void(ConnectedCb, StartedCb)>;
+
+  /**
+   * @param workers_started supplies whether the workers are running, which
+   * they are once the server is initialized, e.g. for listeners added by LDS.
+   */
+  NatsStreamingPreconnector(const PreconnectProto &config,
+                            PreconnectFn preconnect,
+                            Event::Dispatcher &main_dispatcher,
+                            Init::Manager &init_manager, bool workers_started,
+                            Stats::Scope &scope,
+                            const std::string &stats_prefix);
+
+  const NatsStreamingPreconnectStats &stats() const { return stats_; }
+
+private:
+  void start();
+  void onStarted(uint32_t workers);
+  void onWorkerConnected();
+  void onReadinessTimeout();
+  void maybeReady();
+
+  const PreconnectFn preconnect_;
+  Event::Dispatcher &main_dispatcher_;
+  NatsStreamingPreconnectStats stats_;
+  const bool gate_readiness_;
+  const std::chrono::milliseconds readiness_timeout_;
+  Event::TimerPtr readiness_timer_;
+  MonotonicTime started_at_;
+  bool all_started_{};
+  uint32_t workers_{};
+  uint32_t connected_workers_{};
+  bool ready_{};
+  Init::TargetImpl init_target_;
+};
+
+using NatsStreamingPreconnectorSharedPtr =
+    std::shared_ptr<NatsStreamingPreconnector>;
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
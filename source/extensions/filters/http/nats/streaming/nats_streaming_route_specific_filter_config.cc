@@ -10,7 +10,11 @@ NatsStreamingRouteSpecificFilterConfig::NatsStreamingRouteSpecificFilterConfig(
     const envoy::config::filter::http::nats::streaming::v2::
         NatsStreamingPerRoute &proto_config)
     : subject_(proto_config.subject()), cluster_id_(proto_config.cluster_id()),
-      discover_prefix_(proto_config.discover_prefix()) {}
+      discover_prefix_(proto_config.discover_prefix()),
+      compressor_(proto_config.has_compression()
+                      ? std::make_unique<const PayloadCompressor>(
+                            proto_config.compression())
+                      : nullptr) {}
 
 } // namespace Streaming
 } // namespace Nats
@@ -2,6 +2,8 @@
 
 #include "envoy/router/router.h"
 
+#include "source/extensions/filters/http/nats/streaming/payload_compressor.h"
+
 #include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
 
 namespace Envoy {
@@ -20,11 +22,15 @@ public:
   const std::string &subject() const { return subject_; }
   const std::string &clusterId() const { return cluster_id_; }
   const std::string &discoverPrefix() const { return discover_prefix_; }
+  // @return the compressor of the payload body, or nullptr if the route
+  // doesn't compress.
+  const PayloadCompressor *compressor() const { return compressor_.get(); }
 
 private:
   const std::string subject_;
   const std::string cluster_id_;
   const std::string discover_prefix_;
+  const PayloadCompressorConstPtr compressor_;
 };
 
 } // namespace Streaming
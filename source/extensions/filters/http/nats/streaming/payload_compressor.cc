@@ -0,0 +1,109 @@
+#include "source/extensions/filters/http/nats/streaming/payload_compressor.h"
+
+#include "envoy/common/exception.h"
+#include "envoy/stats/histogram.h"
+
+#include "source/common/stats/cpu_accounting.h"
+#include "source/extensions/compression/gzip/compressor/zlib_compressor_impl.h"
+
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+namespace {
+
+using Compression::Gzip::Compressor::ZlibCompressorImpl;
+
+// Defaults of the envoy.compression.* library extensions.
+constexpr uint32_t ChunkSize = 4096;
+// 15 window bits plus 16 selects the gzip wrapper instead of zlib.
+constexpr int64_t GzipWindowBits = 15 | 16;
+constexpr uint64_t GzipMemoryLevel = 5;
+constexpr uint32_t ZstdCompressionLevel = 3;
+constexpr uint32_t ZstdMaxCompressionLevel = 22;
+constexpr uint32_t GzipMaxCompressionLevel = 9;
+
+int64_t compressionLevel(const PayloadCompressor::CompressionProto &config) {
+  const bool zstd =
+      config.codec() == PayloadCompressor::CompressionProto::ZSTD;
+  if (!config.has_level()) {
+    return zstd ? ZstdCompressionLevel
+                : static_cast<int64_t>(
+                      ZlibCompressorImpl::CompressionLevel::Standard);
+  }
+  const uint32_t level = config.level().value();
+  const uint32_t max_level =
+      zstd ? ZstdMaxCompressionLevel : GzipMaxCompressionLevel;
+  if (level < 1 || level > max_level) {
+    throw EnvoyException(fmt::format(
+        "nats-streaming filter: {} compression level must be between 1 and {}",
+        zstd ? "zstd" : "gzip", max_level));
+  }
+  return level;
+}
+
+} // namespace
+
+NatsStreamingCompressionStatsConstSharedPtr
+generateCompressionStats(Stats::Scope &scope, const std::string &prefix) {
+  return std::make_shared<const NatsStreamingCompressionStats>(
+      NatsStreamingCompressionStats{ALL_NATS_STREAMING_COMPRESSION_STATS(
+          POOL_COUNTER_PREFIX(scope, prefix),
+          POOL_HISTOGRAM_PREFIX(scope, prefix))});
+}
+
+PayloadCompressor::PayloadCompressor(const CompressionProto &proto_config)
+    : codec_(proto_config.codec()), level_(compressionLevel(proto_config)),
+      min_size_bytes_(proto_config.min_size_bytes()) {}
+
+absl::string_view
+PayloadCompressor::compress(Buffer::Instance &body,
+                            const NatsStreamingCompressionStats *stats) const {
+  const uint64_t uncompressed_size = body.length();
+  // an empty body doesn't get smaller.
+  if (uncompressed_size == 0 || uncompressed_size < min_size_bytes_) {
+    if (stats != nullptr) {
+      stats->skipped_below_min_size_.inc();
+    }
+    return "";
+  }
+
+  const uint64_t start = Stats::cpuClockNs();
+  createCompressor()->compress(
+      body, Envoy::Compression::Compressor::State::Finish);
+  const uint64_t elapsed_ns = Stats::cpuClockNs() - start;
+
+  if (stats != nullptr) {
+    const uint64_t compressed_size = body.length();
+    stats->compressed_.inc();
+    stats->uncompressed_bytes_.add(uncompressed_size);
+    stats->compressed_bytes_.add(compressed_size);
+    stats->compression_ratio_.recordValue(static_cast<uint64_t>(
+        compressed_size * Stats::Histogram::PercentScale / uncompressed_size));
+    stats->compression_time_.recordValue(elapsed_ns / 1000);
+  }
+  return codec_ == CompressionProto::ZSTD ? "zstd" : "gzip";
+}
+
+Envoy::Compression::Compressor::CompressorPtr
+PayloadCompressor::createCompressor() const {
+  if (codec_ == CompressionProto::ZSTD) {
+    return std::make_unique<Compression::Zstd::Compressor::ZstdCompressorImpl>(
+        level_, false, 0, cdict_manager_, ChunkSize);
+  }
+  auto compressor = std::make_unique<ZlibCompressorImpl>(ChunkSize);
+  compressor->init(static_cast<ZlibCompressorImpl::CompressionLevel>(level_),
+                   ZlibCompressorImpl::CompressionStrategy::Standard,
+                   GzipWindowBits, GzipMemoryLevel);
+  return compressor;
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
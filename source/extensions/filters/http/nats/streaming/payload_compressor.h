@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/compression/compressor/compressor.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "source/extensions/compression/zstd/compressor/zstd_compressor_impl.h"
+
+#include "absl/strings/string_view.h"
+#include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+/**
+ * All NATS Streaming payload compression stats. @see stats_macros.h
+ */
+#define ALL_NATS_STREAMING_COMPRESSION_STATS(COUNTER, HISTOGRAM)               \
+  COUNTER(compressed)                                                          \
+  COUNTER(skipped_below_min_size)                                              \
+  COUNTER(uncompressed_bytes)                                                  \
+  COUNTER(compressed_bytes)                                                    \
+  HISTOGRAM(compression_ratio, Percent)                                        \
+  HISTOGRAM(compression_time, Microseconds)
+
+/**
+ * Struct definition for all NATS Streaming payload compression stats. @see
+ * stats_macros.h
+ */
+struct NatsStreamingCompressionStats {
+  ALL_NATS_STREAMING_COMPRESSION_STATS(GENERATE_COUNTER_STRUCT,
+                                       GENERATE_HISTOGRAM_STRUCT)
+};
+
+using NatsStreamingCompressionStatsConstSharedPtr =
+    std::shared_ptr<const NatsStreamingCompressionStats>;
+
+NatsStreamingCompressionStatsConstSharedPtr
+generateCompressionStats(Stats::Scope &scope, const std::string &prefix);
+
+/**
+ * Compresses the body of published payloads with the codec of a route.
+ */
+class PayloadCompressor {
+public:
+  using CompressionProto = envoy::config::filter::http::nats::streaming::v2::
+      NatsStreamingPerRoute::Compression;
+
+  // Throws EnvoyException if the level is out of range for the codec.
+  explicit PayloadCompressor(const CompressionProto &proto_config);
+
+  /**
+   * Compresses the body in place, unless it is smaller than the minimum size.
+   * @param body supplies the body to compress.
+   * @param stats supplies the stats to record to, or nullptr.
+   * @return the value of the body_encoding field of the payload, which is
+   * empty if the body was left uncompressed.
+   */
+  absl::string_view compress(Buffer::Instance &body,
+                             const NatsStreamingCompressionStats *stats) const;
+
+private:
+  Envoy::Compression::Compressor::CompressorPtr createCompressor() const;
+
+  const CompressionProto::Codec codec_;
+  const int64_t level_;
+  const uint64_t min_size_bytes_;
+  // zstd dictionaries are not supported, the compressor still needs a manager.
+  const Compression::Zstd::Compressor::ZstdCDictManagerPtr cdict_manager_;
+};
+
+using PayloadCompressorConstPtr = std::unique_ptr<const PayloadCompressor>;
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,7 +1,9 @@
 #include "source/extensions/filters/http/transformation/body_header_transformer.h"
 
+#include "source/common/http/header_snapshot.h"
 #include "source/common/http/headers.h"
 #include "source/common/http/utility.h"
+#include "source/extensions/filters/http/transformation/buffer_stream.h"
 
 #include "nlohmann/json.hpp"
 
@@ -25,16 +27,29 @@ void BodyHeaderTransformer::transform(
     json_body["body"] = body.toString();
   }
 
-  auto headers = std::map<std::string, std::string>{};
-  // multi_value_headers will not be populated if add_request_metadata_ is false
-  auto multi_value_headers = std::map<std::string, std::vector<std::string>>{};
-  parse_headers(header_map, headers, multi_value_headers);
-  json_body["headers"] = headers;
+  // the snapshot is only used before the header map is modified below.
+  const Http::HeaderSnapshot snapshot(header_map);
+  json &headers = json_body["headers"] = json::object();
+  for (const auto &entry : snapshot.entries()) {
+    // If there are more than one headers with the same key, use the last one
+    headers[std::string(entry.key)] = entry.values.back();
+  }
 
   if (add_request_metadata_) {
     if (request_headers == (&header_map)){
       // this is a request!
-      json_body["multiValueHeaders"] = multi_value_headers;
+      json &multi_value_headers = json_body["multiValueHeaders"] =
+          json::object();
+      for (const auto &entry : snapshot.entries()) {
+        if (entry.values.size() < 2) {
+          continue;
+        }
+        json &values = multi_value_headers[std::string(entry.key)] =
+            json::array();
+        for (const absl::string_view value : entry.values) {
+          values.emplace_back(value);
+        }
+      }
       const Http::HeaderString& path = request_headers->Path()->value();
       absl::string_view query_string = Http::Utility::findQueryStringStart(path);
       absl::string_view path_view = path.getStringView();
@@ -64,48 +79,10 @@ void BodyHeaderTransformer::transform(
 
   // replace body
   body.drain(body.length());
-  body.add(json_body.dump());
+  dumpTo(json_body, body);
   header_map.setContentLength(body.length());
 }
 
-void BodyHeaderTransformer::parse_headers(
-  const Http::RequestOrResponseHeaderMap &header_map,
-  std::map<std::string, std::string> &headers,
-  std::map<std::string, std::vector<std::string>> &multi_value_headers) const {
-    if (add_request_metadata_) {
-      header_map.iterate(
-        [&headers, &multi_value_headers](const Http::HeaderEntry& header) -> Http::HeaderMap::Iterate {
-            auto header_key = std::string(header.key().getStringView());
-            auto header_value = std::string(header.value().getStringView());
-            // If there are more than one headers with the same key, use the last one
-            auto existing_header_value = headers[header_key];
-            headers[header_key] = header_value;
-
-            // If there is no existing value, we don't need to do anything else
-            if (existing_header_value.empty()) {
-                return Http::HeaderMap::Iterate::Continue;
-            }
-
-            // If this is the second time we've seen this header, we need to add the first value to
-            // multi_value_headers
-            if (multi_value_headers[header_key].empty()) {
-                multi_value_headers[header_key].emplace_back(existing_header_value);
-            }
-
-            // Add the current value to multi_value_headers
-            multi_value_headers[header_key].emplace_back(header_value);
-            return Http::HeaderMap::Iterate::Continue;
-        });
-    } else {
-      header_map.iterate(
-      [&headers](const Http::HeaderEntry &header) -> Http::HeaderMap::Iterate {
-        headers[std::string(header.key().getStringView())] =
-            std::string(header.value().getStringView());
-        return Http::HeaderMap::Iterate::Continue;
-      });
-    }
-}
-
 void BodyHeaderTransformer::parse_query_string(
   absl::string_view query_string,
   std::map<std::string, std::string> &query_string_parameters,
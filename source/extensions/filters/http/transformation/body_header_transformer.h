@@ -18,9 +18,6 @@ public:
                  Buffer::Instance &body,
                  Http::StreamFilterCallbacks &) const override;
   bool passthrough_body() const override { return false; };
-  void parse_headers(const Http::RequestOrResponseHeaderMap &header_map,
-                     std::map<std::string, std::string> &headers,
-                     std::map<std::string, std::vector<std::string>> &multi_value_headers) const;
   void parse_query_string(absl::string_view query_string,
                         std::map<std::string, std::string> &query_string_parameters,
                         std::map<std::string, std::vector<std::string>> &multi_value_query_string_parameters) const;
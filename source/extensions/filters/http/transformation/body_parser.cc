@@ -0,0 +1,379 @@
+#include "source/extensions/filters/http/transformation/body_parser.h"
+
+#include "envoy/common/exception.h"
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "fmt/format.h"
+
+// For convenience
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool isXmlWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool isBlank(absl::string_view text) {
+  for (const char c : text) {
+    if (!isXmlWhitespace(c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void appendUtf8(uint32_t code_point, std::string &out) {
+  if (code_point < 0x80) {
+    out.push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+// Appends the input to out, replacing predefined and numeric character
+// references.
+void decodeEntities(absl::string_view input, std::string &out) {
+  size_t pos = 0;
+  while (true) {
+    const size_t amp = input.find('&', pos);
+    if (amp == absl::string_view::npos) {
+      out.append(input.data() + pos, input.size() - pos);
+      return;
+    }
+    out.append(input.data() + pos, amp - pos);
+    const size_t semi = input.find(';', amp);
+    if (semi == absl::string_view::npos) {
+      throw EnvoyException("unterminated XML entity");
+    }
+    const absl::string_view entity = input.substr(amp + 1, semi - amp - 1);
+    if (entity == "lt") {
+      out.push_back('<');
+    } else if (entity == "gt") {
+      out.push_back('>');
+    } else if (entity == "amp") {
+      out.push_back('&');
+    } else if (entity == "quot") {
+      out.push_back('"');
+    } else if (entity == "apos") {
+      out.push_back('\'');
+    } else if (entity.size() > 1 && entity[0] == '#') {
+      uint32_t code_point = 0;
+      const bool ok = (entity[1] == 'x' || entity[1] == 'X')
+                          ? absl::SimpleHexAtoi(entity.substr(2), &code_point)
+                          : absl::SimpleAtoi(entity.substr(1), &code_point);
+      if (!ok || code_point == 0 || code_point > 0x10FFFF) {
+        throw EnvoyException(
+            fmt::format("invalid XML character reference '&{};'", entity));
+      }
+      appendUtf8(code_point, out);
+    } else {
+      throw EnvoyException(fmt::format("unknown XML entity '&{};'", entity));
+    }
+    pos = semi + 1;
+  }
+}
+
+// An element that has been opened but not yet closed.
+struct XmlFrame {
+  absl::string_view name;
+  json value;
+  std::string text;
+};
+
+json finishElement(XmlFrame &frame) {
+  if (frame.value.empty()) {
+    return std::move(frame.text);
+  }
+  if (!isBlank(frame.text)) {
+    frame.value["#text"] = std::move(frame.text);
+  }
+  return std::move(frame.value);
+}
+
+void addChild(XmlFrame &parent, absl::string_view name, json &&child) {
+  std::string key(name);
+  auto it = parent.value.find(key);
+  if (it == parent.value.end()) {
+    parent.value.emplace(std::move(key), std::move(child));
+  } else if (it->is_array()) {
+    // finishElement never produces arrays, so an array here holds repeated
+    // siblings.
+    it->push_back(std::move(child));
+  } else {
+    json siblings = json::array();
+    siblings.push_back(std::move(*it));
+    siblings.push_back(std::move(child));
+    *it = std::move(siblings);
+  }
+}
+
+} // namespace
+
+void parseFormUrlEncoded(absl::string_view body, json &out) {
+  json result = json::object();
+  std::string key;
+  std::string value;
+  std::string *current = &key;
+
+  for (size_t i = 0; i <= body.size(); i++) {
+    if (i == body.size() || body[i] == '&') {
+      // skip empty pairs such as the one in "a=1&&b=2"
+      if (!key.empty() || current == &value) {
+        result[key] = value;
+      }
+      key.clear();
+      value.clear();
+      current = &key;
+      continue;
+    }
+
+    const char c = body[i];
+    if (c == '=' && current == &key) {
+      current = &value;
+    } else if (c == '+') {
+      current->push_back(' ');
+    } else if (c == '%' && i + 2 < body.size() && hexValue(body[i + 1]) >= 0 &&
+               hexValue(body[i + 2]) >= 0) {
+      current->push_back(
+          static_cast<char>(hexValue(body[i + 1]) << 4 | hexValue(body[i + 2])));
+      i += 2;
+    } else {
+      current->push_back(c);
+    }
+  }
+
+  out = std::move(result);
+}
+
+void parseXml(absl::string_view body, json &out) {
+  XmlPullParser parser(body);
+  std::vector<XmlFrame> open_elements;
+  json result;
+
+  while (true) {
+    switch (parser.next()) {
+    case XmlPullParser::Event::StartElement: {
+      if (open_elements.empty() && !result.is_null()) {
+        throw EnvoyException("XML document has more than one root element");
+      }
+      XmlFrame frame{parser.name(), json::object(), ""};
+      for (const auto &[name, value] : parser.attributes()) {
+        frame.value[absl::StrCat("@", name)] = value;
+      }
+      open_elements.emplace_back(std::move(frame));
+      break;
+    }
+    case XmlPullParser::Event::Text: {
+      if (open_elements.empty()) {
+        if (!isBlank(parser.text())) {
+          throw EnvoyException("XML character data outside of root element");
+        }
+        break;
+      }
+      open_elements.back().text.append(parser.text());
+      break;
+    }
+    case XmlPullParser::Event::EndElement: {
+      if (open_elements.empty() ||
+          open_elements.back().name != parser.name()) {
+        throw EnvoyException(
+            fmt::format("unexpected XML end tag '{}'", parser.name()));
+      }
+      XmlFrame frame = std::move(open_elements.back());
+      open_elements.pop_back();
+      json value = finishElement(frame);
+      if (open_elements.empty()) {
+        result = json::object();
+        result[std::string(frame.name)] = std::move(value);
+      } else {
+        addChild(open_elements.back(), frame.name, std::move(value));
+      }
+      break;
+    }
+    case XmlPullParser::Event::EndDocument: {
+      if (!open_elements.empty()) {
+        throw EnvoyException(fmt::format("unterminated XML element '{}'",
+                                         open_elements.back().name));
+      }
+      if (result.is_null()) {
+        throw EnvoyException("XML document has no root element");
+      }
+      out = std::move(result);
+      return;
+    }
+    }
+  }
+}
+
+XmlPullParser::Event XmlPullParser::next() {
+  if (pending_end_) {
+    pending_end_ = false;
+    attributes_.clear();
+    return Event::EndElement;
+  }
+  attributes_.clear();
+  text_.clear();
+
+  while (pos_ < input_.size()) {
+    if (input_[pos_] != '<') {
+      size_t end = input_.find('<', pos_);
+      if (end == absl::string_view::npos) {
+        end = input_.size();
+      }
+      decodeEntities(input_.substr(pos_, end - pos_), text_);
+      pos_ = end;
+      return Event::Text;
+    }
+
+    if (startsWith("<!--")) {
+      skipPast("-->");
+    } else if (startsWith("<![CDATA[")) {
+      const size_t start = pos_ + 9;
+      skipPast("]]>");
+      text_.append(input_.data() + start, pos_ - 3 - start);
+      return Event::Text;
+    } else if (startsWith("<?")) {
+      skipPast("?>");
+    } else if (startsWith("<!")) {
+      skipDeclaration();
+    } else if (startsWith("</")) {
+      pos_ += 2;
+      name_ = readName();
+      skipWhitespace();
+      if (!startsWith(">")) {
+        throw EnvoyException(
+            fmt::format("malformed XML end tag '{}'", name_));
+      }
+      pos_++;
+      return Event::EndElement;
+    } else {
+      pos_++;
+      name_ = readName();
+      while (true) {
+        skipWhitespace();
+        if (startsWith("/>")) {
+          pos_ += 2;
+          pending_end_ = true;
+          return Event::StartElement;
+        }
+        if (startsWith(">")) {
+          pos_++;
+          return Event::StartElement;
+        }
+        readAttribute();
+      }
+    }
+  }
+  return Event::EndDocument;
+}
+
+bool XmlPullParser::startsWith(absl::string_view prefix) const {
+  return input_.substr(pos_, prefix.size()) == prefix;
+}
+
+void XmlPullParser::skipWhitespace() {
+  while (pos_ < input_.size() && isXmlWhitespace(input_[pos_])) {
+    pos_++;
+  }
+}
+
+void XmlPullParser::skipPast(absl::string_view terminator) {
+  const size_t end = input_.find(terminator, pos_);
+  if (end == absl::string_view::npos) {
+    throw EnvoyException(
+        fmt::format("XML markup is missing terminator '{}'", terminator));
+  }
+  pos_ = end + terminator.size();
+}
+
+// Skips a <!DOCTYPE ...> declaration, including an internal subset.
+void XmlPullParser::skipDeclaration() {
+  int depth = 0;
+  for (pos_ += 2; pos_ < input_.size(); pos_++) {
+    const char c = input_[pos_];
+    if (c == '[') {
+      depth++;
+    } else if (c == ']') {
+      depth--;
+    } else if (c == '>' && depth <= 0) {
+      pos_++;
+      return;
+    }
+  }
+  throw EnvoyException("unterminated XML declaration");
+}
+
+absl::string_view XmlPullParser::readName() {
+  const size_t start = pos_;
+  while (pos_ < input_.size()) {
+    const char c = input_[pos_];
+    if (isXmlWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '<') {
+      break;
+    }
+    pos_++;
+  }
+  if (pos_ == start) {
+    throw EnvoyException("malformed XML: expected a name");
+  }
+  return input_.substr(start, pos_ - start);
+}
+
+void XmlPullParser::readAttribute() {
+  const absl::string_view name = readName();
+  skipWhitespace();
+  if (!startsWith("=")) {
+    throw EnvoyException(
+        fmt::format("XML attribute '{}' is missing a value", name));
+  }
+  pos_++;
+  skipWhitespace();
+  if (pos_ >= input_.size() || (input_[pos_] != '"' && input_[pos_] != '\'')) {
+    throw EnvoyException(
+        fmt::format("XML attribute '{}' value is not quoted", name));
+  }
+  const char quote = input_[pos_++];
+  const size_t end = input_.find(quote, pos_);
+  if (end == absl::string_view::npos) {
+    throw EnvoyException(
+        fmt::format("XML attribute '{}' value is not terminated", name));
+  }
+  std::string value;
+  decodeEntities(input_.substr(pos_, end - pos_), value);
+  attributes_.emplace_back(name, std::move(value));
+  pos_ = end + 1;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
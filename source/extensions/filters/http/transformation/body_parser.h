@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+// clang-format on
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Decodes an application/x-www-form-urlencoded body into a flat json object in
+ * a single pass. Keys and values are percent-decoded and '+' is decoded as a
+ * space. If a key is repeated the last value wins, like queryStringParameters
+ * in the BodyHeaderTransformer.
+ * @param body supplies the raw body.
+ * @param out receives the decoded object.
+ */
+void parseFormUrlEncoded(absl::string_view body, nlohmann::json &out);
+
+/**
+ * Parses an XML document into json. The root element becomes the single key of
+ * the resulting object. Elements with neither attributes nor child elements
+ * are rendered as strings; other elements are rendered as objects where
+ * attributes are prefixed with '@', non-blank character data is stored under
+ * '#text' and repeated child elements are collected into an array.
+ * Throws EnvoyException if the document is malformed.
+ * @param body supplies the raw body.
+ * @param out receives the parsed document.
+ */
+void parseXml(absl::string_view body, nlohmann::json &out);
+
+/**
+ * A minimal, non-validating XML pull parser. Names and attribute names are
+ * views into the input, so the input must outlive the parser. Comments,
+ * processing instructions and DOCTYPE declarations are skipped; CDATA
+ * sections are reported as text.
+ */
+class XmlPullParser {
+public:
+  enum class Event {
+    StartElement,
+    EndElement,
+    Text,
+    EndDocument,
+  };
+
+  explicit XmlPullParser(absl::string_view input) : input_(input) {}
+
+  /**
+   * Advances to the next event. Throws EnvoyException on malformed input.
+   */
+  Event next();
+
+  /**
+   * @return the element name of the current StartElement or EndElement event.
+   */
+  absl::string_view name() const { return name_; }
+
+  /**
+   * @return the entity-decoded attributes of the current StartElement event.
+   */
+  const std::vector<std::pair<absl::string_view, std::string>> &
+  attributes() const {
+    return attributes_;
+  }
+
+  /**
+   * @return the entity-decoded character data of the current Text event.
+   */
+  const std::string &text() const { return text_; }
+
+private:
+  bool startsWith(absl::string_view prefix) const;
+  void skipWhitespace();
+  void skipPast(absl::string_view terminator);
+  void skipDeclaration();
+  absl::string_view readName();
+  void readAttribute();
+
+  absl::string_view input_;
+  size_t pos_{};
+  absl::string_view name_;
+  std::vector<std::pair<absl::string_view, std::string>> attributes_;
+  std::string text_;
+  // set after a self-closing tag so the matching EndElement is reported next.
+  bool pending_end_{};
+};
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,32 @@
+#include "source/extensions/filters/http/transformation/buffer_stream.h"
+
+#include <ostream>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+std::streamsize BufferStreamBuf::xsputn(const char *s, std::streamsize n) {
+  buffer_.add(s, n);
+  return n;
+}
+
+BufferStreamBuf::int_type BufferStreamBuf::overflow(int_type c) {
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    const char ch = traits_type::to_char_type(c);
+    buffer_.add(&ch, 1);
+  }
+  return traits_type::not_eof(c);
+}
+
+void dumpTo(const nlohmann::json &value, Buffer::Instance &output) {
+  BufferStreamBuf streambuf(output);
+  std::ostream os(&streambuf);
+  os << value;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
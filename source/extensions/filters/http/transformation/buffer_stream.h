@@ -0,0 +1,40 @@
+#pragma once
+
+#include <streambuf>
+
+#include "envoy/buffer/buffer.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+// clang-format on
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * A streambuf that appends everything written to it to a Buffer::Instance, so
+ * that templates and json can be written directly into the output body.
+ */
+class BufferStreamBuf : public std::streambuf {
+public:
+  explicit BufferStreamBuf(Buffer::Instance &buffer) : buffer_(buffer) {}
+
+protected:
+  std::streamsize xsputn(const char *s, std::streamsize n) override;
+  int_type overflow(int_type c) override;
+
+private:
+  Buffer::Instance &buffer_;
+};
+
+/**
+ * Appends the serialized json to output without an intermediate string.
+ */
+void dumpTo(const nlohmann::json &value, Buffer::Instance &output);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
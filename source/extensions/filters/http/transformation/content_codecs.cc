@@ -0,0 +1,231 @@
+#include "source/extensions/filters/http/transformation/content_codecs.h"
+
+#include "source/extensions/compression/brotli/compressor/brotli_compressor_impl.h"
+#include "source/extensions/compression/gzip/compressor/zlib_compressor_impl.h"
+
+#include "absl/strings/match.h"
+#include "brotli/decode.h"
+#include "zlib.h"
+#include "zstd.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+// Defaults of the envoy.compression.* library extensions.
+constexpr uint32_t ChunkSize = 4096;
+constexpr uint64_t GzipMaxInflateRatio = 100;
+// 15 window bits plus 16 selects the gzip wrapper instead of zlib.
+constexpr int64_t GzipWindowBits = 15 | 16;
+constexpr uint64_t GzipMemoryLevel = 5;
+constexpr uint32_t BrotliQuality = 3;
+constexpr uint32_t BrotliWindowBits = 18;
+constexpr uint32_t BrotliInputBlockBits = 24;
+constexpr uint32_t ZstdCompressionLevel = 3;
+
+enum class Encoding { Unsupported, Gzip, Brotli, Zstd };
+
+Encoding parseEncoding(absl::string_view encoding) {
+  if (absl::EqualsIgnoreCase(encoding, "gzip")) {
+    return Encoding::Gzip;
+  }
+  if (absl::EqualsIgnoreCase(encoding, "br")) {
+    return Encoding::Brotli;
+  }
+  if (absl::EqualsIgnoreCase(encoding, "zstd")) {
+    return Encoding::Zstd;
+  }
+  return Encoding::Unsupported;
+}
+
+class GzipDecompressor : public CheckedDecompressor {
+public:
+  GzipDecompressor() {
+    zstream_.zalloc = Z_NULL;
+    zstream_.zfree = Z_NULL;
+    zstream_.opaque = Z_NULL;
+    zstream_.next_in = Z_NULL;
+    zstream_.avail_in = 0;
+    initialized_ = inflateInit2(&zstream_, GzipWindowBits) == Z_OK;
+    failed_ = !initialized_;
+  }
+
+  ~GzipDecompressor() override {
+    if (initialized_) {
+      inflateEnd(&zstream_);
+    }
+  }
+
+  bool decompress(const Buffer::Instance &input,
+                  Buffer::Instance &output) override {
+    for (const Buffer::RawSlice &slice : input.getRawSlices()) {
+      if (failed_) {
+        break;
+      }
+      zstream_.next_in = static_cast<Bytef *>(slice.mem_);
+      zstream_.avail_in = slice.len_;
+      bool more_output = true;
+      while (!ended_ && (zstream_.avail_in > 0 || more_output)) {
+        uint8_t chunk[ChunkSize];
+        zstream_.next_out = chunk;
+        zstream_.avail_out = ChunkSize;
+        const int result = inflate(&zstream_, Z_NO_FLUSH);
+        if (result == Z_BUF_ERROR) {
+          // no progress is possible until more input arrives.
+          break;
+        }
+        if (result != Z_OK && result != Z_STREAM_END) {
+          failed_ = true;
+          break;
+        }
+        output.add(chunk, ChunkSize - zstream_.avail_out);
+        ended_ = result == Z_STREAM_END;
+        // guards against a small body that inflates without bound.
+        if (zstream_.total_out > GzipMaxInflateRatio * zstream_.total_in) {
+          failed_ = true;
+          break;
+        }
+        // a full chunk may leave more output in inflate.
+        more_output = zstream_.avail_out == 0;
+      }
+      // bytes after the end of the gzip member don't decode.
+      if (ended_ && zstream_.avail_in > 0) {
+        failed_ = true;
+      }
+    }
+    return !failed_;
+  }
+
+private:
+  z_stream zstream_;
+  bool initialized_{};
+  bool ended_{};
+  bool failed_{};
+};
+
+class BrotliDecompressor : public CheckedDecompressor {
+public:
+  BrotliDecompressor()
+      : state_(BrotliDecoderCreateInstance(nullptr, nullptr, nullptr)),
+        failed_(state_ == nullptr) {}
+
+  ~BrotliDecompressor() override {
+    if (state_ != nullptr) {
+      BrotliDecoderDestroyInstance(state_);
+    }
+  }
+
+  bool decompress(const Buffer::Instance &input,
+                  Buffer::Instance &output) override {
+    for (const Buffer::RawSlice &slice : input.getRawSlices()) {
+      if (failed_) {
+        break;
+      }
+      const uint8_t *next_in = static_cast<const uint8_t *>(slice.mem_);
+      size_t avail_in = slice.len_;
+      BrotliDecoderResult result;
+      do {
+        uint8_t chunk[ChunkSize];
+        uint8_t *next_out = chunk;
+        size_t avail_out = ChunkSize;
+        result = BrotliDecoderDecompressStream(state_, &avail_in, &next_in,
+                                               &avail_out, &next_out, nullptr);
+        output.add(chunk, ChunkSize - avail_out);
+      } while (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
+      // bytes after the end of the stream don't decode either.
+      failed_ = result == BROTLI_DECODER_RESULT_ERROR ||
+                (result == BROTLI_DECODER_RESULT_SUCCESS && avail_in > 0);
+    }
+    return !failed_;
+  }
+
+private:
+  BrotliDecoderState *const state_;
+  bool failed_;
+};
+
+class ZstdDecompressor : public CheckedDecompressor {
+public:
+  ZstdDecompressor() : dctx_(ZSTD_createDCtx()), failed_(dctx_ == nullptr) {}
+
+  ~ZstdDecompressor() override { ZSTD_freeDCtx(dctx_); }
+
+  bool decompress(const Buffer::Instance &input,
+                  Buffer::Instance &output) override {
+    for (const Buffer::RawSlice &slice : input.getRawSlices()) {
+      if (failed_) {
+        break;
+      }
+      ZSTD_inBuffer in{slice.mem_, slice.len_, 0};
+      ZSTD_outBuffer out;
+      do {
+        uint8_t chunk[ChunkSize];
+        out = {chunk, ChunkSize, 0};
+        if (ZSTD_isError(ZSTD_decompressStream(dctx_, &out, &in))) {
+          failed_ = true;
+          break;
+        }
+        output.add(chunk, out.pos);
+      } while (in.pos < in.size || out.pos == out.size);
+    }
+    return !failed_;
+  }
+
+private:
+  ZSTD_DCtx *const dctx_;
+  bool failed_;
+};
+
+} // namespace
+
+ContentCodecs::ContentCodecs(bool recompress) : recompress_(recompress) {}
+
+CheckedDecompressorPtr
+ContentCodecs::createDecompressor(absl::string_view encoding) const {
+  switch (parseEncoding(encoding)) {
+  case Encoding::Gzip:
+    return std::make_unique<GzipDecompressor>();
+  case Encoding::Brotli:
+    return std::make_unique<BrotliDecompressor>();
+  case Encoding::Zstd:
+    return std::make_unique<ZstdDecompressor>();
+  case Encoding::Unsupported:
+    break;
+  }
+  return nullptr;
+}
+
+Envoy::Compression::Compressor::CompressorPtr
+ContentCodecs::createCompressor(absl::string_view encoding) const {
+  switch (parseEncoding(encoding)) {
+  case Encoding::Gzip: {
+    using Compression::Gzip::Compressor::ZlibCompressorImpl;
+    auto compressor = std::make_unique<ZlibCompressorImpl>(ChunkSize);
+    compressor->init(ZlibCompressorImpl::CompressionLevel::Standard,
+                     ZlibCompressorImpl::CompressionStrategy::Standard,
+                     GzipWindowBits, GzipMemoryLevel);
+    return compressor;
+  }
+  case Encoding::Brotli:
+    return std::make_unique<
+        Compression::Brotli::Compressor::BrotliCompressorImpl>(
+        BrotliQuality, BrotliWindowBits, BrotliInputBlockBits, false,
+        Compression::Brotli::Compressor::BrotliCompressorImpl::EncoderMode::
+            Default,
+        ChunkSize);
+  case Encoding::Zstd:
+    return std::make_unique<Compression::Zstd::Compressor::ZstdCompressorImpl>(
+        ZstdCompressionLevel, false, 0, cdict_manager_, ChunkSize);
+  case Encoding::Unsupported:
+    break;
+  }
+  return nullptr;
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/common/pure.h"
+#include "envoy/compression/compressor/compressor.h"
+
+#include "source/extensions/compression/zstd/compressor/zstd_compressor_impl.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * A streaming decompressor that reports whether its input could be decoded.
+ * The envoy.compression decompressors only count their errors in stats that
+ * are shared by all streams, so these are built on the return codes of zlib,
+ * brotli and zstd instead. Once the input fails to decode, so does every
+ * later call.
+ */
+class CheckedDecompressor {
+public:
+  virtual ~CheckedDecompressor() = default;
+
+  /**
+   * Decompresses the input, which is left in place, into the output.
+   * @return false if the input could not be decoded. The output is then
+   * incomplete.
+   */
+  virtual bool decompress(const Buffer::Instance &input,
+                          Buffer::Instance &output) PURE;
+};
+
+using CheckedDecompressorPtr = std::unique_ptr<CheckedDecompressor>;
+
+/**
+ * Creates the decompressors and compressors used to transform bodies with a
+ * gzip, br or zstd content encoding.
+ */
+class ContentCodecs {
+public:
+  explicit ContentCodecs(bool recompress);
+
+  /**
+   * @param encoding supplies the value of a content-encoding header.
+   * @return a decompressor for the encoding, or nullptr if the encoding is not
+   * supported.
+   */
+  CheckedDecompressorPtr createDecompressor(absl::string_view encoding) const;
+
+  /**
+   * @param encoding supplies an encoding accepted by createDecompressor().
+   * @return a compressor producing the encoding.
+   */
+  Envoy::Compression::Compressor::CompressorPtr
+  createCompressor(absl::string_view encoding) const;
+
+  /**
+   * @return whether transformed bodies should be re-encoded with the original
+   * content encoding.
+   */
+  bool recompress() const { return recompress_; }
+
+private:
+  const bool recompress_;
+  // zstd dictionaries are not supported, the compressor still needs a
+  // manager.
+  const Compression::Zstd::Compressor::ZstdCDictManagerPtr cdict_manager_;
+};
+
+using ContentCodecsConstPtr = std::unique_ptr<const ContentCodecs>;
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -33,6 +33,16 @@ TransformationFilterStats FilterConfig::generateStats(const std::string &prefix,
       POOL_COUNTER_PREFIX(scope, final_prefix))};
 }
 
+double FilterConfig::overloadActionValue(const std::string &action) const {
+  if (overload_manager_ == nullptr) {
+    return 0;
+  }
+  return overload_manager_->getThreadLocalOverloadState()
+      .getState(action)
+      .value()
+      .value();
+}
+
 RouteFilterConfig::RouteFilterConfig() : stages_(MAX_STAGE_NUMBER + 1) {}
 
 const TransformConfig *
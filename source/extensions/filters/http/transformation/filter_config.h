@@ -6,13 +6,17 @@
 #include "envoy/http/filter.h"
 #include "envoy/http/header_map.h"
 #include "envoy/router/router.h"
+#include "envoy/server/overload/overload_manager.h"
 #include "envoy/stats/scope.h"
 #include "envoy/stats/stats_macros.h"
 
 #include "source/common/http/header_utility.h"
 #include "source/common/matcher/solo_matcher.h"
+#include "source/common/singleton/const_singleton.h"
+#include "source/common/stats/cpu_accounting.h"
 #include "source/common/protobuf/protobuf.h"
 
+#include "source/extensions/filters/http/transformation/content_codecs.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
 
 namespace Envoy {
@@ -30,7 +34,13 @@ namespace Transformation {
   COUNTER(response_body_transformations)                                       \
   COUNTER(request_error)                                                       \
   COUNTER(response_error)                                                      \
-  COUNTER(on_stream_complete_error)
+  COUNTER(on_stream_complete_error)                                            \
+  COUNTER(response_body_decompressions)                                        \
+  COUNTER(response_body_decompression_errors)                                  \
+  COUNTER(response_body_recompressions)                                        \
+  COUNTER(body_spills)                                                         \
+  COUNTER(overload_body_parsing_disabled)                                      \
+  COUNTER(overload_body_shed)
 
 /**
  * Wrapper struct for transformation @see stats_macros.h
@@ -39,6 +49,27 @@ struct TransformationFilterStats {
   ALL_TRANSFORMATION_FILTER_STATS(GENERATE_COUNTER_STRUCT)
 };
 
+/**
+ * Overload actions that the transformation filter reacts to. They take effect
+ * when they are configured in the overload manager.
+ */
+class TransformationOverloadActionNameValues {
+public:
+  // While saturated, body parsing with ignore_error_on_parse is skipped.
+  const std::string DisableOptionalBodyParsing =
+      "io.solo.transformation.disable_optional_body_parsing";
+  // Scales down the limit for buffered bodies, so that the largest pending
+  // transformations are failed first as memory pressure rises. Bodies without
+  // a buffer limit are scaled against unlimited_body_shed_reference_bytes.
+  // A body is only checked when its data arrives, so bodies already buffered
+  // on idle streams are left to the overload manager's stream resets.
+  const std::string ShedBufferedBodies =
+      "io.solo.transformation.shed_buffered_bodies";
+};
+
+using TransformationOverloadActionNames =
+    ConstSingleton<TransformationOverloadActionNameValues>;
+
 class TransformConfig {
 public:
   virtual ~TransformConfig() {}
@@ -99,6 +130,26 @@ public:
   uint32_t stage() const { return stage_; }
 
   bool logRequestResponseInfo() const { return log_request_response_info_; }
+
+  // The codecs used to decompress response bodies, or nullptr if response
+  // decompression is disabled.
+  const ContentCodecs *responseCodecs() const { return response_codecs_.get(); }
+
+  // The body size above which buffered bodies are spilled out of the heap, or
+  // 0 if spilling is disabled.
+  uint64_t spillThreshold() const { return spill_threshold_; }
+  // The largest body that may be buffered when spilling is enabled.
+  uint64_t spillMaxBytes() const { return spill_max_bytes_; }
+  // The size that the shed action scales bodies without a limit against.
+  uint64_t unlimitedBodyShedReferenceBytes() const {
+    return unlimited_body_shed_reference_bytes_;
+  }
+
+  // The CPU time histograms of the filter, or nullptr if they aren't kept.
+  const Stats::FilterCpuStats *cpuStats() const { return cpu_stats_.get(); }
+
+  // The value of an overload action on the calling worker, between 0 and 1.
+  double overloadActionValue(const std::string &action) const;
 protected:
 
   virtual const std::vector<MatcherTransformerPair> &
@@ -106,6 +157,14 @@ protected:
 
   virtual Envoy::Matcher::MatchTreeSharedPtr<Http::HttpMatchingData> matcher() const {return nullptr;};
 
+  ContentCodecsConstPtr response_codecs_;
+  uint64_t spill_threshold_{};
+  uint64_t spill_max_bytes_{};
+  // envoy's default connection buffer limit.
+  uint64_t unlimited_body_shed_reference_bytes_{1024 * 1024};
+  Server::OverloadManager *overload_manager_{};
+  Stats::FilterCpuStatsConstSharedPtr cpu_stats_;
+
 private:
   TransformationFilterStats stats_;
   uint32_t stage_{};
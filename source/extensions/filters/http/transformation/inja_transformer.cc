@@ -2,17 +2,28 @@
 
 #include <iterator>
 
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_replace.h"
+#include "absl/strings/strip.h"
 
 #include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/cleanup.h"
 #include "source/common/common/macros.h"
 #include "source/common/common/regex.h"
 #include "source/common/regex/regex.h"
+#include "source/common/stats/cpu_accounting.h"
+#include "source/common/tracing/stage_span.h"
 #include "source/common/common/utility.h"
 #include "source/common/config/metadata.h"
 #include "source/common/common/empty_string.h"
+#include "source/common/protobuf/utility.h"
 
 #include "source/extensions/filters/http/solo_well_known_names.h"
+#include "source/extensions/filters/http/transformation/body_parser.h"
+#include "source/extensions/filters/http/transformation/buffer_stream.h"
+#include "source/extensions/filters/http/transformation/text_metrics.h"
 
 extern char **environ;
 
@@ -38,6 +49,19 @@ typedef ConstSingleton<BoolHeaderValues> BoolHeader;
 
 // TODO: move to common
 namespace {
+constexpr uint32_t DefaultRetainedBodyMaxBytes = 64 * 1024;
+// bounds the per worker metadata JSON cache of each transformer.
+constexpr size_t MaxCachedMetadataJson = 1024;
+// the number of replace_with_random values generated at once.
+constexpr size_t RandomPoolBatchSize = 32;
+
+// matches the metadata callbacks whose key is a string literal without escapes.
+const std::regex &metadataKeyLiteralRegex() {
+  CONSTRUCT_ON_FIRST_USE(
+      std::regex,
+      R"re((?:cluster_metadata|dynamic_metadata|host_metadata)\(\s*"([^"\\]*)")re");
+}
+
 const Http::HeaderMap::GetResult
 getHeader(const Http::RequestOrResponseHeaderMap &header_map,
           const Http::LowerCaseString &key) {
@@ -52,6 +76,51 @@ getHeader(const Http::RequestOrResponseHeaderMap &header_map,
   return getHeader(header_map, lowerkey);
 }
 
+const std::regex &bodyExpressionRegex() {
+  CONSTRUCT_ON_FIRST_USE(std::regex, R"(\{\{\s*body\(\s*\)\s*\}\})");
+}
+
+// Returns the expression of a template that consists of a single "{{ ... }}"
+// expression, or nullopt if the template has any other content.
+absl::optional<absl::string_view> singleExpression(absl::string_view text) {
+  text = absl::StripAsciiWhitespace(text);
+  if (!absl::ConsumePrefix(&text, "{{") || !absl::ConsumeSuffix(&text, "}}")) {
+    return absl::nullopt;
+  }
+  // whitespace control changes what is rendered, so leave those templates be.
+  if (absl::StartsWith(text, "-") || absl::EndsWith(text, "-") ||
+      absl::StrContains(text, "{{") || absl::StrContains(text, "}}") ||
+      absl::StrContains(text, "{%") || absl::StrContains(text, "{#")) {
+    return absl::nullopt;
+  }
+  return text;
+}
+
+// Splits a body template on "{{ body() }}" expressions and returns the text
+// around them. Returns an empty vector if there is no such expression, or if
+// the template has statements, comments or line statements that could span a
+// split point.
+std::vector<absl::string_view> splitOnBodyExpressions(absl::string_view text) {
+  std::vector<absl::string_view> pieces;
+  if (absl::StrContains(text, "{%") || absl::StrContains(text, "{#") ||
+      absl::StrContains(text, "##")) {
+    return pieces;
+  }
+  size_t last = 0;
+  for (auto it = std::cregex_iterator(text.data(), text.data() + text.size(),
+                                      bodyExpressionRegex());
+       it != std::cregex_iterator(); ++it) {
+    const size_t pos = it->position(0);
+    pieces.push_back(text.substr(last, pos - last));
+    last = pos + it->length(0);
+  }
+  if (pieces.empty()) {
+    return pieces;
+  }
+  pieces.push_back(text.substr(last));
+  return pieces;
+}
+
 } // namespace
 
 Extractor::Extractor(const envoy::api::v2::filter::http::Extraction &extractor)
@@ -216,6 +285,14 @@ Extractor::replaceAllValues(Http::StreamFilterCallbacks&,
   return std::regex_replace(input, extract_regex_, replacement_text_.value(), std::regex_constants::match_not_null);
 }
 
+const std::string &RetainedRequestBody::key() {
+  CONSTRUCT_ON_FIRST_USE(std::string, "io.solo.transformation.request_body");
+}
+
+const std::string &RandomPatternValues::key() {
+  CONSTRUCT_ON_FIRST_USE(std::string, "io.solo.transformation.random_patterns");
+}
+
 // A TransformerInstance is constructed by the InjaTransformer constructor at config time
 // on the main thread. It access thread-local storage which is populated during the
 // InjaTransformer::transform method call, which happens on the request path on any
@@ -276,6 +353,20 @@ TransformerInstance::TransformerInstance(ThreadLocal::Slot &tls, Envoy::Random::
   env_.add_callback("word_count", 1, [](Arguments &args) {
     return word_count_callback(args);
   });
+  env_.add_callback("token_estimate", 1, [](Arguments &args) {
+    return token_estimate_callback(args);
+  });
+  env_.add_callback("capture_typed_value", 1, [this](Arguments &args) {
+    return capture_typed_value_callback(args);
+  });
+  // request_body can be called with no arguments to get the whole retained
+  // request body, or with a JSON pointer to get a single value from it.
+  env_.add_callback("request_body", 0, [this](Arguments &args) {
+    return request_body_callback(args);
+  });
+  env_.add_callback("request_body", 1, [this](Arguments &args) {
+    return request_body_callback(args);
+  });
 }
 
 
@@ -409,14 +500,15 @@ json TransformerInstance::host_metadata_callback(const inja::Arguments &args) co
   if (!ctx.endpoint_metadata_) {
     return "";
   }
-  return parse_metadata(ctx.endpoint_metadata_.get(), ctx.metadata_string_delimiter_, args);
+  return parse_metadata(ctx.endpoint_metadata_.get(), ctx.endpoint_metadata_, args);
 }
 json TransformerInstance::dynamic_metadata_callback(const inja::Arguments &args) const {
   const auto& ctx = tls_.getTyped<ThreadLocalTransformerContext>();
   if (!ctx.dynamic_metadata_) {
     return "";
   }
-  return parse_metadata(ctx.dynamic_metadata_, ctx.metadata_string_delimiter_, args);
+  // dynamic metadata changes during the stream, so it is never cached.
+  return parse_metadata(ctx.dynamic_metadata_, nullptr, args);
 }
 
 json TransformerInstance::cluster_metadata_callback(const inja::Arguments &args) const {
@@ -424,12 +516,15 @@ json TransformerInstance::cluster_metadata_callback(const inja::Arguments &args)
   if (!ctx.cluster_metadata_) {
     return "";
   }
-  return parse_metadata(ctx.cluster_metadata_, ctx.metadata_string_delimiter_, args);
+  return parse_metadata(ctx.cluster_metadata_, ctx.cluster_info_, args);
 }
 
+// parse_metadata looks up the key in the metadata. If owner is set, the JSON
+// renderings of struct and list values are cached for as long as the owner is
+// alive.
 json TransformerInstance::parse_metadata(const envoy::config::core::v3::Metadata* metadata,
-                                                  char delimiter,
-                                                  const inja::Arguments &args) {
+                                         const std::shared_ptr<const void> &owner,
+                                         const inja::Arguments &args) const {
 
   // If no args are provided, return an empty string
   if (args.size() == 0) {
@@ -444,9 +539,38 @@ json TransformerInstance::parse_metadata(const envoy::config::core::v3::Metadata
   // If a 2nd args is provided, use it as the filter
   const std::string &filter = args.size() > 1 ? args.at(1)->get_ref<const std::string &>() : SoloHttpFilterNames::get().Transformation;
 
-  std::vector<std::string> elements = absl::StrSplit(key, delimiter);
-  const ProtobufWkt::Value &value = Envoy::Config::Metadata::metadataValue(
-      metadata, filter, elements);
+  const ProtobufWkt::Value *value_ptr;
+  const auto compiled = metadata_key_paths_.find(key);
+  if (compiled != metadata_key_paths_.end()) {
+    value_ptr = &Envoy::Config::Metadata::metadataValue(metadata, filter,
+                                                        compiled->second);
+  } else {
+    const std::vector<std::string> elements =
+        absl::StrSplit(key, metadata_string_delimiter_);
+    value_ptr = &Envoy::Config::Metadata::metadataValue(metadata, filter, elements);
+  }
+  const ProtobufWkt::Value &value = *value_ptr;
+
+  if (owner != nullptr && (value.kind_case() == ProtobufWkt::Value::kStructValue ||
+                           value.kind_case() == ProtobufWkt::Value::kListValue)) {
+    auto &cache = tls_.getTyped<ThreadLocalTransformerContext>().metadata_json_cache_;
+    const auto cached = cache.find(&value);
+    if (cached != cache.end() && !cached->second.owner_.expired()) {
+      return cached->second.json_;
+    }
+    std::string output;
+    auto status = value.kind_case() == ProtobufWkt::Value::kStructValue
+                      ? ProtobufUtil::MessageToJsonString(value.struct_value(), &output)
+                      : ProtobufUtil::MessageToJsonString(value.list_value(), &output);
+    if (cache.size() >= MaxCachedMetadataJson) {
+      absl::erase_if(cache, [](const auto &entry) { return entry.second.owner_.expired(); });
+      if (cache.size() >= MaxCachedMetadataJson) {
+        cache.clear();
+      }
+    }
+    cache.insert_or_assign(&value, ThreadLocalTransformerContext::CachedMetadataJson{owner, output});
+    return output;
+  }
 
   switch (value.kind_case()) {
   case ProtobufWkt::Value::kStringValue: {
@@ -504,28 +628,32 @@ json TransformerInstance::base64url_decode_callback(const inja::Arguments &args)
 }
 
 json TransformerInstance::word_count_callback(const inja::Arguments &args) {
-  return json_word_count(args.at(0));
+  return json_text_count(args.at(0), countWords);
 }
 
-int TransformerInstance::json_word_count(const nlohmann::json* input)  {
+json TransformerInstance::token_estimate_callback(const inja::Arguments &args) {
+  return json_text_count(args.at(0), estimateTokens);
+}
+
+// json_text_count applies count to every string and object key in the input.
+// Numbers and booleans count as 1.
+uint64_t TransformerInstance::json_text_count(const nlohmann::json *input,
+                                              uint64_t (*count)(absl::string_view)) {
   if (input->is_string()) {
-    const std::string &input_string = input->get_ref<const std::string &>();
-    return word_count(input_string);
+    return count(input->get_ref<const std::string &>());
   } else if (input->is_array()) {
-    int total_word_count = 0;
-    const auto &input_array = input->get_ref<const std::vector<json> &>();
-    for (auto & element : input_array) {
-      total_word_count += json_word_count(&element);
+    uint64_t total = 0;
+    for (const auto &element : input->get_ref<const json::array_t &>()) {
+      total += json_text_count(&element, count);
     }
-    return total_word_count;
+    return total;
   } else if (input->is_object()) {
-    int total_word_count = 0;
-    const auto element_obj = input->get_ref<const json::object_t &>();
-    for (auto & [key, value] : element_obj) {
-      total_word_count += word_count(key);
-      total_word_count += json_word_count(&value);
+    uint64_t total = 0;
+    for (const auto &[key, value] : input->get_ref<const json::object_t &>()) {
+      total += count(key);
+      total += json_text_count(&value, count);
     }
-    return total_word_count;
+    return total;
   } else if (input->is_number() || input->is_boolean()) {
     // Booleans and numbers are constant
     return 1;
@@ -533,44 +661,6 @@ int TransformerInstance::json_word_count(const nlohmann::json* input)  {
   return 0;
 }
 
-int TransformerInstance::word_count(const std::string& input_string)  {
-    unsigned long ctr = 0; // Initializing a counter variable to count words
-
-    // Advance through all spaces at the beginning
-
-
-    unsigned long first_char = 0;
-    for (unsigned long x = 0; x < input_string.length(); x++) {
-      // https://en.cppreference.com/w/cpp/string/byte/isspace
-      if (!isspace(input_string[x] )){
-        first_char = x;
-        break;
-      }
-    }
-
-    // Loop through the string and count spaces to determine words
-    bool in_white_space = false;
-    for (unsigned long x = first_char; x < input_string.length(); x++) {
-      // https://en.cppreference.com/w/cpp/string/byte/isspace
-      if (isspace(input_string[x] )){ // Checking for spaces to count words
-        if (!in_white_space){
-          ctr++; // Increment the counter for each new "word"
-        }
-        in_white_space = true;
-      } else{
-        in_white_space = false;
-      }
-    }
-    // Return the count of words by adding 1 to the total number of spaces
-    // (plus 1 for the last word without a trailing space
-    // unless it ends with a space 
-    if (isspace(input_string[input_string.length() - 1] )){
-      return ctr;
-    } else {
-      return ctr + 1;
-    }
-}
-
 
 // return a substring of the input string, starting at the start position
 // and extending for length characters. If length is not provided, the
@@ -615,7 +705,7 @@ json TransformerInstance::substring_callback(const inja::Arguments &args) const
   return input.substr(start, substring_len);
 }
 
-json TransformerInstance::replace_with_random_callback(const inja::Arguments &args) {
+json TransformerInstance::replace_with_random_callback(const inja::Arguments &args) const {
     // first argument: string to modify
   const std::string &source = args.at(0)->get_ref<const std::string &>();
     // second argument: pattern to be replaced
@@ -625,22 +715,81 @@ json TransformerInstance::replace_with_random_callback(const inja::Arguments &ar
     absl::StrReplaceAll(source, {{to_replace, absl::StrCat(random_for_pattern(to_replace))}});
 }
 
-std::string& TransformerInstance::random_for_pattern(const std::string& pattern) {
-  auto found = pattern_replacements_.find(pattern);
-  if (found == pattern_replacements_.end()) {
-    // generate 128 bit long random number
-    uint64_t random[2];
-    uint64_t high = rng_.random();
-    uint64_t low = rng_.random();
-    random[0] = low;
-    random[1] = high;
-    // and convert it to a base64-encoded string with no padding
-    pattern_replacements_.insert({pattern, Base64::encode(reinterpret_cast<char *>(random), 16, false)});
-    return pattern_replacements_[pattern];
+// random_for_pattern returns the same value for every use of a pattern within
+// one request. The values live in the request's filter state, so no state is
+// shared between threads or requests.
+const std::string &TransformerInstance::random_for_pattern(const std::string &pattern) const {
+  auto &ctx = tls_.getTyped<ThreadLocalTransformerContext>();
+  auto *pattern_values =
+      ctx.filter_state_->getDataMutable<RandomPatternValues>(RandomPatternValues::key());
+  if (pattern_values == nullptr) {
+    auto created = std::make_shared<RandomPatternValues>();
+    pattern_values = created.get();
+    ctx.filter_state_->setData(RandomPatternValues::key(), std::move(created),
+                               StreamInfo::FilterState::StateType::Mutable,
+                               StreamInfo::FilterState::LifeSpan::Request);
+  }
+  auto &values = pattern_values->values();
+  auto found = values.find(pattern);
+  if (found == values.end()) {
+    found = values.emplace(pattern, std::string(ctx.random_pool_.next(rng_))).first;
   }
   return found->second;
 }
 
+absl::string_view RandomStringPool::next(Envoy::Random::RandomGenerator &rng) {
+  if (offset_ == batch_.size()) {
+    refill(rng);
+  }
+  const absl::string_view value(batch_.data() + offset_, EncodedLength);
+  offset_ += EncodedLength;
+  return value;
+}
+
+void RandomStringPool::refill(Envoy::Random::RandomGenerator &rng) {
+  // base64 encodes 3 bytes as 4 characters, so the random bytes of a whole
+  // batch encode to exactly RandomPoolBatchSize values of 22 characters, each
+  // carrying at least 128 random bits.
+  constexpr size_t BatchBytes = RandomPoolBatchSize * EncodedLength / 4 * 3;
+  static_assert(RandomPoolBatchSize * EncodedLength % 4 == 0 && BatchBytes % 8 == 0);
+  uint64_t random[BatchBytes / 8];
+  for (auto &value : random) {
+    value = rng.random();
+  }
+  batch_ = Base64::encode(reinterpret_cast<const char *>(random), BatchBytes, false);
+  offset_ = 0;
+}
+
+json TransformerInstance::capture_typed_value_callback(const inja::Arguments &args) const {
+  const auto& ctx = tls_.getTyped<ThreadLocalTransformerContext>();
+  if (ctx.typed_value_ != nullptr) {
+    *ctx.typed_value_ = *args.at(0);
+  }
+  return json();
+}
+
+json TransformerInstance::request_body_callback(const inja::Arguments &args) const {
+  const auto& ctx = tls_.getTyped<ThreadLocalTransformerContext>();
+  if (ctx.request_body_ == nullptr) {
+    return "";
+  }
+  if (args.empty()) {
+    return *ctx.request_body_;
+  }
+  if (!args.at(0)->is_string()) {
+    return "";
+  }
+  try {
+    const json::json_pointer pointer(args.at(0)->get_ref<const std::string &>());
+    if (ctx.request_body_->contains(pointer)) {
+      return ctx.request_body_->at(pointer);
+    }
+  } catch (const std::exception &) {
+    // invalid json pointer
+  }
+  return "";
+}
+
 json TransformerInstance::raw_string_callback(const inja::Arguments &args) const {
   // inja::Arguments is a std::vector<const json *>, so we can get the json
   // value from the args directly. We are guaranteed to have exactly one argument
@@ -674,9 +823,23 @@ json TransformerInstance::raw_string_callback(const inja::Arguments &args) const
 // constructor since doing so could cause Inja::Environment member fields to be
 // modified by multiple threads at runtime.
 inja::Template TransformerInstance::parse(std::string_view input) {
+    compile_metadata_key_paths(input);
     return env_.parse(input);
 }
 
+void TransformerInstance::compile_metadata_key_paths(std::string_view input) {
+  const auto &regex = metadataKeyLiteralRegex();
+  for (auto it = std::cregex_iterator(input.data(), input.data() + input.size(), regex);
+       it != std::cregex_iterator(); ++it) {
+    std::string key = (*it)[1].str();
+    if (metadata_key_paths_.contains(key)) {
+      continue;
+    }
+    std::vector<std::string> elements = absl::StrSplit(key, metadata_string_delimiter_);
+    metadata_key_paths_.emplace(std::move(key), std::move(elements));
+  }
+}
+
 std::string TransformerInstance::render(const inja::Template &input) {
   // inja can't handle context that are not objects correctly, so we give it an
   // empty object in that case
@@ -688,6 +851,50 @@ std::string TransformerInstance::render(const inja::Template &input) {
   }
 }
 
+// render_value renders a template produced by parse_typed and returns the value
+// of its expression.
+json TransformerInstance::render_value(const inja::Template &input) {
+  auto& ctx = tls_.getTyped<ThreadLocalTransformerContext>();
+  json value;
+  ctx.typed_value_ = &value;
+  try {
+    render(input);
+  } catch (const std::exception &) {
+    ctx.typed_value_ = nullptr;
+    throw;
+  }
+  ctx.typed_value_ = nullptr;
+  return value;
+}
+
+// parse_typed parses a template that consists of a single expression so that
+// render_value can return the value of the expression without serializing it.
+// Returns nullopt for any other template. Like parse, this is NOT SAFE to call
+// outside of the InjaTransformer constructor.
+absl::optional<inja::Template> TransformerInstance::parse_typed(std::string_view input) {
+  const auto expression = singleExpression(input);
+  if (!expression.has_value()) {
+    return absl::nullopt;
+  }
+  try {
+    return env_.parse(absl::StrCat("{{ capture_typed_value(", expression.value(), ") }}"));
+  } catch (const std::exception &) {
+    return absl::nullopt;
+  }
+}
+
+void TransformerInstance::render_to(const inja::Template &input,
+                                    Buffer::Instance &output) {
+  const auto& ctx = tls_.getTyped<ThreadLocalTransformerContext>();
+  BufferStreamBuf streambuf(output);
+  std::ostream os(&streambuf);
+  if (ctx.context_->is_object()) {
+    env_.render_to(os, input, *ctx.context_);
+  } else {
+    env_.render_to(os, input, {});
+  }
+}
+
 // An InjaTransformer is constructed on initialization on the main thread
 InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
                                  Envoy::Random::RandomGenerator &rng,
@@ -707,6 +914,16 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
 
   instance_->set_escape_strings(escape_characters_);
 
+  // If this is unset it will default to ":". It is set before any template is
+  // parsed so that literal metadata keys are compiled with it.
+  if (transformation.string_delimiter() != "") {
+    if (transformation.string_delimiter().length() > 1) {
+      throw EnvoyException("Metadata string delimiter must be a single character");
+    } else {
+      instance_->set_metadata_string_delimiter(transformation.string_delimiter()[0]);
+    }
+  }
+
   tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
           return std::make_shared<ThreadLocalTransformerContext>();
   });
@@ -772,7 +989,7 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
   switch (transformation.body_transformation_case()) {
   case TransformationTemplate::kBody: {
     try {
-      body_template_.emplace(instance_->parse(transformation.body().text()));
+      parseBodyTemplate(transformation.body().text());
     } catch (const std::exception &e) {
       throw EnvoyException(
           fmt::format("Failed to parse body template {}", e.what()));
@@ -798,7 +1015,15 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
               fmt::format("Invalid key name for merge_json_keys: ({})", name));
         }
         try {
-          merge_templates_.emplace_back(std::make_tuple(name, tmpl.override_empty(), instance_->parse(tmpl.tmpl().text())));
+          MergeTemplate merge_template{name, tmpl.override_empty(),
+                                       instance_->parse(tmpl.tmpl().text()),
+                                       absl::nullopt};
+          // an escaped string renders differently than its value, so only
+          // use typed rendering when strings are rendered as-is.
+          if (!escape_characters_) {
+            merge_template.typed_template_ = instance_->parse_typed(tmpl.tmpl().text());
+          }
+          merge_templates_.emplace_back(std::move(merge_template));
         } catch ( std::exception const&) {
           throw EnvoyException(
               fmt::format("Failed to parse merge_body_key template for key: ({})", name));
@@ -824,13 +1049,23 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
     }
   }
 
-  // If this is unset it will default to ":"
-  if (transformation.string_delimiter() != "") {
-    if (transformation.string_delimiter().length() > 1) {
-      throw EnvoyException("Metadata string delimiter must be a single character");
-    } else {
-      metadata_string_delimiter_ = transformation.string_delimiter()[0];
+  if (transformation.has_retain_parsed_body()) {
+    if (transformation.parse_body_behavior() == TransformationTemplate::DontParse) {
+      throw EnvoyException("retain_parsed_body requires parsing the body");
+    }
+    const auto &retain = transformation.retain_parsed_body();
+    RetainParsedBody retain_parsed_body;
+    for (const auto &projection : retain.projections()) {
+      try {
+        retain_parsed_body.projections_.emplace_back(projection);
+      } catch (const std::exception &e) {
+        throw EnvoyException(fmt::format(
+            "Invalid retain_parsed_body projection '{}': {}", projection, e.what()));
+      }
     }
+    retain_parsed_body.max_bytes_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+        retain, max_bytes, DefaultRetainedBodyMaxBytes);
+    retain_parsed_body_.emplace(std::move(retain_parsed_body));
   }
 
   if (transformation.has_span_transformer() && transformation.span_transformer().has_name()) {
@@ -841,10 +1076,91 @@ InjaTransformer::InjaTransformer(const TransformationTemplate &transformation,
           fmt::format("Failed to parse span name template {}", e.what()));
     }
   }
+  stage_spans_ = transformation.stage_spans();
 }
 
 InjaTransformer::~InjaTransformer() {}
 
+void InjaTransformer::retainParsedBody(const json &json_body,
+                                       uint64_t body_length,
+                                       Http::StreamFilterCallbacks &callbacks) const {
+  const auto &retain = retain_parsed_body_.value();
+  json retained;
+  if (retain.projections_.empty()) {
+    if (body_length > retain.max_bytes_) {
+      ENVOY_STREAM_LOG(debug, "request body too large to retain", callbacks);
+      return;
+    }
+    retained = json_body;
+  } else {
+    retained = json::object();
+    for (const auto &pointer : retain.projections_) {
+      if (json_body.contains(pointer)) {
+        retained[pointer] = json_body.at(pointer);
+      }
+    }
+    if (retained.dump().size() > retain.max_bytes_) {
+      ENVOY_STREAM_LOG(debug, "retained request body projections too large", callbacks);
+      return;
+    }
+  }
+  callbacks.streamInfo().filterState()->setData(
+      RetainedRequestBody::key(),
+      std::make_shared<RetainedRequestBody>(std::move(retained)),
+      StreamInfo::FilterState::StateType::Mutable,
+      StreamInfo::FilterState::LifeSpan::Request);
+}
+
+void InjaTransformer::parseBodyTemplate(const std::string &text) {
+  // with escape_characters the rendered body differs from the raw body, so it
+  // can only be spliced in when strings are rendered as-is.
+  const std::vector<absl::string_view> pieces =
+      escape_characters_ ? std::vector<absl::string_view>{}
+                         : splitOnBodyExpressions(text);
+  if (!pieces.empty()) {
+    try {
+      std::vector<absl::optional<inja::Template>> segments;
+      for (size_t i = 0; i < pieces.size(); i++) {
+        if (i > 0) {
+          segments.emplace_back(absl::nullopt);
+        }
+        if (!pieces[i].empty()) {
+          segments.emplace_back(instance_->parse(pieces[i]));
+        }
+      }
+      body_segments_ = std::move(segments);
+      return;
+    } catch (const std::exception &) {
+      // a piece is not a valid template on its own, e.g. the body()
+      // expression was inside a string literal. render the template whole.
+    }
+  }
+  body_segments_.clear();
+  body_segments_.emplace_back(instance_->parse(text));
+}
+
+void InjaTransformer::parseBody(absl::string_view bodystring,
+                                json &json_body) const {
+  switch (parse_body_behavior_) {
+  case TransformationTemplate::ParseAsJson: {
+    json_body = json::parse(bodystring.begin(), bodystring.end());
+    break;
+  }
+  case TransformationTemplate::ParseAsFormUrlEncoded: {
+    parseFormUrlEncoded(bodystring, json_body);
+    break;
+  }
+  case TransformationTemplate::ParseAsXml: {
+    parseXml(bodystring, json_body);
+    break;
+  }
+  default: {
+    ASSERT("missing behavior");
+    break;
+  }
+  }
+}
+
 // transform is called on the request path, and may be executed on any worker thread.
 // it must be thread-safe. note that calling instance_->parse is NOT THREAD SAFE
 // and MUST NOT be done from this method.
@@ -853,37 +1169,57 @@ void InjaTransformer::transform(Http::RequestOrResponseHeaderMap &header_map,
                                 Buffer::Instance &body,
                                 Http::StreamFilterCallbacks &callbacks) const {
   absl::optional<std::string> string_body;
-  GetBodyFunc get_body = [&string_body, &body]() -> const std::string & {
+  // the original body, which is moved out of body when a new body is
+  // rendered.
+  std::shared_ptr<Buffer::OwnedImpl> original_body;
+  const Buffer::Instance *body_source = &body;
+  GetBodyFunc get_body = [&string_body, &body_source]() -> const std::string & {
     if (!string_body.has_value()) {
-      string_body.emplace(body.toString());
+      string_body.emplace(body_source->toString());
     }
     return string_body.value();
   };
 
   json json_body;
 
+  // parsing that may fail silently is optional, and is skipped under memory
+  // pressure.
+  const bool skip_parse =
+      ignore_error_on_parse_ &&
+      callbacks.streamInfo().filterState()->getDataReadOnly<OptionalBodyParsingDisabled>(
+          OptionalBodyParsingDisabled::key()) != nullptr;
   if (parse_body_behavior_ != TransformationTemplate::DontParse &&
-      body.length() > 0) {
-    const std::string &bodystring = get_body();
-    // parse the body as json
-    // TODO: gate this under a parse_body boolean
-    if (parse_body_behavior_ == TransformationTemplate::ParseAsJson) {
-      if (ignore_error_on_parse_) {
-        try {
-          json_body = json::parse(bodystring);
-        } catch (const std::exception &) {
-        }
-      } else {
-        json_body = json::parse(bodystring);
+      body.length() > 0 && !skip_parse) {
+    // a contiguous body, such as a spilled one, is parsed in place.
+    const Buffer::RawSlice front = body.frontSlice();
+    const absl::string_view bodystring =
+        front.len_ == body.length()
+            ? absl::string_view(static_cast<const char *>(front.mem_), front.len_)
+            : absl::string_view(get_body());
+    Stats::ScopedCpuTimer parse_timer(Stats::CpuStep::BodyParse);
+    Tracing::StageSpan parse_span(stage_spans_, callbacks,
+                                  "transformation.parse_body");
+    parse_span.setBytes("transformation.body_bytes", bodystring.size());
+    if (ignore_error_on_parse_) {
+      try {
+        parseBody(bodystring, json_body);
+      } catch (const std::exception &) {
       }
     } else {
-      ASSERT("missing behavior");
+      parseBody(bodystring, json_body);
+    }
+    // only request bodies are retained, for the response transformations.
+    if (retain_parsed_body_.has_value() && request_headers == &header_map &&
+        !json_body.is_null()) {
+      retainParsedBody(json_body, bodystring.size(), callbacks);
     }
   }
   // get the extractions
   std::unordered_map<std::string, absl::string_view> extractions;
   std::unordered_map<std::string, std::string> destructive_extractions;
-  
+  Tracing::StageSpan extract_span(stage_spans_ && !extractors_.empty(),
+                                  callbacks, "transformation.extract");
+
   if (advanced_templates_) {
     auto extractions_size = 0;
     auto destructive_extractions_size = 0;
@@ -949,6 +1285,8 @@ void InjaTransformer::transform(Http::RequestOrResponseHeaderMap &header_map,
     }
   }
 
+  extract_span.finish();
+
   // get cluster metadata
   const envoy::config::core::v3::Metadata *cluster_metadata{};
   Upstream::ClusterInfoConstSharedPtr ci = callbacks.clusterInfo();
@@ -984,33 +1322,90 @@ void InjaTransformer::transform(Http::RequestOrResponseHeaderMap &header_map,
   typed_tls_data.context_ = &json_body;
   typed_tls_data.environ_ = &environ_;
   typed_tls_data.cluster_metadata_ = cluster_metadata;
+  typed_tls_data.cluster_info_ = ci;
+  typed_tls_data.filter_state_ = callbacks.streamInfo().filterState().get();
   typed_tls_data.dynamic_metadata_ = dynamic_metadata;
   typed_tls_data.endpoint_metadata_ = endpoint_metadata;
-  typed_tls_data.metadata_string_delimiter_ = metadata_string_delimiter_;
+  // the context outlives this transform, so it must not keep a removed
+  // cluster or host alive. the metadata json cache only holds weak references.
+  Cleanup release_metadata_owners([&typed_tls_data]() {
+    typed_tls_data.cluster_info_.reset();
+    typed_tls_data.endpoint_metadata_.reset();
+  });
+  const auto *retained_request_body =
+      callbacks.streamInfo().filterState()->getDataReadOnly<RetainedRequestBody>(
+          RetainedRequestBody::key());
+  typed_tls_data.request_body_ =
+      retained_request_body != nullptr ? &retained_request_body->body() : nullptr;
 
-  // Body transform:
-  absl::optional<Buffer::OwnedImpl> maybe_body;
+  // everything from here on renders templates.
+  Stats::ScopedCpuTimer render_timer(Stats::CpuStep::TemplateRender);
+  Tracing::StageSpan render_span(stage_spans_, callbacks,
+                                 "transformation.render");
 
-  if (body_template_.has_value()) {
-    std::string output = instance_->render(body_template_.value());
-    maybe_body.emplace(output);
+  // Body transform:
+  // the new body is rendered straight into body, so that a buffer that hashes
+  // what is written to it sees the output once. headers and dynamic metadata
+  // are rendered afterwards, and read the original body that is moved out.
+  const auto take_original_body = [&]() {
+    original_body = std::make_shared<Buffer::OwnedImpl>();
+    original_body->move(body);
+    body_source = original_body.get();
+    // lets a buffer that tracks its writes know that it was emptied.
+    body.drain(body.length());
+  };
+  bool body_replaced = false;
+
+  if (!body_segments_.empty()) {
+    take_original_body();
+    body_replaced = true;
+    for (const auto &segment : body_segments_) {
+      if (segment.has_value()) {
+        instance_->render_to(segment.value(), body);
+        continue;
+      }
+      // splice the original body in by reference. the fragments keep the
+      // original body alive until the new body is drained.
+      for (const Buffer::RawSlice &slice : original_body->getRawSlices()) {
+        auto *fragment = new Buffer::BufferFragmentImpl(
+            slice.mem_, slice.len_,
+            [original_body](const void *, size_t,
+                            const Buffer::BufferFragmentImpl *this_fragment) {
+              delete this_fragment;
+            });
+        body.addBufferFragment(*fragment);
+      }
+    }
   } else if (merged_extractors_to_body_) {
-    std::string output = json_body.dump();
-    maybe_body.emplace(output);
+    take_original_body();
+    body_replaced = true;
+    dumpTo(json_body, body);
   } else if (!merge_templates_.empty()) {
 
     for (const auto &merge_template : merge_templates_) {
-      const std::string &name = std::get<0>(merge_template);
-      
-      const auto rendered = instance_->render(std::get<2>(merge_template));
+      std::string rendered;
+      if (merge_template.typed_template_.has_value()) {
+        json value = instance_->render_value(merge_template.typed_template_.value());
+        if (!value.is_string() && !value.is_null()) {
+          json_body[merge_template.name_] = std::move(value);
+          continue;
+        }
+        // strings render as their contents, which are parsed like any other
+        // rendered text. null renders as nothing.
+        if (value.is_string()) {
+          rendered = std::move(value.get_ref<std::string &>());
+        }
+      } else {
+        rendered = instance_->render(merge_template.template_);
+      }
       // Do not overwrite with empty unless specified
-      if (rendered.size() > 0 || std::get<1>(merge_template)) {
-        auto rendered_json = json::parse(rendered);
-        json_body[std::string(name)] = rendered_json;
+      if (rendered.size() > 0 || merge_template.override_empty_) {
+        json_body[merge_template.name_] = json::parse(rendered);
       }
     }
-    std::string output = json_body.dump();
-    maybe_body.emplace(output);
+    take_original_body();
+    body_replaced = true;
+    dumpTo(json_body, body);
   }
 
   // DynamicMetadata transform:
@@ -1082,16 +1477,9 @@ void InjaTransformer::transform(Http::RequestOrResponseHeaderMap &header_map,
     }
   }
 
-  // replace body. we do it here so that headers and dynamic metadata have the
-  // original body.
-  if (maybe_body.has_value()) {
-    // remove content length, as we have new body.
-    header_map.removeContentLength();
-    // replace body
-    body.drain(body.length());
-    // prepend is used because it doesn't copy, it drains maybe_body
-    body.prepend(maybe_body.value());
+  if (body_replaced) {
     header_map.setContentLength(body.length());
+    render_span.setBytes("transformation.rendered_bytes", body.length());
   }
 }
 
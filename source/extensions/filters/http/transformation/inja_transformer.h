@@ -1,13 +1,17 @@
 #pragma once
 
 #include <map>
+#include <memory>
 
 #include "envoy/buffer/buffer.h"
 #include "envoy/http/header_map.h"
 #include "envoy/common/random_generator.h"
+#include "envoy/stream_info/filter_state.h"
 
 #include "source/common/common/base64.h"
 
+#include "absl/container/flat_hash_map.h"
+
 #include "envoy/thread_local/thread_local_object.h"
 #include "envoy/thread_local/thread_local.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
@@ -27,6 +31,51 @@ namespace Transformation {
 using GetBodyFunc = std::function<const std::string &()>;
 using ExtractionApi = envoy::api::v2::filter::http::Extraction;
 
+// The parsed request body kept for the rest of the stream by
+// retain_parsed_body, so that response transformations don't need to parse it
+// again.
+class RetainedRequestBody : public StreamInfo::FilterState::Object {
+public:
+  RetainedRequestBody(nlohmann::json body) : body_(std::move(body)) {}
+
+  static const std::string &key();
+
+  const nlohmann::json &body() const { return body_; }
+
+private:
+  const nlohmann::json body_;
+};
+
+// The replace_with_random values of a request, so that the request and
+// response transformations of a stream use the same value for a pattern.
+class RandomPatternValues : public StreamInfo::FilterState::Object {
+public:
+  static const std::string &key();
+
+  absl::flat_hash_map<std::string, std::string> &values() { return values_; }
+
+private:
+  absl::flat_hash_map<std::string, std::string> values_;
+};
+
+// Hands out base64 encoded 128 bit random values. Values are generated and
+// encoded in batches, so a pool must only be used by a single thread.
+class RandomStringPool {
+public:
+  // the length of a base64 encoded 128 bit value without padding.
+  static constexpr size_t EncodedLength = 22;
+
+  // @return a random value. The view is valid until the next call.
+  absl::string_view next(Envoy::Random::RandomGenerator &rng);
+
+private:
+  void refill(Envoy::Random::RandomGenerator &rng);
+
+  // the encoded values of the current batch, back to back.
+  std::string batch_;
+  size_t offset_{};
+};
+
 struct ThreadLocalTransformerContext : public ThreadLocal::ThreadLocalObject {
 public:
   ThreadLocalTransformerContext(){}
@@ -39,9 +88,30 @@ public:
   const nlohmann::json *context_;
   const std::unordered_map<std::string, std::string> *environ_;
   const envoy::config::core::v3::Metadata *cluster_metadata_;
+  // keeps cluster_metadata_ alive while a transform runs, and is released at
+  // its end. see metadata_json_cache_.
+  Upstream::ClusterInfoConstSharedPtr cluster_info_;
   Envoy::Upstream::MetadataConstSharedPtr endpoint_metadata_;
   const envoy::config::core::v3::Metadata *dynamic_metadata_;
-  char metadata_string_delimiter_ = ':';
+  // receives the value of the expression rendered by render_value
+  nlohmann::json *typed_value_{};
+  const nlohmann::json *request_body_{};
+
+  struct CachedMetadataJson {
+    // the cluster info or host metadata the value belongs to. While it is
+    // alive the value can't change and its address can't be reused.
+    std::weak_ptr<const void> owner_;
+    std::string json_;
+  };
+  // JSON renderings of cluster and host metadata struct and list values. This
+  // outlives a single transform, so entries are validated against their owner.
+  absl::flat_hash_map<const ProtobufWkt::Value *, CachedMetadataJson>
+      metadata_json_cache_;
+
+  // holds the replace_with_random values of the current request, see
+  // RandomPatternValues.
+  StreamInfo::FilterState *filter_state_{};
+  RandomStringPool random_pool_;
 };
 
 
@@ -51,6 +121,10 @@ public:
 
   inja::Template parse(std::string_view input);
   std::string render(const inja::Template &input);
+  // Renders the template by appending it to output.
+  void render_to(const inja::Template &input, Buffer::Instance &output);
+  absl::optional<inja::Template> parse_typed(std::string_view input);
+  nlohmann::json render_value(const inja::Template &input);
   void set_element_notation(inja::ElementNotation notation) {
       env_.set_element_notation(notation);
   };
@@ -58,6 +132,11 @@ public:
   void set_escape_strings(bool escape_strings) {
       env_.set_escape_strings(escape_strings);
   };
+  // Sets the delimiter of metadata keys. Must be called before parse so that
+  // literal keys are compiled with it.
+  void set_metadata_string_delimiter(char delimiter) {
+      metadata_string_delimiter_ = delimiter;
+  };
 
 private:
   // header_value(name)
@@ -76,18 +155,26 @@ private:
   nlohmann::json base64_decode_callback(const inja::Arguments &args) const;
   nlohmann::json base64url_decode_callback(const inja::Arguments &args) const;
   nlohmann::json substring_callback(const inja::Arguments &args) const;
-  nlohmann::json replace_with_random_callback(const inja::Arguments &args);
-  std::string& random_for_pattern(const std::string& pattern);
+  nlohmann::json replace_with_random_callback(const inja::Arguments &args) const;
+  const std::string &random_for_pattern(const std::string &pattern) const;
   nlohmann::json raw_string_callback(const inja::Arguments &args) const;
-  static nlohmann::json parse_metadata(const envoy::config::core::v3::Metadata* metadata,
-                                                  char delimiter,
-                                                  const inja::Arguments &args);
+  nlohmann::json capture_typed_value_callback(const inja::Arguments &args) const;
+  nlohmann::json request_body_callback(const inja::Arguments &args) const;
+  nlohmann::json parse_metadata(const envoy::config::core::v3::Metadata* metadata,
+                                const std::shared_ptr<const void> &owner,
+                                const inja::Arguments &args) const;
+  // splits the literal keys of metadata callbacks in the template.
+  void compile_metadata_key_paths(std::string_view input);
   static nlohmann::json word_count_callback(const inja::Arguments &args);
-  static int json_word_count(const nlohmann::json* str);
-  static int word_count(const std::string& str);
+  static nlohmann::json token_estimate_callback(const inja::Arguments &args);
+  static uint64_t json_text_count(const nlohmann::json *input,
+                                  uint64_t (*count)(absl::string_view));
 
   inja::Environment env_;
-  absl::flat_hash_map<std::string, std::string> pattern_replacements_;
+  char metadata_string_delimiter_ = ':';
+  // metadata keys that appear as literals in the templates, already split on
+  // the delimiter. Only written by parse.
+  absl::flat_hash_map<std::string, std::vector<std::string>> metadata_key_paths_;
   ThreadLocal::Slot &tls_;
   Envoy::Random::RandomGenerator &rng_;
 };
@@ -133,6 +220,14 @@ public:
   bool passthrough_body() const override { return passthrough_body_; };
 
 private:
+  // parses the body according to parse_body_behavior_. throws on invalid input.
+  void parseBody(absl::string_view bodystring, nlohmann::json &json_body) const;
+  // fills body_segments_. throws if the template can't be parsed.
+  void parseBodyTemplate(const std::string &text);
+  // keeps the parsed request body in the stream's filter state.
+  void retainParsedBody(const nlohmann::json &json_body, uint64_t body_length,
+                        Http::StreamFilterCallbacks &callbacks) const;
+
   struct DynamicMetadataValue {
     std::string namespace_;
     std::string key_;
@@ -140,6 +235,23 @@ private:
     bool parse_json_;
   };
 
+  struct MergeTemplate {
+    // The json key to merge the template into
+    std::string name_;
+    // Whether to override the value at the key if the template renders empty
+    bool override_empty_;
+    // The template to merge
+    inja::Template template_;
+    // Set if the template is a single expression, whose value can be merged
+    // without rendering it to a string and parsing it back.
+    absl::optional<inja::Template> typed_template_;
+  };
+
+  struct RetainParsedBody {
+    std::vector<nlohmann::json::json_pointer> projections_;
+    uint32_t max_bytes_;
+  };
+
   bool advanced_templates_{};
   bool passthrough_body_{};
   std::vector<std::pair<std::string, Extractor>> extractors_;
@@ -154,17 +266,16 @@ private:
   bool ignore_error_on_parse_;
   bool escape_characters_{};
 
-  absl::optional<inja::Template> body_template_;
+  // The body template, split on "{{ body() }}" expressions. An empty optional
+  // marks where the original body is spliced in without copying it.
+  std::vector<absl::optional<inja::Template>> body_segments_;
   absl::optional<inja::Template> span_name_template_;
+  bool stage_spans_{};
   bool merged_extractors_to_body_{};
-  // merged_templates_ is a vector of tuples with the following fields:
-  // 1. The json path to merge the template into
-  // 2. Whether to override the value at the json path if empty
-  // 3. The template to merge
-  std::vector<std::tuple<std::string, bool, inja::Template>> merge_templates_;
+  std::vector<MergeTemplate> merge_templates_;
+  absl::optional<RetainParsedBody> retain_parsed_body_;
   ThreadLocal::SlotPtr tls_;
   std::unique_ptr<TransformerInstance> instance_;
-  char metadata_string_delimiter_ = ':';
 };
 
 } // namespace Transformation
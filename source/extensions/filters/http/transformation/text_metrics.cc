@@ -0,0 +1,146 @@
+#include "source/extensions/filters/http/transformation/text_metrics.h"
+
+#include <array>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+bool isWhitespace(char c) {
+  // ' ' and '\t', '\n', '\v', '\f', '\r'
+  return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+#if defined(__SSE2__)
+uint64_t whitespaceMask16(const char *data) {
+  const __m128i bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+  const __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+  // '\t' to '\r' are contiguous, so they are the bytes b for which b - '\t'
+  // is at most 4 when compared as unsigned.
+  const __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+  const __m128i control = _mm_cmpeq_epi8(
+      _mm_min_epu8(offset, _mm_set1_epi8('\r' - '\t')), offset);
+  return static_cast<uint16_t>(
+      _mm_movemask_epi8(_mm_or_si128(space, control)));
+}
+#endif
+
+// @return a mask with bit i set if data[i] is whitespace.
+uint64_t whitespaceMask64(const char *data) {
+#if defined(__SSE2__)
+  return whitespaceMask16(data) | whitespaceMask16(data + 16) << 16 |
+         whitespaceMask16(data + 32) << 32 | whitespaceMask16(data + 48) << 48;
+#else
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; i++) {
+    mask |= static_cast<uint64_t>(isWhitespace(data[i])) << i;
+  }
+  return mask;
+#endif
+}
+
+enum CharClass : uint8_t {
+  Space,
+  Letter,
+  Digit,
+  Punctuation,
+  Utf8Lead,
+  Utf8Continuation,
+  CharClassCount,
+};
+
+constexpr std::array<uint8_t, 256> charClasses() {
+  std::array<uint8_t, 256> classes{};
+  for (int c = 0; c < 256; c++) {
+    if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      classes[c] = Space;
+    } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      classes[c] = Letter;
+    } else if (c >= '0' && c <= '9') {
+      classes[c] = Digit;
+    } else if (c < 0x80) {
+      classes[c] = Punctuation;
+    } else if (c < 0xC0) {
+      classes[c] = Utf8Continuation;
+    } else {
+      classes[c] = Utf8Lead;
+    }
+  }
+  return classes;
+}
+
+constexpr std::array<uint8_t, 256> CharClasses = charClasses();
+
+// The number of consecutive characters of a class that make up about one
+// token, or 0 if the class is free. English words average about 4 letters per
+// token, and numbers are split into groups of up to 3 digits. Every
+// punctuation character and every non ASCII code point is a token of its own.
+constexpr uint8_t CharsPerToken[CharClassCount] = {
+    0, // Space
+    4, // Letter
+    3, // Digit
+    1, // Punctuation
+    1, // Utf8Lead
+    0, // Utf8Continuation
+};
+
+uint64_t runTokens(uint8_t char_class, uint64_t length) {
+  const uint64_t chars_per_token = CharsPerToken[char_class];
+  return chars_per_token == 0
+             ? 0
+             : (length + chars_per_token - 1) / chars_per_token;
+}
+
+} // namespace
+
+uint64_t countWords(absl::string_view text) {
+  uint64_t words = 0;
+  // whether the byte before the current one is whitespace. The start of the
+  // text counts as whitespace.
+  uint64_t previous_whitespace = 1;
+  size_t i = 0;
+  for (; i + 64 <= text.size(); i += 64) {
+    const uint64_t whitespace = whitespaceMask64(text.data() + i);
+    // a word starts at every non whitespace byte that follows whitespace.
+    const uint64_t starts =
+        ~whitespace & ((whitespace << 1) | previous_whitespace);
+    words += __builtin_popcountll(starts);
+    previous_whitespace = whitespace >> 63;
+  }
+  for (; i < text.size(); i++) {
+    const bool whitespace = isWhitespace(text[i]);
+    words += !whitespace && previous_whitespace;
+    previous_whitespace = whitespace;
+  }
+  return words;
+}
+
+uint64_t estimateTokens(absl::string_view text) {
+  uint64_t tokens = 0;
+  uint8_t run_class = Space;
+  uint64_t run_length = 0;
+  for (const char c : text) {
+    const uint8_t char_class = CharClasses[static_cast<unsigned char>(c)];
+    if (char_class == run_class) {
+      run_length++;
+      continue;
+    }
+    tokens += runTokens(run_class, run_length);
+    run_class = char_class;
+    run_length = 1;
+  }
+  return tokens + runTokens(run_class, run_length);
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+/**
+ * Counts the runs of non whitespace characters in the text, where whitespace
+ * is what isspace() matches in the C locale. Processes 64 bytes per step.
+ * @param text supplies the text.
+ * @return the number of words.
+ */
+uint64_t countWords(absl::string_view text);
+
+/**
+ * Approximates the number of tokens a BPE tokenizer would split the text into,
+ * without a vocabulary. Runs of letters and digits are charged per a few
+ * characters, punctuation and non ASCII characters one token each, and
+ * whitespace is free.
+ * @param text supplies the text.
+ * @return the estimated number of tokens.
+ */
+uint64_t estimateTokens(absl::string_view text);
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
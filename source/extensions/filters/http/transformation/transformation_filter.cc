@@ -1,6 +1,7 @@
 #include "source/extensions/filters/http/transformation/transformation_filter.h"
 
 #include "source/common/common/empty_string.h"
+#include "source/common/common/utility.h"
 #include "source/common/common/enum_to_int.h"
 #include "source/common/config/metadata.h"
 #include "source/common/http/header_utility.h"
@@ -23,13 +24,20 @@ struct RcDetailsValues {
 typedef ConstSingleton<RcDetailsValues> RcDetails;
 
 TransformationFilter::TransformationFilter(FilterConfigSharedPtr config)
-    : filter_config_(config) {}
+    : request_spill_(config->spillThreshold()),
+      response_spill_(config->spillThreshold()), filter_config_(config) {
+  cpu_sampled_ = config->cpuStats() != nullptr && config->cpuStats()->sample();
+}
 
 TransformationFilter::~TransformationFilter() {}
 
 void TransformationFilter::onDestroy() { 
   destroyed_ = true;
   resetInternalState(); 
+  if (cpu_sampled_) {
+    cpu_account_.flush(*filter_config_->cpuStats(),
+                       decoder_callbacks_->streamInfo().getRouteName());
+  }
 }
 
 void TransformationFilter::onStreamComplete() { transformOnStreamCompletion(); }
@@ -37,7 +45,7 @@ void TransformationFilter::onStreamComplete() { transformOnStreamCompletion(); }
 Http::FilterHeadersStatus
 TransformationFilter::decodeHeaders(Http::RequestHeaderMap &header_map,
                                     bool end_stream) {
-
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeHeaders);
   request_headers_ = &header_map;
   setupTransformationPair();
   if (is_error()) {
@@ -61,14 +69,15 @@ TransformationFilter::decodeHeaders(Http::RequestHeaderMap &header_map,
 
 Http::FilterDataStatus TransformationFilter::decodeData(Buffer::Instance &data,
                                                         bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeData);
   if (!requestActive()) {
     return Http::FilterDataStatus::Continue;
   }
 
-  request_body_.move(data);
-  if ((decoder_buffer_limit_ != 0) &&
-      (request_body_.length() > decoder_buffer_limit_)) {
-    error(Error::PayloadTooLarge);
+  request_spill_.move(data);
+  if (const auto limit_error =
+          bodyLimitError(request_spill_.length(), decoder_buffer_limit_)) {
+    error(*limit_error);
     requestError();
     return Http::FilterDataStatus::StopIterationNoBuffer;
   }
@@ -85,6 +94,7 @@ Http::FilterDataStatus TransformationFilter::decodeData(Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 TransformationFilter::decodeTrailers(Http::RequestTrailerMap &) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::DecodeTrailers);
   if (requestActive()) {
     filter_config_->stats().request_body_transformations_.inc();
     transformRequest();
@@ -96,6 +106,7 @@ TransformationFilter::decodeTrailers(Http::RequestTrailerMap &) {
 Http::FilterHeadersStatus
 TransformationFilter::encodeHeaders(Http::ResponseHeaderMap &header_map,
                                     bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::EncodeHeaders);
   response_headers_ = &header_map;
 
   if (!response_transformation_ && route_config_ != nullptr) {
@@ -121,19 +132,30 @@ TransformationFilter::encodeHeaders(Http::ResponseHeaderMap &header_map,
     return destroyed_ ? Http::FilterHeadersStatus::StopIteration : Http::FilterHeadersStatus::Continue;
   }
 
+  setupResponseDecompression();
   return Http::FilterHeadersStatus::StopIteration;
 }
 
 Http::FilterDataStatus TransformationFilter::encodeData(Buffer::Instance &data,
                                                         bool end_stream) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::EncodeData);
   if (!responseActive()) {
     return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer : Http::FilterDataStatus::Continue;
   }
 
-  response_body_.move(data);
-  if ((encoder_buffer_limit_ != 0) &&
-      (response_body_.length() > encoder_buffer_limit_)) {
-    error(Error::PayloadTooLarge);
+  if (response_decompressor_ != nullptr) {
+    if (!decompressResponseData(data)) {
+      error(Error::DecompressionError);
+      responseError();
+      return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer : Http::FilterDataStatus::Continue;
+    }
+  } else {
+    response_spill_.move(data);
+  }
+  // the limit applies to the decompressed body.
+  if (const auto limit_error =
+          bodyLimitError(response_spill_.length(), encoder_buffer_limit_)) {
+    error(*limit_error);
     responseError();
     return destroyed_ ? Http::FilterDataStatus::StopIterationNoBuffer : Http::FilterDataStatus::Continue;
   }
@@ -149,6 +171,7 @@ Http::FilterDataStatus TransformationFilter::encodeData(Buffer::Instance &data,
 
 Http::FilterTrailersStatus
 TransformationFilter::encodeTrailers(Http::ResponseTrailerMap &) {
+  Stats::ScopedCpuAccount cpu(cpuAccount(), Stats::CpuStep::EncodeTrailers);
   if (responseActive()) {
     filter_config_->stats().response_body_transformations_.inc();
     transformResponse();
@@ -187,6 +210,7 @@ void TransformationFilter::setupTransformationPair() {
 }
 
 void TransformationFilter::transformRequest() {
+  drainSpill(request_spill_, request_body_);
   transformSomething(*decoder_callbacks_, request_transformation_,
                      *request_headers_, request_body_,
                      &TransformationFilter::requestError,
@@ -198,10 +222,17 @@ void TransformationFilter::transformRequest() {
 }
 
 void TransformationFilter::transformResponse() {
+  drainSpill(response_spill_, response_body_);
   transformSomething(*encoder_callbacks_, response_transformation_,
                      *response_headers_, response_body_,
                      &TransformationFilter::responseError,
                      &TransformationFilter::addEncoderData);
+  if (response_decompressor_ != nullptr) {
+    // the transformation rendered an empty body, so addEncoderData() wasn't
+    // called; the content-length removed for decompression still needs to be
+    // set.
+    finishResponseDecompression(response_body_);
+  }
 }
 
 void TransformationFilter::addDecoderData(Buffer::Instance &data) {
@@ -209,9 +240,65 @@ void TransformationFilter::addDecoderData(Buffer::Instance &data) {
 }
 
 void TransformationFilter::addEncoderData(Buffer::Instance &data) {
+  if (response_decompressor_ != nullptr) {
+    finishResponseDecompression(data);
+  }
   encoder_callbacks_->addEncodedData(data, false);
 }
 
+void TransformationFilter::setupResponseDecompression() {
+  const ContentCodecs *codecs = filter_config_->responseCodecs();
+  if (codecs == nullptr) {
+    return;
+  }
+  const auto encoding =
+      response_headers_->get(Http::CustomHeaders::get().ContentEncoding);
+  // stacked encodings such as "gzip, br" are left alone.
+  if (encoding.size() != 1) {
+    return;
+  }
+  const absl::string_view value =
+      StringUtil::trim(encoding[0]->value().getStringView());
+  response_decompressor_ = codecs->createDecompressor(value);
+  if (response_decompressor_ == nullptr) {
+    return;
+  }
+  response_content_encoding_ = std::string(value);
+  // the transformation sees, and by default produces, an identity body.
+  response_headers_->remove(Http::CustomHeaders::get().ContentEncoding);
+  response_headers_->removeContentLength();
+  filter_config_->stats().response_body_decompressions_.inc();
+}
+
+bool TransformationFilter::decompressResponseData(Buffer::Instance &data) {
+  // decompress as the data arrives so the limit applies to the decompressed
+  // body, and only the decompressed body is buffered.
+  Buffer::OwnedImpl decompressed;
+  if (!response_decompressor_->decompress(data, decompressed)) {
+    ENVOY_STREAM_LOG(debug, "failed to decompress {} response body",
+                     *encoder_callbacks_, response_content_encoding_);
+    filter_config_->stats().response_body_decompression_errors_.inc();
+    return false;
+  }
+  data.drain(data.length());
+  response_spill_.move(decompressed);
+  return true;
+}
+
+void TransformationFilter::finishResponseDecompression(Buffer::Instance &data) {
+  response_decompressor_.reset();
+  const ContentCodecs *codecs = filter_config_->responseCodecs();
+  // an empty body is sent as is, with no encoding.
+  if (codecs->recompress() && data.length() > 0) {
+    codecs->createCompressor(response_content_encoding_)
+        ->compress(data, Envoy::Compression::Compressor::State::Finish);
+    response_headers_->addCopy(Http::CustomHeaders::get().ContentEncoding,
+                               response_content_encoding_);
+    filter_config_->stats().response_body_recompressions_.inc();
+  }
+  response_headers_->setContentLength(data.length());
+}
+
 void TransformationFilter::transformOnStreamCompletion() {
   if (on_stream_completion_transformation_ == nullptr) {
     return;
@@ -250,6 +337,7 @@ void TransformationFilter::transformSomething(
     void (TransformationFilter::*responeWithError)(),
     void (TransformationFilter::*addData)(Buffer::Instance &)) {
 
+  disableOptionalBodyParsing(callbacks);
   try {
     // if log_request_response_info_ is set on the transformation, log the
     // request body and request headers before transformation
@@ -304,6 +392,63 @@ void TransformationFilter::responseError() {
 void TransformationFilter::resetInternalState() {
   request_body_.drain(request_body_.length());
   response_body_.drain(response_body_.length());
+  request_spill_.reset();
+  response_spill_.reset();
+  response_decompressor_.reset();
+}
+
+absl::optional<TransformationFilter::Error>
+TransformationFilter::bodyLimitError(uint64_t length,
+                                     uint32_t buffer_limit) const {
+  // a body that can spill is bounded by the spill limit instead of the
+  // connection buffer limit.
+  const uint64_t limit = filter_config_->spillThreshold() != 0
+                             ? filter_config_->spillMaxBytes()
+                             : buffer_limit;
+  if (limit != 0 && length > limit) {
+    return Error::PayloadTooLarge;
+  }
+  // the limit shrinks as the shed action rises, so the largest bodies are
+  // shed first. unlimited bodies are the most exposed to memory pressure, so
+  // they are shed too. this only runs as a body's data arrives: a body
+  // buffered on an idle stream is left to the overload manager's resets.
+  const double shed = filter_config_->overloadActionValue(
+      TransformationOverloadActionNames::get().ShedBufferedBodies);
+  const uint64_t shed_limit =
+      limit != 0 ? limit
+                 : filter_config_->unlimitedBodyShedReferenceBytes();
+  if (shed > 0 && length > shed_limit * (1 - shed)) {
+    filter_config_->stats().overload_body_shed_.inc();
+    return Error::Overloaded;
+  }
+  return absl::nullopt;
+}
+
+void TransformationFilter::disableOptionalBodyParsing(
+    Http::StreamFilterCallbacks &callbacks) {
+  const double value = filter_config_->overloadActionValue(
+      TransformationOverloadActionNames::get().DisableOptionalBodyParsing);
+  if (value < 1) {
+    return;
+  }
+  auto &filter_state = *callbacks.streamInfo().filterState();
+  if (filter_state.getDataReadOnly<OptionalBodyParsingDisabled>(
+          OptionalBodyParsingDisabled::key()) != nullptr) {
+    return;
+  }
+  filter_state.setData(OptionalBodyParsingDisabled::key(),
+                       std::make_shared<OptionalBodyParsingDisabled>(),
+                       StreamInfo::FilterState::StateType::ReadOnly,
+                       StreamInfo::FilterState::LifeSpan::Request);
+  filter_config_->stats().overload_body_parsing_disabled_.inc();
+}
+
+void TransformationFilter::drainSpill(Buffer::SpillBuffer &spill,
+                                      Buffer::Instance &body) {
+  if (spill.spilled()) {
+    filter_config_->stats().body_spills_.inc();
+  }
+  spill.drainTo(body);
 }
 
 void TransformationFilter::error(Error error, std::string msg) {
@@ -330,6 +475,16 @@ void TransformationFilter::error(Error error, std::string msg) {
     error_code_ = Http::Code::NotFound;
     break;
   }
+  case Error::Overloaded: {
+    error_messgae_ = "envoy overloaded";
+    error_code_ = Http::Code::ServiceUnavailable;
+    break;
+  }
+  case Error::DecompressionError: {
+    error_messgae_ = "upstream response body could not be decompressed";
+    error_code_ = Http::Code::BadGateway;
+    break;
+  }
   }
   if (!msg.empty()) {
     if (error_messgae_.empty()) {
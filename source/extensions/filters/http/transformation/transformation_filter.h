@@ -3,6 +3,8 @@
 #include "envoy/server/filter_config.h"
 
 #include "source/common/buffer/buffer_impl.h"
+#include "source/common/buffer/spill_buffer.h"
+#include "source/common/stats/cpu_accounting.h"
 
 #include "source/extensions/filters/http/transformation/transformation_filter_config.h"
 #include "source/extensions/filters/http/transformation/transformer.h"
@@ -39,6 +41,10 @@ public:
       Http::StreamDecoderFilterCallbacks &callbacks) override {
     decoder_callbacks_ = &callbacks;
     decoder_buffer_limit_ = callbacks.decoderBufferLimit();
+    // charge buffered bodies to the stream, so the overload manager can see
+    // and reset the streams holding the most transformation memory.
+    request_body_.bindAccount(callbacks.account());
+    request_spill_.bindAccount(callbacks.account());
   };
 
   // Http::StreamEncoderFilter
@@ -60,6 +66,8 @@ public:
       Http::StreamEncoderFilterCallbacks &callbacks) override {
     encoder_callbacks_ = &callbacks;
     encoder_buffer_limit_ = callbacks.encoderBufferLimit();
+    response_body_.bindAccount(callbacks.account());
+    response_spill_.bindAccount(callbacks.account());
   };
 
 private:
@@ -68,6 +76,8 @@ private:
     JsonParseError,
     TemplateParseError,
     TransformationNotFound,
+    Overloaded,
+    DecompressionError,
   };
 
   enum class Direction {
@@ -91,6 +101,9 @@ private:
 
   void addDecoderData(Buffer::Instance &data);
   void addEncoderData(Buffer::Instance &data);
+  void setupResponseDecompression();
+  bool decompressResponseData(Buffer::Instance &data);
+  void finishResponseDecompression(Buffer::Instance &data);
   void
   transformSomething(Http::StreamFilterCallbacks &callbacks,
                      TransformerConstSharedPtr &transformation,
@@ -100,6 +113,13 @@ private:
                      void (TransformationFilter::*addData)(Buffer::Instance &));
 
   void resetInternalState();
+  Stats::StreamCpuAccount *cpuAccount() {
+    return cpu_sampled_ ? &cpu_account_ : nullptr;
+  }
+  absl::optional<Error> bodyLimitError(uint64_t length,
+                                       uint32_t buffer_limit) const;
+  void disableOptionalBodyParsing(Http::StreamFilterCallbacks &callbacks);
+  void drainSpill(Buffer::SpillBuffer &spill, Buffer::Instance &body);
 
   Http::StreamDecoderFilterCallbacks *decoder_callbacks_{};
   Http::StreamEncoderFilterCallbacks *encoder_callbacks_{};
@@ -111,6 +131,13 @@ private:
   Http::ResponseHeaderMap *response_headers_{nullptr};
   Buffer::OwnedImpl request_body_{};
   Buffer::OwnedImpl response_body_{};
+  // Bodies are accumulated here while they arrive and moved to request_body_
+  // and response_body_ when they are transformed.
+  Buffer::SpillBuffer request_spill_;
+  Buffer::SpillBuffer response_spill_;
+  // Set while a compressed response body is decompressed into response_body_.
+  CheckedDecompressorPtr response_decompressor_;
+  std::string response_content_encoding_;
 
   TransformerConstSharedPtr request_transformation_;
   TransformerConstSharedPtr response_transformation_;
@@ -120,6 +147,8 @@ private:
   std::string error_messgae_;
   bool should_clear_cache_{};
   bool destroyed_{};
+  bool cpu_sampled_{};
+  Stats::StreamCpuAccount cpu_account_;
 
   FilterConfigSharedPtr filter_config_;
 };
@@ -4,6 +4,7 @@
 #include "source/common/common/matchers.h"
 #include "source/common/protobuf/message_validator_impl.h"
 #include "source/common/protobuf/protobuf.h"
+#include "source/common/protobuf/utility.h"
 #include "source/extensions/filters/http/transformation/matcher.h"
 #include "source/extensions/filters/http/transformation/transformation_factory.h"
 #include "source/common/matcher/matcher.h"
@@ -13,6 +14,10 @@ namespace Extensions {
 namespace HttpFilters {
 namespace Transformation {
 
+namespace {
+constexpr uint64_t DefaultSpillMaxBytes = 64 * 1024 * 1024;
+} // namespace
+
 void TransformationFilterConfig::addTransformationLegacy(
     const envoy::api::v2::filter::http::TransformationRule &rule,
     Server::Configuration::ServerFactoryContext &context) {
@@ -40,6 +45,21 @@ TransformationFilterConfig::TransformationFilterConfig(
     Server::Configuration::ServerFactoryContext &context)
     : FilterConfig(prefix, context.scope(), proto_config.stage(),
                    proto_config.log_request_response_info()) {
+    overload_manager_ = &context.overloadManager();
+    cpu_stats_ = std::make_shared<const Stats::FilterCpuStats>(
+        context.scope(), prefix + "transformation.cpu", context.runtime());
+    if (proto_config.has_response_decompression()) {
+      response_codecs_ = std::make_unique<const ContentCodecs>(
+          proto_config.response_decompression().recompress());
+    }
+    if (proto_config.has_body_spill()) {
+      spill_threshold_ = proto_config.body_spill().threshold_bytes();
+      spill_max_bytes_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+          proto_config.body_spill(), max_bytes, DefaultSpillMaxBytes);
+    }
+    unlimited_body_shed_reference_bytes_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+        proto_config, unlimited_body_shed_reference_bytes,
+        unlimited_body_shed_reference_bytes_);
     if (proto_config.has_matcher()) {
       matcher_ = createTransformationMatcher(proto_config.matcher(), context);
       return;
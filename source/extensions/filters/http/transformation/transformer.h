@@ -6,7 +6,9 @@
 #include "envoy/http/filter.h"
 #include "envoy/http/header_map.h"
 #include "envoy/router/router.h"
+#include "envoy/stream_info/filter_state.h"
 
+#include "source/common/common/macros.h"
 #include "source/common/protobuf/protobuf.h"
 
 namespace Envoy {
@@ -36,6 +38,17 @@ private:
 
 typedef std::shared_ptr<const Transformer> TransformerConstSharedPtr;
 
+// Set in the filter state while the transformation filter is under memory
+// pressure. Transformers skip body parsing whose failure they would ignore
+// anyway.
+class OptionalBodyParsingDisabled : public StreamInfo::FilterState::Object {
+public:
+  static const std::string &key() {
+    CONSTRUCT_ON_FIRST_USE(std::string,
+                           "io.solo.transformation.optional_body_parsing_disabled");
+  }
+};
+
 class TransformerPair {
 public:
   TransformerPair(TransformerConstSharedPtr request_transformer,
@@ -0,0 +1,313 @@
+#include "source/extensions/transformers/aws_lambda/api_gateway_v2_request_transformer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/base64.h"
+#include "source/common/http/header_snapshot.h"
+#include "source/common/http/headers.h"
+#include "source/common/http/utility.h"
+#include "source/extensions/transformers/aws_lambda/json_writer.h"
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/types/span.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+constexpr absl::string_view DefaultName = "$default";
+
+// Checks that text is valid UTF-8, i.e. that it can be written as a json
+// string. Sequences may span the parts it is given.
+class Utf8Validator {
+public:
+  void update(absl::string_view part) {
+    for (const char ch : part) {
+      if (!valid_) {
+        return;
+      }
+      const uint8_t c = static_cast<uint8_t>(ch);
+      if (remaining_ != 0) {
+        valid_ = c >= lower_ && c <= upper_;
+        lower_ = 0x80;
+        upper_ = 0xBF;
+        remaining_--;
+      } else if (c >= 0xC2 && c <= 0xDF) {
+        remaining_ = 1;
+      } else if (c >= 0xE0 && c <= 0xEF) {
+        // excludes overlong encodings and surrogates.
+        remaining_ = 2;
+        lower_ = c == 0xE0 ? 0xA0 : 0x80;
+        upper_ = c == 0xED ? 0x9F : 0xBF;
+      } else if (c >= 0xF0 && c <= 0xF4) {
+        // excludes overlong encodings and code points above U+10FFFF.
+        remaining_ = 3;
+        lower_ = c == 0xF0 ? 0x90 : 0x80;
+        upper_ = c == 0xF4 ? 0x8F : 0xBF;
+      } else {
+        valid_ = c < 0x80;
+      }
+    }
+  }
+
+  bool valid() const { return valid_ && remaining_ == 0; }
+
+private:
+  bool valid_{true};
+  int remaining_{};
+  // the range of the next continuation byte.
+  uint8_t lower_{0x80};
+  uint8_t upper_{0xBF};
+};
+
+// Decodes the query string into parameters whose repeated values are joined
+// with commas, like API Gateway does.
+std::vector<std::pair<std::string, std::string>>
+parseQueryString(absl::string_view query_string) {
+  std::vector<std::pair<std::string, std::string>> params;
+  for (absl::string_view param :
+       absl::StrSplit(query_string, '&', absl::SkipEmpty())) {
+    const std::pair<absl::string_view, absl::string_view> name_value =
+        absl::StrSplit(param, absl::MaxSplits('=', 1));
+    std::string name = Http::Utility::PercentEncoding::decode(name_value.first);
+    std::string value =
+        Http::Utility::PercentEncoding::decode(name_value.second);
+    auto it = std::find_if(params.begin(), params.end(),
+                           [&name](const auto &p) { return p.first == name; });
+    if (it == params.end()) {
+      params.emplace_back(std::move(name), std::move(value));
+    } else {
+      absl::StrAppend(&it->second, ",", value);
+    }
+  }
+  return params;
+}
+
+} // namespace
+
+HttpFilters::Transformation::TransformerConstSharedPtr
+ApiGatewayV2RequestTransformerFactory::createTransformer(
+    const Protobuf::Message &config,
+    __attribute__((unused)) google::protobuf::BoolValue log_request_response_info,
+    Server::Configuration::CommonFactoryContext &context) {
+  const auto &typed_config = MessageUtil::downcastAndValidate<
+      const ApiGatewayV2RequestTransformerProto &>(
+      config, context.messageValidationContext().staticValidationVisitor());
+  return std::make_shared<ApiGatewayV2RequestTransformer>(typed_config);
+}
+
+ApiGatewayV2RequestTransformer::ApiGatewayV2RequestTransformer(
+    const ApiGatewayV2RequestTransformerProto &config)
+    : Transformation::Transformer(google::protobuf::BoolValue()),
+      stage_(config.stage().empty() ? DefaultName : config.stage()),
+      route_key_(config.route_key().empty() ? DefaultName : config.route_key()),
+      time_formatter_("%d/%b/%Y:%H:%M:%S +0000") {}
+
+void ApiGatewayV2RequestTransformer::transform(
+    Http::RequestOrResponseHeaderMap &header_map,
+    Http::RequestHeaderMap *request_headers, Buffer::Instance &body,
+    Http::StreamFilterCallbacks &stream_filter_callbacks) const {
+  if (request_headers == nullptr || &header_map != request_headers) {
+    ENVOY_STREAM_LOG(debug,
+                     "Api Gateway v2 request transformer cannot be used on "
+                     "the response path",
+                     stream_filter_callbacks);
+    return;
+  }
+
+  // the views into the headers stay valid while the event is written.
+  const Http::HeaderSnapshot snapshot(*request_headers);
+  const absl::string_view authority = request_headers->getHostValue();
+  // a host header, which codecs normally turn into the authority, is joined
+  // to it.
+  const Http::HeaderSnapshot::Values *host = nullptr;
+  absl::InlinedVector<absl::string_view, 4> cookies;
+  for (const Http::HeaderSnapshot::Entry &header : snapshot.entries()) {
+    if (header.key == Http::Headers::get().HostLegacy.get()) {
+      host = &header.values;
+    } else if (header.key == Http::Headers::get().Cookie.get()) {
+      for (const absl::string_view value : header.values) {
+        for (absl::string_view cookie : absl::StrSplit(value, ';')) {
+          cookie = absl::StripAsciiWhitespace(cookie);
+          if (!cookie.empty()) {
+            cookies.push_back(cookie);
+          }
+        }
+      }
+    }
+  }
+
+  const absl::string_view path = request_headers->getPathValue();
+  const size_t query_start = path.find('?');
+  const absl::string_view raw_path = path.substr(0, query_start);
+  absl::string_view raw_query_string;
+  if (query_start != absl::string_view::npos) {
+    raw_query_string = path.substr(query_start + 1);
+    raw_query_string = raw_query_string.substr(0, raw_query_string.find('#'));
+  }
+  const std::vector<std::pair<std::string, std::string>> query_params =
+      parseQueryString(raw_query_string);
+
+  const StreamInfo::StreamInfo &stream_info =
+      stream_filter_callbacks.streamInfo();
+  absl::string_view source_ip;
+  const Network::Address::InstanceConstSharedPtr &remote_address =
+      stream_info.downstreamAddressProvider().remoteAddress();
+  if (remote_address != nullptr && remote_address->ip() != nullptr) {
+    source_ip = remote_address->ip()->addressAsString();
+  }
+  absl::string_view protocol;
+  if (stream_info.protocol().has_value()) {
+    protocol = Http::Utility::getProtocolString(stream_info.protocol().value());
+  }
+  const SystemTime start_time = stream_info.startTime();
+  const absl::string_view domain_name =
+      Http::Utility::parseAuthority(authority).host_;
+
+  // the request body is moved aside and the event written in its place.
+  Buffer::OwnedImpl request_body;
+  request_body.move(body);
+  body.drain(body.length());
+  Utf8Validator utf8;
+  for (const Buffer::RawSlice &slice : request_body.getRawSlices()) {
+    utf8.update(
+        absl::string_view(static_cast<const char *>(slice.mem_), slice.len_));
+  }
+  const bool base64_encoded = !utf8.valid();
+
+  JsonWriter writer(body);
+  writer.startObject();
+  writer.key("version");
+  writer.stringValue("2.0");
+  writer.key("routeKey");
+  writer.stringValue(route_key_);
+  writer.key("rawPath");
+  writer.stringValue(raw_path);
+  writer.key("rawQueryString");
+  writer.stringValue(raw_query_string);
+
+  if (!cookies.empty()) {
+    writer.key("cookies");
+    writer.startArray();
+    for (const absl::string_view cookie : cookies) {
+      writer.stringValue(cookie);
+    }
+    writer.endArray();
+  }
+
+  // repeated headers are joined with commas, like API Gateway does.
+  const auto write_values = [&writer](absl::string_view key,
+                                      absl::Span<const absl::string_view> values) {
+    writer.key(key);
+    if (values.size() == 1) {
+      writer.stringValue(values.front());
+    } else {
+      writer.stringValue(absl::StrJoin(values, ","));
+    }
+  };
+  writer.key("headers");
+  writer.startObject();
+  if (!authority.empty() || host != nullptr) {
+    Http::HeaderSnapshot::Values values;
+    if (!authority.empty()) {
+      values.push_back(authority);
+    }
+    if (host != nullptr) {
+      values.insert(values.end(), host->begin(), host->end());
+    }
+    write_values(Http::Headers::get().HostLegacy.get(), values);
+  }
+  for (const Http::HeaderSnapshot::Entry &header : snapshot.entries()) {
+    if (absl::StartsWith(header.key, ":") ||
+        header.key == Http::Headers::get().HostLegacy.get() ||
+        header.key == Http::Headers::get().Cookie.get()) {
+      continue;
+    }
+    write_values(header.key, header.values);
+  }
+  writer.endObject();
+
+  if (!query_params.empty()) {
+    writer.key("queryStringParameters");
+    writer.startObject();
+    for (const auto &param : query_params) {
+      writer.key(param.first);
+      writer.stringValue(param.second);
+    }
+    writer.endObject();
+  }
+
+  writer.key("requestContext");
+  writer.startObject();
+  writer.key("domainName");
+  writer.stringValue(domain_name);
+  writer.key("domainPrefix");
+  writer.stringValue(domain_name.substr(0, domain_name.find('.')));
+  writer.key("http");
+  writer.startObject();
+  writer.key("method");
+  writer.stringValue(request_headers->getMethodValue());
+  writer.key("path");
+  writer.stringValue(raw_path);
+  writer.key("protocol");
+  writer.stringValue(protocol);
+  writer.key("sourceIp");
+  writer.stringValue(source_ip);
+  writer.key("userAgent");
+  writer.stringValue(request_headers->getUserAgentValue());
+  writer.endObject();
+  writer.key("requestId");
+  writer.stringValue(request_headers->getRequestIdValue());
+  writer.key("routeKey");
+  writer.stringValue(route_key_);
+  writer.key("stage");
+  writer.stringValue(stage_);
+  writer.key("time");
+  writer.stringValue(time_formatter_.fromTime(start_time));
+  writer.key("timeEpoch");
+  writer.numberValue(std::chrono::duration_cast<std::chrono::milliseconds>(
+                         start_time.time_since_epoch())
+                         .count());
+  writer.endObject();
+
+  if (request_body.length() != 0) {
+    writer.key("body");
+    if (base64_encoded) {
+      writer.stringValue(Base64::encode(request_body, request_body.length()));
+    } else {
+      writer.startString();
+      for (const Buffer::RawSlice &slice : request_body.getRawSlices()) {
+        writer.stringPart(absl::string_view(
+            static_cast<const char *>(slice.mem_), slice.len_));
+      }
+      writer.endString();
+    }
+  }
+  writer.key("isBase64Encoded");
+  writer.boolValue(base64_encoded);
+  writer.endObject();
+
+  request_headers->setReferenceContentType(
+      Http::Headers::get().ContentTypeValues.Json);
+  request_headers->setContentLength(body.length());
+}
+
+REGISTER_FACTORY(ApiGatewayV2RequestTransformerFactory,
+                 HttpFilters::Transformation::TransformerExtensionFactory);
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
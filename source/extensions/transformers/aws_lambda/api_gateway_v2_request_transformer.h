@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+
+#include "source/common/common/utility.h"
+#include "source/extensions/filters/http/transformation/transformer.h"
+#include "source/extensions/filters/http/transformation/transformation_factory.h"
+
+#include "api/envoy/config/transformer/aws_lambda/v2/api_gateway_transformer.pb.h"
+#include "api/envoy/config/transformer/aws_lambda/v2/api_gateway_transformer.pb.validate.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+using ApiGatewayV2RequestTransformerProto =
+    envoy::config::transformer::aws_lambda::v2::ApiGatewayV2RequestTransformation;
+
+class ApiGatewayV2RequestTransformerFactory
+    : public HttpFilters::Transformation::TransformerExtensionFactory {
+public:
+  HttpFilters::Transformation::TransformerConstSharedPtr createTransformer(
+      const Protobuf::Message &config,
+      google::protobuf::BoolValue log_request_response_info,
+      Server::Configuration::CommonFactoryContext &context) override;
+
+  ProtobufTypes::MessagePtr createEmptyConfigProto() override {
+    return std::make_unique<ApiGatewayV2RequestTransformerProto>();
+  };
+  std::string name() const override {
+    return "io.solo.api_gateway.api_gateway_v2_request_transformer";
+  }
+};
+
+/**
+ * Replaces the request body with an API Gateway HTTP API event in the payload
+ * format version 2.0. The event is written directly to the body in a single
+ * pass. Bodies that aren't valid UTF-8 are base64 encoded. In header values
+ * and decoded query parameters, bytes that aren't valid UTF-8 are replaced
+ * with U+FFFD.
+ */
+class ApiGatewayV2RequestTransformer : public Transformation::Transformer,
+                                       Logger::Loggable<Logger::Id::filter> {
+public:
+  ApiGatewayV2RequestTransformer(const ApiGatewayV2RequestTransformerProto &config);
+
+  void transform(Http::RequestOrResponseHeaderMap &map,
+                 Http::RequestHeaderMap *request_headers,
+                 Buffer::Instance &body,
+                 Http::StreamFilterCallbacks &) const override;
+  bool passthrough_body() const override { return false; };
+
+private:
+  const std::string stage_;
+  const std::string route_key_;
+  const DateFormatter time_formatter_;
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
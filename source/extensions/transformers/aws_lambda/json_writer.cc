@@ -0,0 +1,193 @@
+#include "source/extensions/transformers/aws_lambda/json_writer.h"
+
+#include "source/common/common/assert.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace {
+
+// @return the length of the UTF-8 sequence starting at the given byte, or 0 if
+// it isn't a complete and valid one.
+size_t utf8SequenceLength(absl::string_view text, size_t start) {
+  const uint8_t lead = static_cast<uint8_t>(text[start]);
+  size_t length;
+  // the range of the first continuation byte, which excludes overlong
+  // encodings, surrogates and code points above U+10FFFF.
+  uint8_t lower = 0x80;
+  uint8_t upper = 0xBF;
+  if (lead < 0x80) {
+    return 1;
+  } else if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    lower = lead == 0xE0 ? 0xA0 : 0x80;
+    upper = lead == 0xED ? 0x9F : 0xBF;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    lower = lead == 0xF0 ? 0x90 : 0x80;
+    upper = lead == 0xF4 ? 0x8F : 0xBF;
+  } else {
+    return 0;
+  }
+  if (text.size() - start < length) {
+    return 0;
+  }
+  for (size_t i = 1; i < length; i++) {
+    const uint8_t c = static_cast<uint8_t>(text[start + i]);
+    if (c < lower || c > upper) {
+      return 0;
+    }
+    lower = 0x80;
+    upper = 0xBF;
+  }
+  return length;
+}
+
+// U+FFFD, the replacement character.
+constexpr absl::string_view Replacement = "\xEF\xBF\xBD";
+
+} // namespace
+
+void JsonWriter::startObject() {
+  separate();
+  output_.add("{", 1);
+  empty_.push_back(true);
+}
+
+void JsonWriter::endObject() {
+  ASSERT(!empty_.empty() && !after_key_);
+  empty_.pop_back();
+  output_.add("}", 1);
+}
+
+void JsonWriter::startArray() {
+  separate();
+  output_.add("[", 1);
+  empty_.push_back(true);
+}
+
+void JsonWriter::endArray() {
+  ASSERT(!empty_.empty());
+  empty_.pop_back();
+  output_.add("]", 1);
+}
+
+void JsonWriter::key(absl::string_view name) {
+  ASSERT(!after_key_);
+  separate();
+  output_.add("\"", 1);
+  escape(name, true);
+  output_.add("\":", 2);
+  after_key_ = true;
+}
+
+void JsonWriter::stringValue(absl::string_view value) {
+  startString();
+  escape(value, true);
+  output_.add("\"", 1);
+}
+
+void JsonWriter::numberValue(uint64_t value) {
+  separate();
+  output_.add(absl::StrCat(value));
+}
+
+void JsonWriter::boolValue(bool value) {
+  separate();
+  output_.add(value ? absl::string_view("true") : absl::string_view("false"));
+}
+
+void JsonWriter::startString() {
+  separate();
+  output_.add("\"", 1);
+}
+
+void JsonWriter::stringPart(absl::string_view part) { escape(part, false); }
+
+void JsonWriter::endString() { output_.add("\"", 1); }
+
+// Writes the comma before a value, unless it is the first of its container or
+// follows a key.
+void JsonWriter::separate() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (empty_.empty()) {
+    return;
+  }
+  if (empty_.back()) {
+    empty_.back() = false;
+  } else {
+    output_.add(",", 1);
+  }
+}
+
+// Runs of characters that need no escaping are added as a whole. Bytes of
+// multibyte UTF-8 sequences are never escaped, so text may be split anywhere
+// unless invalid sequences are replaced.
+void JsonWriter::escape(absl::string_view text, bool replace_invalid) {
+  static constexpr char Hex[] = "0123456789abcdef";
+  size_t run = 0;
+  size_t i = 0;
+  while (i < text.size()) {
+    const unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c >= 0x80) {
+      const size_t length = replace_invalid ? utf8SequenceLength(text, i) : 1;
+      if (length != 0) {
+        i += length;
+        continue;
+      }
+      output_.add(text.data() + run, i - run);
+      output_.add(Replacement);
+      run = ++i;
+      continue;
+    }
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      i++;
+      continue;
+    }
+    output_.add(text.data() + run, i - run);
+    run = ++i;
+    switch (c) {
+    case '"':
+      output_.add("\\\"", 2);
+      break;
+    case '\\':
+      output_.add("\\\\", 2);
+      break;
+    case '\n':
+      output_.add("\\n", 2);
+      break;
+    case '\r':
+      output_.add("\\r", 2);
+      break;
+    case '\t':
+      output_.add("\\t", 2);
+      break;
+    case '\b':
+      output_.add("\\b", 2);
+      break;
+    case '\f':
+      output_.add("\\f", 2);
+      break;
+    default: {
+      const char escaped[] = {'\\', 'u', '0', '0', Hex[c >> 4], Hex[c & 0xf]};
+      output_.add(escaped, sizeof(escaped));
+      break;
+    }
+    }
+  }
+  output_.add(text.data() + run, text.size() - run);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
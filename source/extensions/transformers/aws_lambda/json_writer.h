@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include "envoy/buffer/buffer.h"
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+/**
+ * Writes a json document directly to a buffer as it is produced, without
+ * building a document first. Separators are inserted automatically; the caller
+ * is responsible for the calls being well nested and for keys being written
+ * only in objects. Keys and string values that aren't valid UTF-8, e.g. taken
+ * from headers or percent-decoded query strings, have each invalid byte
+ * replaced with U+FFFD.
+ */
+class JsonWriter {
+public:
+  explicit JsonWriter(Buffer::Instance &output) : output_(output) {}
+
+  void startObject();
+  void endObject();
+  void startArray();
+  void endArray();
+  void key(absl::string_view name);
+
+  void stringValue(absl::string_view value);
+  void numberValue(uint64_t value);
+  void boolValue(bool value);
+
+  /**
+   * Writes a string value in parts, e.g. from several buffer slices, without
+   * joining them first. A multibyte sequence may be split between parts, so
+   * parts are written as they are: the caller must check that the joined
+   * text is valid UTF-8.
+   */
+  void startString();
+  void stringPart(absl::string_view part);
+  void endString();
+
+private:
+  void separate();
+  void escape(absl::string_view text, bool replace_invalid);
+
+  Buffer::Instance &output_;
+  // for each open container, whether it has no element yet.
+  absl::InlinedVector<bool, 8> empty_;
+  bool after_key_{};
+};
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,89 @@
+#include <string>
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/buffer/spill_buffer.h"
+
+#include "absl/strings/str_cat.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Buffer {
+namespace {
+
+TEST(SpillBufferTest, KeepsSmallBodyOnHeap) {
+  SpillBuffer spill(16);
+  OwnedImpl data("hello");
+  spill.move(data);
+  EXPECT_EQ(0, data.length());
+  EXPECT_EQ(5, spill.length());
+  EXPECT_FALSE(spill.spilled());
+
+  OwnedImpl output;
+  spill.drainTo(output);
+  EXPECT_EQ("hello", output.toString());
+  EXPECT_EQ(0, spill.length());
+}
+
+TEST(SpillBufferTest, DisabledWithZeroThreshold) {
+  SpillBuffer spill(0);
+  OwnedImpl data(std::string(1024, 'a'));
+  spill.move(data);
+  EXPECT_FALSE(spill.spilled());
+  EXPECT_EQ(1024, spill.length());
+}
+
+#if defined(__linux__)
+TEST(SpillBufferTest, SpillsLargeBodyAsSingleSlice) {
+  SpillBuffer spill(8);
+  std::string expected;
+  for (int i = 0; i < 100; i++) {
+    const std::string chunk = absl::StrCat("chunk", i, ";");
+    expected += chunk;
+    OwnedImpl data(chunk);
+    spill.move(data);
+    EXPECT_EQ(0, data.length());
+  }
+  EXPECT_TRUE(spill.spilled());
+  EXPECT_EQ(expected.size(), spill.length());
+
+  OwnedImpl output;
+  spill.drainTo(output);
+  EXPECT_FALSE(spill.spilled());
+  EXPECT_EQ(0, spill.length());
+  EXPECT_EQ(1, output.getRawSlices().size());
+  EXPECT_EQ(expected, output.toString());
+}
+
+TEST(SpillBufferTest, DrainAppendsToOutput) {
+  SpillBuffer spill(4);
+  OwnedImpl data("spilled body");
+  spill.move(data);
+  EXPECT_TRUE(spill.spilled());
+
+  OwnedImpl output("prefix:");
+  spill.drainTo(output);
+  EXPECT_EQ("prefix:spilled body", output.toString());
+}
+
+TEST(SpillBufferTest, ResetDiscardsSpilledBody) {
+  SpillBuffer spill(4);
+  OwnedImpl data("spilled body");
+  spill.move(data);
+  EXPECT_TRUE(spill.spilled());
+
+  spill.reset();
+  EXPECT_FALSE(spill.spilled());
+  EXPECT_EQ(0, spill.length());
+
+  OwnedImpl more("abc");
+  spill.move(more);
+  OwnedImpl output;
+  spill.drainTo(output);
+  EXPECT_EQ("abc", output.toString());
+}
+#endif
+
+} // namespace
+} // namespace Buffer
+} // namespace Envoy
@@ -0,0 +1,45 @@
+#include "source/common/http/header_snapshot.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Http {
+
+TEST(HeaderSnapshotTest, Empty) {
+  TestRequestHeaderMapImpl headers;
+  EXPECT_TRUE(HeaderSnapshot(headers).entries().empty());
+}
+
+TEST(HeaderSnapshotTest, GroupsRepeatedHeadersInKeyOrder) {
+  TestRequestHeaderMapImpl headers{{":path", "/"},
+                                   {"x-b", "1"},
+                                   {"x-a", "2"},
+                                   {"x-b", "3"},
+                                   {"x-b", ""}};
+  const HeaderSnapshot snapshot(headers);
+
+  const auto &entries = snapshot.entries();
+  ASSERT_EQ(3U, entries.size());
+  EXPECT_EQ(":path", entries[0].key);
+  EXPECT_EQ(HeaderSnapshot::Values({"/"}), entries[0].values);
+  EXPECT_EQ("x-a", entries[1].key);
+  EXPECT_EQ(HeaderSnapshot::Values({"2"}), entries[1].values);
+  EXPECT_EQ("x-b", entries[2].key);
+  EXPECT_EQ(HeaderSnapshot::Values({"1", "3", ""}), entries[2].values);
+}
+
+TEST(HeaderSnapshotTest, ViewsIntoHeaderMap) {
+  TestRequestHeaderMapImpl headers{{"x-a", "value"}};
+  const HeaderSnapshot snapshot(headers);
+
+  const HeaderEntry *entry = headers.get(LowerCaseString("x-a"))[0];
+  EXPECT_EQ(entry->key().getStringView().data(),
+            snapshot.entries()[0].key.data());
+  EXPECT_EQ(entry->value().getStringView().data(),
+            snapshot.entries()[0].values[0].data());
+}
+
+} // namespace Http
+} // namespace Envoy
@@ -1,3 +1,4 @@
+#include "source/common/nats/message_builder.h"
 #include "source/common/nats/streaming/client_impl.h"
 
 #include "test/mocks/common.h"
@@ -9,6 +10,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+using testing::_;
 using testing::NiceMock;
 using testing::Return;
 
@@ -33,6 +35,27 @@ TEST_F(NatsStreamingClientImplTest, Empty) {
                     random_, dispatcher_, op_timeout_};
 }
 
+TEST_F(NatsStreamingClientImplTest, ConnectAheadOfRequests) {
+  ClientImpl client{Tcp::ConnPoolNats::InstancePtr<Message>{conn_pool_},
+                    random_, dispatcher_, op_timeout_};
+  EXPECT_CALL(*conn_pool_, setPoolCallbacks(_));
+  EXPECT_CALL(*conn_pool_,
+              makeRequest(_, MessageBuilder::createConnectMessage()));
+  int connected = 0;
+  client.connect("cluster_id", "discover_prefix", [&connected]() { connected++; });
+
+  // connecting again neither reconnects nor calls back early.
+  client.connect("cluster_id", "discover_prefix", [&connected]() { connected++; });
+  EXPECT_EQ(0, connected);
+
+  client.onConnected("pub_prefix");
+  EXPECT_EQ(2, connected);
+
+  // once connected, the callback is called right away.
+  client.connect("cluster_id", "discover_prefix", [&connected]() { connected++; });
+  EXPECT_EQ(3, connected);
+}
+
 } // namespace Streaming
 } // namespace Nats
 } // namespace Envoy
@@ -0,0 +1,162 @@
+#include "source/common/stats/cpu_accounting.h"
+
+#include "test/mocks/runtime/mocks.h"
+#include "test/mocks/stats/mocks.h"
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::AllOf;
+using testing::ElementsAre;
+using testing::NiceMock;
+using testing::Property;
+using testing::Return;
+
+namespace Envoy {
+namespace Stats {
+namespace {
+
+class CpuAccountingTest : public testing::Test {
+public:
+  NiceMock<MockIsolatedStatsStore> store_;
+  NiceMock<Runtime::MockLoader> runtime_;
+};
+
+TEST_F(CpuAccountingTest, SamplesAtRuntimePercentage) {
+  FilterCpuStats stats(*store_.rootScope(), "test.cpu", runtime_);
+  EXPECT_CALL(runtime_.snapshot_,
+              featureEnabled("io.solo.filters.http.cpu_accounting.sample_percent",
+                             testing::Matcher<uint64_t>(0)))
+      .WillOnce(Return(true))
+      .WillOnce(Return(false));
+  EXPECT_TRUE(stats.sample());
+  EXPECT_FALSE(stats.sample());
+}
+
+TEST_F(CpuAccountingTest, SubStepsAreAccountedToCurrentCallback) {
+  StreamCpuAccount account;
+  EXPECT_EQ(nullptr, StreamCpuAccount::current());
+  {
+    ScopedCpuAccount callback(&account, CpuStep::DecodeData);
+    EXPECT_EQ(&account, StreamCpuAccount::current());
+    {
+      // an unsampled filter's callback running inside this one.
+      ScopedCpuAccount nested(nullptr, CpuStep::EncodeHeaders);
+      EXPECT_EQ(nullptr, StreamCpuAccount::current());
+      ScopedCpuTimer timer(CpuStep::PayloadHash);
+    }
+    EXPECT_EQ(&account, StreamCpuAccount::current());
+    ScopedCpuTimer timer(CpuStep::BodyParse);
+  }
+  EXPECT_EQ(nullptr, StreamCpuAccount::current());
+
+  FilterCpuStats stats(*store_.rootScope(), "test.cpu", runtime_);
+  EXPECT_CALL(store_, deliverHistogramToSinks(
+                          Property(&Metric::name, "test.cpu.payload_hash"), _))
+      .Times(0);
+  account.flush(stats, "");
+}
+
+// Uses at least the given CPU time on this thread.
+void burnCpu(uint64_t ns) {
+  const uint64_t start = cpuClockNs();
+  volatile uint64_t sink = 0;
+  while (cpuClockNs() - start < ns) {
+    sink = sink + 1;
+  }
+}
+
+TEST_F(CpuAccountingTest, NestedCallbacksAreExcluded) {
+  StreamCpuAccount account;
+  StreamCpuAccount other;
+  {
+    ScopedCpuAccount outer(&account, CpuStep::DecodeHeaders);
+    {
+      // a local reply sent from the callback runs the encoder callbacks, of
+      // this filter and of an unsampled one, inside it.
+      ScopedCpuAccount nested(&account, CpuStep::EncodeHeaders);
+      burnCpu(20 * 1000 * 1000);
+      ScopedCpuAccount unsampled(nullptr, CpuStep::EncodeData);
+      burnCpu(20 * 1000 * 1000);
+    }
+    {
+      ScopedCpuTimer step(CpuStep::TemplateRender);
+      ScopedCpuAccount nested(&other, CpuStep::EncodeHeaders);
+      burnCpu(20 * 1000 * 1000);
+    }
+  }
+
+  FilterCpuStats stats(*store_.rootScope(), "test.cpu", runtime_);
+  uint64_t decode_headers = 0;
+  uint64_t encode_headers = 0;
+  uint64_t template_render = 0;
+  ON_CALL(store_, deliverHistogramToSinks(_, _))
+      .WillByDefault(testing::Invoke([&](const Histogram &histogram,
+                                         uint64_t value) {
+        if (histogram.name() == "test.cpu.decode_headers") {
+          decode_headers = value;
+        } else if (histogram.name() == "test.cpu.encode_headers") {
+          encode_headers = value;
+        } else if (histogram.name() == "test.cpu.template_render") {
+          template_render = value;
+        }
+      }));
+  account.flush(stats, "");
+
+  // the nested callbacks took at least 60ms, none of which is accounted to
+  // the callback or sub-step they ran in.
+  EXPECT_GE(encode_headers, 20 * 1000);
+  EXPECT_LT(decode_headers, 10 * 1000);
+  EXPECT_LT(template_render, 10 * 1000);
+}
+
+TEST_F(CpuAccountingTest, FlushRecordsPerRouteInMicroseconds) {
+  FilterCpuStats stats(*store_.rootScope(), "test.cpu", runtime_);
+  StreamCpuAccount account;
+  account.add(CpuStep::TemplateRender, 5000);
+
+  EXPECT_CALL(store_,
+              deliverHistogramToSinks(
+                  Property(&Metric::name, "test.cpu.template_render"), 5));
+  // the route is a tag rather than a part of the name.
+  EXPECT_CALL(store_,
+              deliverHistogramToSinks(
+                  AllOf(Property(&Metric::tagExtractedName,
+                                 "test.cpu.route.template_render"),
+                        Property(&Metric::tags,
+                                 ElementsAre(Tag{"route_name", "r1"}))),
+                  5));
+  account.flush(stats, "r1");
+
+  // the account is reset by the flush.
+  EXPECT_CALL(store_, deliverHistogramToSinks(_, _)).Times(0);
+  account.flush(stats, "r1");
+}
+
+TEST_F(CpuAccountingTest, CapsTheNumberOfRoutes) {
+  FilterCpuStats stats(*store_.rootScope(), "test.cpu", runtime_);
+  for (size_t i = 0; i < FilterCpuStats::MaxRoutes; i++) {
+    stats.record(CpuStep::DecodeHeaders, absl::StrCat("r", i), 1);
+  }
+  EXPECT_EQ(0U, store_.counter("test.cpu.route_overflow").value());
+
+  // a further route is only recorded for the filter, while a known one still
+  // is recorded for the route.
+  EXPECT_CALL(store_,
+              deliverHistogramToSinks(
+                  Property(&Metric::name, "test.cpu.decode_headers"), 1))
+      .Times(2);
+  EXPECT_CALL(store_, deliverHistogramToSinks(
+                          Property(&Metric::tags,
+                                   ElementsAre(Tag{"route_name", "r0"})),
+                          1));
+  stats.record(CpuStep::DecodeHeaders, "another", 1);
+  stats.record(CpuStep::DecodeHeaders, "r0", 1);
+  EXPECT_EQ(1U, store_.counter("test.cpu.route_overflow").value());
+}
+
+} // namespace
+} // namespace Stats
+} // namespace Envoy
@@ -76,6 +76,87 @@ TEST_F(AwsAuthenticatorTest, RepeatedlyBodyHash) {
 }
 
 
+TEST_F(AwsAuthenticatorTest, HashesPayloadWhileWritten) {
+  DangerousDeprecatedTestTime time;
+  AwsAuthenticator aws(time.timeSystem());
+
+  // a transformer replacing the request body.
+  Buffer::OwnedImpl request("original body");
+  PayloadHashingBuffer body;
+  body.fill(request);
+  EXPECT_FALSE(body.hashValid());
+  body.drain(body.length());
+  body.add("\"a");
+  Buffer::OwnedImpl rest("bc\"");
+  body.move(rest);
+  EXPECT_TRUE(body.hashValid());
+
+  aws.updatePayloadHash(body);
+  EXPECT_EQ("6cc43f858fbb763301637b5af970e2a46b46f461f27e5a0f41e009c59b827b25",
+            getBodyHexSha(aws));
+}
+
+TEST_F(AwsAuthenticatorTest, HashesPrependedPayload) {
+  DangerousDeprecatedTestTime time;
+  AwsAuthenticator aws(time.timeSystem());
+
+  PayloadHashingBuffer body;
+  Buffer::OwnedImpl output("\"abc\"");
+  body.prepend(output);
+  EXPECT_TRUE(body.hashValid());
+
+  aws.updatePayloadHash(body);
+  EXPECT_EQ("6cc43f858fbb763301637b5af970e2a46b46f461f27e5a0f41e009c59b827b25",
+            getBodyHexSha(aws));
+}
+
+TEST_F(AwsAuthenticatorTest, HashesEachByteOnce) {
+  DangerousDeprecatedTestTime time;
+  AwsAuthenticator aws(time.timeSystem());
+
+  PayloadHashingBuffer body;
+  Buffer::OwnedImpl head("\"a");
+  body.add(head);
+  EXPECT_EQ(2UL, body.hashedBytes());
+
+  // moving part of a slice copies it.
+  Buffer::OwnedImpl rest("bc\"xx");
+  body.move(rest, 3);
+  EXPECT_EQ(5UL, body.hashedBytes());
+  EXPECT_TRUE(body.hashValid());
+
+  aws.updatePayloadHash(body);
+  EXPECT_EQ("6cc43f858fbb763301637b5af970e2a46b46f461f27e5a0f41e009c59b827b25",
+            getBodyHexSha(aws));
+}
+
+TEST_F(AwsAuthenticatorTest, RehashesPayloadNotWrittenInOrder) {
+  DangerousDeprecatedTestTime time;
+  AwsAuthenticator aws(time.timeSystem());
+
+  PayloadHashingBuffer body;
+  body.add("xx\"abc");
+  body.drain(2);
+  EXPECT_FALSE(body.hashValid());
+  body.add("\"");
+
+  aws.updatePayloadHash(body);
+  EXPECT_EQ("6cc43f858fbb763301637b5af970e2a46b46f461f27e5a0f41e009c59b827b25",
+            getBodyHexSha(aws));
+}
+
+TEST_F(AwsAuthenticatorTest, AppendsHashingBufferToPayload) {
+  DangerousDeprecatedTestTime time;
+  AwsAuthenticator aws(time.timeSystem());
+
+  updatePayloadHash(aws, "\"a");
+  PayloadHashingBuffer body;
+  body.add("bc\"");
+  aws.updatePayloadHash(body);
+  EXPECT_EQ("6cc43f858fbb763301637b5af970e2a46b46f461f27e5a0f41e009c59b827b25",
+            getBodyHexSha(aws));
+}
+
 TEST_F(AwsAuthenticatorTest, UrlQuery) {
   DangerousDeprecatedTestTime time;
   AwsAuthenticator aws(time.timeSystem());
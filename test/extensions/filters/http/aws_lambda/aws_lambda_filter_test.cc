@@ -1,9 +1,15 @@
+#include "source/common/http/message_impl.h"
 #include "source/extensions/filters/http/aws_lambda/aws_authenticator.h"
 #include "source/extensions/filters/http/aws_lambda/aws_lambda_filter.h"
 #include "source/extensions/filters/http/aws_lambda/aws_lambda_filter_config_factory.h"
 
+#include "test/extensions/filters/http/aws_lambda/event_stream_test_utility.h"
+
 #include "test/mocks/common.h"
+#include "test/mocks/http/mocks.h"
 #include "test/mocks/server/mocks.h"
+#include "test/mocks/stats/mocks.h"
+#include "test/mocks/tracing/mocks.h"
 #include "test/mocks/upstream/mocks.h"
 #include "test/test_common/utility.h"
 
@@ -13,8 +19,12 @@
 #include "gtest/gtest.h"
 
 using testing::_;
+using testing::AnyNumber;
 using testing::AtLeast;
+using testing::DoAll;
+using testing::Eq;
 using testing::Invoke;
+using testing::Property;
 using testing::Return;
 using testing::ReturnPointee;
 using testing::ReturnRef;
@@ -42,6 +52,13 @@ public:
     return propagate_original_routing_;
   }
 
+  uint64_t spillThreshold() const override { return spill_threshold_; }
+  uint64_t spillMaxBytes() const override { return spill_max_bytes_; }
+  bool stageSpans() const override { return stage_spans_; }
+  uint64_t spill_threshold_{};
+  uint64_t spill_max_bytes_{};
+  bool stage_spans_{};
+
   MOCK_METHOD(StsConnectionPool::Context *, getCreds,
                    (StsConnectionPool::Context::Callbacks *callbacks), (const));
 
@@ -446,6 +463,108 @@ TEST_F(AWSLambdaFilterTest, SignsDataSetByPreviousFilters) {
   EXPECT_EQ(hex_sha1, hex_sha3);
 }
 
+TEST_F(AWSLambdaFilterTest, SpillsBodyWhileWaitingForCredentials) {
+  setupRoute(false, false, false, false, true);
+  filter_config_->spill_threshold_ = 4;
+  filter_config_->spill_max_bytes_ = 1024;
+  filter_ = std::make_unique<AWSLambdaFilter>(
+      factory_context_.server_factory_context_.cluster_manager_, factory_context_.server_factory_context_.api_,
+      filter_config_);
+  filter_->setDecoderFilterCallbacks(filter_callbacks_);
+
+  StsConnectionPool::Context::Callbacks *callbackReference;
+  StsContextStub fakeContext;
+  EXPECT_CALL(*filter_config_, getCreds).WillOnce(
+     [&](StsConnectionPool::Context::Callbacks *callbacks) ->
+                                         StsConnectionPool::Context*{
+        callbackReference = callbacks;
+        return &fakeContext;
+     }
+  );
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, false);
+  Buffer::OwnedImpl first("some ");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(first, false));
+  Buffer::OwnedImpl second("data");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(second, true));
+
+  std::string upstream_body;
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, false))
+      .WillOnce(Invoke(
+          [&](Buffer::Instance &b, bool) { upstream_body = b.toString(); }));
+  callbackReference->onSuccess(filter_config_->credentials_);
+  EXPECT_EQ("some data", upstream_body);
+  EXPECT_TRUE(headers.has("Authorization"));
+}
+
+TEST_F(AWSLambdaFilterTest, RecordsStageSpans) {
+  setupRoute(false, false, false, false, true);
+  filter_config_->stage_spans_ = true;
+
+  StsConnectionPool::Context::Callbacks *callbackReference;
+  StsContextStub fakeContext;
+  EXPECT_CALL(*filter_config_, getCreds).WillOnce(
+     [&](StsConnectionPool::Context::Callbacks *callbacks) ->
+                                         StsConnectionPool::Context*{
+        callbackReference = callbacks;
+        return &fakeContext;
+     }
+  );
+
+  auto *credentials_span = new testing::NiceMock<Tracing::MockSpan>();
+  auto *finalize_span = new testing::NiceMock<Tracing::MockSpan>();
+  auto *sign_span = new testing::NiceMock<Tracing::MockSpan>();
+  EXPECT_CALL(filter_callbacks_.active_span_,
+              spawnChild_(_, "aws_lambda.credentials", _))
+      .WillOnce(Return(credentials_span));
+  EXPECT_CALL(filter_callbacks_.active_span_,
+              spawnChild_(_, "aws_lambda.finalize_request", _))
+      .WillOnce(Return(finalize_span));
+  EXPECT_CALL(filter_callbacks_.active_span_,
+              spawnChild_(_, "aws_lambda.sign", _))
+      .WillOnce(Return(sign_span));
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, false);
+  Buffer::OwnedImpl data("some data");
+  filter_->decodeData(data, true);
+
+  EXPECT_CALL(*credentials_span, finishSpan());
+  EXPECT_CALL(*finalize_span, setTag(_, _)).Times(AnyNumber());
+  EXPECT_CALL(*finalize_span, setTag(Eq("aws_lambda.request_bytes"), Eq("9")));
+  EXPECT_CALL(*finalize_span, finishSpan());
+  EXPECT_CALL(*sign_span, finishSpan());
+  callbackReference->onSuccess(filter_config_->credentials_);
+  EXPECT_TRUE(headers.has("Authorization"));
+}
+
+TEST_F(AWSLambdaFilterTest, RejectsBodyPastSpillLimit) {
+  filter_config_->spill_threshold_ = 4;
+  filter_config_->spill_max_bytes_ = 8;
+  filter_ = std::make_unique<AWSLambdaFilter>(
+      factory_context_.server_factory_context_.cluster_manager_, factory_context_.server_factory_context_.api_,
+      filter_config_);
+  filter_->setDecoderFilterCallbacks(filter_callbacks_);
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, false);
+
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::PayloadTooLarge, _, _, _, _));
+  Buffer::OwnedImpl data("more than eight bytes");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(data, false));
+}
+
 TEST_F(AWSLambdaFilterTest, InvalidFunction) {
   // invalid function
   EXPECT_CALL(filter_callbacks_,
@@ -587,6 +706,484 @@ TEST_F(AWSLambdaFilterTest, UpstreamErrorSetTo504) {
 
 }
 
+// Finds a stat of the function by its tag-extracted name, checking that the
+// function and qualifier are tags rather than part of that name.
+const Stats::Counter *findFunctionCounter(Stats::Store &store,
+                                          const std::string &name) {
+  for (const Stats::CounterSharedPtr &counter : store.counters()) {
+    if (counter->tagExtractedName() == "aws_lambda.function." + name) {
+      EXPECT_THAT(counter->tags(),
+                  testing::ElementsAre(
+                      Stats::Tag{"aws_lambda_function", "func"},
+                      Stats::Tag{"aws_lambda_qualifier", "v1"}));
+      return counter.get();
+    }
+  }
+  return nullptr;
+}
+
+TEST_F(AWSLambdaFilterTest, RecordsFunctionStats) {
+  setup_func();
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  Stats::MockIsolatedStatsStore &store = server_factory_context_.store_;
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  EXPECT_CALL(store, deliverHistogramToSinks(_, _)).Times(AnyNumber());
+  EXPECT_CALL(store,
+              deliverHistogramToSinks(
+                  Property(&Stats::Metric::tagExtractedName,
+                           "aws_lambda.function.request_payload_size"),
+                  3));
+  EXPECT_CALL(store,
+              deliverHistogramToSinks(
+                  Property(&Stats::Metric::tagExtractedName,
+                           "aws_lambda.function.signing_time"),
+                  _));
+  Buffer::OwnedImpl request_body("abc");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(request_body, true));
+
+  EXPECT_CALL(store,
+              deliverHistogramToSinks(
+                  Property(&Stats::Metric::tagExtractedName,
+                           "aws_lambda.function.invocation_time"),
+                  _));
+  EXPECT_CALL(store,
+              deliverHistogramToSinks(
+                  Property(&Stats::Metric::tagExtractedName,
+                           "aws_lambda.function.response_payload_size"),
+                  5));
+  Http::TestResponseHeaderMapImpl response_headers{
+      {":status", "200"}, {"x-amz-function-error", "Unhandled"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->encodeHeaders(response_headers, false));
+  Buffer::OwnedImpl response_body("hello");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->encodeData(response_body, true));
+  filter_->onDestroy();
+
+  EXPECT_EQ(1, findFunctionCounter(store, "invocations")->value());
+  EXPECT_EQ(1, findFunctionCounter(store, "function_errors")->value());
+  EXPECT_EQ(0, findFunctionCounter(store, "throttles")->value());
+  EXPECT_EQ(1, findFunctionCounter(store, "estimated_cold_starts")->value());
+}
+
+TEST_F(AWSLambdaFilterTest, RecordsThrottleAndWarmInvocation) {
+  setup_func();
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "429"}};
+  filter_->encodeHeaders(response_headers, true);
+  filter_->onDestroy();
+
+  // an invocation right after the first is not a cold start.
+  AWSLambdaFilter second(factory_context_.server_factory_context_.cluster_manager_,
+                         factory_context_.server_factory_context_.api_,
+                         filter_config_);
+  second.setDecoderFilterCallbacks(filter_callbacks_);
+  second.setEncoderFilterCallbacks(filter_encode_callbacks_);
+  Http::TestRequestHeaderMapImpl second_headers{{":method", "GET"},
+                                                {":authority", "www.solo.io"},
+                                                {":path", "/getsomething"}};
+  second.decodeHeaders(second_headers, true);
+  second.onDestroy();
+
+  Stats::Store &store = server_factory_context_.store_;
+  EXPECT_EQ(2, findFunctionCounter(store, "invocations")->value());
+  EXPECT_EQ(1, findFunctionCounter(store, "throttles")->value());
+  EXPECT_EQ(1, findFunctionCounter(store, "estimated_cold_starts")->value());
+}
+
+TEST_F(AWSLambdaFilterTest, ConfigUpdateKeepsLastInvocation) {
+  setup_func();
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  filter_->onDestroy();
+
+  // the new route config is created while the old one is still in use, as
+  // it is on a config push.
+  setup_func();
+  AWSLambdaFilter second(factory_context_.server_factory_context_.cluster_manager_,
+                         factory_context_.server_factory_context_.api_,
+                         filter_config_);
+  second.setDecoderFilterCallbacks(filter_callbacks_);
+  Http::TestRequestHeaderMapImpl second_headers{{":method", "GET"},
+                                                {":authority", "www.solo.io"},
+                                                {":path", "/getsomething"}};
+  second.decodeHeaders(second_headers, true);
+  second.onDestroy();
+
+  Stats::Store &store = server_factory_context_.store_;
+  EXPECT_EQ(2, findFunctionCounter(store, "invocations")->value());
+  EXPECT_EQ(1, findFunctionCounter(store, "estimated_cold_starts")->value());
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamFuncCalled) {
+  routeconfig_.set_response_stream(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+
+  EXPECT_EQ("/2021-11-15/functions/" + routeconfig_.name() +
+                "/response-streaming-invocations?Qualifier=" +
+                routeconfig_.qualifier(),
+            headers.get_(":path"));
+  EXPECT_EQ("RequestResponse", headers.get_("x-amz-invocation-type"));
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamCannotBeAsync) {
+  routeconfig_.set_response_stream(true);
+  routeconfig_.set_async(true);
+  EXPECT_THROW_WITH_MESSAGE(setup_func(), EnvoyException,
+                            "response_stream cannot be combined with async, "
+                            "unwrap_as_alb or transformer_config");
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamForwardsPayloadChunks) {
+  routeconfig_.set_response_stream(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+
+  Http::TestResponseHeaderMapImpl response_headers{
+      {":status", "200"},
+      {"content-type", "application/vnd.amazon.eventstream"},
+      {"content-length", "1000"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->encodeHeaders(response_headers, false));
+  EXPECT_EQ("application/octet-stream", response_headers.getContentTypeValue());
+  EXPECT_FALSE(response_headers.has("content-length"));
+
+  // the second chunk is split across reads, and is forwarded once complete.
+  const std::string second = EventStreamTestUtility::payloadChunk(" world");
+  Buffer::OwnedImpl data(EventStreamTestUtility::payloadChunk("hello") +
+                         second.substr(0, 10));
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(data, false));
+  EXPECT_EQ("hello", data.toString());
+
+  data.drain(data.length());
+  data.add(second.substr(10));
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(data, false));
+  EXPECT_EQ(" world", data.toString());
+
+  EXPECT_CALL(filter_encode_callbacks_, resetStream(_, _)).Times(0);
+  data.drain(data.length());
+  data.add(EventStreamTestUtility::invokeComplete());
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(data, true));
+  EXPECT_EQ(0, data.length());
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamResetOnFunctionError) {
+  routeconfig_.set_response_stream(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+
+  Http::TestResponseHeaderMapImpl response_headers{
+      {":status", "200"}, {"content-type", "application/vnd.amazon.eventstream"}};
+  filter_->encodeHeaders(response_headers, false);
+
+  EXPECT_CALL(filter_encode_callbacks_, resetStream(_, _));
+  Buffer::OwnedImpl data(EventStreamTestUtility::invokeComplete(
+      R"({"ErrorCode":"Unhandled","ErrorDetails":"boom"})"));
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->encodeData(data, true));
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamResetWhenTruncated) {
+  routeconfig_.set_response_stream(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+
+  Http::TestResponseHeaderMapImpl response_headers{
+      {":status", "200"}, {"content-type", "application/vnd.amazon.eventstream"}};
+  filter_->encodeHeaders(response_headers, false);
+
+  EXPECT_CALL(filter_encode_callbacks_, resetStream(_, _));
+  Buffer::OwnedImpl data(EventStreamTestUtility::payloadChunk("partial"));
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->encodeData(data, true));
+}
+
+TEST_F(AWSLambdaFilterTest, ResponseStreamPassesThroughErrorResponse) {
+  routeconfig_.set_response_stream(true);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  filter_->decodeHeaders(headers, true);
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+
+  // errors raised before the stream starts are plain json responses.
+  Http::TestResponseHeaderMapImpl response_headers{
+      {":status", "429"}, {"content-type", "application/json"}};
+  filter_->encodeHeaders(response_headers, false);
+
+  Buffer::OwnedImpl data(R"({"Type":"User","message":"Rate Exceeded."})");
+  EXPECT_EQ(Http::FilterDataStatus::Continue, filter_->encodeData(data, true));
+  EXPECT_EQ(R"({"Type":"User","message":"Rate Exceeded."})", data.toString());
+}
+
+TEST_F(AWSLambdaFilterTest, HedgeCannotBeAsync) {
+  routeconfig_.set_async(true);
+  routeconfig_.mutable_hedge()->mutable_delay()->set_seconds(1);
+  EXPECT_THROW_WITH_MESSAGE(setup_func(), EnvoyException,
+                            "hedge cannot be combined with async or response_stream");
+}
+
+class AWSLambdaHedgeTest : public AWSLambdaFilterTest {
+protected:
+  void SetUp() override {
+    AWSLambdaFilterTest::SetUp();
+    routeconfig_.mutable_hedge()->set_qualifier("v2");
+    routeconfig_.mutable_hedge()->mutable_delay()->set_nanos(100000000);
+    setup_func();
+    filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+  }
+
+  // Sends a header only request and fires the hedge timer.
+  void fireHedge() {
+    auto *timer = new NiceMock<Event::MockTimer>(&filter_callbacks_.dispatcher_);
+    EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(100), _));
+    Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                           {":authority", "www.solo.io"},
+                                           {":path", "/getsomething"}};
+    EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+              filter_->decodeHeaders(headers, true));
+    timer->invokeCallback();
+  }
+
+  uint64_t counter(const std::string &name) {
+    return TestUtility::findCounter(server_factory_context_.store_,
+                                    "aws_lambda.hedge." + name)
+        ->value();
+  }
+
+  Http::MockAsyncClient &asyncClient() {
+    return factory_context_.server_factory_context_.cluster_manager_
+        .thread_local_cluster_.async_client_;
+  }
+};
+
+TEST_F(AWSLambdaHedgeTest, HedgeWins) {
+  Http::MockAsyncClientRequest request(&asyncClient());
+  Http::AsyncClient::Callbacks *callbacks{};
+  EXPECT_CALL(asyncClient(), send_(_, _, _))
+      .WillOnce(Invoke([&](Http::RequestMessagePtr &message,
+                           Http::AsyncClient::Callbacks &cb,
+                           const Http::AsyncClient::RequestOptions &) {
+        EXPECT_EQ("/2015-03-31/functions/func/invocations?Qualifier=v2",
+                  message->headers().getPathValue());
+        EXPECT_EQ("lambda.us-east-1.amazonaws.com",
+                  message->headers().getHostValue());
+        EXPECT_EQ(1, message->headers().get(Http::LowerCaseString("authorization")).size());
+        callbacks = &cb;
+        return &request;
+      }));
+  fireHedge();
+  EXPECT_EQ(1, counter("sent"));
+
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, false))
+      .WillOnce(Invoke([](Http::ResponseHeaderMap &headers, bool) {
+        EXPECT_EQ("200", headers.getStatusValue());
+      }));
+  EXPECT_CALL(filter_callbacks_, encodeData(_, true))
+      .WillOnce(Invoke([](Buffer::Instance &data, bool) {
+        EXPECT_EQ("hedged", data.toString());
+      }));
+  auto response = std::make_unique<Http::ResponseMessageImpl>(
+      Http::ResponseHeaderMapPtr{new Http::TestResponseHeaderMapImpl{{":status", "200"}}});
+  response->body().add("hedged");
+  callbacks->onSuccess(request, std::move(response));
+  EXPECT_EQ(1, counter("won"));
+  filter_->onDestroy();
+}
+
+TEST_F(AWSLambdaHedgeTest, HedgeGetsRemainingRouteTimeout) {
+  ON_CALL(filter_callbacks_.route_->route_entry_, timeout())
+      .WillByDefault(Return(std::chrono::milliseconds(15000)));
+  ON_CALL(filter_callbacks_.stream_info_, startTimeMonotonic())
+      .WillByDefault(Return(factory_context_.server_factory_context_.api_
+                                .timeSource()
+                                .monotonicTime()));
+  Http::MockAsyncClientRequest request(&asyncClient());
+  EXPECT_CALL(asyncClient(), send_(_, _, _))
+      .WillOnce(Invoke([&](Http::RequestMessagePtr &,
+                           Http::AsyncClient::Callbacks &,
+                           const Http::AsyncClient::RequestOptions &options) {
+        EXPECT_TRUE(options.timeout.has_value());
+        EXPECT_GT(options.timeout.value(), std::chrono::milliseconds(0));
+        EXPECT_LE(options.timeout.value(), std::chrono::milliseconds(15000));
+        return &request;
+      }));
+  fireHedge();
+  EXPECT_CALL(request, cancel());
+  filter_->onDestroy();
+}
+
+TEST_F(AWSLambdaHedgeTest, HedgeAfterFirstResponseIsDropped) {
+  Http::MockAsyncClientRequest request(&asyncClient());
+  Http::AsyncClient::Callbacks *callbacks{};
+  EXPECT_CALL(asyncClient(), send_(_, _, _))
+      .WillOnce(DoAll(WithArg<1>(Invoke([&](Http::AsyncClient::Callbacks &cb) {
+                        callbacks = &cb;
+                      })),
+                      Return(&request)));
+  fireHedge();
+
+  EXPECT_CALL(request, cancel());
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  filter_->encodeHeaders(response_headers, false);
+
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, _)).Times(0);
+  callbacks->onSuccess(request,
+                       std::make_unique<Http::ResponseMessageImpl>(
+                           Http::ResponseHeaderMapPtr{new Http::TestResponseHeaderMapImpl{
+                               {":status", "200"}}}));
+  EXPECT_EQ(0, counter("won"));
+  filter_->onDestroy();
+}
+
+TEST_F(AWSLambdaHedgeTest, FirstResponseCancelsHedge) {
+  Http::MockAsyncClientRequest request(&asyncClient());
+  EXPECT_CALL(asyncClient(), send_(_, _, _)).WillOnce(Return(&request));
+  fireHedge();
+
+  EXPECT_CALL(request, cancel());
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->encodeHeaders(response_headers, true));
+  filter_->onDestroy();
+  EXPECT_EQ(0, counter("won"));
+}
+
+TEST_F(AWSLambdaHedgeTest, FailedHedgeLeavesFirstInvocation) {
+  Http::MockAsyncClientRequest request(&asyncClient());
+  Http::AsyncClient::Callbacks *callbacks{};
+  EXPECT_CALL(asyncClient(), send_(_, _, _))
+      .WillOnce(DoAll(WithArg<1>(Invoke([&](Http::AsyncClient::Callbacks &cb) {
+                        callbacks = &cb;
+                      })),
+                      Return(&request)));
+  fireHedge();
+
+  EXPECT_CALL(filter_callbacks_, encodeHeaders_(_, _)).Times(0);
+  callbacks->onSuccess(request,
+                       std::make_unique<Http::ResponseMessageImpl>(
+                           Http::ResponseHeaderMapPtr{new Http::TestResponseHeaderMapImpl{
+                               {":status", "429"}}}));
+  EXPECT_EQ(1, counter("failed"));
+  filter_->onDestroy();
+}
+
+TEST_F(AWSLambdaHedgeTest, BudgetExhausted) {
+  routeconfig_.mutable_hedge()->mutable_budget_percent()->set_value(0);
+  routeconfig_.mutable_hedge()->mutable_min_concurrency()->set_value(0);
+  setup_func();
+
+  EXPECT_CALL(asyncClient(), send_(_, _, _)).Times(0);
+  fireHedge();
+  EXPECT_EQ(1, counter("budget_exhausted"));
+  filter_->onDestroy();
+}
+
+TEST_F(AWSLambdaFilterTest, ConcurrencyLimitQueuesRequest) {
+  routeconfig_.mutable_concurrency_limit()->mutable_initial_limit()->set_value(1);
+  routeconfig_.mutable_concurrency_limit()->set_max_queue_size(1);
+  setup_func();
+  filter_->setEncoderFilterCallbacks(filter_encode_callbacks_);
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> queued_callbacks;
+  ON_CALL(queued_callbacks, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(filter_route_config_.get()));
+  auto *queue_timer = new NiceMock<Event::MockTimer>(&queued_callbacks.dispatcher_);
+  EXPECT_CALL(*queue_timer, enableTimer(std::chrono::milliseconds(100), _));
+  AWSLambdaFilter queued(
+      factory_context_.server_factory_context_.cluster_manager_,
+      factory_context_.server_factory_context_.api_, filter_config_);
+  queued.setDecoderFilterCallbacks(queued_callbacks);
+  Http::TestRequestHeaderMapImpl queued_headers{{":method", "GET"},
+                                                {":authority", "www.solo.io"},
+                                                {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            queued.decodeHeaders(queued_headers, true));
+  EXPECT_FALSE(queued_headers.has("authorization"));
+
+  // the first response frees the slot for the queued request.
+  EXPECT_CALL(*queue_timer, enableTimer(std::chrono::milliseconds(0), _));
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  filter_->encodeHeaders(response_headers, true);
+
+  EXPECT_CALL(queued_callbacks, continueDecoding());
+  queue_timer->invokeCallback();
+  EXPECT_TRUE(queued_headers.has("authorization"));
+  queued.onDestroy();
+  filter_->onDestroy();
+}
+
+TEST_F(AWSLambdaFilterTest, ConcurrencyLimitRejectsRequest) {
+  routeconfig_.mutable_concurrency_limit()->mutable_initial_limit()->set_value(1);
+  setup_func();
+
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> rejected_callbacks;
+  ON_CALL(rejected_callbacks, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(filter_route_config_.get()));
+  AWSLambdaFilter rejected(
+      factory_context_.server_factory_context_.cluster_manager_,
+      factory_context_.server_factory_context_.api_, filter_config_);
+  rejected.setDecoderFilterCallbacks(rejected_callbacks);
+  EXPECT_CALL(rejected_callbacks,
+              sendLocalReply(Http::Code::ServiceUnavailable, _, _, _,
+                             "aws_lambda_concurrency_limited"));
+  Http::TestRequestHeaderMapImpl rejected_headers{{":method", "GET"},
+                                                  {":authority", "www.solo.io"},
+                                                  {":path", "/getsomething"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            rejected.decodeHeaders(rejected_headers, true));
+  rejected.onDestroy();
+  filter_->onDestroy();
+}
+
 TEST_F(AWSLambdaFilterTest, ALBDecodingBasic) {
   setupRoute(false, false, false, true);
 
@@ -49,6 +49,13 @@ public:
   bool propagateOriginalRouting() const override{
     return propagate_original_routing_;
   }
+
+  uint64_t spillThreshold() const override { return spill_threshold_; }
+  uint64_t spillMaxBytes() const override { return spill_max_bytes_; }
+  bool stageSpans() const override { return stage_spans_; }
+  uint64_t spill_threshold_{};
+  uint64_t spill_max_bytes_{};
+  bool stage_spans_{};
   bool propagate_original_routing_;
 };
 
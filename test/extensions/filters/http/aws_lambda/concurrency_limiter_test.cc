@@ -0,0 +1,180 @@
+#include "source/extensions/filters/http/aws_lambda/concurrency_limiter.h"
+
+#include "test/mocks/server/server_factory_context.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class MockWaiter : public ConcurrencyLimiter::Waiter {
+public:
+  MOCK_METHOD(void, onAdmitted, ());
+};
+
+class ConcurrencyLimiterTest : public testing::Test {
+protected:
+  void setup(const std::string &yaml) {
+    envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::
+        ConcurrencyLimit proto;
+    TestUtility::loadFromYaml(yaml, proto);
+    policy_ = std::make_unique<ConcurrencyLimitPolicy>(proto, "arn:func", "v1",
+                                                       context_);
+  }
+
+  // Finds a stat of the function by its tag-extracted name, checking that the
+  // function and qualifier are tags, as they are for the function stats.
+  template <class StatVector>
+  uint64_t find(const StatVector &stats, const std::string &name) {
+    for (const auto &stat : stats) {
+      if (stat->tagExtractedName() == "aws_lambda.concurrency_limit." + name) {
+        EXPECT_THAT(stat->tags(),
+                    testing::ElementsAre(
+                        Stats::Tag{"aws_lambda_function", "arn_func"},
+                        Stats::Tag{"aws_lambda_qualifier", "v1"}));
+        return stat->value();
+      }
+    }
+    ADD_FAILURE() << "no stat " << name;
+    return 0;
+  }
+
+  uint64_t gauge(const std::string &name) {
+    return find(context_.store_.gauges(), name);
+  }
+  uint64_t counter(const std::string &name) {
+    return find(context_.store_.counters(), name);
+  }
+
+  NiceMock<Server::Configuration::MockServerFactoryContext> context_;
+  std::unique_ptr<ConcurrencyLimitPolicy> policy_;
+  MockWaiter waiter_;
+};
+
+TEST_F(ConcurrencyLimiterTest, QueuesAndRejectsOverLimit) {
+  setup(R"EOF(
+initial_limit: 2
+max_queue_size: 1
+)EOF");
+  ConcurrencyLimiter &limiter = policy_->limiter();
+  MockWaiter queued;
+
+  EXPECT_EQ(ConcurrencyLimiter::Result::Admitted, limiter.acquire(waiter_));
+  EXPECT_EQ(ConcurrencyLimiter::Result::Admitted, limiter.acquire(waiter_));
+  EXPECT_EQ(ConcurrencyLimiter::Result::Queued, limiter.acquire(queued));
+  EXPECT_EQ(ConcurrencyLimiter::Result::Rejected, limiter.acquire(waiter_));
+  EXPECT_EQ(2, gauge("in_flight"));
+  EXPECT_EQ(1, gauge("queue_depth"));
+
+  EXPECT_CALL(queued, onAdmitted());
+  limiter.release();
+  EXPECT_EQ(2, gauge("in_flight"));
+  EXPECT_EQ(0, gauge("queue_depth"));
+}
+
+TEST_F(ConcurrencyLimiterTest, CancelledWaiterIsNotAdmitted) {
+  setup(R"EOF(
+initial_limit: 1
+max_queue_size: 1
+)EOF");
+  ConcurrencyLimiter &limiter = policy_->limiter();
+  MockWaiter queued;
+
+  EXPECT_EQ(ConcurrencyLimiter::Result::Admitted, limiter.acquire(waiter_));
+  EXPECT_EQ(ConcurrencyLimiter::Result::Queued, limiter.acquire(queued));
+  limiter.cancel(queued);
+  EXPECT_CALL(queued, onAdmitted()).Times(0);
+  limiter.release();
+  EXPECT_EQ(0, limiter.inFlight());
+}
+
+TEST_F(ConcurrencyLimiterTest, ThrottlesLowerTheLimit) {
+  setup(R"EOF(
+initial_limit: 10
+min_limit: 8
+backoff_ratio: 0.5
+)EOF");
+  ConcurrencyLimiter &limiter = policy_->limiter();
+
+  limiter.acquire(waiter_);
+  limiter.release(std::chrono::milliseconds(10), true);
+  EXPECT_EQ(8, limiter.limit());
+  EXPECT_EQ(8, gauge("limit"));
+  EXPECT_EQ(1, counter("throttled"));
+}
+
+TEST_F(ConcurrencyLimiterTest, SlowResponsesLowerTheLimit) {
+  setup(R"EOF(
+initial_limit: 10
+latency_threshold: 1s
+)EOF");
+  ConcurrencyLimiter &limiter = policy_->limiter();
+
+  limiter.acquire(waiter_);
+  limiter.release(std::chrono::milliseconds(500), false);
+  EXPECT_EQ(10, limiter.limit());
+  limiter.acquire(waiter_);
+  limiter.release(std::chrono::milliseconds(1500), false);
+  EXPECT_EQ(9, limiter.limit());
+}
+
+TEST_F(ConcurrencyLimiterTest, GrowsOnlyWhileInUse) {
+  setup(R"EOF(
+initial_limit: 2
+max_limit: 3
+)EOF");
+  ConcurrencyLimiter &limiter = policy_->limiter();
+
+  limiter.acquire(waiter_);
+  limiter.acquire(waiter_);
+  limiter.release(std::chrono::milliseconds(10), false);
+  EXPECT_EQ(3, limiter.limit());
+  // one of three slots is in use.
+  limiter.release(std::chrono::milliseconds(10), false);
+  EXPECT_EQ(3, limiter.limit());
+
+  for (int i = 0; i < 3; i++) {
+    limiter.acquire(waiter_);
+  }
+  limiter.release(std::chrono::milliseconds(10), false);
+  EXPECT_EQ(3, limiter.limit());
+  EXPECT_EQ(3, gauge("limit"));
+}
+
+TEST_F(ConcurrencyLimiterTest, OutlivesTheRouteThatConfiguredIt) {
+  envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute::
+      ConcurrencyLimit proto;
+  TestUtility::loadFromYaml("initial_limit: 2", proto);
+  auto settings = std::make_shared<const ConcurrencyLimitSettings>(
+      proto, "arn:func", "v1", context_.scope());
+  // worker slots are torn down after the policy that created them is gone.
+  auto limiter = std::make_shared<ConcurrencyLimiter>(settings);
+  settings.reset();
+
+  limiter->acquire(waiter_);
+  EXPECT_EQ(1, gauge("in_flight"));
+  limiter.reset();
+  EXPECT_EQ(0, gauge("in_flight"));
+  EXPECT_EQ(0, gauge("limit"));
+}
+
+TEST_F(ConcurrencyLimiterTest, InvalidLimits) {
+  EXPECT_THROW_WITH_MESSAGE(setup(R"EOF(
+initial_limit: 5
+min_limit: 10
+)EOF"),
+                            EnvoyException,
+                            "concurrency_limit: initial_limit 5 must be "
+                            "between min_limit 10 and max_limit 1000");
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,10 +1,15 @@
+#include <deque>
+
+#include "source/common/init/manager_impl.h"
 #include "source/extensions/filters/http/aws_lambda/config.h"
 
 #include "test/extensions/common/aws/mocks.h"
 #include "test/extensions/filters/http/aws_lambda/mocks.h"
 #include "test/mocks/common.h"
+#include "test/mocks/init/mocks.h"
 #include "test/mocks/server/mocks.h"
 #include "test/mocks/upstream/mocks.h"
+#include "test/test_common/thread_factory_for_test.h"
 #include "test/test_common/utility.h"
 
 #include "fmt/format.h"
@@ -14,6 +19,7 @@
 using testing::_;
 using testing::AtLeast;
 using testing::Invoke;
+using testing::Lt;
 using testing::Return;
 using testing::ReturnPointee;
 using testing::ReturnRef;
@@ -52,9 +58,40 @@ protected:
         new NiceMock<Event::MockTimer>(&context_.server_factory_context_.dispatcher_);
     protoconfig.mutable_use_default_credentials()->set_value(true);
     EXPECT_CALL(context_.server_factory_context_.thread_local_, allocateSlot()).Times(1);
+
+    // credentials are fetched on a refresh thread, and its results are run on
+    // the test thread by runNextPost().
+    ON_CALL(context_.server_factory_context_.dispatcher_, post(_))
+        .WillByDefault(Invoke([this](Event::PostCb callback) {
+          absl::MutexLock lock(&posted_lock_);
+          posted_.push_back(std::move(callback));
+        }));
     return timer;
   }
 
+  CredentialsRefresherSharedPtr refresher() {
+    return std::make_shared<CredentialsRefresher>(
+        context_.server_factory_context_.dispatcher_,
+        Thread::threadFactoryForTest(),
+        context_.server_factory_context_.lifecycle_notifier_);
+  }
+
+  void runNextPost() {
+    Event::PostCb callback;
+    {
+      absl::MutexLock lock(&posted_lock_);
+      posted_lock_.Await(absl::Condition(
+          +[](std::deque<Event::PostCb> *posted) { return !posted->empty(); },
+          &posted_));
+      callback = std::move(posted_.front());
+      posted_.pop_front();
+    }
+    callback();
+  }
+
+  absl::Mutex posted_lock_;
+  std::deque<Event::PostCb> posted_ ABSL_GUARDED_BY(posted_lock_);
+
   void prepareSTS() {
     envoy::config::filter::http::aws_lambda::v2::
         AWSLambdaConfig_ServiceAccountCredentials creds_;
@@ -83,9 +120,20 @@ TEST_F(ConfigTest, WithUseDefaultCreds) {
 
   std::unique_ptr<NiceMock<MockStsCredentialsProviderFactory>> unique_factory{
       sts_factory_};
+  Init::ManagerImpl init_manager("test");
   auto config = std::make_shared<AWSLambdaConfigImpl>(
-      std::move(cred_provider), std::move(unique_factory), context_.server_factory_context_.dispatcher_,
-      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, "prefix.", *stats_.rootScope(), protoconfig);
+      std::move(cred_provider), std::move(unique_factory), refresher(), context_.server_factory_context_.dispatcher_,
+      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, init_manager, "prefix.", *stats_.rootScope(), protoconfig);
+
+  // initialization waits for the first fetch.
+  Init::ExpectableWatcherImpl init_watcher;
+  init_manager.initialize(init_watcher);
+  EXPECT_EQ(Init::Manager::State::Initializing, init_manager.state());
+  EXPECT_CALL(init_watcher, ready());
+  EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(std::chrono::minutes(14)), _))
+      .Times(2);
+  runNextPost();
+  EXPECT_EQ(Init::Manager::State::Initialized, init_manager.state());
 
   NiceMock<MockStsContextCallbacks> callbacks_1;
 
@@ -104,6 +152,7 @@ TEST_F(ConfigTest, WithUseDefaultCreds) {
   EXPECT_EQ(nullptr, config->getCredentials(ext_config_1, &callbacks_1));
 
   timer->invokeCallback();
+  runNextPost();
 
   NiceMock<MockStsContextCallbacks> callbacks_2;
   std::shared_ptr<const AWSLambdaProtocolExtensionConfig> ext_config_2 =
@@ -150,8 +199,9 @@ TEST_F(ConfigTest, FailingToRotate) {
   std::unique_ptr<NiceMock<MockStsCredentialsProviderFactory>> unique_factory{
       sts_factory_};
   auto config = std::make_shared<AWSLambdaConfigImpl>(
-      std::move(cred_provider), std::move(unique_factory), context_.server_factory_context_.dispatcher_,
-      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, "prefix.", *stats_.rootScope(), protoconfig);
+      std::move(cred_provider), std::move(unique_factory), refresher(), context_.server_factory_context_.dispatcher_,
+      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, context_.init_manager_, "prefix.", *stats_.rootScope(), protoconfig);
+  runNextPost();
 
   std::shared_ptr<const AWSLambdaProtocolExtensionConfig> ext_config_1 =
       std::make_shared<const AWSLambdaProtocolExtensionConfig>(protoextconfig);
@@ -170,7 +220,10 @@ TEST_F(ConfigTest, FailingToRotate) {
 
   EXPECT_EQ(nullptr, config->getCredentials(ext_config_1, &callbacks_1));
 
+  // failed fetches are retried with a backoff.
+  EXPECT_CALL(*timer, enableTimer(Lt(std::chrono::milliseconds(60001)), _));
   timer->invokeCallback();
+  runNextPost();
 
   // When we fail to rotate we latch to the last good credentials
   EXPECT_EQ(nullptr, config->getCredentials(ext_config_1, &callbacks_1));
@@ -200,8 +253,8 @@ TEST_F(ConfigTest, WithProtocolExtensionCreds) {
   std::unique_ptr<NiceMock<MockStsCredentialsProviderFactory>> unique_factory{
       sts_factory_};
   auto config = std::make_shared<AWSLambdaConfigImpl>(
-      std::move(cred_provider), std::move(unique_factory), context_.server_factory_context_.dispatcher_,
-      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, "prefix.", *stats_.rootScope(), protoconfig);
+      std::move(cred_provider), std::move(unique_factory), nullptr, context_.server_factory_context_.dispatcher_,
+      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, context_.init_manager_, "prefix.", *stats_.rootScope(), protoconfig);
 
   NiceMock<MockStsContextCallbacks> callbacks_1;
 
@@ -280,8 +333,8 @@ TEST_F(ConfigTest, WithStsCreds) {
   std::unique_ptr<NiceMock<MockStsCredentialsProviderFactory>> unique_factory{
       sts_factory_};
   auto config = std::make_shared<AWSLambdaConfigImpl>(
-      std::move(cred_provider), std::move(unique_factory), context_.server_factory_context_.dispatcher_,
-      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, "prefix.", *stats_.rootScope(), protoconfig);
+      std::move(cred_provider), std::move(unique_factory), nullptr, context_.server_factory_context_.dispatcher_,
+      context_.server_factory_context_.api_, context_.server_factory_context_.thread_local_, context_.init_manager_, "prefix.", *stats_.rootScope(), protoconfig);
 
   NiceMock<MockStsContextCallbacks> callbacks;
 
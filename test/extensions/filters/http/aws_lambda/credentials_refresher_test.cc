@@ -0,0 +1,279 @@
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <deque>
+
+#include "source/common/common/backoff_strategy.h"
+#include "source/common/http/message_impl.h"
+#include "source/extensions/filters/http/aws_lambda/credentials_refresher.h"
+
+#include "test/extensions/common/aws/mocks.h"
+#include "test/mocks/common.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/server/server_lifecycle_notifier.h"
+#include "test/test_common/thread_factory_for_test.h"
+
+#include "absl/synchronization/notification.h"
+#include "fmt/format.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::DoAll;
+using testing::InSequence;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+using testing::SaveArg;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace CommonAws = Envoy::Extensions::Common::Aws;
+
+namespace {
+
+constexpr std::chrono::milliseconds RefreshInterval = std::chrono::minutes(14);
+
+// Notifies when it is destroyed, which happens on the refresh thread if its
+// subscription is gone by the time its fetch completes.
+class NotifyingCredentialsProvider : public CommonAws::MockCredentialsProvider {
+public:
+  explicit NotifyingCredentialsProvider(absl::Notification &destroyed)
+      : destroyed_(destroyed) {}
+  ~NotifyingCredentialsProvider() override { destroyed_.Notify(); }
+
+private:
+  absl::Notification &destroyed_;
+};
+
+// Accepts connections on a loopback port and never answers.
+class SilentServer {
+public:
+  SilentServer() : fd_(socket(AF_INET, SOCK_STREAM, 0)) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    RELEASE_ASSERT(
+        bind(fd_, reinterpret_cast<sockaddr *>(&address), length) == 0 &&
+            listen(fd_, 1) == 0 &&
+            getsockname(fd_, reinterpret_cast<sockaddr *>(&address),
+                        &length) == 0,
+        "could not listen on a loopback port");
+    port_ = ntohs(address.sin_port);
+  }
+  ~SilentServer() { close(fd_); }
+
+  uint16_t port() const { return port_; }
+
+private:
+  const int fd_;
+  uint16_t port_{};
+};
+
+} // namespace
+
+class CredentialsRefresherTest : public testing::Test {
+protected:
+  CredentialsRefresherTest() {
+    // results are run on the test thread by runNextPost().
+    ON_CALL(dispatcher_, post(_))
+        .WillByDefault(Invoke([this](Event::PostCb callback) {
+          absl::MutexLock lock(&posted_lock_);
+          posted_.push_back(std::move(callback));
+        }));
+  }
+
+  void runNextPost() {
+    Event::PostCb callback;
+    {
+      absl::MutexLock lock(&posted_lock_);
+      posted_lock_.Await(absl::Condition(
+          +[](std::deque<Event::PostCb> *posted) { return !posted->empty(); },
+          &posted_));
+      callback = std::move(posted_.front());
+      posted_.pop_front();
+    }
+    callback();
+  }
+
+  bool hasPosts() {
+    absl::MutexLock lock(&posted_lock_);
+    return !posted_.empty();
+  }
+
+  BackOffStrategyPtr backoff() {
+    return std::make_unique<JitteredExponentialBackOffStrategy>(1000, 60000,
+                                                                random_);
+  }
+
+  CredentialsRefresherSharedPtr refresher() {
+    return std::make_shared<CredentialsRefresher>(
+        dispatcher_, Thread::threadFactoryForTest(), lifecycle_notifier_);
+  }
+
+  CredentialsRefresher::ResultCallback recordResult() {
+    return [this](const CommonAws::Credentials &credentials) {
+      results_.push_back(credentials);
+    };
+  }
+
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  NiceMock<Server::MockServerLifecycleNotifier> lifecycle_notifier_;
+  NiceMock<Random::MockRandomGenerator> random_;
+  std::vector<CommonAws::Credentials> results_;
+
+  absl::Mutex posted_lock_;
+  std::deque<Event::PostCb> posted_ ABSL_GUARDED_BY(posted_lock_);
+
+  const CommonAws::Credentials creds_{"access_key", "secret_key"};
+};
+
+TEST_F(CredentialsRefresherTest, RetriesFailedFetchesWithBackoff) {
+  auto *timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  auto provider =
+      std::make_unique<NiceMock<CommonAws::MockCredentialsProvider>>();
+  EXPECT_CALL(*provider, getCredentials())
+      .WillOnce(Return(CommonAws::Credentials()))
+      .WillOnce(Return(CommonAws::Credentials()))
+      .WillOnce(Return(creds_))
+      .WillOnce(Return(CommonAws::Credentials()));
+  // the backoff is drawn below a maximum that doubles on each failure, and
+  // this value picks the top of the range.
+  ON_CALL(random_, random()).WillByDefault(Return(999999));
+
+  auto refresher = this->refresher();
+  auto subscription = refresher->subscribe(std::move(provider), RefreshInterval,
+                                           backoff(), recordResult());
+  {
+    InSequence s;
+    EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(999), _));
+    EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(1999), _));
+    // a success resets the backoff.
+    EXPECT_CALL(*timer, enableTimer(RefreshInterval, _));
+    EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(999), _));
+  }
+  runNextPost();
+  for (int i = 0; i < 3; ++i) {
+    timer->invokeCallback();
+    runNextPost();
+  }
+
+  ASSERT_EQ(4UL, results_.size());
+  EXPECT_EQ(CommonAws::Credentials(), results_[1]);
+  EXPECT_EQ(creds_, results_[2]);
+}
+
+TEST_F(CredentialsRefresherTest, CoalescesRequestsWaitingForTheThread) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+
+  absl::Notification fetching;
+  absl::Notification release;
+  auto blocking =
+      std::make_unique<NiceMock<CommonAws::MockCredentialsProvider>>();
+  EXPECT_CALL(*blocking, getCredentials()).WillOnce(Invoke([&]() {
+    fetching.Notify();
+    release.WaitForNotification();
+    return creds_;
+  }));
+  auto provider =
+      std::make_unique<NiceMock<CommonAws::MockCredentialsProvider>>();
+  EXPECT_CALL(*provider, getCredentials()).Times(2).WillRepeatedly(Return(creds_));
+
+  auto refresher = this->refresher();
+  auto blocked = refresher->subscribe(std::move(blocking), RefreshInterval,
+                                      backoff(), [](const auto &) {});
+  fetching.WaitForNotification();
+
+  // the thread is busy, so these wait for it together with the first fetch.
+  auto subscription = refresher->subscribe(std::move(provider), RefreshInterval,
+                                           backoff(), recordResult());
+  subscription->refresh();
+  subscription->refresh();
+  release.Notify();
+  runNextPost();
+  runNextPost();
+  EXPECT_EQ(1UL, results_.size());
+
+  // a request made after the fetch completed is a new fetch.
+  subscription->refresh();
+  runNextPost();
+  EXPECT_EQ(2UL, results_.size());
+}
+
+TEST_F(CredentialsRefresherTest, ConfigTeardownDoesNotWaitForFetchInFlight) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+
+  absl::Notification fetching;
+  absl::Notification release;
+  absl::Notification destroyed;
+  auto provider = std::make_unique<NiceMock<NotifyingCredentialsProvider>>(
+      destroyed);
+  EXPECT_CALL(*provider, getCredentials()).WillOnce(Invoke([&]() {
+    fetching.Notify();
+    release.WaitForNotification();
+    return creds_;
+  }));
+
+  // the server keeps the refresher, so dropping the subscription of a config
+  // returns while the fetch is still blocked.
+  auto refresher = this->refresher();
+  auto subscription = refresher->subscribe(std::move(provider), RefreshInterval,
+                                           backoff(), recordResult());
+  fetching.WaitForNotification();
+  subscription.reset();
+  EXPECT_FALSE(destroyed.HasBeenNotified());
+
+  // the provider is released by the thread, and its result is dropped.
+  release.Notify();
+  destroyed.WaitForNotification();
+  runNextPost();
+  EXPECT_TRUE(results_.empty());
+}
+
+TEST_F(CredentialsRefresherTest, ServerShutdownAbortsMetadataFetchInFlight) {
+  new NiceMock<Event::MockTimer>(&dispatcher_);
+  Server::ServerLifecycleNotifier::StageCallback shutdown;
+  EXPECT_CALL(lifecycle_notifier_,
+              registerCallback(Server::ServerLifecycleNotifier::Stage::ShutdownExit,
+                               testing::A<Server::ServerLifecycleNotifier::StageCallback>()))
+      .WillOnce(DoAll(SaveArg<1>(&shutdown), Return(nullptr)));
+
+  SilentServer server;
+  auto refresher = this->refresher();
+  absl::Notification fetching;
+  absl::optional<std::string> metadata = "unset";
+  auto provider =
+      std::make_unique<NiceMock<CommonAws::MockCredentialsProvider>>();
+  EXPECT_CALL(*provider, getCredentials()).WillOnce(Invoke([&]() {
+    Http::RequestMessageImpl message;
+    message.headers().setScheme("http");
+    message.headers().setMethod("GET");
+    message.headers().setHost(fmt::format("127.0.0.1:{}", server.port()));
+    message.headers().setPath("/latest/meta-data/iam/security-credentials/");
+    fetching.Notify();
+    metadata = refresher->metadataFetcher()(message);
+    return CommonAws::Credentials();
+  }));
+  auto subscription = refresher->subscribe(std::move(provider), RefreshInterval,
+                                           backoff(), recordResult());
+  fetching.WaitForNotification();
+
+  // joins the thread well before the call would time out.
+  const auto started = std::chrono::steady_clock::now();
+  shutdown();
+  EXPECT_LT(std::chrono::steady_clock::now() - started,
+            CredentialsRefresher::MetadataTimeout);
+  EXPECT_EQ(absl::nullopt, metadata);
+  EXPECT_FALSE(hasPosts());
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,132 @@
+#include "source/extensions/filters/http/aws_lambda/event_stream_decoder.h"
+
+#include "test/extensions/filters/http/aws_lambda/event_stream_test_utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+using namespace EventStreamTestUtility;
+
+TEST(EventStreamDecoderTest, DecodesPayloadChunks) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl input(payloadChunk("hello ") + payloadChunk("world"));
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Continue, decoder.decode(input, output));
+  EXPECT_EQ("hello world", output.toString());
+  EXPECT_EQ(0, input.length());
+  EXPECT_FALSE(decoder.hasPartialMessage());
+
+  input.add(invokeComplete());
+  EXPECT_EQ(EventStreamDecoder::Status::Complete, decoder.decode(input, output));
+  EXPECT_EQ("hello world", output.toString());
+}
+
+TEST(EventStreamDecoderTest, DecodesMessagesSplitAcrossReads) {
+  EventStreamDecoder decoder;
+  const std::string stream =
+      payloadChunk("first") + payloadChunk("second") + invokeComplete();
+  Buffer::OwnedImpl output;
+
+  for (size_t i = 0; i < stream.size(); i++) {
+    Buffer::OwnedImpl input(stream.substr(i, 1));
+    const auto status = decoder.decode(input, output);
+    EXPECT_EQ(i + 1 == stream.size() ? EventStreamDecoder::Status::Complete
+                                     : EventStreamDecoder::Status::Continue,
+              status);
+  }
+  EXPECT_EQ("firstsecond", output.toString());
+}
+
+TEST(EventStreamDecoderTest, IgnoresOtherEvents) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl input(
+      message({{":event-type", "Unknown"}, {":message-type", "event"}}, "x") +
+      payloadChunk("data"));
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Continue, decoder.decode(input, output));
+  EXPECT_EQ("data", output.toString());
+}
+
+TEST(EventStreamDecoderTest, FunctionErrorInInvokeComplete) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl input(
+      payloadChunk("partial") +
+      invokeComplete(
+          R"({"ErrorCode":"Unhandled","ErrorDetails":"boom","LogResult":""})"));
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Error, decoder.decode(input, output));
+  EXPECT_EQ("Unhandled: boom", decoder.error());
+  EXPECT_EQ("partial", output.toString());
+}
+
+TEST(EventStreamDecoderTest, ExceptionMessage) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl input(message({{":exception-type", "ServiceException"},
+                                   {":message-type", "exception"}},
+                                  R"({"message":"oops"})"));
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Error, decoder.decode(input, output));
+  EXPECT_EQ(R"(ServiceException: {"message":"oops"})", decoder.error());
+}
+
+TEST(EventStreamDecoderTest, PreludeChecksumMismatch) {
+  EventStreamDecoder decoder;
+  std::string stream = payloadChunk("data");
+  stream[9] ^= 1;
+  Buffer::OwnedImpl input(stream.substr(0, 12));
+  Buffer::OwnedImpl output;
+
+  // detected before the rest of the message arrives.
+  EXPECT_EQ(EventStreamDecoder::Status::Error, decoder.decode(input, output));
+  EXPECT_EQ("event stream prelude checksum mismatch", decoder.error());
+}
+
+TEST(EventStreamDecoderTest, MessageChecksumMismatch) {
+  EventStreamDecoder decoder;
+  std::string stream = payloadChunk("data");
+  stream[stream.size() - 5] ^= 1;
+  Buffer::OwnedImpl input(stream);
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Error, decoder.decode(input, output));
+  EXPECT_EQ("event stream message checksum mismatch", decoder.error());
+  EXPECT_EQ(0, output.length());
+}
+
+TEST(EventStreamDecoderTest, RejectsOversizedMessage) {
+  EventStreamDecoder decoder;
+  std::string prelude;
+  appendBE32(prelude, EventStreamDecoder::MaxMessageBytes + 1);
+  appendBE32(prelude, 0);
+  appendBE32(prelude, crc(prelude));
+  Buffer::OwnedImpl input(prelude);
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Error, decoder.decode(input, output));
+  EXPECT_FALSE(decoder.hasPartialMessage());
+}
+
+TEST(EventStreamDecoderTest, DiscardsInputAfterCompletion) {
+  EventStreamDecoder decoder;
+  Buffer::OwnedImpl input(invokeComplete() + payloadChunk("late"));
+  Buffer::OwnedImpl output;
+
+  EXPECT_EQ(EventStreamDecoder::Status::Complete, decoder.decode(input, output));
+  input.add(payloadChunk("later"));
+  EXPECT_EQ(EventStreamDecoder::Status::Complete, decoder.decode(input, output));
+  EXPECT_EQ(0, input.length());
+  EXPECT_EQ(0, output.length());
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zlib.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+namespace EventStreamTestUtility {
+
+inline void appendBE32(std::string &out, uint32_t value) {
+  out.push_back(static_cast<char>(value >> 24));
+  out.push_back(static_cast<char>(value >> 16));
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+inline uint32_t crc(const std::string &data) {
+  return static_cast<uint32_t>(
+      crc32(0L, reinterpret_cast<const Bytef *>(data.data()), data.size()));
+}
+
+// Encodes an event stream message with string valued headers.
+inline std::string
+message(const std::vector<std::pair<std::string, std::string>> &headers,
+        const std::string &payload) {
+  std::string encoded_headers;
+  for (const auto &[name, value] : headers) {
+    encoded_headers.push_back(static_cast<char>(name.size()));
+    encoded_headers.append(name);
+    encoded_headers.push_back(7);
+    encoded_headers.push_back(static_cast<char>(value.size() >> 8));
+    encoded_headers.push_back(static_cast<char>(value.size()));
+    encoded_headers.append(value);
+  }
+  std::string out;
+  appendBE32(out, 16 + encoded_headers.size() + payload.size());
+  appendBE32(out, encoded_headers.size());
+  appendBE32(out, crc(out));
+  out.append(encoded_headers);
+  out.append(payload);
+  appendBE32(out, crc(out));
+  return out;
+}
+
+inline std::string payloadChunk(const std::string &payload) {
+  return message({{":event-type", "PayloadChunk"},
+                  {":message-type", "event"},
+                  {":content-type", "application/octet-stream"}},
+                 payload);
+}
+
+inline std::string invokeComplete(const std::string &payload = "{}") {
+  return message({{":event-type", "InvokeComplete"},
+                  {":message-type", "event"},
+                  {":content-type", "application/json"}},
+                 payload);
+}
+
+} // namespace EventStreamTestUtility
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
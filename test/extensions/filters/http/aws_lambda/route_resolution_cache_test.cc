@@ -0,0 +1,101 @@
+#include "source/extensions/filters/http/aws_lambda/route_resolution_cache.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+
+class RouteResolutionCacheTest : public testing::Test {
+protected:
+  void SetUp() override {
+    cluster_manager_.initializeThreadLocalClusters({"fake_cluster"});
+    envoy::config::filter::http::aws_lambda::v2::AWSLambdaProtocolExtension
+        protoextconfig;
+    protoextconfig.set_host("lambda.us-east-1.amazonaws.com");
+    protoextconfig.set_region("us-east-1");
+    protocol_options_ =
+        std::make_shared<AWSLambdaProtocolExtensionConfig>(protoextconfig);
+    ON_CALL(*cluster_manager_.thread_local_cluster_.cluster_.info_,
+            extensionProtocolOptions(SoloHttpFilterNames::get().AwsLambda))
+        .WillByDefault(Return(protocol_options_));
+    ON_CALL(cluster_manager_, addThreadLocalClusterUpdateCallbacks(_))
+        .WillByDefault(Invoke([this](Upstream::ClusterUpdateCallbacks &cb) {
+          update_callbacks_ = &cb;
+          return std::make_unique<Upstream::ClusterUpdateCallbacksHandle>();
+        }));
+  }
+
+  NiceMock<ThreadLocal::MockInstance> tls_;
+  NiceMock<Upstream::MockClusterManager> cluster_manager_;
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks_;
+  std::shared_ptr<AWSLambdaProtocolExtensionConfig> protocol_options_;
+  Upstream::ClusterUpdateCallbacks *update_callbacks_{};
+};
+
+TEST_F(RouteResolutionCacheTest, ResolvesOncePerClusterUntilClustersChange) {
+  RouteResolutionCache cache(tls_, cluster_manager_);
+  EXPECT_CALL(cluster_manager_, getThreadLocalCluster(_))
+      .Times(2)
+      .WillRepeatedly(Return(&cluster_manager_.thread_local_cluster_));
+
+  EXPECT_EQ(protocol_options_, cache.resolve(callbacks_).protocol_options);
+  EXPECT_EQ(protocol_options_, cache.resolve(callbacks_).protocol_options);
+  ASSERT_NE(nullptr, update_callbacks_);
+
+  update_callbacks_->onClusterRemoval("other_cluster");
+  EXPECT_EQ(protocol_options_, cache.resolve(callbacks_).protocol_options);
+  EXPECT_EQ(protocol_options_, cache.resolve(callbacks_).protocol_options);
+}
+
+TEST_F(RouteResolutionCacheTest, ResolvesEachClusterOfARoute) {
+  RouteResolutionCache cache(tls_, cluster_manager_);
+  EXPECT_CALL(cluster_manager_, getThreadLocalCluster(_))
+      .Times(2)
+      .WillRepeatedly(Return(&cluster_manager_.thread_local_cluster_));
+
+  cache.resolve(callbacks_);
+  callbacks_.route_->route_entry_.cluster_name_ = "other_cluster";
+  cache.resolve(callbacks_);
+  cache.resolve(callbacks_);
+}
+
+TEST_F(RouteResolutionCacheTest, SharesClusterAcrossRouteObjects) {
+  RouteResolutionCache cache(tls_, cluster_manager_);
+  EXPECT_CALL(cluster_manager_, getThreadLocalCluster(_))
+      .WillOnce(Return(&cluster_manager_.thread_local_cluster_));
+
+  // routes that select their cluster from a header are a new object for each
+  // request.
+  for (int i = 0; i < 3; ++i) {
+    callbacks_.route_ = std::make_shared<NiceMock<Router::MockRoute>>();
+    EXPECT_EQ(protocol_options_, cache.resolve(callbacks_).protocol_options);
+  }
+}
+
+TEST_F(RouteResolutionCacheTest, NoRoute) {
+  RouteResolutionCache cache(tls_, cluster_manager_);
+  ON_CALL(callbacks_, route()).WillByDefault(Return(nullptr));
+  EXPECT_CALL(cluster_manager_, getThreadLocalCluster(_)).Times(0);
+
+  const auto resolution = cache.resolve(callbacks_);
+  EXPECT_EQ(nullptr, resolution.protocol_options);
+  EXPECT_EQ(nullptr, resolution.function_on_route);
+}
+
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -218,6 +218,28 @@ TEST_F(NatsStreamingFilterTest, RequestWithHeadersAndOneChunkOfData) {
   EXPECT_EQ("hello world", actual_payload.body());
 }
 
+TEST_F(NatsStreamingFilterTest, RequestWithRepeatedHeaders) {
+  const auto &&config =
+      routeSpecificFilterConfig("Subject1", "cluster_id", "discover_prefix1");
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  Http::TestRequestHeaderMapImpl headers{
+      {"x-forwarded-for", "10.0.0.1"},
+      {"some-header", "a"},
+      {"x-forwarded-for", "10.0.0.2"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, true));
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_EQ(2U, actual_payload.headers().size());
+  EXPECT_EQ("a", actual_payload.headers().at("some-header"));
+  // only the last value of a repeated header is kept.
+  EXPECT_EQ("10.0.0.2", actual_payload.headers().at("x-forwarded-for"));
+}
+
 TEST_F(NatsStreamingFilterTest, RequestWithTrailers) {
   // `nats_streaming_client_->makeRequest()` should be called exactly once.
   EXPECT_CALL(*nats_streaming_client_,
@@ -257,6 +279,67 @@ TEST_F(NatsStreamingFilterTest, RequestWithTrailers) {
   EXPECT_EQ("hello world", actual_payload.body());
 }
 
+TEST_F(NatsStreamingFilterTest, RequestWithCompressedBody) {
+  EXPECT_CALL(*nats_streaming_client_,
+              makeRequest_("Subject1", "cluster_id", "discover_prefix1", _,
+                           Ref(*filter_)))
+      .Times(1);
+
+  envoy::config::filter::http::nats::streaming::v2::NatsStreamingPerRoute
+      proto_config;
+  proto_config.set_subject("Subject1");
+  proto_config.set_cluster_id("cluster_id");
+  proto_config.set_discover_prefix("discover_prefix1");
+  proto_config.mutable_compression()->set_codec(
+      envoy::config::filter::http::nats::streaming::v2::NatsStreamingPerRoute::
+          Compression::GZIP);
+  const NatsStreamingRouteSpecificFilterConfig config(proto_config);
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  callbacks_.buffer_.reset(new Buffer::OwnedImpl);
+
+  Http::TestRequestHeaderMapImpl headers{{"some-header", "a"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  const std::string body(1024, 'a');
+  Buffer::OwnedImpl data(body);
+  callbacks_.buffer_->add(data);
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(data, true));
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_EQ("a", actual_payload.headers().at("some-header"));
+  EXPECT_EQ("gzip", actual_payload.body_encoding());
+  EXPECT_LT(actual_payload.body().size(), body.size());
+}
+
+TEST_F(NatsStreamingFilterTest, RequestWithoutCompressionHasNoBodyEncoding) {
+  const auto &&config =
+      routeSpecificFilterConfig("Subject1", "cluster_id", "discover_prefix1");
+  ON_CALL(callbacks_, mostSpecificPerFilterConfig())
+      .WillByDefault(Return(&config));
+
+  callbacks_.buffer_.reset(new Buffer::OwnedImpl);
+
+  Http::TestRequestHeaderMapImpl headers;
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+
+  Buffer::OwnedImpl data("hello world");
+  callbacks_.buffer_->add(data);
+  filter_->decodeData(data, true);
+
+  pb::Payload actual_payload;
+  EXPECT_TRUE(
+      actual_payload.ParseFromString(nats_streaming_client_->last_payload_));
+  EXPECT_TRUE(actual_payload.body_encoding().empty());
+  EXPECT_EQ("hello world", actual_payload.body());
+}
+
 } // namespace Streaming
 } // namespace Nats
 } // namespace HttpFilters
@@ -0,0 +1,158 @@
+#include "source/common/init/manager_impl.h"
+#include "source/extensions/filters/http/nats/streaming/nats_streaming_preconnector.h"
+
+#include "test/common/stats/stat_test_utility.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/init/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+class NatsStreamingPreconnectorTest : public testing::Test {
+protected:
+  NatsStreamingPreconnectorTest() {
+    config_.set_cluster_id("cluster_id");
+    config_.set_discover_prefix("discover_prefix");
+    ON_CALL(dispatcher_, post(_))
+        .WillByDefault(Invoke(
+            [this](Event::PostCb callback) { posted_.push_back(std::move(callback)); }));
+  }
+
+  NatsStreamingPreconnectorSharedPtr create(bool workers_started = true) {
+    return std::make_shared<NatsStreamingPreconnector>(
+        config_,
+        [this](NatsStreamingPreconnector::ConnectedCb on_connected,
+               NatsStreamingPreconnector::StartedCb on_started) {
+          on_connected_ = std::move(on_connected);
+          on_started_ = std::move(on_started);
+        },
+        dispatcher_, init_manager_, workers_started, *store_.rootScope(),
+        "test.preconnect.");
+  }
+
+  // runs the posts of the workers, as the main dispatcher would.
+  void runPosts() {
+    for (auto &callback : posted_) {
+      callback();
+    }
+    posted_.clear();
+  }
+
+  uint64_t counter(const std::string &name) {
+    return store_.counterFromString("test.preconnect." + name).value();
+  }
+
+  uint64_t ready() {
+    return store_
+        .gaugeFromString("test.preconnect.ready",
+                         Stats::Gauge::ImportMode::NeverImport)
+        .value();
+  }
+
+  NatsStreamingPreconnector::PreconnectProto config_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  Init::ManagerImpl init_manager_{"test"};
+  Init::ExpectableWatcherImpl init_watcher_;
+  Stats::TestUtil::TestStore store_;
+  std::vector<Event::PostCb> posted_;
+  NatsStreamingPreconnector::ConnectedCb on_connected_;
+  NatsStreamingPreconnector::StartedCb on_started_;
+};
+
+TEST_F(NatsStreamingPreconnectorTest, ReadyWithoutWaitingByDefault) {
+  auto preconnector = create();
+  EXPECT_CALL(init_watcher_, ready());
+  init_manager_.initialize(init_watcher_);
+  ASSERT_NE(nullptr, on_connected_);
+
+  on_started_(2);
+  on_connected_();
+  runPosts();
+  EXPECT_EQ(1, counter("workers_connected"));
+  EXPECT_EQ(0, ready());
+
+  on_connected_();
+  runPosts();
+  EXPECT_EQ(2, counter("workers_connected"));
+  EXPECT_EQ(1, ready());
+}
+
+TEST_F(NatsStreamingPreconnectorTest, WaitsForWorkersToConnect) {
+  config_.mutable_readiness_timeout()->set_seconds(5);
+  auto *timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(5000), _));
+  auto preconnector = create();
+  init_manager_.initialize(init_watcher_);
+  EXPECT_EQ(Init::Manager::State::Initializing, init_manager_.state());
+
+  // a worker may connect before all of them have started.
+  on_connected_();
+  runPosts();
+  on_started_(2);
+  EXPECT_EQ(Init::Manager::State::Initializing, init_manager_.state());
+
+  EXPECT_CALL(init_watcher_, ready());
+  EXPECT_CALL(*timer, disableTimer());
+  on_connected_();
+  runPosts();
+  EXPECT_EQ(Init::Manager::State::Initialized, init_manager_.state());
+  EXPECT_EQ(1, ready());
+  EXPECT_EQ(0, counter("readiness_timeout"));
+}
+
+TEST_F(NatsStreamingPreconnectorTest, ReadyAfterTimeout) {
+  config_.mutable_readiness_timeout()->set_seconds(5);
+  auto *timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  auto preconnector = create();
+  init_manager_.initialize(init_watcher_);
+  on_started_(2);
+
+  EXPECT_CALL(init_watcher_, ready());
+  timer->invokeCallback();
+  EXPECT_EQ(Init::Manager::State::Initialized, init_manager_.state());
+  EXPECT_EQ(1, counter("readiness_timeout"));
+  EXPECT_EQ(0, ready());
+}
+
+TEST_F(NatsStreamingPreconnectorTest, DoesNotWaitBeforeWorkersStart) {
+  config_.mutable_readiness_timeout()->set_seconds(5);
+  EXPECT_CALL(dispatcher_, createTimer_(_)).Times(0);
+  auto preconnector = create(false);
+  EXPECT_CALL(init_watcher_, ready());
+  init_manager_.initialize(init_watcher_);
+  ASSERT_NE(nullptr, on_connected_);
+
+  on_started_(1);
+  on_connected_();
+  runPosts();
+  EXPECT_EQ(1, ready());
+  EXPECT_EQ(0, counter("readiness_timeout"));
+}
+
+TEST_F(NatsStreamingPreconnectorTest, IgnoresWorkersAfterDestruction) {
+  auto preconnector = create();
+  EXPECT_CALL(init_watcher_, ready());
+  init_manager_.initialize(init_watcher_);
+  on_connected_();
+  preconnector.reset();
+  runPosts();
+  on_started_(1);
+  EXPECT_EQ(0, counter("workers_connected"));
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,105 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/compression/gzip/decompressor/zlib_decompressor_impl.h"
+#include "source/extensions/compression/zstd/decompressor/zstd_decompressor_impl.h"
+#include "source/extensions/filters/http/nats/streaming/payload_compressor.h"
+
+#include "test/common/stats/stat_test_utility.h"
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Nats {
+namespace Streaming {
+
+class PayloadCompressorTest : public testing::Test {
+protected:
+  std::string decompress(absl::string_view encoding,
+                         Buffer::Instance &compressed) {
+    Buffer::OwnedImpl decompressed;
+    if (encoding == "gzip") {
+      Compression::Gzip::Decompressor::ZlibDecompressorImpl decompressor(
+          *store_.rootScope(), "test.gzip.", 4096, 100);
+      decompressor.init(15 | 16);
+      decompressor.decompress(compressed, decompressed);
+    } else {
+      Compression::Zstd::Decompressor::ZstdDDictManagerPtr ddict_manager;
+      Compression::Zstd::Decompressor::ZstdDecompressorImpl decompressor(
+          *store_.rootScope(), "test.zstd.", ddict_manager, 4096);
+      decompressor.decompress(compressed, decompressed);
+    }
+    return decompressed.toString();
+  }
+
+  uint64_t counter(const std::string &name) {
+    return store_.counterFromString("test.compression." + name).value();
+  }
+
+  Stats::TestUtil::TestStore store_;
+  NatsStreamingCompressionStatsConstSharedPtr stats_{
+      generateCompressionStats(*store_.rootScope(), "test.compression.")};
+  PayloadCompressor::CompressionProto config_;
+  const std::string body_ = std::string(1024, 'a') + "hello world";
+};
+
+TEST_F(PayloadCompressorTest, CompressesWithZstd) {
+  config_.set_codec(PayloadCompressor::CompressionProto::ZSTD);
+  PayloadCompressor compressor(config_);
+
+  Buffer::OwnedImpl body(body_);
+  EXPECT_EQ("zstd", compressor.compress(body, stats_.get()));
+  EXPECT_LT(body.length(), body_.size());
+  EXPECT_EQ(body_, decompress("zstd", body));
+
+  EXPECT_EQ(1U, counter("compressed"));
+  EXPECT_EQ(body_.size(), counter("uncompressed_bytes"));
+  EXPECT_GT(counter("compressed_bytes"), 0U);
+}
+
+TEST_F(PayloadCompressorTest, CompressesWithGzipAtLevel) {
+  config_.set_codec(PayloadCompressor::CompressionProto::GZIP);
+  config_.mutable_level()->set_value(9);
+  PayloadCompressor compressor(config_);
+
+  Buffer::OwnedImpl body(body_);
+  EXPECT_EQ("gzip", compressor.compress(body, stats_.get()));
+  EXPECT_LT(body.length(), body_.size());
+  EXPECT_EQ(body_, decompress("gzip", body));
+}
+
+TEST_F(PayloadCompressorTest, SkipsBodiesBelowMinSize) {
+  config_.set_min_size_bytes(body_.size() + 1);
+  PayloadCompressor compressor(config_);
+
+  Buffer::OwnedImpl body(body_);
+  EXPECT_EQ("", compressor.compress(body, stats_.get()));
+  EXPECT_EQ(body_, body.toString());
+
+  Buffer::OwnedImpl empty;
+  EXPECT_EQ("", compressor.compress(empty, nullptr));
+
+  EXPECT_EQ(0U, counter("compressed"));
+  EXPECT_EQ(1U, counter("skipped_below_min_size"));
+}
+
+TEST_F(PayloadCompressorTest, RejectsLevelOutOfRange) {
+  config_.set_codec(PayloadCompressor::CompressionProto::GZIP);
+  config_.mutable_level()->set_value(10);
+  EXPECT_THROW_WITH_MESSAGE(
+      PayloadCompressor{config_}, EnvoyException,
+      "nats-streaming filter: gzip compression level must be between 1 and 9");
+
+  config_.set_codec(PayloadCompressor::CompressionProto::ZSTD);
+  config_.mutable_level()->set_value(0);
+  EXPECT_THROW_WITH_MESSAGE(
+      PayloadCompressor{config_}, EnvoyException,
+      "nats-streaming filter: zstd compression level must be between 1 and 22");
+}
+
+} // namespace Streaming
+} // namespace Nats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -206,6 +206,52 @@ TEST(BodyHeaderTransformer, transformWithExtraMultiValueHeaders) {
   EXPECT_EQ(expected, actual);
 }
 
+TEST(BodyHeaderTransformer, transformWithExtraMultiValueHeadersKeepsEmptyValues) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "www.solo.io"},
+                                         {"x-test", "678"},
+                                         {"x-test", ""},
+                                         {"x-test", "789"},
+                                         {"x-empty", ""},
+                                         {":path", "/users/123"}};
+  Buffer::OwnedImpl body("testbody");
+
+  BodyHeaderTransformer transformer(true, google::protobuf::BoolValue());
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> filter_callbacks_{};
+  transformer.transform(headers, &headers, body, filter_callbacks_);
+
+  std::string res = body.toString();
+  json actual = json::parse(res);
+  // an empty value is one of the values of a repeated header, rather than
+  // hiding the values around it.
+  auto expected = R"(
+  {
+    "headers" : {
+      ":method": "GET",
+      ":authority": "www.solo.io",
+      "x-test": "789",
+      "x-empty": "",
+      ":path": "/users/123"
+    },
+    "body": "testbody",
+    "queryString":"",
+    "httpMethod":"GET",
+    "path":"/users/123",
+    "multiValueHeaders": {
+        "x-test": [
+            "678",
+            "",
+            "789"
+        ]
+    },
+    "multiValueQueryStringParameters": {},
+    "queryStringParameters": {}
+  }
+)"_json;
+
+  EXPECT_EQ(expected, actual);
+}
+
 TEST(BodyHeaderTransformer, transformWithExtraMultiValueHeadersAndMultiValueQuery) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
                                          {":authority", "www.solo.io"},
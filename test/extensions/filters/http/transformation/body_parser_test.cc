@@ -0,0 +1,78 @@
+#include "source/extensions/filters/http/transformation/body_parser.h"
+
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+TEST(FormUrlEncoded, DecodesFields) {
+  json out;
+  parseFormUrlEncoded("name=John+Doe&city=New%20York&empty=&flag", out);
+  EXPECT_EQ(out["name"], "John Doe");
+  EXPECT_EQ(out["city"], "New York");
+  EXPECT_EQ(out["empty"], "");
+  EXPECT_EQ(out["flag"], "");
+}
+
+TEST(FormUrlEncoded, LastRepeatedValueWins) {
+  json out;
+  parseFormUrlEncoded("a=1&&a=2", out);
+  EXPECT_EQ(out, json::parse("{\"a\":\"2\"}"));
+}
+
+TEST(FormUrlEncoded, KeepsInvalidPercentEncoding) {
+  json out;
+  parseFormUrlEncoded("a=%zz%4&b=%4a", out);
+  EXPECT_EQ(out["a"], "%zz%4");
+  EXPECT_EQ(out["b"], "J");
+}
+
+TEST(Xml, ParsesElementsAndAttributes) {
+  json out;
+  parseXml("<?xml version=\"1.0\"?>\n"
+           "<!-- order -->\n"
+           "<order id=\"7\">\n"
+           "  <item>a</item>\n"
+           "  <item>b</item>\n"
+           "  <note><![CDATA[<raw>]]> &amp; &#x41;</note>\n"
+           "  <empty/>\n"
+           "</order>\n",
+           out);
+  EXPECT_EQ(out["order"]["@id"], "7");
+  EXPECT_EQ(out["order"]["item"], json::parse("[\"a\",\"b\"]"));
+  EXPECT_EQ(out["order"]["note"], "<raw> & A");
+  EXPECT_EQ(out["order"]["empty"], "");
+  EXPECT_FALSE(out["order"].contains("#text"));
+}
+
+TEST(Xml, MixedContent) {
+  json out;
+  parseXml("<a x='1'>text<b>c</b></a>", out);
+  EXPECT_EQ(out, json::parse("{\"a\":{\"@x\":\"1\",\"#text\":\"text\",\"b\":\"c\"}}"));
+}
+
+TEST(Xml, RejectsMalformedDocuments) {
+  json out;
+  EXPECT_THROW_WITH_MESSAGE(parseXml("<a><b></a>", out), EnvoyException,
+                            "unexpected XML end tag 'a'");
+  EXPECT_THROW_WITH_MESSAGE(parseXml("<a>", out), EnvoyException,
+                            "unterminated XML element 'a'");
+  EXPECT_THROW_WITH_MESSAGE(parseXml("<a/><b/>", out), EnvoyException,
+                            "XML document has more than one root element");
+  EXPECT_THROW_WITH_MESSAGE(parseXml("<a>&nbsp;</a>", out), EnvoyException,
+                            "unknown XML entity '&nbsp;'");
+  EXPECT_THROW_WITH_MESSAGE(parseXml("not xml", out), EnvoyException,
+                            "XML character data outside of root element");
+  EXPECT_TRUE(out.is_null());
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
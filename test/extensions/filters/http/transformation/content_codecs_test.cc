@@ -0,0 +1,76 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/transformation/content_codecs.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+class ContentCodecsTest : public testing::TestWithParam<std::string> {
+protected:
+  Buffer::OwnedImpl compress(const std::string &data) {
+    Buffer::OwnedImpl buffer(data);
+    codecs_.createCompressor(GetParam())
+        ->compress(buffer, Envoy::Compression::Compressor::State::Finish);
+    return buffer;
+  }
+
+  ContentCodecs codecs_{false};
+};
+
+INSTANTIATE_TEST_SUITE_P(Encodings, ContentCodecsTest,
+                         testing::Values("gzip", "br", "zstd"));
+
+TEST_P(ContentCodecsTest, DecompressesInPieces) {
+  // larger than a chunk, so the output is produced over several calls.
+  std::string body;
+  for (int i = 0; i < 2000; i++) {
+    body += std::to_string(i) + ",";
+  }
+  Buffer::OwnedImpl compressed = compress(body);
+
+  CheckedDecompressorPtr decompressor = codecs_.createDecompressor(GetParam());
+  Buffer::OwnedImpl decompressed;
+  while (compressed.length() > 0) {
+    Buffer::OwnedImpl piece;
+    piece.move(compressed, std::min<uint64_t>(7, compressed.length()));
+    ASSERT_TRUE(decompressor->decompress(piece, decompressed));
+  }
+  EXPECT_EQ(body, decompressed.toString());
+}
+
+TEST_P(ContentCodecsTest, FailsOnCorruptInput) {
+  CheckedDecompressorPtr decompressor = codecs_.createDecompressor(GetParam());
+  Buffer::OwnedImpl garbage(std::string(64, '\xff'));
+  Buffer::OwnedImpl decompressed;
+  EXPECT_FALSE(decompressor->decompress(garbage, decompressed));
+  // the failure sticks, even for input that would otherwise decode.
+  Buffer::OwnedImpl valid = compress("valid");
+  EXPECT_FALSE(decompressor->decompress(valid, decompressed));
+}
+
+TEST_P(ContentCodecsTest, FailureIsNotSharedBetweenDecompressors) {
+  CheckedDecompressorPtr failing = codecs_.createDecompressor(GetParam());
+  CheckedDecompressorPtr decompressor = codecs_.createDecompressor(GetParam());
+  Buffer::OwnedImpl garbage(std::string(64, '\xff'));
+  Buffer::OwnedImpl ignored;
+  EXPECT_FALSE(failing->decompress(garbage, ignored));
+
+  Buffer::OwnedImpl compressed = compress("body");
+  Buffer::OwnedImpl decompressed;
+  EXPECT_TRUE(decompressor->decompress(compressed, decompressed));
+  EXPECT_EQ("body", decompressed.toString());
+}
+
+TEST(ContentCodecs, UnsupportedEncoding) {
+  ContentCodecs codecs(false);
+  EXPECT_EQ(nullptr, codecs.createDecompressor("deflate"));
+  EXPECT_NE(nullptr, codecs.createDecompressor("GZIP"));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
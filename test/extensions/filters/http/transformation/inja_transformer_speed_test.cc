@@ -1,8 +1,11 @@
 #include "source/common/common/empty_string.h"
 
 #include "source/extensions/filters/http/transformation/inja_transformer.h"
+#include "source/extensions/filters/http/transformation/text_metrics.h"
 
+#include "test/mocks/common.h"
 #include "test/mocks/http/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
 #include "test/test_common/utility.h"
 
 #include "benchmark/benchmark.h"
@@ -17,6 +20,43 @@ namespace Transformation {
 
 namespace {
 std::function<const std::string &()> empty_body = [] { return EMPTY_STRING; };
+
+// A JSON chat request whose messages add up to about size bytes of prose.
+std::string largeRequestBody(size_t size) {
+  const std::string sentence =
+      "The quick brown fox jumps over the lazy dog, 42 times in a row!\n";
+  json messages = json::array();
+  std::string content;
+  while (content.size() < size) {
+    content += sentence;
+    if (content.size() >= 4096) {
+      messages.push_back({{"role", "user"}, {"content", std::move(content)}});
+      content.clear();
+    }
+  }
+  messages.push_back({{"role", "user"}, {"content", content}});
+  return json{{"model", "test"}, {"messages", messages}}.dump();
+}
+
+void transformBody(benchmark::State &state, const std::string &template_text) {
+  envoy::api::v2::filter::http::TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(template_text);
+  NiceMock<Random::MockRandomGenerator> rng;
+  NiceMock<ThreadLocal::MockInstance> tls;
+  InjaTransformer transformer(transformation, rng, google::protobuf::BoolValue(),
+                              tls);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"},
+                                         {":path", "/v1/chat"}};
+  const std::string request_body = largeRequestBody(state.range(0));
+
+  for (auto _ : state) {
+    Buffer::OwnedImpl body(request_body);
+    transformer.transform(headers, &headers, body, callbacks);
+    benchmark::DoNotOptimize(body.length());
+  }
+  state.SetBytesProcessed(state.iterations() * request_body.size());
+}
 }
 
 static void BM_ExrtactHeader(benchmark::State &state) {
@@ -40,6 +80,36 @@ static void BM_ExrtactHeader(benchmark::State &state) {
 // Register the function as a benchmark
 BENCHMARK(BM_ExrtactHeader);
 
+static void BM_CountWords(benchmark::State &state) {
+  const std::string text = largeRequestBody(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(countWords(text));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_CountWords)->Arg(128 << 10)->Arg(1 << 20);
+
+static void BM_EstimateTokens(benchmark::State &state) {
+  const std::string text = largeRequestBody(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(estimateTokens(text));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_EstimateTokens)->Arg(128 << 10)->Arg(1 << 20);
+
+// Includes parsing the body, as when the callbacks are used for rate limit
+// estimates in a request transformation.
+static void BM_WordCountTemplate(benchmark::State &state) {
+  transformBody(state, "{{ word_count(messages) }}");
+}
+BENCHMARK(BM_WordCountTemplate)->Arg(128 << 10)->Arg(1 << 20);
+
+static void BM_TokenEstimateTemplate(benchmark::State &state) {
+  transformBody(state, "{{ token_estimate(messages) }}");
+}
+BENCHMARK(BM_TokenEstimateTemplate)->Arg(128 << 10)->Arg(1 << 20);
+
 } // namespace Transformation
 } // namespace HttpFilters
 } // namespace Extensions
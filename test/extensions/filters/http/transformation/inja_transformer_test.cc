@@ -11,6 +11,7 @@
 #include "test/mocks/upstream/mocks.h"
 #include "test/test_common/environment.h"
 
+#include "absl/container/flat_hash_set.h"
 #include "fmt/format.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -18,6 +19,7 @@
 
 using testing::_;
 using testing::AtLeast;
+using testing::Eq;
 using testing::HasSubstr;
 using testing::Invoke;
 using testing::Return;
@@ -760,6 +762,102 @@ TEST_F(InjaTransformerTest, UseBodyFunction) {
   EXPECT_EQ(body.toString(), "1 1");
 }
 
+TEST_F(InjaTransformerTest, BodyFunctionSplicesOriginalBody) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.set_advanced_templates(true);
+
+  transformation.mutable_body()->set_text(
+      "{\"wrapped\": {{ body() }}, \"method\": \"{{ header(\":method\") }}\"}");
+  (*transformation.mutable_headers())["x-body"].set_text("{{ body() }}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  Buffer::OwnedImpl body("{\"a\":1}");
+  const void *original_data = body.frontSlice().mem_;
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "{\"wrapped\": {\"a\":1}, \"method\": \"GET\"}");
+  // headers are rendered after the body and still see the original body
+  EXPECT_EQ(headers.get_("x-body"), "{\"a\":1}");
+
+  bool spliced = false;
+  for (const Buffer::RawSlice &slice : body.getRawSlices()) {
+    spliced = spliced || slice.mem_ == original_data;
+  }
+  EXPECT_TRUE(spliced);
+}
+
+// Records what is appended to it, like a buffer that hashes its content as it
+// is written.
+class AppendRecordingBuffer : public Buffer::OwnedImpl {
+public:
+  using Buffer::OwnedImpl::add;
+  using Buffer::OwnedImpl::prepend;
+
+  void add(const void *data, uint64_t size) override {
+    appended_.append(static_cast<const char *>(data), size);
+    Buffer::OwnedImpl::add(data, size);
+  }
+  void prepend(Buffer::Instance &) override { FAIL() << "prepend"; }
+
+  std::string appended_;
+};
+
+TEST_F(InjaTransformerTest, RendersBodyIntoOutputBuffer) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.mutable_body()->set_text("{{ header(\":method\") }} {{ header(\":path\") }}");
+  (*transformation.mutable_headers())["x-body"].set_text("{{ body() }}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  AppendRecordingBuffer body;
+  body.add("original");
+  body.appended_.clear();
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "GET /foo");
+  EXPECT_EQ(body.appended_, "GET /foo");
+  EXPECT_EQ(headers.get_("x-body"), "original");
+  EXPECT_EQ(headers.getContentLengthValue(), "8");
+}
+
+TEST_F(InjaTransformerTest, BodyFunctionInsideStatement) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.set_advanced_templates(true);
+
+  transformation.mutable_body()->set_text(
+      "{% if header(\":method\") == \"GET\" %}[{{ body() }}]{% endif %}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  Buffer::OwnedImpl body("1");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "[1]");
+}
+
+TEST_F(InjaTransformerTest, BodyFunctionWithEscapeCharacters) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.set_escape_characters(true);
+
+  transformation.mutable_body()->set_text("{\"wrapped\": \"{{ body() }}\"}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  Buffer::OwnedImpl body("say \"hi\"");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "{\"wrapped\": \"say \\\"hi\\\"\"}");
+}
+
 TEST_F(InjaTransformerTest, MergeJsonKeys) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -783,6 +881,34 @@ TEST_F(InjaTransformerTest, MergeJsonKeys) {
   EXPECT_EQ(body.toString(), "{\"ext1\":\"/foo\",\"ext2\":\"/foo\"}");
 }
 
+TEST_F(InjaTransformerTest, MergeJsonKeysSingleExpression) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":path", "/foo"}, {"x-json", "{\"c\":true}"}};
+  TransformationTemplate transformation;
+
+  auto add_key = [&transformation](const std::string &key, const std::string &text) {
+    envoy::api::v2::filter::http::MergeJsonKeys_OverridableTemplate tmpl;
+    tmpl.mutable_tmpl()->set_text(text);
+    (*transformation.mutable_merge_json_keys()->mutable_json_keys())[key] = tmpl;
+  };
+  // objects and numbers are merged as values
+  add_key("copy", "{{ a }}");
+  add_key("sum", " {{ 1 + 2 }} ");
+  // strings are parsed as json, like rendered text
+  add_key("parsed", "{{ header(\"x-json\") }}");
+  // text around the expression is rendered and parsed
+  add_key("text", "[{{ a.b }}]");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  Buffer::OwnedImpl body("{\"a\":{\"b\":1}}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(json::parse(body.toString()),
+            json::parse("{\"a\":{\"b\":1},\"copy\":{\"b\":1},\"sum\":3,"
+                        "\"parsed\":{\"c\":true},\"text\":[1]}"));
+}
+
 TEST_F(InjaTransformerTest, MergeJsonKeysNoOverrideEmpty ) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -1143,6 +1269,37 @@ TEST_F(InjaTransformerTest, WordCountJSON) {
   transformer.transform(headers, &headers, body, callbacks);
 }
 
+TEST_F(InjaTransformerTest, TokenEstimateJSON) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{token_estimate(context())}}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  // key "prompt" (2), "Hello, world!" (6), key "n" (1), 3 (1)
+  Buffer::OwnedImpl body("{\"prompt\": \"Hello, world!\", \"n\": 3}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "10");
+}
+
+TEST_F(InjaTransformerTest, WordCountWhitespaceOnly) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+
+  transformation.mutable_body()->set_text("{{word_count(body())}}");
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body(" \t ");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "0");
+}
+
 TEST_F(InjaTransformerTest, SubstringOutOfBounds) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -1217,6 +1374,162 @@ TEST_F(InjaTransformerTest, ParseBodyListUsingContext) {
   EXPECT_EQ(body.toString(), "321");
 }
 
+TEST_F(InjaTransformerTest, ParseBodyAsFormUrlEncoded) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(
+      TransformationTemplate::ParseAsFormUrlEncoded);
+  transformation.mutable_body()->set_text("{{ user }}:{{ lang }}");
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("user=jane+doe&lang=c%2B%2B");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "jane doe:c++");
+}
+
+TEST_F(InjaTransformerTest, ParseBodyAsXml) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::ParseAsXml);
+  transformation.set_advanced_templates(true);
+  transformation.mutable_body()->set_text(
+      "{{ at(order, \"@id\") }}{% for i in order/item %}-{{ i }}{% endfor %}");
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("<order id=\"7\"><item>a</item><item>b</item></order>");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "7-a-b");
+}
+
+TEST_F(InjaTransformerTest, ParseBodyAsXmlError) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::ParseAsXml);
+  transformation.mutable_body()->set_text("{{ body() }}");
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  Buffer::OwnedImpl body("<order>");
+  EXPECT_THROW(transformer.transform(headers, &headers, body, callbacks),
+               EnvoyException);
+
+  transformation.set_ignore_error_on_parse(true);
+  InjaTransformer transformer2(transformation, rng_, google::protobuf::BoolValue(), tls_);
+  transformer2.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "<order>");
+}
+
+TEST_F(InjaTransformerTest, SkipsOptionalParsingWhenDisabled) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"}, {":path", "/foo"}};
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  callbacks.stream_info_.filterState()->setData(
+      OptionalBodyParsingDisabled::key(),
+      std::make_shared<OptionalBodyParsingDisabled>(),
+      StreamInfo::FilterState::StateType::ReadOnly,
+      StreamInfo::FilterState::LifeSpan::Request);
+
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{default(a,\"skipped\")}}");
+  transformation.set_ignore_error_on_parse(true);
+  InjaTransformer optional(transformation, rng_, google::protobuf::BoolValue(), tls_);
+  Buffer::OwnedImpl body("{\"a\":\"parsed\"}");
+  optional.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "skipped");
+
+  // parsing that can fail the request is never skipped.
+  transformation.set_ignore_error_on_parse(false);
+  InjaTransformer required(transformation, rng_, google::protobuf::BoolValue(), tls_);
+  Buffer::OwnedImpl body2("{\"a\":\"parsed\"}");
+  required.transform(headers, &headers, body2, callbacks);
+  EXPECT_EQ(body2.toString(), "parsed");
+}
+
+TEST_F(InjaTransformerTest, RecordsStageSpans) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "POST"}, {":path", "/foo"}};
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{a}}");
+  transformation.set_stage_spans(true);
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  auto *parse_span = new NiceMock<Tracing::MockSpan>();
+  auto *render_span = new NiceMock<Tracing::MockSpan>();
+  EXPECT_CALL(callbacks.active_span_, spawnChild_(_, "transformation.parse_body", _))
+      .WillOnce(Return(parse_span));
+  // without extractors there is no extraction stage.
+  EXPECT_CALL(callbacks.active_span_, spawnChild_(_, "transformation.extract", _))
+      .Times(0);
+  EXPECT_CALL(callbacks.active_span_, spawnChild_(_, "transformation.render", _))
+      .WillOnce(Return(render_span));
+  EXPECT_CALL(*parse_span, setTag(Eq("transformation.body_bytes"), Eq("14")));
+  EXPECT_CALL(*parse_span, finishSpan());
+  EXPECT_CALL(*render_span, setTag(Eq("transformation.rendered_bytes"), Eq("6")));
+  EXPECT_CALL(*render_span, finishSpan());
+
+  Buffer::OwnedImpl body("{\"a\":\"hello!\"}");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "hello!");
+}
+
+TEST_F(InjaTransformerTest, RetainParsedRequestBody) {
+  Http::TestRequestHeaderMapImpl request_headers{{":method", "POST"}, {":path", "/foo"}};
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  TransformationTemplate request_transformation;
+  request_transformation.mutable_retain_parsed_body()->add_projections("/request/id");
+  InjaTransformer request_transformer(request_transformation, rng_,
+                                      google::protobuf::BoolValue(), tls_);
+  Buffer::OwnedImpl request_body("{\"request\":{\"id\":\"abc\",\"other\":1}}");
+  request_transformer.transform(request_headers, &request_headers, request_body, callbacks);
+
+  TransformationTemplate response_transformation;
+  response_transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  response_transformation.mutable_body()->set_text(
+      "{{ request_body(\"/request/id\") }}:{{ request_body(\"/request/other\") }}");
+  InjaTransformer response_transformer(response_transformation, rng_,
+                                       google::protobuf::BoolValue(), tls_);
+  Buffer::OwnedImpl response_body("not json");
+  response_transformer.transform(response_headers, &request_headers, response_body, callbacks);
+  EXPECT_EQ(response_body.toString(), "abc:");
+}
+
+TEST_F(InjaTransformerTest, RetainParsedRequestBodyOverBudget) {
+  Http::TestRequestHeaderMapImpl request_headers{{":method", "POST"}, {":path", "/foo"}};
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  TransformationTemplate request_transformation;
+  request_transformation.mutable_retain_parsed_body()->mutable_max_bytes()->set_value(4);
+  InjaTransformer request_transformer(request_transformation, rng_,
+                                      google::protobuf::BoolValue(), tls_);
+  Buffer::OwnedImpl request_body("{\"id\":\"abc\"}");
+  request_transformer.transform(request_headers, &request_headers, request_body, callbacks);
+
+  TransformationTemplate response_transformation;
+  response_transformation.mutable_body()->set_text("[{{ request_body() }}]");
+  InjaTransformer response_transformer(response_transformation, rng_,
+                                       google::protobuf::BoolValue(), tls_);
+  Buffer::OwnedImpl response_body("{}");
+  response_transformer.transform(response_headers, &request_headers, response_body, callbacks);
+  EXPECT_EQ(response_body.toString(), "[]");
+}
+
+TEST_F(InjaTransformerTest, RetainParsedBodyRequiresParsing) {
+  TransformationTemplate transformation;
+  transformation.set_parse_body_behavior(TransformationTemplate::DontParse);
+  transformation.mutable_retain_parsed_body();
+  EXPECT_THROW_WITH_MESSAGE(
+      InjaTransformer(transformation, rng_, google::protobuf::BoolValue(), tls_),
+      EnvoyException, "retain_parsed_body requires parsing the body");
+}
+
 TEST_F(InjaTransformerTest, ParseFromClusterMetadata) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -1414,6 +1727,81 @@ TEST_F(InjaTransformerTest, ParseFromClusterMetadataList) {
   EXPECT_EQ(body.toString(), "[1,2]");
 }
 
+TEST_F(InjaTransformerTest, ParseFromClusterMetadataCompiledAndDynamicKeys) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.set_string_delimiter(".");
+  transformation.mutable_body()->set_text(
+      "{{cluster_metadata(\"outer.inner\")}}-{% set k = \"outer.other\" %}{{cluster_metadata(k)}}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  ProtobufWkt::Struct struct_obj;
+  auto status = ProtobufUtil::JsonStringToMessage(
+      R"({"outer":{"inner":"a","other":"b"}})", &struct_obj);
+  envoy::config::core::v3::Metadata meta;
+  meta.mutable_filter_metadata()->insert(
+      {SoloHttpFilterNames::get().Transformation,
+       struct_obj});
+  ON_CALL(*callbacks.cluster_info_, metadata())
+      .WillByDefault(testing::ReturnRefOfCopy(meta));
+
+  Buffer::OwnedImpl body("1");
+  transformer.transform(headers, &headers, body, callbacks);
+  EXPECT_EQ(body.toString(), "a-b");
+}
+
+TEST_F(InjaTransformerTest, ParseFromClusterMetadataCachedPerCluster) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{cluster_metadata(\"key\")}}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  auto metadataWithKey = [](const std::string &value) {
+    ProtobufWkt::Struct struct_obj;
+    auto status = ProtobufUtil::JsonStringToMessage(
+        fmt::format(R"({{"key":{}}})", value), &struct_obj);
+    envoy::config::core::v3::Metadata meta;
+    meta.mutable_filter_metadata()->insert(
+        {SoloHttpFilterNames::get().Transformation, struct_obj});
+    return meta;
+  };
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  ON_CALL(*callbacks.cluster_info_, metadata())
+      .WillByDefault(testing::ReturnRefOfCopy(metadataWithKey("[1,2]")));
+  for (int i = 0; i < 2; i++) {
+    Buffer::OwnedImpl body("1");
+    transformer.transform(headers, &headers, body, callbacks);
+    EXPECT_EQ(body.toString(), "[1,2]");
+  }
+
+  // a new cluster info must not be served from the cache.
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> other_callbacks;
+  ON_CALL(*other_callbacks.cluster_info_, metadata())
+      .WillByDefault(testing::ReturnRefOfCopy(metadataWithKey("[3]")));
+  Buffer::OwnedImpl body("1");
+  transformer.transform(headers, &headers, body, other_callbacks);
+  EXPECT_EQ(body.toString(), "[3]");
+}
+
+TEST_F(InjaTransformerTest, DoesNotKeepClusterInfoAfterTransform) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text("{{cluster_metadata(\"key\")}}");
+
+  InjaTransformer transformer(transformation, rng_, google::protobuf::BoolValue(), tls_);
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  const long use_count = callbacks.cluster_info_.use_count();
+  Buffer::OwnedImpl body("1");
+  transformer.transform(headers, &headers, body, callbacks);
+  // a removed cluster must not be kept alive by the worker's context.
+  EXPECT_EQ(use_count, callbacks.cluster_info_.use_count());
+}
+
 TEST_F(InjaTransformerTest, ParseFromClusterMetadataListDeprecated) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -1611,6 +1999,49 @@ TEST_F(InjaTransformerTest, ReplaceWithRandomTest_SameReplacementPatternUsesSame
   assert_replacements(body.toString(), "test-3-");
 }
 
+TEST_F(InjaTransformerTest, ReplaceWithRandomIsScopedToRequest) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
+  TransformationTemplate transformation;
+  transformation.mutable_body()->set_text(
+      "{{ replace_with_random(\"replace-me\", \"replace-me\") }}");
+
+  Random::RandomGeneratorImpl rng;
+  InjaTransformer request_transformer(transformation, rng, google::protobuf::BoolValue(), tls_);
+  InjaTransformer response_transformer(transformation, rng, google::protobuf::BoolValue(), tls_);
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+
+  // the request and response transformations of a stream share the value.
+  Buffer::OwnedImpl first("");
+  request_transformer.transform(headers, &headers, first, callbacks);
+  Buffer::OwnedImpl second("");
+  response_transformer.transform(headers, &headers, second, callbacks);
+  EXPECT_EQ(22, first.length());
+  EXPECT_EQ(first.toString(), second.toString());
+
+  // another request gets a new value.
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> other_callbacks;
+  Buffer::OwnedImpl third("");
+  request_transformer.transform(headers, &headers, third, other_callbacks);
+  EXPECT_EQ(22, third.length());
+  EXPECT_NE(first.toString(), third.toString());
+}
+
+TEST(RandomStringPool, GeneratesDistinctBase64Values) {
+  Random::RandomGeneratorImpl rng;
+  RandomStringPool pool;
+  absl::flat_hash_set<std::string> values;
+  // spans more than one batch
+  for (int i = 0; i < 100; i++) {
+    const std::string value(pool.next(rng));
+    EXPECT_EQ(RandomStringPool::EncodedLength, value.size());
+    EXPECT_EQ(std::string::npos,
+              value.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                      "abcdefghijklmnopqrstuvwxyz0123456789+/"));
+    values.insert(value);
+  }
+  EXPECT_EQ(100, values.size());
+}
+
 TEST_F(InjaTransformerTest, ParseUsingSetKeyword) {
   Http::TestRequestHeaderMapImpl headers{{":method", "GET"}, {":path", "/foo"}};
   TransformationTemplate transformation;
@@ -0,0 +1,73 @@
+#include <cctype>
+#include <random>
+#include <string>
+
+#include "source/extensions/filters/http/transformation/text_metrics.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Transformation {
+
+namespace {
+
+uint64_t countWordsOneByteAtATime(const std::string &text) {
+  uint64_t words = 0;
+  bool previous_whitespace = true;
+  for (const char c : text) {
+    const bool whitespace = isspace(static_cast<unsigned char>(c));
+    words += !whitespace && previous_whitespace;
+    previous_whitespace = whitespace;
+  }
+  return words;
+}
+
+} // namespace
+
+TEST(TextMetricsTest, CountWords) {
+  EXPECT_EQ(0, countWords(""));
+  EXPECT_EQ(0, countWords(" \t\r\n\v\f"));
+  EXPECT_EQ(1, countWords("word"));
+  EXPECT_EQ(5, countWords("  why  don't   you \t\t accept me   "));
+}
+
+TEST(TextMetricsTest, CountWordsAcrossBlocks) {
+  std::string text;
+  for (int i = 0; i < 100; i++) {
+    text += "abc ";
+  }
+  // words straddle the 64 byte blocks
+  EXPECT_EQ(100, countWords(text));
+  EXPECT_EQ(100, countWords(" " + text));
+  EXPECT_EQ(1, countWords(std::string(200, 'x')));
+}
+
+TEST(TextMetricsTest, CountWordsMatchesByteAtATime) {
+  std::mt19937 generator(0);
+  const std::string alphabet = " \t\n\v\f\rab,\x80\xe4";
+  for (int i = 0; i < 1000; i++) {
+    std::string text(generator() % 300, ' ');
+    for (char &c : text) {
+      c = alphabet[generator() % alphabet.size()];
+    }
+    EXPECT_EQ(countWordsOneByteAtATime(text), countWords(text)) << text;
+  }
+}
+
+TEST(TextMetricsTest, EstimateTokens) {
+  EXPECT_EQ(0, estimateTokens(""));
+  EXPECT_EQ(0, estimateTokens("   "));
+  // Hello(2) ,(1) world(2) !(1)
+  EXPECT_EQ(6, estimateTokens("Hello, world!"));
+  // 123 456 78
+  EXPECT_EQ(3, estimateTokens("12345678"));
+  // one token per code point
+  EXPECT_EQ(2, estimateTokens("\xe4\xb8\xad\xe6\x96\x87"));
+}
+
+} // namespace Transformation
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -766,6 +766,269 @@ TEST_F(TransformationFilterTest, ErroredOnStreamComplete) {
 
 }
 
+TEST_F(TransformationFilterTest, DecompressesResponseBody) {
+  listener_config_.mutable_response_decompression();
+  route_config_.mutable_response_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("{{a}}");
+  initFilter();
+
+  ContentCodecs codecs(false);
+  Buffer::OwnedImpl compressed("{\"a\":\"b\"}");
+  codecs.createCompressor("gzip")->compress(
+      compressed, Envoy::Compression::Compressor::State::Finish);
+
+  Http::TestResponseHeaderMapImpl response_headers{
+      {"content-encoding", "gzip"},
+      {"content-length", std::to_string(compressed.length())}};
+  filter_->decodeHeaders(headers_, true);
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->encodeHeaders(response_headers, false));
+  EXPECT_FALSE(response_headers.has("content-encoding"));
+
+  std::string downstream_body;
+  EXPECT_CALL(encoder_filter_callbacks_, addEncodedData(_, false))
+      .WillOnce(Invoke(
+          [&](Buffer::Instance &b, bool) { downstream_body = b.toString(); }));
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->encodeData(compressed, true));
+  EXPECT_EQ("b", downstream_body);
+  EXPECT_EQ("1", response_headers.get_("content-length"));
+  EXPECT_EQ(1U, config_->stats().response_body_decompressions_.value());
+  EXPECT_EQ(0U, config_->stats().response_body_recompressions_.value());
+}
+
+TEST_F(TransformationFilterTest, RecompressesResponseBody) {
+  listener_config_.mutable_response_decompression()->set_recompress(true);
+  route_config_.mutable_response_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("{{a}}");
+  initFilter();
+
+  ContentCodecs codecs(false);
+  Buffer::OwnedImpl compressed("{\"a\":\"b\"}");
+  codecs.createCompressor("br")->compress(
+      compressed, Envoy::Compression::Compressor::State::Finish);
+
+  Http::TestResponseHeaderMapImpl response_headers{{"content-encoding", "br"}};
+  filter_->decodeHeaders(headers_, true);
+  filter_->encodeHeaders(response_headers, false);
+
+  Buffer::OwnedImpl downstream_body;
+  EXPECT_CALL(encoder_filter_callbacks_, addEncodedData(_, false))
+      .WillOnce(Invoke(
+          [&](Buffer::Instance &b, bool) { downstream_body.move(b); }));
+  filter_->encodeData(compressed, true);
+
+  EXPECT_EQ("br", response_headers.get_("content-encoding"));
+  EXPECT_EQ(std::to_string(downstream_body.length()),
+            response_headers.get_("content-length"));
+  Buffer::OwnedImpl decompressed;
+  codecs.createDecompressor("br")->decompress(downstream_body, decompressed);
+  EXPECT_EQ("b", decompressed.toString());
+  EXPECT_EQ(1U, config_->stats().response_body_recompressions_.value());
+}
+
+TEST_F(TransformationFilterTest, SetsContentLengthOfEmptyDecompressedBody) {
+  listener_config_.mutable_response_decompression()->set_recompress(true);
+  route_config_.mutable_response_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("");
+  initFilter();
+
+  ContentCodecs codecs(false);
+  Buffer::OwnedImpl compressed("{\"a\":\"b\"}");
+  codecs.createCompressor("gzip")->compress(
+      compressed, Envoy::Compression::Compressor::State::Finish);
+
+  Http::TestResponseHeaderMapImpl response_headers{
+      {"content-encoding", "gzip"},
+      {"content-length", std::to_string(compressed.length())}};
+  filter_->decodeHeaders(headers_, true);
+  filter_->encodeHeaders(response_headers, false);
+
+  EXPECT_CALL(encoder_filter_callbacks_, addEncodedData(_, _)).Times(0);
+  filter_->encodeData(compressed, true);
+
+  EXPECT_EQ("0", response_headers.get_("content-length"));
+  // an empty body is not re-encoded.
+  EXPECT_FALSE(response_headers.has("content-encoding"));
+  EXPECT_EQ(0U, config_->stats().response_body_recompressions_.value());
+}
+
+TEST_F(TransformationFilterTest, RejectsBodyThatDoesNotDecompress) {
+  listener_config_.mutable_response_decompression();
+  route_config_.mutable_response_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("{{a}}");
+  initFilter();
+
+  const std::string garbage = "this is not gzip";
+  Http::TestResponseHeaderMapImpl response_headers{
+      {"content-encoding", "gzip"},
+      {"content-length", std::to_string(garbage.size())}};
+  filter_->decodeHeaders(headers_, true);
+  filter_->encodeHeaders(response_headers, false);
+
+  std::string downstream_body;
+  EXPECT_CALL(encoder_filter_callbacks_, addEncodedData(_, false))
+      .WillOnce(Invoke(
+          [&](Buffer::Instance &b, bool) { downstream_body = b.toString(); }));
+  Buffer::OwnedImpl data(garbage);
+  filter_->encodeData(data, false);
+
+  EXPECT_EQ(0U, data.length());
+  EXPECT_EQ("502", response_headers.get_(":status"));
+  EXPECT_EQ("upstream response body could not be decompressed",
+            downstream_body);
+  EXPECT_FALSE(response_headers.has("content-encoding"));
+  EXPECT_EQ(1U, config_->stats().response_body_decompression_errors_.value());
+  EXPECT_EQ(1U, config_->stats().response_error_.value());
+}
+
+TEST_F(TransformationFilterTest, DoesNotDecompressStackedEncodings) {
+  listener_config_.mutable_response_decompression();
+  route_config_.mutable_response_transformation()
+      ->mutable_transformation_template()
+      ->mutable_body()
+      ->set_text("solo");
+  initFilter();
+
+  Http::TestResponseHeaderMapImpl response_headers{
+      {"content-encoding", "gzip, br"}};
+  filter_->decodeHeaders(headers_, true);
+  filter_->encodeHeaders(response_headers, false);
+  EXPECT_EQ("gzip, br", response_headers.get_("content-encoding"));
+  EXPECT_EQ(0U, config_->stats().response_body_decompressions_.value());
+}
+
+TEST_F(TransformationFilterTest, SpillsBodyPastBufferLimit) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(4));
+  listener_config_.mutable_body_spill()->set_threshold_bytes(4);
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Both,
+                             "{{a}}");
+  filter_->decodeHeaders(headers_, false);
+
+  std::string upstream_body;
+  EXPECT_CALL(filter_callbacks_, addDecodedData(_, false))
+      .WillOnce(Invoke(
+          [&](Buffer::Instance &b, bool) { upstream_body = b.toString(); }));
+  Buffer::OwnedImpl first("{\"a\":");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(first, false));
+  Buffer::OwnedImpl second("\"b\"}");
+  EXPECT_EQ(Http::FilterDataStatus::Continue,
+            filter_->decodeData(second, true));
+  EXPECT_EQ("b", upstream_body);
+  EXPECT_EQ(0U, config_->stats().request_error_.value());
+#if defined(__linux__)
+  EXPECT_EQ(1U, config_->stats().body_spills_.value());
+#endif
+}
+
+TEST_F(TransformationFilterTest, RejectsBodyPastSpillLimit) {
+  auto *body_spill = listener_config_.mutable_body_spill();
+  body_spill->set_threshold_bytes(4);
+  body_spill->mutable_max_bytes()->set_value(8);
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Both,
+                             "{{a}}");
+  filter_->decodeHeaders(headers_, false);
+
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::PayloadTooLarge, _, _, _, _));
+  Buffer::OwnedImpl body("{\"a\":\"bcdef\"}");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(body, false));
+  EXPECT_EQ(1U, config_->stats().request_error_.value());
+}
+
+TEST_F(TransformationFilterTest, ShedsLargestBodiesUnderMemoryPressure) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(16));
+  const Server::OverloadActionState half(UnitFloat(0.5));
+  ON_CALL(server_factory_context_.overload_manager_.overload_state_,
+          getState(TransformationOverloadActionNames::get().ShedBufferedBodies))
+      .WillByDefault(ReturnRef(half));
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Both,
+                             "{{a}}");
+  filter_->decodeHeaders(headers_, false);
+
+  // a body below half of the limit is kept.
+  Buffer::OwnedImpl small("{\"a\":");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(small, false));
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::ServiceUnavailable, _, _, _, _));
+  Buffer::OwnedImpl more("\"bcd\"");
+  filter_->decodeData(more, false);
+  EXPECT_EQ(1U, config_->stats().overload_body_shed_.value());
+  EXPECT_EQ(1U, config_->stats().request_error_.value());
+}
+
+TEST_F(TransformationFilterTest, ShedsUnlimitedBodiesUnderMemoryPressure) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(0));
+  const Server::OverloadActionState half(UnitFloat(0.5));
+  ON_CALL(server_factory_context_.overload_manager_.overload_state_,
+          getState(TransformationOverloadActionNames::get().ShedBufferedBodies))
+      .WillByDefault(ReturnRef(half));
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Both,
+                             "{{a}}");
+  filter_->decodeHeaders(headers_, false);
+
+  // without a limit, bodies are shed past half of 1MiB.
+  Buffer::OwnedImpl small(std::string(512 * 1024, 'a'));
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(small, false));
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::ServiceUnavailable, _, _, _, _));
+  Buffer::OwnedImpl more("a");
+  filter_->decodeData(more, false);
+  EXPECT_EQ(1U, config_->stats().overload_body_shed_.value());
+}
+
+TEST_F(TransformationFilterTest, ShedsUnlimitedBodiesAgainstConfiguredSize) {
+  ON_CALL(filter_callbacks_, decoderBufferLimit()).WillByDefault(Return(0));
+  const Server::OverloadActionState half(UnitFloat(0.5));
+  ON_CALL(server_factory_context_.overload_manager_.overload_state_,
+          getState(TransformationOverloadActionNames::get().ShedBufferedBodies))
+      .WillByDefault(ReturnRef(half));
+  listener_config_.mutable_unlimited_body_shed_reference_bytes()->set_value(16);
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Both,
+                             "{{a}}");
+  filter_->decodeHeaders(headers_, false);
+
+  Buffer::OwnedImpl small("{\"a\":");
+  EXPECT_EQ(Http::FilterDataStatus::StopIterationNoBuffer,
+            filter_->decodeData(small, false));
+  EXPECT_CALL(filter_callbacks_,
+              sendLocalReply(Http::Code::ServiceUnavailable, _, _, _, _));
+  Buffer::OwnedImpl more("\"bcd\"");
+  filter_->decodeData(more, false);
+  EXPECT_EQ(1U, config_->stats().overload_body_shed_.value());
+}
+
+TEST_F(TransformationFilterTest, DisablesOptionalBodyParsingWhenSaturated) {
+  const Server::OverloadActionState saturated(UnitFloat::max());
+  ON_CALL(server_factory_context_.overload_manager_.overload_state_,
+          getState(TransformationOverloadActionNames::get()
+                       .DisableOptionalBodyParsing))
+      .WillByDefault(ReturnRef(saturated));
+  initFilterWithBodyTemplate(TransformationFilterTest::ConfigType::Both,
+                             "solo");
+  filter_->decodeHeaders(headers_, false);
+  Buffer::OwnedImpl body("{}");
+  filter_->decodeData(body, true);
+
+  EXPECT_NE(nullptr,
+            filter_callbacks_.stream_info_.filterState()
+                ->getDataReadOnly<OptionalBodyParsingDisabled>(
+                    OptionalBodyParsingDisabled::key()));
+  EXPECT_EQ(1U, config_->stats().overload_body_parsing_disabled_.value());
+}
+
 TEST_F(TransformationFilterTest, EncodeStopIterationOnFilterDestroy) {
   initFilterWithHeadersBody(TransformationFilterTest::ConfigType::Both);
   filter_->onDestroy();
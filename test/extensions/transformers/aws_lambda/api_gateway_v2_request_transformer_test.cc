@@ -0,0 +1,215 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/network/address_impl.h"
+#include "source/extensions/transformers/aws_lambda/api_gateway_v2_request_transformer.h"
+#include "source/extensions/transformers/aws_lambda/json_writer.h"
+
+#include "test/mocks/http/mocks.h"
+
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace AwsLambda {
+namespace {
+
+class ApiGatewayV2RequestTransformerTest : public testing::Test {
+protected:
+  ApiGatewayV2RequestTransformerTest() {
+    callbacks_.stream_info_.protocol_ = Http::Protocol::Http11;
+    callbacks_.stream_info_.start_time_ =
+        SystemTime(std::chrono::milliseconds(1583348638390));
+    callbacks_.stream_info_.downstream_connection_info_provider_
+        ->setRemoteAddress(
+            std::make_shared<Network::Address::Ipv4Instance>("192.0.2.1"));
+  }
+
+  json transform(Http::TestRequestHeaderMapImpl &headers, Buffer::Instance &body,
+                 const ApiGatewayV2RequestTransformerProto &config = {}) {
+    ApiGatewayV2RequestTransformer transformer(config);
+    transformer.transform(headers, &headers, body, callbacks_);
+    return json::parse(body.toString());
+  }
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks_;
+};
+
+TEST_F(ApiGatewayV2RequestTransformerTest, WritesEvent) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "POST"},
+      {":authority", "api.example.com"},
+      {":path", "/my/path?a=1&b=x%20y&a=2"},
+      {"x-request-id", "request-1"},
+      {"user-agent", "agent"},
+      {"cookie", "c1=v1; c2=v2"},
+      {"accept", "text/plain"},
+      {"accept", "application/json"}};
+  Buffer::OwnedImpl body("Hello \"lambda\"\n");
+
+  const json actual = transform(headers, body);
+  const json expected = R"({
+    "version": "2.0",
+    "routeKey": "$default",
+    "rawPath": "/my/path",
+    "rawQueryString": "a=1&b=x%20y&a=2",
+    "cookies": ["c1=v1", "c2=v2"],
+    "headers": {
+      "host": "api.example.com",
+      "x-request-id": "request-1",
+      "user-agent": "agent",
+      "accept": "text/plain,application/json"
+    },
+    "queryStringParameters": {"a": "1,2", "b": "x y"},
+    "requestContext": {
+      "domainName": "api.example.com",
+      "domainPrefix": "api",
+      "http": {
+        "method": "POST",
+        "path": "/my/path",
+        "protocol": "HTTP/1.1",
+        "sourceIp": "192.0.2.1",
+        "userAgent": "agent"
+      },
+      "requestId": "request-1",
+      "routeKey": "$default",
+      "stage": "$default",
+      "time": "04/Mar/2020:19:03:58 +0000",
+      "timeEpoch": 1583348638390
+    },
+    "body": "Hello \"lambda\"\n",
+    "isBase64Encoded": false
+  })"_json;
+  EXPECT_EQ(expected, actual);
+  EXPECT_EQ("application/json", headers.getContentTypeValue());
+  EXPECT_EQ(std::to_string(body.length()), headers.getContentLengthValue());
+}
+
+TEST_F(ApiGatewayV2RequestTransformerTest, UsesConfiguredStageAndRouteKey) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":authority", "api.example.com"}, {":path", "/"}};
+  Buffer::OwnedImpl body;
+  ApiGatewayV2RequestTransformerProto config;
+  config.set_stage("prod");
+  config.set_route_key("GET /");
+
+  const json actual = transform(headers, body, config);
+  EXPECT_EQ("GET /", actual["routeKey"]);
+  EXPECT_EQ("prod", actual["requestContext"]["stage"]);
+  EXPECT_EQ("GET /", actual["requestContext"]["routeKey"]);
+  EXPECT_FALSE(actual.contains("body"));
+  EXPECT_FALSE(actual.contains("cookies"));
+  EXPECT_FALSE(actual.contains("queryStringParameters"));
+  EXPECT_EQ("", actual["rawQueryString"]);
+}
+
+TEST_F(ApiGatewayV2RequestTransformerTest, Base64EncodesBinaryBody) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "POST"}, {":authority", "api.example.com"}, {":path", "/"}};
+  const char binary[] = {'\x00', '\xff', '\xfe', 'a'};
+  Buffer::OwnedImpl body(binary, sizeof(binary));
+
+  const json actual = transform(headers, body);
+  EXPECT_EQ("AP/+YQ==", actual["body"]);
+  EXPECT_EQ(true, actual["isBase64Encoded"]);
+}
+
+TEST_F(ApiGatewayV2RequestTransformerTest, KeepsUtf8SplitAcrossSlices) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "POST"}, {":authority", "api.example.com"}, {":path", "/"}};
+  // "é" is split between two slices.
+  Buffer::OwnedImpl body;
+  body.appendSliceForTest("caf\xc3");
+  body.appendSliceForTest("\xa9");
+
+  const json actual = transform(headers, body);
+  EXPECT_EQ("caf\xc3\xa9", actual["body"]);
+  EXPECT_EQ(false, actual["isBase64Encoded"]);
+}
+
+TEST_F(ApiGatewayV2RequestTransformerTest, ReplacesInvalidUtf8InHeadersAndQuery) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"},
+      {":authority", "api.example.com"},
+      {":path", "/?name=%FFx&caf%C3%A9=%C3"},
+      {"x-obs-text", "caf\xe9"},
+      {"x-repeated", "a"},
+      {"x-repeated", "\xc3\xa9"}};
+  Buffer::OwnedImpl body;
+
+  // parses only if the event is valid UTF-8.
+  const json actual = transform(headers, body);
+  EXPECT_EQ("\xef\xbf\xbdx", actual["queryStringParameters"]["name"]);
+  EXPECT_EQ("\xef\xbf\xbd",
+            actual["queryStringParameters"]["caf\xc3\xa9"]);
+  EXPECT_EQ("caf\xef\xbf\xbd", actual["headers"]["x-obs-text"]);
+  EXPECT_EQ("a,\xc3\xa9", actual["headers"]["x-repeated"]);
+}
+
+TEST_F(ApiGatewayV2RequestTransformerTest, JoinsHostHeaderToAuthority) {
+  Http::TestRequestHeaderMapImpl headers{{":method", "GET"},
+                                         {":authority", "api.example.com"},
+                                         {":path", "/"},
+                                         {"host", "other.example.com"}};
+  Buffer::OwnedImpl body;
+
+  const json actual = transform(headers, body);
+  EXPECT_EQ("api.example.com,other.example.com", actual["headers"]["host"]);
+  EXPECT_EQ(1U, actual["headers"].size());
+}
+
+TEST_F(ApiGatewayV2RequestTransformerTest, IgnoresResponsePath) {
+  Http::TestRequestHeaderMapImpl headers{
+      {":method", "GET"}, {":authority", "api.example.com"}, {":path", "/"}};
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  Buffer::OwnedImpl body("response");
+  ApiGatewayV2RequestTransformer transformer({});
+  transformer.transform(response_headers, &headers, body, callbacks_);
+  EXPECT_EQ("response", body.toString());
+}
+
+TEST(JsonWriter, EscapesStrings) {
+  Buffer::OwnedImpl output;
+  JsonWriter writer(output);
+  writer.startArray();
+  writer.stringValue("a\"b\\c\td\x01");
+  writer.numberValue(42);
+  writer.boolValue(false);
+  writer.startObject();
+  writer.endObject();
+  writer.endArray();
+  EXPECT_EQ("[\"a\\\"b\\\\c\\td\\u0001\",42,false,{}]", output.toString());
+}
+
+TEST(JsonWriter, ReplacesInvalidUtf8) {
+  Buffer::OwnedImpl output;
+  JsonWriter writer(output);
+  writer.startObject();
+  // a lone continuation byte, an overlong encoding, a surrogate and a
+  // truncated sequence.
+  writer.key("\x80");
+  writer.stringValue("a\xc0\xaf"
+                     "b\xed\xa0\x80"
+                     "c\xe2\x82");
+  writer.endObject();
+  EXPECT_EQ("{\"\xef\xbf\xbd\":\"a\xef\xbf\xbd\xef\xbf\xbd"
+            "b\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd"
+            "c\xef\xbf\xbd\xef\xbf\xbd\"}",
+            output.toString());
+
+  // parts are written as they are, as a sequence may continue in the next.
+  Buffer::OwnedImpl parts;
+  JsonWriter part_writer(parts);
+  part_writer.startString();
+  part_writer.stringPart("\xc3");
+  part_writer.stringPart("\xa9\xe2\x82\xac");
+  part_writer.endString();
+  EXPECT_EQ("\"\xc3\xa9\xe2\x82\xac\"", parts.toString());
+}
+
+} // namespace
+} // namespace AwsLambda
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,149 @@
+#include "test/integration/fake_nats_upstream.h"
+
+#include <vector>
+
+#include "envoy/network/filter.h"
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/assert.h"
+#include "source/common/nats/streaming/message_utility.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "fmt/format.h"
+
+namespace Envoy {
+
+namespace {
+
+constexpr absl::string_view InfoMessage =
+    "INFO {\"server_id\":\"fake\",\"version\":\"1.2.2\",\"max_payload\":"
+    "1048576}\r\n";
+
+} // namespace
+
+/**
+ * Serves one NATS connection. Operations may span reads, so the unconsumed
+ * input is kept until the operation is complete.
+ */
+class FakeNatsSession : public Network::ReadFilter {
+public:
+  explicit FakeNatsSession(FakeNatsUpstream &parent) : parent_(parent) {}
+
+  // Network::ReadFilter
+  Network::FilterStatus onNewConnection() override {
+    Buffer::OwnedImpl info(InfoMessage);
+    read_callbacks_->connection().write(info, false);
+    return Network::FilterStatus::Continue;
+  }
+
+  Network::FilterStatus onData(Buffer::Instance &data, bool) override {
+    pending_.append(data.toString());
+    data.drain(data.length());
+
+    Buffer::OwnedImpl out;
+    size_t consumed = 0;
+    while (consumeOperation(consumed, out)) {
+    }
+    pending_.erase(0, consumed);
+
+    if (out.length() > 0) {
+      read_callbacks_->connection().write(out, false);
+    }
+    return Network::FilterStatus::StopIteration;
+  }
+
+  void initializeReadFilterCallbacks(
+      Network::ReadFilterCallbacks &callbacks) override {
+    read_callbacks_ = &callbacks;
+  }
+
+private:
+  // Handles the operation at the offset if it has been fully read, and
+  // advances the offset past it. @return whether it had been.
+  bool consumeOperation(size_t &offset, Buffer::Instance &out) {
+    const absl::string_view input = absl::string_view(pending_).substr(offset);
+    const size_t line_end = input.find("\r\n");
+    if (line_end == absl::string_view::npos) {
+      return false;
+    }
+    const absl::string_view line = input.substr(0, line_end);
+    size_t length = line_end + 2;
+
+    const std::vector<absl::string_view> tokens =
+        absl::StrSplit(line, ' ', absl::SkipEmpty());
+    if (!tokens.empty() && absl::EqualsIgnoreCase(tokens[0], "PUB")) {
+      uint64_t payload_size = 0;
+      RELEASE_ASSERT((tokens.size() == 3 || tokens.size() == 4) &&
+                         absl::SimpleAtoi(tokens.back(), &payload_size),
+                     absl::StrCat("malformed NATS PUB: ", line));
+      if (input.size() < length + payload_size + 2) {
+        return false;
+      }
+      const absl::string_view reply_to = tokens.size() == 4 ? tokens[2] : "";
+      onPub(tokens[1], reply_to, input.substr(length, payload_size), out);
+      length += payload_size + 2;
+    } else if (!tokens.empty() && absl::EqualsIgnoreCase(tokens[0], "PING")) {
+      out.add("PONG\r\n");
+    }
+    // CONNECT, SUB, UNSUB and PONG need no answer.
+
+    offset += length;
+    return true;
+  }
+
+  void onPub(absl::string_view subject, absl::string_view reply_to,
+             absl::string_view payload, Buffer::Instance &out) {
+    if (absl::StartsWith(subject,
+                         absl::StrCat(FakeNatsUpstream::PubPrefix, "."))) {
+      pb::PubMsg pub_msg;
+      RELEASE_ASSERT(pub_msg.ParseFromArray(payload.data(), payload.size()),
+                     "malformed STAN PubMsg");
+      parent_.published_++;
+      parent_.published_bytes_ += pub_msg.data().size();
+      writeMsg(reply_to,
+               Nats::Streaming::MessageUtility::createPubAckMessage(
+                   pub_msg.guid(), ""),
+               out);
+      return;
+    }
+
+    // anything else is a connect request on <discover prefix>.<cluster id>.
+    parent_.connects_++;
+    writeMsg(reply_to,
+             Nats::Streaming::MessageUtility::createConnectResponseMessage(
+                 std::string(FakeNatsUpstream::PubPrefix), "_STAN.sub.fake",
+                 "_STAN.unsub.fake", "_STAN.close.fake"),
+             out);
+  }
+
+  static void writeMsg(absl::string_view subject, const std::string &payload,
+                       Buffer::Instance &out) {
+    // the client decodes NATS line by line, even within a payload.
+    RELEASE_ASSERT(payload.find('\r') == std::string::npos,
+                   "the fake NATS server can't send a payload with CR");
+    out.add(fmt::format("MSG {} 1 {}\r\n", subject, payload.size()));
+    out.add(payload);
+    out.add("\r\n");
+  }
+
+  FakeNatsUpstream &parent_;
+  Network::ReadFilterCallbacks *read_callbacks_{};
+  std::string pending_;
+};
+
+FakeNatsUpstream::FakeNatsUpstream(uint32_t port,
+                                   Network::Address::IpVersion version,
+                                   const FakeUpstreamConfig &config)
+    : FakeUpstream(port, version, config) {}
+
+bool FakeNatsUpstream::createNetworkFilterChain(
+    Network::Connection &connection,
+    const Filter::NetworkFilterFactoriesList &) {
+  connection.addReadFilter(std::make_shared<FakeNatsSession>(*this));
+  return true;
+}
+
+} // namespace Envoy
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "test/integration/fake_upstream.h"
+
+namespace Envoy {
+
+/**
+ * A fake NATS server that speaks just enough of NATS and NATS Streaming for
+ * the nats_streaming filter: it answers STAN connect requests and acks every
+ * published message. Unlike a FakeRawConnection, it serves any number of
+ * connections on the upstream's own thread without the test driving it, so
+ * it can be used under load.
+ */
+class FakeNatsUpstream : public FakeUpstream {
+public:
+  // The prefix STAN clients publish to, as returned in the connect response.
+  static constexpr absl::string_view PubPrefix = "_STAN.pub.fake";
+
+  FakeNatsUpstream(uint32_t port, Network::Address::IpVersion version,
+                   const FakeUpstreamConfig &config);
+
+  // Network::FilterChainFactory
+  bool createNetworkFilterChain(
+      Network::Connection &connection,
+      const Filter::NetworkFilterFactoriesList &filter_factories) override;
+
+  /**
+   * @return the number of STAN connect requests answered.
+   */
+  uint64_t connects() const { return connects_; }
+
+  /**
+   * @return the number of messages published and acked.
+   */
+  uint64_t published() const { return published_; }
+
+  /**
+   * @return the total size of the published message data.
+   */
+  uint64_t publishedBytes() const { return published_bytes_; }
+
+private:
+  friend class FakeNatsSession;
+
+  std::atomic<uint64_t> connects_{};
+  std::atomic<uint64_t> published_{};
+  std::atomic<uint64_t> published_bytes_{};
+};
+
+} // namespace Envoy
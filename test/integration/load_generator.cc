@@ -0,0 +1,253 @@
+#include "test/integration/load_generator.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "source/common/common/logger.h"
+
+#include "absl/strings/numbers.h"
+#include "fmt/format.h"
+
+namespace Envoy {
+
+namespace {
+
+// The latency below which the given fraction of the sorted latencies fall.
+double percentileMs(const std::vector<std::chrono::microseconds> &sorted,
+                    double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t index = std::min(
+      sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+  return sorted[index].count() / 1000.0;
+}
+
+uint64_t currentRssBytes() {
+  // the second field of statm is the resident set in pages.
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size_pages = 0;
+  uint64_t resident_pages = 0;
+  if (!(statm >> size_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+// Records when and how a response ends, and tells the generator.
+class TimedResponse : public Http::ResponseDecoder, public Http::StreamCallbacks {
+public:
+  using DoneFn = std::function<void(TimedResponse &)>;
+
+  TimedResponse(TimeSource &time_source, DoneFn done)
+      : time_source_(time_source), done_(std::move(done)),
+        started_(time_source.monotonicTime()) {}
+
+  std::chrono::microseconds latency() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(ended_ -
+                                                                 started_);
+  }
+  bool ok() const { return ok_; }
+
+  // Http::StreamDecoder
+  void decodeData(Buffer::Instance &, bool end_stream) override {
+    if (end_stream) {
+      end();
+    }
+  }
+  void decodeMetadata(Http::MetadataMapPtr &&) override {}
+
+  // Http::ResponseDecoder
+  void decode1xxHeaders(Http::ResponseHeaderMapPtr &&) override {}
+  void decodeHeaders(Http::ResponseHeaderMapPtr &&headers,
+                     bool end_stream) override {
+    ok_ = headers->getStatusValue() == "200";
+    if (end_stream) {
+      end();
+    }
+  }
+  void decodeTrailers(Http::ResponseTrailerMapPtr &&) override { end(); }
+  void dumpState(std::ostream &, int) const override {}
+
+  // Http::StreamCallbacks
+  void onResetStream(Http::StreamResetReason, absl::string_view) override {
+    ok_ = false;
+    end();
+  }
+  void onAboveWriteBufferHighWatermark() override {}
+  void onBelowWriteBufferLowWatermark() override {}
+
+private:
+  void end() {
+    if (done_called_) {
+      return;
+    }
+    done_called_ = true;
+    ended_ = time_source_.monotonicTime();
+    done_(*this);
+  }
+
+  TimeSource &time_source_;
+  const DoneFn done_;
+  const MonotonicTime started_;
+  MonotonicTime ended_;
+  bool ok_{};
+  bool done_called_{};
+};
+
+uint64_t peakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // ru_maxrss is in kilobytes on Linux.
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+} // namespace
+
+std::string LoadResult::toJson() const {
+  return fmt::format(
+      "{{\"scenario\":\"{}\",\"requests\":{},\"errors\":{},\"rps\":{:.1f},"
+      "\"p50_ms\":{:.3f},\"p99_ms\":{:.3f},\"rss_bytes\":{},"
+      "\"peak_rss_bytes\":{}}}",
+      scenario, requests, errors, rps, p50_ms, p99_ms, rss_bytes,
+      peak_rss_bytes);
+}
+
+LoadGenerator::LoadGenerator(Event::Dispatcher &dispatcher,
+                             TimeSource &time_source, ConnectFn connect)
+    : dispatcher_(dispatcher), time_source_(time_source),
+      connect_(std::move(connect)) {}
+
+LoadResult LoadGenerator::run(const std::string &scenario,
+                              const SendFn &send) {
+  struct Client {
+    // declared first so that it outlives the codec.
+    std::unique_ptr<TimedResponse> response;
+    IntegrationCodecClientPtr codec;
+  };
+
+  const uint32_t concurrency = static_cast<uint32_t>(
+      std::min<uint64_t>(std::max<uint32_t>(concurrency_, 1), requests_));
+  std::vector<Client> clients(concurrency);
+  for (Client &client : clients) {
+    client.codec = connect_();
+  }
+
+  std::vector<std::chrono::microseconds> latencies;
+  latencies.reserve(requests_);
+  uint64_t sent = 0;
+  uint64_t errors = 0;
+  uint64_t finished = 0;
+  bool waiting = false;
+  bool timed_out = false;
+  // the clients whose response ended since the dispatcher last returned.
+  std::vector<Client *> done;
+
+  auto start_request = [&](Client &client) {
+    client.response = std::make_unique<TimedResponse>(
+        time_source_, [&, client = &client](TimedResponse &) {
+          done.push_back(client);
+          if (waiting) {
+            dispatcher_.exit();
+          }
+        });
+    Http::RequestEncoder &encoder = client.codec->newStream(*client.response);
+    encoder.getStream().addCallbacks(*client.response);
+    send(encoder);
+    sent++;
+  };
+
+  const MonotonicTime start = time_source_.monotonicTime();
+  Event::TimerPtr timeout = dispatcher_.createTimer([&]() {
+    timed_out = true;
+    dispatcher_.exit();
+  });
+  timeout->enableTimer(timeout_);
+  for (Client &client : clients) {
+    start_request(client);
+  }
+
+  while (finished < requests_ && !timed_out) {
+    if (done.empty()) {
+      // the server and the upstreams run on their own threads, so this only
+      // returns once a response ends or the timeout fires.
+      waiting = true;
+      dispatcher_.run(Event::Dispatcher::RunType::Block);
+      waiting = false;
+    }
+    // a new request may end while the next one is being sent.
+    std::vector<Client *> ended;
+    ended.swap(done);
+    for (Client *client : ended) {
+      latencies.push_back(client->response->latency());
+      if (!client->response->ok()) {
+        errors++;
+      }
+      finished++;
+      // the response is only destroyed here, once its callbacks returned.
+      if (sent < requests_) {
+        start_request(*client);
+      }
+    }
+  }
+  timeout->disableTimer();
+  if (finished < requests_) {
+    ENVOY_LOG_MISC(error, "load scenario {} timed out with {} of {} done",
+                   scenario, finished, requests_);
+    errors += requests_ - finished;
+  }
+  const double elapsed_seconds =
+      std::chrono::duration<double>(time_source_.monotonicTime() - start)
+          .count();
+
+  // closing resets the requests still in flight, which must outlive it.
+  for (Client &client : clients) {
+    client.codec->close();
+  }
+  clients.clear();
+
+  std::sort(latencies.begin(), latencies.end());
+  LoadResult result;
+  result.scenario = scenario;
+  result.requests = requests_;
+  result.errors = errors;
+  result.rps = elapsed_seconds > 0 ? latencies.size() / elapsed_seconds : 0;
+  result.p50_ms = percentileMs(latencies, 0.50);
+  result.p99_ms = percentileMs(latencies, 0.99);
+  result.rss_bytes = currentRssBytes();
+  result.peak_rss_bytes = peakRssBytes();
+  return result;
+}
+
+void reportLoadResult(const LoadResult &result) {
+  const std::string json = result.toJson();
+  ENVOY_LOG_MISC(info, "load result: {}", json);
+
+  const char *outputs_dir = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR");
+  if (outputs_dir == nullptr) {
+    return;
+  }
+  std::ofstream out(fmt::format("{}/load_results.jsonl", outputs_dir),
+                    std::ios::app);
+  out << json << "\n";
+}
+
+uint64_t loadTestKnob(const char *name, uint64_t default_value) {
+  const char *value = std::getenv(name);
+  uint64_t parsed = 0;
+  if (value == nullptr || !absl::SimpleAtoi(value, &parsed)) {
+    return default_value;
+  }
+  return parsed;
+}
+
+} // namespace Envoy
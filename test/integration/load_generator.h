@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/http/codec.h"
+
+#include "test/integration/http_integration.h"
+
+namespace Envoy {
+
+/**
+ * The outcome of one load scenario.
+ */
+struct LoadResult {
+  std::string scenario;
+  uint64_t requests{};
+  // Responses that weren't a 200, streams that were reset and requests that
+  // didn't complete before the timeout.
+  uint64_t errors{};
+  double rps{};
+  double p50_ms{};
+  double p99_ms{};
+  // The resident set of the test process after the scenario, and the peak
+  // since the process started. The process also holds the fake upstreams and
+  // the clients, so these are upper bounds of the server's own.
+  uint64_t rss_bytes{};
+  uint64_t peak_rss_bytes{};
+
+  /**
+   * @return the result as a single line JSON object.
+   */
+  std::string toJson() const;
+};
+
+/**
+ * Sends requests from a fixed number of connections, each with one request in
+ * flight at a time, and measures throughput and latency. The requests are
+ * driven by the test's dispatcher, so the clients share its thread. Each
+ * response is timed when it ends, and its connection sends the next request
+ * right away.
+ */
+class LoadGenerator {
+public:
+  using ConnectFn = std::function<IntegrationCodecClientPtr()>;
+  // Encodes a whole request on a new stream.
+  using SendFn = std::function<void(Http::RequestEncoder &)>;
+
+  LoadGenerator(Event::Dispatcher &dispatcher, TimeSource &time_source,
+                ConnectFn connect);
+
+  /**
+   * Runs a scenario to completion or until the timeout passes.
+   * @param scenario supplies the name of the scenario, for reporting.
+   * @param send supplies a function that starts a request on a client.
+   */
+  LoadResult run(const std::string &scenario, const SendFn &send);
+
+  LoadGenerator &requests(uint64_t requests) {
+    requests_ = requests;
+    return *this;
+  }
+  LoadGenerator &concurrency(uint32_t concurrency) {
+    concurrency_ = concurrency;
+    return *this;
+  }
+  LoadGenerator &timeout(std::chrono::milliseconds timeout) {
+    timeout_ = timeout;
+    return *this;
+  }
+
+private:
+  Event::Dispatcher &dispatcher_;
+  TimeSource &time_source_;
+  const ConnectFn connect_;
+  uint64_t requests_{1000};
+  uint32_t concurrency_{16};
+  std::chrono::milliseconds timeout_{60000};
+};
+
+/**
+ * Logs the result and, when run by bazel, appends it to load_results.jsonl in
+ * the undeclared outputs of the test, so that runs can be compared.
+ */
+void reportLoadResult(const LoadResult &result);
+
+/**
+ * @return the value of the environment variable, or the default if it is
+ * unset or not a number.
+ */
+uint64_t loadTestKnob(const char *name, uint64_t default_value);
+
+} // namespace Envoy
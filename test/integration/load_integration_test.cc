@@ -0,0 +1,304 @@
+#include "source/common/buffer/buffer_impl.h"
+#include "source/extensions/filters/http/solo_well_known_names.h"
+
+#include "test/integration/autonomous_upstream.h"
+#include "test/integration/fake_nats_upstream.h"
+#include "test/integration/http_integration.h"
+#include "test/integration/load_generator.h"
+#include "test/test_common/environment.h"
+#include "test/test_common/network_utility.h"
+
+#include "api/envoy/config/filter/http/aws_lambda/v2/aws_lambda.pb.validate.h"
+#include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
+#include "absl/strings/str_cat.h"
+#include "api/envoy/config/transformer/aws_lambda/v2/api_gateway_transformer.pb.h"
+
+namespace Envoy {
+namespace {
+
+// Runs each scenario against in-process fake upstreams and reports RPS,
+// latency and the RSS of the whole test process. The load can be scaled with GLOO_LOAD_TEST_REQUESTS,
+// GLOO_LOAD_TEST_CONCURRENCY (connections) and GLOO_LOAD_TEST_WORKERS;
+// the defaults are small enough to run with the other integration tests.
+
+enum class LoadScenario {
+  // a Lambda whose ALB envelope is unwrapped, with static credentials.
+  LambdaAlb,
+  // a Lambda whose API Gateway envelope is transformed.
+  LambdaApiGateway,
+  // a Lambda invoked with credentials from STS AssumeRoleWithWebIdentity.
+  LambdaSts,
+  // a NATS Streaming publish.
+  NatsStreaming,
+};
+
+std::string scenarioName(LoadScenario scenario) {
+  switch (scenario) {
+  case LoadScenario::LambdaAlb:
+    return "LambdaAlb";
+  case LoadScenario::LambdaApiGateway:
+    return "LambdaApiGateway";
+  case LoadScenario::LambdaSts:
+    return "LambdaSts";
+  case LoadScenario::NatsStreaming:
+    return "NatsStreaming";
+  }
+  PANIC_DUE_TO_CORRUPT_ENUM;
+}
+
+const std::string STATIC_CREDENTIALS_LAMBDA_FILTER =
+    R"EOF(
+name: io.solo.aws_lambda
+typed_config:
+  "@type": type.googleapis.com/envoy.config.filter.http.aws_lambda.v2.AWSLambdaConfig
+)EOF";
+
+const std::string STS_LAMBDA_FILTER =
+    R"EOF(
+name: io.solo.aws_lambda
+typed_config:
+  "@type": type.googleapis.com/envoy.config.filter.http.aws_lambda.v2.AWSLambdaConfig
+  service_account_credentials:
+    cluster: sts
+    uri: https://sts.amazonaws.com
+    region: us-east-1
+    timeout: 1s
+)EOF";
+
+const std::string NATS_STREAMING_FILTER =
+    R"EOF(
+name: io.solo.nats_streaming
+typed_config:
+  "@type": type.googleapis.com/envoy.config.filter.http.nats.streaming.v2.NatsStreaming
+  cluster: nats
+  max_connections: 1
+  op_timeout: 5s
+)EOF";
+
+const std::string ALB_RESPONSE =
+    R"({"statusCode":200,"statusDescription":"200 OK","isBase64Encoded":false,)"
+    R"("headers":{"content-type":"application/json"},"body":"{\"ok\":true}"})";
+
+const std::string API_GATEWAY_RESPONSE =
+    R"({"statusCode":200,"isBase64Encoded":false,)"
+    R"("headers":{"content-type":"application/json"},)"
+    R"("multiValueHeaders":{"x-request-ids":["a","b"]},"body":"{\"ok\":true}"})";
+
+const std::string STS_RESPONSE = R"(
+<AssumeRoleWithWebIdentityResponse xmlns="https://sts.amazonaws.com/doc/2011-06-15/">
+  <AssumeRoleWithWebIdentityResult>
+    <Credentials>
+      <AccessKeyId>some_access_key</AccessKeyId>
+      <SecretAccessKey>some_secret_key</SecretAccessKey>
+      <SessionToken>some_session_token</SessionToken>
+      <Expiration>3000-07-28T21:20:25Z</Expiration>
+    </Credentials>
+  </AssumeRoleWithWebIdentityResult>
+</AssumeRoleWithWebIdentityResponse>
+)";
+
+// The order of the fake upstreams and of their clusters, with the fake STS
+// in between.
+constexpr size_t LambdaUpstream = 0;
+constexpr size_t NatsUpstream = 2;
+
+class GlooLoadIntegrationTest : public HttpIntegrationTest,
+                                public testing::TestWithParam<LoadScenario> {
+public:
+  GlooLoadIntegrationTest()
+      : HttpIntegrationTest(Http::CodecClient::Type::HTTP1,
+                            TestEnvironment::getIpVersionsForTest().front()) {
+    concurrency_ = loadTestKnob("GLOO_LOAD_TEST_WORKERS", 1);
+  }
+
+  void TearDown() override {
+    TestEnvironment::unsetEnvVar("AWS_WEB_IDENTITY_TOKEN_FILE");
+    TestEnvironment::unsetEnvVar("AWS_ROLE_ARN");
+  }
+
+  void createUpstreams() override {
+    auto lambda = std::make_unique<AutonomousUpstream>(
+        Network::Test::createRawBufferDownstreamSocketFactory(), 0, version_,
+        upstreamConfig(), false);
+    lambda->setResponseHeaders(std::make_unique<Http::TestResponseHeaderMapImpl>(
+        Http::TestResponseHeaderMapImpl{{":status", "200"},
+                                        {"content-type", "application/json"}}));
+    lambda->setResponseBody(GetParam() == LoadScenario::LambdaApiGateway
+                                ? API_GATEWAY_RESPONSE
+                                : ALB_RESPONSE);
+    fake_upstreams_.emplace_back(std::move(lambda));
+
+    auto sts = std::make_unique<AutonomousUpstream>(
+        Network::Test::createRawBufferDownstreamSocketFactory(), 0, version_,
+        upstreamConfig(), false);
+    sts->setResponseBody(STS_RESPONSE);
+    fake_upstreams_.emplace_back(std::move(sts));
+
+    fake_upstreams_.emplace_back(
+        std::make_unique<FakeNatsUpstream>(0, version_, upstreamConfig()));
+  }
+
+  void initialize() override {
+    setUpstreamCount(3);
+    const LoadScenario scenario = GetParam();
+
+    switch (scenario) {
+    case LoadScenario::LambdaAlb:
+    case LoadScenario::LambdaApiGateway:
+      config_helper_.prependFilter(STATIC_CREDENTIALS_LAMBDA_FILTER);
+      break;
+    case LoadScenario::LambdaSts:
+      TestEnvironment::setEnvVar(
+          "AWS_WEB_IDENTITY_TOKEN_FILE",
+          TestEnvironment::runfilesPath("test/integration/fakejwt.txt",
+                                        "envoy_gloo"),
+          1);
+      TestEnvironment::setEnvVar("AWS_ROLE_ARN", "test", 1);
+      config_helper_.prependFilter(STS_LAMBDA_FILTER);
+      break;
+    case LoadScenario::NatsStreaming:
+      config_helper_.prependFilter(NATS_STREAMING_FILTER);
+      break;
+    }
+
+    config_helper_.addConfigModifier(
+        [scenario](envoy::config::bootstrap::v3::Bootstrap &bootstrap) {
+          auto *static_resources = bootstrap.mutable_static_resources();
+          // the STS and NATS clusters are copies of cluster_0, which points
+          // at the fake Lambda.
+          const auto cluster_0 = static_resources->clusters(LambdaUpstream);
+          for (const std::string name : {"sts", "nats"}) {
+            auto *cluster = static_resources->add_clusters();
+            cluster->MergeFrom(cluster_0);
+            cluster->set_name(name);
+            cluster->mutable_load_assignment()->set_cluster_name(name);
+          }
+
+          envoy::config::filter::http::aws_lambda::v2::
+              AWSLambdaProtocolExtension protocol_extension;
+          protocol_extension.set_host("lambda.us-east-1.amazonaws.com");
+          protocol_extension.set_region("us-east-1");
+          if (scenario != LoadScenario::LambdaSts) {
+            protocol_extension.set_access_key("access key");
+            protocol_extension.set_secret_key("secret key");
+          }
+          (*static_resources->mutable_clusters(LambdaUpstream)
+                ->mutable_typed_extension_protocol_options())
+              [Extensions::HttpFilters::SoloHttpFilterNames::get().AwsLambda]
+                  .PackFrom(protocol_extension);
+        });
+
+    config_helper_.addConfigModifier(
+        [scenario](envoy::extensions::filters::network::http_connection_manager::
+                       v3::HttpConnectionManager &hcm) {
+          auto &per_filter_config =
+              *hcm.mutable_route_config()
+                   ->mutable_virtual_hosts(0)
+                   ->mutable_routes(0)
+                   ->mutable_typed_per_filter_config();
+
+          if (scenario == LoadScenario::NatsStreaming) {
+            envoy::config::filter::http::nats::streaming::v2::
+                NatsStreamingPerRoute route_config;
+            route_config.set_subject("webhooks");
+            route_config.set_cluster_id("test-cluster");
+            route_config.set_discover_prefix("_STAN.discover");
+            per_filter_config[Extensions::HttpFilters::SoloHttpFilterNames::
+                                  get()
+                                      .NatsStreaming]
+                .PackFrom(route_config);
+            return;
+          }
+
+          envoy::config::filter::http::aws_lambda::v2::AWSLambdaPerRoute
+              route_config;
+          route_config.set_name("FunctionName");
+          route_config.set_qualifier("v1");
+          if (scenario == LoadScenario::LambdaApiGateway) {
+            auto *transformer = route_config.mutable_transformer_config();
+            transformer->set_name("io.solo.api_gateway.api_gateway_transformer");
+            transformer->mutable_typed_config()->PackFrom(
+                envoy::config::transformer::aws_lambda::v2::
+                    ApiGatewayTransformation());
+          } else {
+            route_config.set_unwrap_as_alb(true);
+          }
+          per_filter_config[Extensions::HttpFilters::SoloHttpFilterNames::get()
+                                .AwsLambda]
+              .PackFrom(route_config);
+        });
+
+    HttpIntegrationTest::initialize();
+  }
+
+  LoadResult runLoad() {
+    const Http::TestRequestHeaderMapImpl request_headers{
+        {":method", "POST"},
+        {":authority", "www.solo.io"},
+        {":path", "/webhooks"},
+        {"content-type", "application/json"}};
+    // a JSON webhook of about 1KiB.
+    const std::string body =
+        absl::StrCat(R"({"event":"order.created","id":"0123456789","data":")",
+                     std::string(960, 'x'), R"("})");
+
+    LoadGenerator generator(*dispatcher_, timeSystem(), [this]() {
+      return makeHttpConnection(lookupPort("http"));
+    });
+    generator.requests(loadTestKnob("GLOO_LOAD_TEST_REQUESTS", 1000))
+        .concurrency(loadTestKnob("GLOO_LOAD_TEST_CONCURRENCY", 16));
+    LoadResult result = generator.run(
+        scenarioName(GetParam()),
+        [&request_headers, &body](Http::RequestEncoder &encoder) {
+          encoder.encodeHeaders(request_headers, false).IgnoreError();
+          Buffer::OwnedImpl data(body);
+          encoder.encodeData(data, true);
+        });
+    reportLoadResult(result);
+    return result;
+  }
+
+  FakeNatsUpstream &natsUpstream() {
+    return static_cast<FakeNatsUpstream &>(*fake_upstreams_[NatsUpstream]);
+  }
+};
+
+INSTANTIATE_TEST_SUITE_P(
+    Scenarios, GlooLoadIntegrationTest,
+    testing::Values(LoadScenario::LambdaAlb, LoadScenario::LambdaApiGateway,
+                    LoadScenario::LambdaSts, LoadScenario::NatsStreaming),
+    [](const testing::TestParamInfo<LoadScenario> &info) {
+      return scenarioName(info.param);
+    });
+
+TEST_P(GlooLoadIntegrationTest, Load) {
+  initialize();
+  const LoadResult result = runLoad();
+
+  EXPECT_EQ(0U, result.errors);
+  EXPECT_GT(result.rps, 0);
+  EXPECT_LE(result.p50_ms, result.p99_ms);
+
+  switch (GetParam()) {
+  case LoadScenario::LambdaAlb:
+  case LoadScenario::LambdaApiGateway:
+    EXPECT_GE(test_server_->counter("cluster.cluster_0.upstream_rq_total")
+                  ->value(),
+              result.requests);
+    break;
+  case LoadScenario::LambdaSts:
+    EXPECT_GE(test_server_->counter("cluster.cluster_0.upstream_rq_total")
+                  ->value(),
+              result.requests);
+    EXPECT_GE(test_server_->counter("cluster.sts.upstream_rq_total")->value(),
+              1U);
+    break;
+  case LoadScenario::NatsStreaming:
+    EXPECT_EQ(result.requests, natsUpstream().published());
+    EXPECT_GE(natsUpstream().connects(), 1U);
+    break;
+  }
+}
+
+} // namespace
+} // namespace Envoy
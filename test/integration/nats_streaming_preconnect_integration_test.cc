@@ -0,0 +1,67 @@
+#include "test/integration/fake_nats_upstream.h"
+#include "test/integration/http_integration.h"
+
+#include "api/envoy/config/filter/http/nats/streaming/v2/nats_streaming.pb.validate.h"
+
+namespace Envoy {
+namespace {
+
+// The readiness timeout is far longer than the test, so a startup that waited
+// it out would time out the test rather than pass.
+const std::string NATS_STREAMING_PRECONNECT_FILTER =
+    R"EOF(
+name: io.solo.nats_streaming
+typed_config:
+  "@type": type.googleapis.com/envoy.config.filter.http.nats.streaming.v2.NatsStreaming
+  cluster: cluster_0
+  max_connections: 1
+  op_timeout: 5s
+  preconnect:
+    cluster_id: test-cluster
+    discover_prefix: _STAN.discover
+    readiness_timeout: 3600s
+)EOF";
+
+const std::string STATS_PREFIX = "http.config_test.nats_streaming.preconnect.";
+
+class NatsStreamingPreconnectIntegrationTest
+    : public HttpIntegrationTest,
+      public testing::TestWithParam<Network::Address::IpVersion> {
+public:
+  NatsStreamingPreconnectIntegrationTest()
+      : HttpIntegrationTest(Http::CodecClient::Type::HTTP1, GetParam()) {
+    concurrency_ = 2;
+  }
+
+  void createUpstreams() override {
+    fake_upstreams_.emplace_back(
+        std::make_unique<FakeNatsUpstream>(0, version_, upstreamConfig()));
+  }
+
+  void initialize() override {
+    config_helper_.prependFilter(NATS_STREAMING_PRECONNECT_FILTER);
+    HttpIntegrationTest::initialize();
+  }
+
+  FakeNatsUpstream &natsUpstream() {
+    return static_cast<FakeNatsUpstream &>(*fake_upstreams_[0]);
+  }
+};
+
+INSTANTIATE_TEST_SUITE_P(
+    IpVersions, NatsStreamingPreconnectIntegrationTest,
+    testing::ValuesIn(TestEnvironment::getIpVersionsForTest()));
+
+// The workers of a starting server only run once its listeners are ready, so
+// the clients connect after startup rather than holding it.
+TEST_P(NatsStreamingPreconnectIntegrationTest, ConnectsWorkersAfterStartup) {
+  initialize();
+
+  test_server_->waitForCounterEq(STATS_PREFIX + "workers_connected", 2);
+  test_server_->waitForGaugeEq(STATS_PREFIX + "ready", 1);
+  EXPECT_EQ(0, test_server_->counter(STATS_PREFIX + "readiness_timeout")->value());
+  EXPECT_EQ(2U, natsUpstream().connects());
+}
+
+} // namespace
+} // namespace Envoy
@@ -0,0 +1,157 @@
+#include "test/tools/transformation_cost/corpus.h"
+
+#include "envoy/common/exception.h"
+
+#include "source/common/common/base64.h"
+#include "source/common/http/header_map_impl.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "fmt/format.h"
+
+// clang-format off
+#include "nlohmann/json.hpp"
+// clang-format on
+
+using json = nlohmann::json;
+
+namespace Envoy {
+namespace TransformationCost {
+
+namespace {
+
+std::string stringOr(const json &object, const char *key,
+                     const std::string &fallback) {
+  auto it = object.find(key);
+  return it != object.end() && it->is_string() ? it->get<std::string>()
+                                               : fallback;
+}
+
+// HAR headers are a list of name/value objects. Pseudo-headers are skipped,
+// as they are set from the method, url and status.
+void addHarHeaders(const json &headers, Http::HeaderMap &header_map) {
+  if (!headers.is_array()) {
+    return;
+  }
+  for (const auto &header : headers) {
+    const std::string name = absl::AsciiStrToLower(stringOr(header, "name", ""));
+    if (name.empty() || name[0] == ':') {
+      continue;
+    }
+    header_map.addCopy(Http::LowerCaseString(name),
+                       stringOr(header, "value", ""));
+  }
+}
+
+void addJsonHeaders(const json &headers, Http::HeaderMap &header_map) {
+  if (!headers.is_object()) {
+    return;
+  }
+  for (const auto &[name, value] : headers.items()) {
+    header_map.addCopy(Http::LowerCaseString(name),
+                       value.is_string() ? value.get<std::string>()
+                                         : value.dump());
+  }
+}
+
+CorpusEntry harEntry(const json &entry) {
+  CorpusEntry result;
+  result.request_headers = Http::RequestHeaderMapImpl::create();
+  result.response_headers = Http::ResponseHeaderMapImpl::create();
+
+  const json &request = entry.value("request", json::object());
+  result.request_headers->setMethod(stringOr(request, "method", "GET"));
+  // strip the scheme and authority from the url.
+  const std::string full_url = stringOr(request, "url", "/");
+  absl::string_view url = full_url;
+  const size_t scheme = url.find("://");
+  if (scheme != absl::string_view::npos) {
+    url.remove_prefix(scheme + 3);
+    const size_t path = url.find('/');
+    result.request_headers->setHost(url.substr(0, path));
+    url = path == absl::string_view::npos ? "/" : url.substr(path);
+  }
+  result.request_headers->setPath(url);
+  addHarHeaders(request.value("headers", json::array()),
+                *result.request_headers);
+  if (request.contains("postData")) {
+    result.request_body = stringOr(request["postData"], "text", "");
+  }
+
+  const json &response = entry.value("response", json::object());
+  result.response_headers->setStatus(response.value("status", 200));
+  addHarHeaders(response.value("headers", json::array()),
+                *result.response_headers);
+  if (response.contains("content")) {
+    const json &content = response["content"];
+    result.response_body = stringOr(content, "text", "");
+    if (stringOr(content, "encoding", "") == "base64") {
+      result.response_body = Base64::decode(result.response_body);
+    }
+  }
+  return result;
+}
+
+CorpusEntry jsonLineEntry(const json &line) {
+  CorpusEntry result;
+  result.request_headers = Http::RequestHeaderMapImpl::create();
+  result.response_headers = Http::ResponseHeaderMapImpl::create();
+
+  const json &request = line.value("request", json::object());
+  result.request_headers->setMethod(stringOr(request, "method", "GET"));
+  result.request_headers->setPath(stringOr(request, "path", "/"));
+  addJsonHeaders(request.value("headers", json::object()),
+                 *result.request_headers);
+  result.request_body = stringOr(request, "body", "");
+
+  const json &response = line.value("response", json::object());
+  result.response_headers->setStatus(response.value("status", 200));
+  addJsonHeaders(response.value("headers", json::object()),
+                 *result.response_headers);
+  result.response_body = stringOr(response, "body", "");
+  return result;
+}
+
+} // namespace
+
+std::vector<CorpusEntry> parseCorpus(absl::string_view contents) {
+  std::vector<CorpusEntry> corpus;
+  try {
+    const absl::string_view trimmed = absl::StripAsciiWhitespace(contents);
+    if (absl::StartsWith(trimmed, "{")) {
+      json document = json::parse(trimmed.begin(), trimmed.end(), nullptr,
+                                  /*allow_exceptions=*/false);
+      if (document.is_object() && document.contains("log")) {
+        for (const auto &entry :
+             document["log"].value("entries", json::array())) {
+          corpus.push_back(harEntry(entry));
+        }
+        return corpus;
+      }
+    }
+
+    size_t line_number = 0;
+    for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+      line_number++;
+      line = absl::StripAsciiWhitespace(line);
+      if (line.empty()) {
+        continue;
+      }
+      json parsed = json::parse(line.begin(), line.end(), nullptr,
+                                /*allow_exceptions=*/false);
+      if (!parsed.is_object()) {
+        throw EnvoyException(
+            fmt::format("corpus line {} is not a JSON object", line_number));
+      }
+      corpus.push_back(jsonLineEntry(parsed));
+    }
+  } catch (const json::exception &e) {
+    throw EnvoyException(fmt::format("malformed corpus: {}", e.what()));
+  }
+  return corpus;
+}
+
+} // namespace TransformationCost
+} // namespace Envoy
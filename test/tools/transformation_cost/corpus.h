@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "envoy/http/header_map.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace TransformationCost {
+
+/**
+ * A request and its response, as replayed through transformations.
+ */
+struct CorpusEntry {
+  Http::RequestHeaderMapPtr request_headers;
+  std::string request_body;
+  Http::ResponseHeaderMapPtr response_headers;
+  std::string response_body;
+};
+
+/**
+ * Parses a corpus of requests and responses. A document whose top level is an
+ * object with a "log" key is read as a HAR archive; anything else is read as
+ * JSON lines of the form
+ *   {"request": {"method": "POST", "path": "/", "headers": {"k": "v"},
+ *                "body": "..."},
+ *    "response": {"status": 200, "headers": {"k": "v"}, "body": "..."}}
+ * where every field is optional. Throws EnvoyException if the corpus is
+ * malformed.
+ */
+std::vector<CorpusEntry> parseCorpus(absl::string_view contents);
+
+} // namespace TransformationCost
+} // namespace Envoy
@@ -0,0 +1,67 @@
+#include "test/tools/transformation_cost/corpus.h"
+#include "test/test_common/utility.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace TransformationCost {
+namespace {
+
+TEST(CorpusTest, ParsesJsonLines) {
+  const auto corpus = parseCorpus(R"EOF(
+{"request": {"method": "POST", "path": "/orders", "headers": {"content-type": "application/json"}, "body": "{\"id\":1}"}, "response": {"status": 201, "body": "ok"}}
+
+{"request": {"path": "/health"}}
+)EOF");
+
+  ASSERT_EQ(2, corpus.size());
+  EXPECT_EQ("POST", corpus[0].request_headers->getMethodValue());
+  EXPECT_EQ("/orders", corpus[0].request_headers->getPathValue());
+  EXPECT_EQ("application/json",
+            corpus[0].request_headers->getContentTypeValue());
+  EXPECT_EQ("{\"id\":1}", corpus[0].request_body);
+  EXPECT_EQ("201", corpus[0].response_headers->getStatusValue());
+  EXPECT_EQ("ok", corpus[0].response_body);
+
+  EXPECT_EQ("GET", corpus[1].request_headers->getMethodValue());
+  EXPECT_EQ("200", corpus[1].response_headers->getStatusValue());
+  EXPECT_EQ("", corpus[1].request_body);
+}
+
+TEST(CorpusTest, ParsesHar) {
+  const auto corpus = parseCorpus(R"EOF(
+{"log": {"entries": [{
+  "request": {
+    "method": "PUT",
+    "url": "https://api.example.com/v1/items?id=2",
+    "headers": [{"name": ":authority", "value": "ignored"},
+                {"name": "X-Request-Id", "value": "abc"}],
+    "postData": {"text": "item"}
+  },
+  "response": {
+    "status": 204,
+    "headers": [{"name": "Content-Type", "value": "text/plain"}],
+    "content": {"text": "aGVsbG8=", "encoding": "base64"}
+  }
+}]}}
+)EOF");
+
+  ASSERT_EQ(1, corpus.size());
+  EXPECT_EQ("PUT", corpus[0].request_headers->getMethodValue());
+  EXPECT_EQ("api.example.com", corpus[0].request_headers->getHostValue());
+  EXPECT_EQ("/v1/items?id=2", corpus[0].request_headers->getPathValue());
+  EXPECT_EQ("abc", corpus[0].request_headers->getRequestIdValue());
+  EXPECT_EQ("item", corpus[0].request_body);
+  EXPECT_EQ("204", corpus[0].response_headers->getStatusValue());
+  EXPECT_EQ("hello", corpus[0].response_body);
+}
+
+TEST(CorpusTest, RejectsMalformedLines) {
+  EXPECT_THROW_WITH_MESSAGE(parseCorpus("{\"request\": {}}\nnot json\n"),
+                            EnvoyException,
+                            "corpus line 2 is not a JSON object");
+}
+
+} // namespace
+} // namespace TransformationCost
+} // namespace Envoy
@@ -0,0 +1,316 @@
+// NOLINT(namespace-envoy)
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/http/header_map_impl.h"
+#include "source/common/matcher/solo_matcher.h"
+#include "source/common/memory/stats.h"
+#include "source/extensions/filters/http/transformation/transformation_factory.h"
+
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/server/mocks.h"
+#include "test/test_common/utility.h"
+#include "test/tools/transformation_cost/corpus.h"
+
+#include "api/envoy/config/filter/http/transformation/v2/transformation_filter.pb.validate.h"
+#include "fmt/format.h"
+
+#if defined(GPERFTOOLS_TCMALLOC)
+#include "gperftools/malloc_hook.h"
+#endif
+
+// Replays a corpus of requests and responses through the transformations of a
+// transformation filter config and reports what each transformation costs per
+// request. The transformations are built and run by the same code as in the
+// filter, so extension transformers such as the API Gateway transformer are
+// measured as well.
+//
+// Usage: transformation_cost_tool <filter config yaml> <corpus> [iterations]
+//
+// The config is the filter's typed_config (a FilterTransformations message) in
+// YAML or JSON. The corpus is a HAR archive or JSON lines; see corpus.h.
+//
+// Like the filter, each corpus entry runs the transformations of the first
+// rule in `transformations` whose `match` matches its request. Configs that
+// use `matcher` instead are not supported. Only the transformers are run, not
+// the transformation or aws_lambda filters, so body buffering, response
+// decompression and Lambda signing aren't part of the cost.
+//
+// Allocations are counted through the gperftools malloc hooks, or through a
+// replaced operator new when tcmalloc is disabled. The default tcmalloc has no
+// hooks, so build with --define tcmalloc=gperftools or tcmalloc=disabled to
+// count them.
+
+namespace Envoy {
+namespace TransformationCost {
+namespace {
+
+// Allocations made on this thread while counting is on. Only the thread that
+// replays the corpus turns it on.
+struct AllocationCounter {
+  bool counting{};
+  uint64_t allocations{};
+  uint64_t bytes{};
+};
+
+thread_local AllocationCounter allocation_counter;
+
+void countAllocation(size_t size) {
+  if (allocation_counter.counting) {
+    allocation_counter.allocations++;
+    allocation_counter.bytes += size;
+  }
+}
+
+#if defined(GPERFTOOLS_TCMALLOC)
+constexpr bool AllocationsCounted = true;
+
+void onNew(const void *, size_t size) { countAllocation(size); }
+
+void installAllocationCounter() { MallocHook::AddNewHook(&onNew); }
+#elif !defined(TCMALLOC)
+// operator new is replaced below.
+constexpr bool AllocationsCounted = true;
+
+void installAllocationCounter() {}
+#else
+constexpr bool AllocationsCounted = false;
+
+void installAllocationCounter() {}
+#endif
+
+using FilterTransformations =
+    envoy::api::v2::filter::http::FilterTransformations;
+using Transformations =
+    envoy::api::v2::filter::http::TransformationRule::Transformations;
+using Extensions::HttpFilters::Transformation::Transformation;
+using Extensions::HttpFilters::Transformation::TransformerConstSharedPtr;
+
+struct Measured {
+  std::string name;
+  // the index of the rule the transformation belongs to.
+  size_t rule{};
+  TransformerConstSharedPtr transformer;
+  bool response{};
+  uint64_t ops{};
+  uint64_t errors{};
+  uint64_t total_ns{};
+  uint64_t total_allocations{};
+  uint64_t total_allocated_bytes{};
+  // heap still held when the transformation returns, i.e. the transformed
+  // body and headers and anything the transformation retains.
+  uint64_t total_retained_bytes{};
+  uint64_t peak_buffer_bytes{};
+};
+
+std::string readFile(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw EnvoyException(fmt::format("unable to read {}", path));
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+void addTransformations(const std::string &prefix, size_t rule,
+                        const Transformations &transformations,
+                        Server::Configuration::CommonFactoryContext &context,
+                        std::vector<Measured> &measured) {
+  if (transformations.has_request_transformation()) {
+    measured.push_back(
+        {prefix + ".request", rule,
+         Transformation::getTransformer(
+             transformations.request_transformation(), context),
+         false});
+  }
+  if (transformations.has_response_transformation()) {
+    measured.push_back(
+        {prefix + ".response", rule,
+         Transformation::getTransformer(
+             transformations.response_transformation(), context),
+         true});
+  }
+}
+
+void replay(Measured &measured, const CorpusEntry &entry) {
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  // transformations mutate their input, so each run gets a copy, which isn't
+  // measured.
+  auto request_headers =
+      Http::createHeaderMap<Http::RequestHeaderMapImpl>(*entry.request_headers);
+  auto response_headers =
+      Http::createHeaderMap<Http::ResponseHeaderMapImpl>(
+          *entry.response_headers);
+  Buffer::OwnedImpl body(measured.response ? entry.response_body
+                                           : entry.request_body);
+  Http::RequestOrResponseHeaderMap &headers =
+      measured.response
+          ? static_cast<Http::RequestOrResponseHeaderMap &>(*response_headers)
+          : *request_headers;
+  const uint64_t input_bytes = body.length();
+
+  const uint64_t heap_before = Memory::Stats::totalCurrentlyAllocated();
+  allocation_counter = {true, 0, 0};
+  const auto start = std::chrono::steady_clock::now();
+  try {
+    measured.transformer->transform(headers, request_headers.get(), body,
+                                    callbacks);
+  } catch (const std::exception &) {
+    measured.errors++;
+  }
+  const auto end = std::chrono::steady_clock::now();
+  allocation_counter.counting = false;
+  const uint64_t heap_after = Memory::Stats::totalCurrentlyAllocated();
+
+  measured.ops++;
+  measured.total_ns +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count();
+  measured.total_allocations += allocation_counter.allocations;
+  measured.total_allocated_bytes += allocation_counter.bytes;
+  measured.total_retained_bytes +=
+      heap_after > heap_before ? heap_after - heap_before : 0;
+  measured.peak_buffer_bytes =
+      std::max({measured.peak_buffer_bytes, input_bytes, body.length()});
+}
+
+int run(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <filter config yaml> <corpus> [iterations]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const uint64_t iterations = argc > 3 ? std::stoull(argv[3]) : 100;
+
+  FilterTransformations config;
+  TestUtility::loadFromYaml(readFile(argv[1]), config);
+  TestUtility::validate(config);
+  if (config.has_matcher()) {
+    throw EnvoyException(
+        "configs with a matcher are not supported, use transformations");
+  }
+  const std::vector<CorpusEntry> corpus = parseCorpus(readFile(argv[2]));
+
+  NiceMock<Server::Configuration::MockServerFactoryContext> context;
+  std::vector<MatcherCopy::MatcherConstPtr> matchers;
+  std::vector<Measured> measured;
+  for (int i = 0; i < config.transformations_size(); i++) {
+    const auto &rule = config.transformations(i);
+    // the filter ignores rules without a match.
+    matchers.push_back(rule.has_match()
+                           ? MatcherCopy::Matcher::create(rule.match(), context)
+                           : nullptr);
+    const std::string prefix = fmt::format("transformations[{}]", i);
+    if (rule.has_match() && rule.has_route_transformations()) {
+      addTransformations(prefix, i, rule.route_transformations(), context,
+                         measured);
+    }
+  }
+
+  // the rule each entry selects, or matchers.size() if it matches none.
+  std::vector<size_t> selected;
+  uint64_t unmatched = 0;
+  for (const auto &entry : corpus) {
+    size_t rule = 0;
+    while (rule < matchers.size() &&
+           (matchers[rule] == nullptr ||
+            !matchers[rule]->matches(*entry.request_headers))) {
+      rule++;
+    }
+    selected.push_back(rule);
+    unmatched += rule == matchers.size();
+  }
+
+  installAllocationCounter();
+  for (auto &transformation : measured) {
+    for (uint64_t i = 0; i < iterations; i++) {
+      for (size_t e = 0; e < corpus.size(); e++) {
+        if (selected[e] == transformation.rule) {
+          replay(transformation, corpus[e]);
+        }
+      }
+    }
+  }
+
+  if (unmatched > 0) {
+    std::cerr << fmt::format("{} of {} corpus entries match no rule",
+                             unmatched, corpus.size())
+              << std::endl;
+  }
+  if (!AllocationsCounted) {
+    std::cerr << "allocations are only counted when built with --define "
+                 "tcmalloc=gperftools or tcmalloc=disabled"
+              << std::endl;
+  }
+  if (Memory::Stats::totalCurrentlyAllocated() == 0) {
+    std::cerr << "retained heap is unavailable without tcmalloc" << std::endl;
+  }
+  std::cout << fmt::format("{:<40} {:>10} {:>12} {:>10} {:>14} {:>14} {:>12} "
+                           "{:>8}\n",
+                           "transformation", "ops", "ns/op", "allocs/op",
+                           "alloc_bytes/op", "retained/op", "peak_buffer",
+                           "errors");
+  for (const auto &transformation : measured) {
+    const uint64_t ops = std::max<uint64_t>(transformation.ops, 1);
+    std::cout << fmt::format(
+        "{:<40} {:>10} {:>12} {:>10} {:>14} {:>14} {:>12} {:>8}\n",
+        transformation.name, transformation.ops, transformation.total_ns / ops,
+        transformation.total_allocations / ops,
+        transformation.total_allocated_bytes / ops,
+        transformation.total_retained_bytes / ops,
+        transformation.peak_buffer_bytes, transformation.errors);
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace
+} // namespace TransformationCost
+} // namespace Envoy
+
+#if !defined(TCMALLOC) && !defined(GPERFTOOLS_TCMALLOC)
+// Without tcmalloc the global operator new can be replaced to count the
+// allocations. The aligned forms are left to the standard library.
+void *operator new(size_t size) {
+  Envoy::TransformationCost::countAllocation(size);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return ::operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  Envoy::TransformationCost::countAllocation(size);
+  return std::malloc(size == 0 ? 1 : size);
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+  return ::operator new(size, tag);
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+#endif
+
+int main(int argc, char **argv) {
+  try {
+    return Envoy::TransformationCost::run(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}